@@ -13,6 +13,7 @@
 #include "crypto/Hex.h"
 #include "main/Application.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 
 #include <chrono>
 
@@ -281,11 +282,13 @@ FutureBucket::startMerge(Application& app)
         << " with snap=" << hexAbbrev(snap->getHash());
 
     BucketManager& bm = app.getBucketManager();
+    Tracer& tracer = app.getTracer();
 
     using task_t = std::packaged_task<std::shared_ptr<Bucket>()>;
     std::shared_ptr<task_t> task = std::make_shared<task_t>(
-        [curr, snap, &bm, shadows, keepDeadEntries]()
+        [curr, snap, &bm, &tracer, shadows, keepDeadEntries]()
         {
+            TraceSpan span(tracer, "merge", "bucket");
             CLOG(TRACE, "Bucket")
             << "Worker merging curr=" << hexAbbrev(curr->getHash())
             << " with snap=" << hexAbbrev(snap->getHash());
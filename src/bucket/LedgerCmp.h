@@ -5,8 +5,11 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "overlay/StellarXDR.h"
+#include "crypto/ShortHash.h"
 #include "ledger/EntryFrame.h"
 
+#include <cstring>
+
 namespace stellar
 {
 using xdr::operator<;
@@ -74,6 +77,64 @@ struct LedgerEntryIdCmp
     }
 };
 
+/**
+ * Hash a LedgerEntry or LedgerKey by identity, consistently with
+ * LedgerEntryIdCmp. Keys are chosen by users, so the bytes identifying the
+ * entry go through shortHash, whose per-process key keeps anyone from
+ * crafting keys that collide in a table.
+ */
+struct LedgerEntryIdHash
+{
+    template <typename T>
+    size_t operator()(T const& x) const
+    {
+        switch (x.type())
+        {
+        case ACCOUNT:
+            return shortHash(x.account().accountID.ed25519());
+
+        case TRUSTLINE:
+        {
+            // account, issuer and asset code
+            unsigned char buf[32 + 32 + 12];
+            size_t n = 0;
+            auto add = [&buf, &n](ByteSlice const& bytes)
+            {
+                std::memcpy(buf + n, bytes.data(), bytes.size());
+                n += bytes.size();
+            };
+            auto const& tl = x.trustLine();
+            add(tl.accountID.ed25519());
+            switch (tl.asset.type())
+            {
+            case ASSET_TYPE_CREDIT_ALPHANUM4:
+                add(tl.asset.alphaNum4().issuer.ed25519());
+                add(tl.asset.alphaNum4().assetCode);
+                break;
+            case ASSET_TYPE_CREDIT_ALPHANUM12:
+                add(tl.asset.alphaNum12().issuer.ed25519());
+                add(tl.asset.alphaNum12().assetCode);
+                break;
+            default:
+                break;
+            }
+            return shortHash(ByteSlice(buf, n));
+        }
+
+        case OFFER:
+        {
+            unsigned char buf[32 + sizeof(uint64_t)];
+            auto const& seller = x.offer().sellerID.ed25519();
+            uint64_t offerID = x.offer().offerID;
+            std::memcpy(buf, seller.data(), seller.size());
+            std::memcpy(buf + seller.size(), &offerID, sizeof(offerID));
+            return shortHash(ByteSlice(buf, sizeof(buf)));
+        }
+        }
+        return 0;
+    }
+};
+
 /**
  * Compare two BucketEntries for identity by comparing their respective
  * LedgerEntries (ignoring their hashes, as the LedgerEntryIdCmp ignores their
@@ -9,13 +9,18 @@
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
+#include "crypto/ShortHash.h"
 #include "crypto/Random.h"
 #include "crypto/StrKey.h"
 #include "util/basen.h"
 #include <autocheck/autocheck.hpp>
 #include <sodium.h>
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <regex>
+#include <set>
+#include <thread>
 
 using namespace stellar;
 
@@ -87,6 +92,24 @@ TEST_CASE("SHA256 tests", "[crypto]")
     }
 }
 
+TEST_CASE("short hash", "[crypto]")
+{
+    auto bytes = randomBytes(32);
+    auto other = bytes;
+    other[31] ^= 1;
+    REQUIRE(shortHash(bytes) == shortHash(bytes));
+    REQUIRE(shortHash(bytes) != shortHash(other));
+
+    // inputs differing only in their last byte still spread over a table
+    std::set<uint64_t> buckets;
+    for (int i = 0; i < 256; i++)
+    {
+        other[31] = static_cast<uint8_t>(i);
+        buckets.insert(shortHash(other) & 1023);
+    }
+    REQUIRE(buckets.size() > 200);
+}
+
 TEST_CASE("Stateful SHA256 tests", "[crypto]")
 {
     // Do some fixed test vectors.
@@ -325,6 +348,115 @@ TEST_CASE("sign and verify benchmarking", "[crypto-bench][bench][hide]")
     }
 }
 
+TEST_CASE("verify sig cache", "[crypto]")
+{
+    auto sk = SecretKey::random();
+    auto pk = sk.getPublicKey();
+    std::string msg = "hello";
+    auto sig = sk.sign(msg);
+    auto badSig = sig;
+    badSig[4] ^= 1;
+
+    uint64_t hits0, misses0, hits, misses;
+    PubKeyUtils::getVerifySigCacheCounts(hits0, misses0);
+
+    CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+    CHECK(!PubKeyUtils::verifySig(pk, badSig, msg));
+    PubKeyUtils::getVerifySigCacheCounts(hits, misses);
+    CHECK(hits == hits0);
+    CHECK(misses == misses0 + 2);
+
+    // both answers come from the cache the second time
+    CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+    CHECK(!PubKeyUtils::verifySig(pk, badSig, msg));
+    PubKeyUtils::getVerifySigCacheCounts(hits, misses);
+    CHECK(hits == hits0 + 2);
+    CHECK(misses == misses0 + 2);
+
+    // a shorter signature followed by a longer message hashes differently
+    auto shortSig = sig;
+    shortSig.pop_back();
+    std::string longMsg = std::string(1, static_cast<char>(sig.back())) + msg;
+    CHECK(!PubKeyUtils::verifySig(pk, shortSig, longMsg));
+
+    PubKeyUtils::setVerifySigCacheSize(0);
+    CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+    CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+    PubKeyUtils::getVerifySigCacheCounts(hits0, misses0);
+    CHECK(hits0 == hits);
+    CHECK(misses0 == misses + 3);
+
+    PubKeyUtils::setVerifySigCacheSize(4096);
+}
+
+static void
+verifyOnThreads(size_t nThreads, size_t nRounds,
+                std::vector<SignVerifyTestcase> const& cases,
+                std::atomic<size_t>& failures)
+{
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < nThreads; ++t)
+    {
+        threads.emplace_back([&cases, &failures, nRounds]()
+                             {
+                                 for (size_t r = 0; r < nRounds; ++r)
+                                 {
+                                     for (auto const& c : cases)
+                                     {
+                                         if (!PubKeyUtils::verifySig(
+                                                 c.pub, c.sig, c.msg))
+                                         {
+                                             failures++;
+                                         }
+                                     }
+                                 }
+                             });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+TEST_CASE("verify sig cache on many threads", "[crypto]")
+{
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+    std::atomic<size_t> failures{0};
+    verifyOnThreads(4, 10, cases, failures);
+    REQUIRE(failures == 0);
+}
+
+TEST_CASE("verify sig cache contention", "[crypto-bench][bench][hide]")
+{
+    size_t const nCases = 1000;
+    size_t const nRounds = 100;
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < nCases; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+
+    for (size_t nThreads : {1, 2, 4, 8})
+    {
+        std::atomic<size_t> failures{0};
+        auto start = std::chrono::steady_clock::now();
+        verifyOnThreads(nThreads, nRounds, cases, failures);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        REQUIRE(failures == 0);
+
+        LOG(INFO) << nThreads << " threads, " << nThreads * nRounds * nCases
+                  << " mostly cached verifications in " << elapsed.count()
+                  << "s";
+    }
+}
+
 TEST_CASE("StrKey tests", "[crypto]")
 {
     std::regex b32("^([A-Z2-7])+$");
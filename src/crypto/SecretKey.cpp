@@ -12,7 +12,8 @@
 #include <util/make_unique.h>
 #include <mutex>
 
-#include "util/lrucache.hpp"
+#include "util/HashOfHash.h"
+#include "util/SegmentedCache.h"
 
 namespace stellar
 {
@@ -23,24 +24,53 @@ namespace stellar
 // to the state of the process; caching its results centrally
 // makes all signature-verification in the program faster and
 // has no effect on correctness.
+//
+// Entries are keyed by a hash of what is verified and spread over shards
+// with a lock each, so that threads verifying at once rarely wait on each
+// other.
 
-static std::mutex gVerifySigCacheMutex;
-static cache::lru_cache<std::string, bool> gVerifySigCache(4096);
+static size_t const VERIFY_SIG_CACHE_SHARDS = 16;
+static size_t const DEFAULT_VERIFY_SIG_CACHE_SIZE = 4096;
 
-static bool
-shouldCacheVerifySig(PublicKey const& key, Signature const& signature,
-                     ByteSlice const& bin)
+namespace
+{
+struct alignas(64) VerifySigCacheShard
 {
-    return (bin.size() < 0xffff);
+    SegmentedCache<uint256, bool, UnitCacheWeight, std::mutex> mCache;
+
+    VerifySigCacheShard()
+        : mCache(DEFAULT_VERIFY_SIG_CACHE_SIZE / VERIFY_SIG_CACHE_SHARDS)
+    {
+    }
+};
+
+VerifySigCacheShard*
+verifySigCacheShards()
+{
+    static VerifySigCacheShard shards[VERIFY_SIG_CACHE_SHARDS];
+    return shards;
+}
 }
 
-static std::string
+static uint256
 verifySigCacheKey(PublicKey const& key, Signature const& signature,
                   ByteSlice const& bin)
 {
-    return (binToHex(key.ed25519())
-            + ":" + binToHex(signature)
-            + ":" + binToHex(bin));
+    // the signature length keeps (signature, message) pairs that concatenate
+    // to the same bytes apart
+    uint32_t sigLen = static_cast<uint32_t>(signature.size());
+    uint256 res;
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, nullptr, 0, res.size());
+    crypto_generichash_update(&state, key.ed25519().data(),
+                              key.ed25519().size());
+    crypto_generichash_update(&state,
+                              reinterpret_cast<unsigned char const*>(&sigLen),
+                              sizeof(sigLen));
+    crypto_generichash_update(&state, signature.data(), signature.size());
+    crypto_generichash_update(&state, bin.data(), bin.size());
+    crypto_generichash_final(&state, res.data(), res.size());
+    return res;
 }
 
 
@@ -228,27 +258,46 @@ bool
 PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
                        ByteSlice const& bin)
 {
-    bool shouldCache = shouldCacheVerifySig(key, signature, bin);
-    std::string cacheKey;
+    auto cacheKey = verifySigCacheKey(key, signature, bin);
+    auto& shard = verifySigCacheShards()[cacheKey[31] %
+                                         VERIFY_SIG_CACHE_SHARDS];
+    bool ok;
+    if (shard.mCache.maybeGet(cacheKey, ok))
+    {
+        return ok;
+    }
 
-    if (shouldCache)
+    ok = (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
+                                      key.ed25519().data()) == 0);
+    shard.mCache.put(cacheKey, ok);
+    return ok;
+}
+
+void
+PubKeyUtils::setVerifySigCacheSize(size_t size)
+{
+    // rounded up so that every shard holds at least one entry
+    size_t perShard =
+        (size + VERIFY_SIG_CACHE_SHARDS - 1) / VERIFY_SIG_CACHE_SHARDS;
+    auto shards = verifySigCacheShards();
+    for (size_t i = 0; i < VERIFY_SIG_CACHE_SHARDS; ++i)
     {
-        cacheKey = verifySigCacheKey(key, signature, bin);
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
-        {
-            return gVerifySigCache.get(cacheKey);
-        }
+        shards[i].mCache.clear();
+        shards[i].mCache.setCapacity(perShard);
     }
+}
 
-    bool ok = (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
-                                           key.ed25519().data()) == 0);
-    if (shouldCache)
+void
+PubKeyUtils::getVerifySigCacheCounts(uint64_t& hits, uint64_t& misses)
+{
+    hits = 0;
+    misses = 0;
+    auto shards = verifySigCacheShards();
+    for (size_t i = 0; i < VERIFY_SIG_CACHE_SHARDS; ++i)
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        gVerifySigCache.put(cacheKey, ok);
+        hits += shards[i].mCache.hits();
+        misses += shards[i].mCache.misses();
     }
-    return ok;
 }
 
 std::string
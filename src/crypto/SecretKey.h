@@ -78,6 +78,14 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// Resizes the process-wide cache of verifySig results, emptying it; 0 turns
+// the cache off.
+void setVerifySigCacheSize(size_t size);
+
+// Lookups the verifySig cache answered, and those it could not, since the
+// process started.
+void getVerifySigCacheCounts(uint64_t& hits, uint64_t& misses);
+
 std::string toShortString(PublicKey const& pk);
 
 std::string toStrKey(PublicKey const& pk);
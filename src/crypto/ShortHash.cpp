@@ -0,0 +1,39 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ShortHash.h"
+#include <sodium.h>
+#include <cstring>
+#include <stdexcept>
+
+namespace stellar
+{
+
+namespace
+{
+struct ShortHashKey
+{
+    unsigned char mKey[crypto_shorthash_KEYBYTES];
+
+    ShortHashKey()
+    {
+        randombytes_buf(mKey, sizeof(mKey));
+    }
+};
+}
+
+uint64_t
+shortHash(ByteSlice const& bin)
+{
+    static ShortHashKey const key;
+    unsigned char out[crypto_shorthash_BYTES];
+    if (crypto_shorthash(out, bin.data(), bin.size(), key.mKey) != 0)
+    {
+        throw std::runtime_error("error from crypto_shorthash");
+    }
+    uint64_t res;
+    std::memcpy(&res, out, sizeof(res));
+    return res;
+}
+}
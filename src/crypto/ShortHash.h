@@ -0,0 +1,17 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "crypto/ByteSlice.h"
+#include <cstdint>
+
+namespace stellar
+{
+
+// SipHash-2-4 under a random key drawn once per process, for in-memory hash
+// tables whose keys come from others: without the key, nobody can pick keys
+// that land in the same buckets.
+uint64_t shortHash(ByteSlice const& bin);
+}
@@ -4,9 +4,11 @@
 
 #include "bucket/BucketManager.h"
 #include "crypto/Hex.h"
+#include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "overlay/StellarXDR.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerState.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "main/PersistentState.h"
@@ -16,12 +18,17 @@
 #include "util/make_unique.h"
 #include "util/types.h"
 #include "util/GlobalChecks.h"
+#include "xdrpp/marshal.h"
 
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "medida/counter.h"
 
+#include <sodium.h>
+#include <array>
+#include <atomic>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
 #include <thread>
@@ -43,6 +50,20 @@ using namespace std;
 
 bool Database::gDriversRegistered = false;
 
+// smallest schema version supported
+static unsigned long const MIN_SCHEMA_VERSION = 1;
+
+// bytes of keys and entries the LedgerEntry cache holds
+static size_t const ENTRY_CACHE_BYTES = 1 << 20;
+
+size_t
+LedgerEntryCacheWeight::
+operator()(std::string const& key,
+           std::shared_ptr<LedgerEntry const> const& entry) const
+{
+    return key.size() + (entry ? xdr::xdr_size(*entry) : 0);
+}
+
 static void
 setSerializable(soci::session& sess)
 {
@@ -63,12 +84,19 @@ Database::registerDrivers()
     }
 }
 
+static std::atomic<uint64_t> gNextDatabaseID{1};
+
 Database::Database(Application& app)
     : mApp(app)
+    , mID(gNextDatabaseID++)
     , mStatementsSize(
           app.getMetrics().NewCounter({"database", "memory", "statements"}))
-    , mEntryCache(4096)
+    , mEntryCache(ENTRY_CACHE_BYTES)
+    , mEntryFilter(app.getMetrics())
+    , mLedgerState(nullptr)
 {
+    mEntryCache.trackMetrics(app.getShardedMetrics(), "database",
+                             "entry-cache");
     registerDrivers();
     CLOG(INFO, "Database") << "Connecting to: " << app.getConfig().DATABASE;
     mSession.open(app.getConfig().DATABASE);
@@ -80,38 +108,208 @@ Database::Database(Application& app)
     {
         setSerializable(mSession);
     }
+    mStatementCache = make_unique<StatementCache>(*this, mSession);
 }
 
-medida::TimerContext
+void
+Database::applySchemaUpgrade(unsigned long vers)
+{
+    switch (vers)
+    {
+    case 2:
+        TransactionFrame::convertTxHistoryToBinary(*this);
+        break;
+    case 3:
+        // inflationvotes is built by step 5, as it reads the converted keys
+        break;
+    case 4:
+        AccountFrame::convertSignersToBinary(*this);
+        break;
+    case 5:
+        convertKeysToBinary();
+        break;
+    default:
+        throw std::runtime_error("Unknown DB schema version");
+    }
+}
+
+// StrKey columns are converted in SQL, through a table mapping every StrKey
+// in use to its raw bytes
+void
+Database::convertKeysToBinary()
+{
+    auto& sess = mSession;
+    sess << "DROP TABLE IF EXISTS strkeys";
+    sess << "CREATE TABLE strkeys"
+            "("
+            "strkey          VARCHAR(56)  PRIMARY KEY,"
+            "rawkey          " +
+                getBinaryColumnType() + " NOT NULL"
+                                        ");";
+
+    std::vector<std::string> strKeys;
+    {
+        std::string strKey;
+        soci::indicator strKeyInd;
+        soci::statement sel =
+            (sess.prepare << "SELECT accountid FROM accounts UNION "
+                             "SELECT inflationdest FROM accounts UNION "
+                             "SELECT accountid FROM trustlines UNION "
+                             "SELECT issuer FROM trustlines UNION "
+                             "SELECT sellerid FROM offers UNION "
+                             "SELECT sellingissuer FROM offers UNION "
+                             "SELECT buyingissuer FROM offers",
+             into(strKey, strKeyInd));
+        sel.execute(true);
+        while (sel.got_data())
+        {
+            // NULL and empty issuers are left out
+            if (strKeyInd == soci::i_ok && !strKey.empty())
+            {
+                strKeys.push_back(strKey);
+            }
+            sel.fetch();
+        }
+    }
+
+    BinaryColumn rawKey(*this, sess);
+    std::string strKey;
+    soci::statement ins(sess);
+    ins.exchange(use(strKey));
+    rawKey.bindUse(ins);
+    ins.alloc();
+    ins.prepare("INSERT INTO strkeys (strkey, rawkey) VALUES (:s, :r)");
+    ins.define_and_bind();
+    for (auto const& k : strKeys)
+    {
+        strKey = k;
+        rawKey.set(PubKeyUtils::fromStrKey(k));
+        ins.execute(true);
+    }
+
+    AccountFrame::convertKeysToBinary(*this);
+    TrustFrame::convertKeysToBinary(*this);
+    OfferFrame::convertKeysToBinary(*this);
+    sess << "DROP TABLE strkeys";
+
+    AccountFrame::rebuildInflationVotes(*this);
+    CLOG(INFO, "Database") << "Converted " << strKeys.size()
+                           << " account IDs to binary";
+}
+
+void
+Database::upgradeToCurrentSchema()
+{
+    auto vers = getDBSchemaVersion();
+    if (vers < MIN_SCHEMA_VERSION)
+    {
+        std::string s = ("DB schema version " + std::to_string(vers) +
+                         " is older than minimum supported schema " +
+                         std::to_string(MIN_SCHEMA_VERSION));
+        throw std::runtime_error(s);
+    }
+
+    if (vers > SCHEMA_VERSION)
+    {
+        std::string s = ("DB schema version " + std::to_string(vers) +
+                         " is newer than application schema " +
+                         std::to_string(SCHEMA_VERSION));
+        throw std::runtime_error(s);
+    }
+    while (vers < SCHEMA_VERSION)
+    {
+        // upgrades rewrite the tables behind the filter's back
+        mEntryFilter.disable();
+        ++vers;
+        CLOG(INFO, "Database") << "Applying DB schema upgrade to version "
+                               << vers;
+        soci::transaction tx(mSession);
+        applySchemaUpgrade(vers);
+        putSchemaVersion(vers);
+        tx.commit();
+    }
+    assert(vers == SCHEMA_VERSION);
+}
+
+void
+Database::putSchemaVersion(unsigned long vers)
+{
+    mApp.getPersistentState().setState(PersistentState::kDatabaseSchema,
+                                       std::to_string(vers));
+}
+
+unsigned long
+Database::getDBSchemaVersion()
+{
+    auto vstr =
+        mApp.getPersistentState().getState(PersistentState::kDatabaseSchema);
+    if (vstr.empty())
+    {
+        return MIN_SCHEMA_VERSION;
+    }
+    try
+    {
+        return std::stoul(vstr);
+    }
+    catch (std::logic_error&)
+    {
+        throw std::runtime_error("invalid database schema version: " + vstr);
+    }
+}
+
+ShardedTimer&
+Database::getEntityTimer(EntityOperation op, std::string const& entityName)
+{
+    static char const* const names[ENTITY_OPERATIONS] = {"insert", "select",
+                                                         "delete", "update"};
+    typedef std::array<std::unordered_map<std::string, ShardedTimer*>,
+                       ENTITY_OPERATIONS> Timers;
+
+    // Entity names are few: each thread keeps the timers it looked up, so
+    // that only its first lookup of each takes the lock of ShardedMetrics. A
+    // thread may use several databases at once, as simulations do; the cache
+    // is dropped if it fills up with those of past applications.
+    static thread_local std::unordered_map<uint64_t, Timers> cache;
+    auto it = cache.find(mID);
+    if (it == cache.end())
+    {
+        if (cache.size() >= 16)
+        {
+            cache.clear();
+        }
+        it = cache.emplace(mID, Timers()).first;
+    }
+    auto& timer = it->second[op][entityName];
+    if (!timer)
+    {
+        timer = &mApp.getShardedMetrics().NewTimer(
+            {"database", names[op], entityName});
+    }
+    return *timer;
+}
+
+ShardedTimer::Context
 Database::getInsertTimer(std::string const& entityName)
 {
-    return mApp.getMetrics()
-        .NewTimer({"database", "insert", entityName})
-        .TimeScope();
+    return getEntityTimer(ENTITY_INSERT, entityName).TimeScope();
 }
 
-medida::TimerContext
+ShardedTimer::Context
 Database::getSelectTimer(std::string const& entityName)
 {
-    return mApp.getMetrics()
-        .NewTimer({"database", "select", entityName})
-        .TimeScope();
+    return getEntityTimer(ENTITY_SELECT, entityName).TimeScope();
 }
 
-medida::TimerContext
+ShardedTimer::Context
 Database::getDeleteTimer(std::string const& entityName)
 {
-    return mApp.getMetrics()
-        .NewTimer({"database", "delete", entityName})
-        .TimeScope();
+    return getEntityTimer(ENTITY_DELETE, entityName).TimeScope();
 }
 
-medida::TimerContext
+ShardedTimer::Context
 Database::getUpdateTimer(std::string const& entityName)
 {
-    return mApp.getMetrics()
-        .NewTimer({"database", "update", entityName})
-        .TimeScope();
+    return getEntityTimer(ENTITY_UPDATE, entityName).TimeScope();
 }
 
 bool
@@ -120,6 +318,12 @@ Database::isSqlite() const
     return mApp.getConfig().DATABASE.find("sqlite3:") != std::string::npos;
 }
 
+std::string
+Database::getBinaryColumnType() const
+{
+    return isSqlite() ? "BLOB" : "BYTEA";
+}
+
 bool
 Database::canUsePool() const
 {
@@ -137,11 +341,20 @@ Database::initialize()
     LedgerHeaderFrame::dropAll(*this);
     TransactionFrame::dropAll(*this);
     BucketManager::dropAll(mApp);
+    putSchemaVersion(SCHEMA_VERSION);
+    mEntryFilter.reset();
 }
 
 soci::session&
 Database::getSession()
 {
+    // an isolated LedgerState may be current on a worker thread, see
+    // ParallelTxApply
+    if (LedgerState::getThreadState())
+    {
+        throw LedgerState::FootprintError(
+            "database accessed from an isolated LedgerState");
+    }
     // global session can only be used from the main thread
     assertThreadIsMain();
     return mSession;
@@ -177,12 +390,34 @@ Database::getPool()
     return *mPool;
 }
 
-cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>&
+LedgerEntryCache&
 Database::getEntryCache()
 {
     return mEntryCache;
 }
 
+LedgerEntryFilter&
+Database::getEntryFilter()
+{
+    return mEntryFilter;
+}
+
+LedgerState*
+Database::getLedgerState()
+{
+    if (auto state = LedgerState::getThreadState())
+    {
+        return state;
+    }
+    return mLedgerState;
+}
+
+void
+Database::setLedgerState(LedgerState* state)
+{
+    mLedgerState = state;
+}
+
 
 class SQLLogContext : NonCopyable
 {
@@ -220,6 +455,90 @@ class SQLLogContext : NonCopyable
     }
 };
 
+// name and SQL of the registered statements, in StatementId order
+static std::vector<std::pair<std::string, std::string>>&
+registeredStatements()
+{
+    static std::vector<std::pair<std::string, std::string>> statements;
+    return statements;
+}
+
+StatementId
+StatementId::registerStatement(std::string const& name, std::string const& sql)
+{
+    auto& statements = registeredStatements();
+    statements.emplace_back(name, sql);
+    return StatementId(statements.size() - 1);
+}
+
+StatementContext::StatementContext(std::shared_ptr<soci::statement> stmt,
+                                   ShardedTimer* timer)
+    : mStmt(stmt), mTimer(timer)
+{
+    mStmt->clean_up(false);
+    if (mTimer)
+    {
+        mStart = std::chrono::steady_clock::now();
+    }
+}
+
+StatementContext::~StatementContext()
+{
+    if (mStmt)
+    {
+        mStmt->clean_up(false);
+    }
+    if (mTimer)
+    {
+        mTimer->Update(std::chrono::steady_clock::now() - mStart);
+    }
+}
+
+StatementCache::StatementCache(Database& db, soci::session& sess)
+    : mSession(sess)
+{
+    auto const& statements = registeredStatements();
+    mStatements.resize(statements.size());
+    mTimers.reserve(statements.size());
+    for (auto const& s : statements)
+    {
+        mTimers.push_back(&db.getStatementTimer(s.first));
+    }
+}
+
+StatementContext
+StatementCache::get(StatementId id)
+{
+    auto& p = mStatements.at(id.mIndex);
+    if (!p)
+    {
+        // tables may not exist before the database is initialized, so
+        // statements can only be prepared once they are needed
+        p = std::make_shared<soci::statement>(mSession);
+        p->alloc();
+        p->prepare(registeredStatements()[id.mIndex].second);
+    }
+    return StatementContext(p, mTimers[id.mIndex]);
+}
+
+StatementContext
+Database::getPreparedStatement(StatementId id)
+{
+    return mStatementCache->get(id);
+}
+
+StatementCache&
+Database::getStatementCache()
+{
+    return *mStatementCache;
+}
+
+ShardedTimer&
+Database::getStatementTimer(std::string const& name)
+{
+    return mApp.getShardedMetrics().NewTimer({"database", "statement", name});
+}
+
 StatementContext
 Database::getPreparedStatement(std::string const& query)
 {
@@ -241,6 +560,136 @@ Database::getPreparedStatement(std::string const& query)
     return sc;
 }
 
+BinaryColumn::BinaryColumn(Database& db, soci::session& sess)
+    : mInd(soci::i_ok)
+{
+    if (db.isSqlite())
+    {
+        mBlob = make_unique<soci::blob>(sess);
+    }
+}
+
+void
+BinaryColumn::set(ByteSlice const& bytes)
+{
+    mInd = soci::i_ok;
+    if (mBlob)
+    {
+        mBlob->trim(0);
+        if (!bytes.empty())
+        {
+            mBlob->write(0, reinterpret_cast<char const*>(bytes.data()),
+                         bytes.size());
+        }
+    }
+    else
+    {
+        mHex.assign("\\x");
+        mHex.resize(2 + bytes.size() * 2 + 1);
+        sodium_bin2hex(&mHex[2], mHex.size() - 2, bytes.data(), bytes.size());
+        // drop the NUL written by sodium_bin2hex
+        mHex.resize(mHex.size() - 1);
+    }
+}
+
+void
+BinaryColumn::setNull()
+{
+    mInd = soci::i_null;
+}
+
+void
+BinaryColumn::set(PublicKey const& key)
+{
+    set(ByteSlice(key.ed25519()));
+}
+
+void
+BinaryColumn::getFixed(uint8_t* out, size_t size)
+{
+    if (mBlob)
+    {
+        if (mBlob->get_len() != size)
+        {
+            throw std::runtime_error("unexpected binary value size");
+        }
+        mBlob->read(0, reinterpret_cast<char*>(out), size);
+    }
+    else
+    {
+        size_t len = 0;
+        if (mHex.size() != 2 + size * 2 || mHex[0] != '\\' ||
+            mHex[1] != 'x' ||
+            sodium_hex2bin(out, size, mHex.data() + 2, mHex.size() - 2,
+                           nullptr, &len, nullptr) != 0 ||
+            len != size)
+        {
+            throw std::runtime_error("could not decode BYTEA value");
+        }
+    }
+}
+
+void
+BinaryColumn::get(PublicKey& key)
+{
+    key.type(PUBLIC_KEY_TYPE_ED25519);
+    getFixed(key.ed25519().data(), key.ed25519().size());
+}
+
+void
+BinaryColumn::get(std::vector<uint8_t>& out)
+{
+    if (mBlob)
+    {
+        out.resize(mBlob->get_len());
+        if (!out.empty())
+        {
+            mBlob->read(0, reinterpret_cast<char*>(out.data()), out.size());
+        }
+    }
+    else
+    {
+        if (mHex.size() < 2 || mHex[0] != '\\' || mHex[1] != 'x')
+        {
+            throw std::runtime_error("unexpected BYTEA format");
+        }
+        out.resize((mHex.size() - 2) / 2);
+        size_t len = 0;
+        if (sodium_hex2bin(out.data(), out.size(), mHex.data() + 2,
+                           mHex.size() - 2, nullptr, &len, nullptr) != 0 ||
+            len != out.size())
+        {
+            throw std::runtime_error("could not decode BYTEA value");
+        }
+    }
+}
+
+void
+BinaryColumn::bindUse(soci::statement& st, std::string const& name)
+{
+    if (mBlob)
+    {
+        st.exchange(soci::use(*mBlob, mInd, name));
+    }
+    else
+    {
+        st.exchange(soci::use(mHex, mInd, name));
+    }
+}
+
+void
+BinaryColumn::bindInto(soci::statement& st)
+{
+    if (mBlob)
+    {
+        st.exchange(soci::into(*mBlob, mInd));
+    }
+    else
+    {
+        st.exchange(soci::into(mHex, mInd));
+    }
+}
+
 std::shared_ptr<SQLLogContext>
 Database::captureAndLogSQL(std::string contextName)
 {
@@ -4,15 +4,20 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <chrono>
 #include <string>
+#include <vector>
 #include <soci.h>
 #include "overlay/StellarXDR.h"
 #include "ledger/AccountFrame.h"
+#include "ledger/LedgerEntryFilter.h"
 #include "ledger/OfferFrame.h"
 #include "ledger/TrustFrame.h"
 #include "medida/timer_context.h"
 #include "util/NonCopyable.h"
-#include "util/lrucache.hpp"
+#include "util/SegmentedCache.h"
+#include "util/ShardedMetrics.h"
+#include "crypto/ByteSlice.h"
 
 namespace medida
 {
@@ -24,8 +29,27 @@ class Counter;
 namespace stellar
 {
 class Application;
+class Database;
+class LedgerState;
 class SQLLogContext;
 
+// Current version of the SQL schema. Bump this and add a step to
+// Database::applySchemaUpgrade whenever the layout of an existing table
+// changes, so that databases created by older versions get migrated.
+static const unsigned long SCHEMA_VERSION = 5;
+
+// Weighs an entry of the LedgerEntry cache as the bytes of its key and of the
+// XDR of the LedgerEntry.
+struct LedgerEntryCacheWeight
+{
+    size_t operator()(std::string const& key,
+                      std::shared_ptr<LedgerEntry const> const& entry) const;
+};
+
+typedef SegmentedCache<std::string, std::shared_ptr<LedgerEntry const>,
+                       LedgerEntryCacheWeight>
+    LedgerEntryCache;
+
 /**
  * Helper class for borrowing a SOCI prepared statement handle into a local
  * scope and cleaning it up once done with it. Returned by
@@ -34,24 +58,20 @@ class SQLLogContext;
 class StatementContext : NonCopyable
 {
     std::shared_ptr<soci::statement> mStmt;
+    // when set, the time the statement is borrowed for is recorded there
+    ShardedTimer* mTimer;
+    std::chrono::steady_clock::time_point mStart;
 
   public:
-    StatementContext(std::shared_ptr<soci::statement> stmt) : mStmt(stmt)
-    {
-        mStmt->clean_up(false);
-    }
+    StatementContext(std::shared_ptr<soci::statement> stmt,
+                     ShardedTimer* timer = nullptr);
     StatementContext(StatementContext&& other)
+        : mStmt(other.mStmt), mTimer(other.mTimer), mStart(other.mStart)
     {
-        mStmt = other.mStmt;
         other.mStmt.reset();
+        other.mTimer = nullptr;
     }
-    ~StatementContext()
-    {
-        if (mStmt)
-        {
-            mStmt->clean_up(false);
-        }
-    }
+    ~StatementContext();
     soci::statement&
     statement()
     {
@@ -59,6 +79,100 @@ class StatementContext : NonCopyable
     }
 };
 
+/**
+ * Identifies one of the statements run on the ledger hot paths. Each is
+ * registered once, at startup, by the file using it:
+ *
+ *   static StatementId const kLoadThing =
+ *       StatementId::registerStatement("thing-load", "SELECT ...");
+ *
+ * and borrowed with Database::getPreparedStatement or StatementCache::get,
+ * which prepare it the first time a given session runs it. Every registered
+ * statement gets a timer {"database", "statement", <name>}, counting its
+ * executions and how long they took.
+ */
+class StatementId
+{
+    size_t mIndex;
+
+    explicit StatementId(size_t index) : mIndex(index)
+    {
+    }
+    friend class StatementCache;
+
+  public:
+    static StatementId registerStatement(std::string const& name,
+                                         std::string const& sql);
+};
+
+/**
+ * The registered statements prepared on one session. Database holds the one
+ * of its main session; code reading through a pool session keeps its own for
+ * as long as it uses that session.
+ */
+class StatementCache : NonMovableOrCopyable
+{
+    soci::session& mSession;
+    std::vector<std::shared_ptr<soci::statement>> mStatements;
+    std::vector<ShardedTimer*> mTimers;
+
+  public:
+    StatementCache(Database& db, soci::session& sess);
+
+    StatementContext get(StatementId id);
+
+    soci::session&
+    getSession()
+    {
+        return mSession;
+    }
+};
+
+/**
+ * Helper for exchanging raw bytes with a column declared with
+ * Database::getBinaryColumnType(), without going through base64 text. On
+ * SQLite the bytes are bound and fetched as a BLOB. SOCI only speaks the text
+ * protocol to PostgreSQL, so there the value travels in BYTEA's "\x" hex
+ * format, which is still much cheaper to produce and parse than base64.
+ *
+ * The helper must outlive the statement it is bound to; it can be reused
+ * across executions and fetches of that statement.
+ */
+class BinaryColumn : NonMovableOrCopyable
+{
+    std::unique_ptr<soci::blob> mBlob;
+    std::string mHex;
+    soci::indicator mInd;
+
+    void getFixed(uint8_t* out, size_t size);
+
+  public:
+    BinaryColumn(Database& db, soci::session& sess);
+
+    // Set the value to bind on the next execution of the statement.
+    void set(ByteSlice const& bytes);
+    void setNull();
+
+    // Copy the value fetched for the current row into out, reusing its
+    // storage.
+    void get(std::vector<uint8_t>& out);
+
+    // Whether the value fetched for the current row is NULL.
+    bool
+    isNull() const
+    {
+        return mInd == soci::i_null;
+    }
+
+    // Public keys are stored as their 32 raw bytes.
+    void set(PublicKey const& key);
+    void get(PublicKey& key);
+
+    // `name` is needed when the other parameters are bound by name.
+    void bindUse(soci::statement& st, std::string const& name = "");
+    void bindInto(soci::statement& st);
+};
+
 /**
  * Object that owns the database connection(s) that an application
  * uses to store the current ledger and other persistent state in.
@@ -86,16 +200,36 @@ class StatementContext : NonCopyable
 class Database : NonMovableOrCopyable
 {
     Application& mApp;
+    // tells apart databases of successive applications in the per-thread
+    // cache of getEntityTimer
+    uint64_t const mID;
     soci::session mSession;
     std::unique_ptr<soci::connection_pool> mPool;
 
     std::map<std::string, std::shared_ptr<soci::statement>> mStatements;
     medida::Counter& mStatementsSize;
+    std::unique_ptr<StatementCache> mStatementCache;
 
-    cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>> mEntryCache;
+    LedgerEntryCache mEntryCache;
+    LedgerEntryFilter mEntryFilter;
+    LedgerState* mLedgerState;
+
+    // the families of timers of getInsertTimer and the like
+    enum EntityOperation
+    {
+        ENTITY_INSERT,
+        ENTITY_SELECT,
+        ENTITY_DELETE,
+        ENTITY_UPDATE,
+        ENTITY_OPERATIONS
+    };
+    ShardedTimer& getEntityTimer(EntityOperation op,
+                                 std::string const& entityName);
 
     static bool gDriversRegistered;
     static void registerDrivers();
+    void applySchemaUpgrade(unsigned long vers);
+    void convertKeysToBinary();
 
   public:
     // Instantiate object and connect to app.getConfig().DATABASE;
@@ -113,13 +247,24 @@ class Database : NonMovableOrCopyable
     // when the statement context is destroyed.
     StatementContext getPreparedStatement(std::string const& query);
 
+    // Same as above for a registered statement, which is looked up by index
+    // rather than by its text; see StatementId.
+    StatementContext getPreparedStatement(StatementId id);
+
+    // The registered statements of the main session.
+    StatementCache& getStatementCache();
+
+    // Return the timer recording the executions of the registered statement
+    // `name`.
+    ShardedTimer& getStatementTimer(std::string const& name);
+
     // Return metric-gathering timers for various families of SQL operation.
     // These timers automatically count the time they are alive for,
     // so only acquire them immediately before executing an SQL statement.
-    medida::TimerContext getInsertTimer(std::string const& entityName);
-    medida::TimerContext getSelectTimer(std::string const& entityName);
-    medida::TimerContext getDeleteTimer(std::string const& entityName);
-    medida::TimerContext getUpdateTimer(std::string const& entityName);
+    ShardedTimer::Context getInsertTimer(std::string const& entityName);
+    ShardedTimer::Context getSelectTimer(std::string const& entityName);
+    ShardedTimer::Context getDeleteTimer(std::string const& entityName);
+    ShardedTimer::Context getUpdateTimer(std::string const& entityName);
 
     // Return true if the Database target is SQLite, otherwise false.
     bool isSqlite() const;
@@ -128,10 +273,24 @@ class Database : NonMovableOrCopyable
     // to read from the database through, otherwise false.
     bool canUsePool() const;
 
+    // Return the SQL type to use for columns holding raw binary data.
+    std::string getBinaryColumnType() const;
+
     // Drop and recreate all tables in the database target. This is called
     // by the --newdb command-line flag on stellar-core.
     void initialize();
 
+    // Save `vers` as schema version.
+    void putSchemaVersion(unsigned long vers);
+
+    // Get current schema version in DB; databases created before the
+    // version was recorded report version 1.
+    unsigned long getDBSchemaVersion();
+
+    // Check schema version and apply any upgrades necessary to bring it to
+    // SCHEMA_VERSION; throws if the DB is newer than this binary.
+    void upgradeToCurrentSchema();
+
     // Access the underlying SOCI session object
     soci::session& getSession();
 
@@ -142,7 +301,16 @@ class Database : NonMovableOrCopyable
     // Access the LedgerEntry cache. Note: clients are responsible for
     // invalidating entries in this cache as they perform statements
     // against the database. It's kept here only for ease of access.
-    cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>&
-        getEntryCache();
+    LedgerEntryCache& getEntryCache();
+
+    // Access the filter over the account and trust line keys stored in the
+    // database; see LedgerEntryFilter. It starts disabled, and is rebuilt
+    // when the last known ledger is loaded.
+    LedgerEntryFilter& getEntryFilter();
+
+    // The LedgerState that ledger entries are currently read from and written
+    // to instead of the database, if any; see LedgerState.
+    LedgerState* getLedgerState();
+    void setLedgerState(LedgerState* state);
 };
 }
@@ -6,12 +6,22 @@
 #include "database/Database.h"
 #include "main/Application.h"
 #include "main/Config.h"
+#include "main/PersistentState.h"
 #include "main/test.h"
 #include "crypto/Hex.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
 #include "lib/catch.hpp"
+#include "util/basen.h"
+#include "util/types.h"
+#include "crypto/SecretKey.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/OfferFrame.h"
+#include "ledger/TrustFrame.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include <algorithm>
 #include <random>
 
 using namespace stellar;
@@ -186,6 +196,325 @@ TEST_CASE("sqlite MVCC test", "[db]")
     checkMVCCIsolation(app);
 }
 
+static void
+binaryColumnTest(Application::pointer app)
+{
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    session << "DROP TABLE IF EXISTS test";
+    session << "CREATE TABLE test (x INTEGER, b " + db.getBinaryColumnType() +
+                   " NOT NULL)";
+
+    std::vector<uint8_t> in = {0, 1, 2, 0, 0xff, 0x5c, 'x', 0}, out;
+    int x = 1;
+    {
+        BinaryColumn b(db, session);
+        b.set(in);
+        soci::statement st(session);
+        st.exchange(soci::use(x));
+        b.bindUse(st);
+        st.alloc();
+        st.prepare("INSERT INTO test (x, b) VALUES (:x, :b)");
+        st.define_and_bind();
+        st.execute(true);
+        REQUIRE(st.get_affected_rows() == 1);
+    }
+    {
+        BinaryColumn b(db, session);
+        soci::statement st(session);
+        b.bindInto(st);
+        st.alloc();
+        st.prepare("SELECT b FROM test");
+        st.define_and_bind();
+        st.execute(true);
+        REQUIRE(st.got_data());
+        b.get(out);
+    }
+    CHECK(in == out);
+}
+
+TEST_CASE("binary column round trip", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    binaryColumnTest(app);
+}
+
+static StatementId const kTestEcho =
+    StatementId::registerStatement("test-echo", "SELECT :v");
+
+static int
+runEcho(StatementContext prep, int v)
+{
+    int res = 0;
+    auto& st = prep.statement();
+    st.exchange(soci::into(res));
+    st.exchange(soci::use(v));
+    st.define_and_bind();
+    st.execute(true);
+    return res;
+}
+
+TEST_CASE("registered statements", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& timer =
+        app->getMetrics().NewTimer({"database", "statement", "test-echo"});
+    timer.Clear();
+
+    for (int i = 0; i < 3; i++)
+    {
+        REQUIRE(runEcho(db.getPreparedStatement(kTestEcho), i) == i);
+    }
+    app->getShardedMetrics().flush();
+    REQUIRE(timer.count() == 3);
+
+    // pool sessions prepare their own copy
+    soci::session sess2(db.getPool());
+    StatementCache poolStatements(db, sess2);
+    REQUIRE(runEcho(poolStatements.get(kTestEcho), 7) == 7);
+    REQUIRE(runEcho(db.getPreparedStatement(kTestEcho), 8) == 8);
+    app->getShardedMetrics().flush();
+    REQUIRE(timer.count() == 5);
+}
+
+// recreates the ledger tables as they were before version 4, with StrKey
+// columns and a separate signers table
+static void
+createStrKeyLayout(soci::session& session)
+{
+    session << "DROP TABLE accounts";
+    session << "CREATE TABLE accounts"
+               "("
+               "accountid       VARCHAR(56)  PRIMARY KEY,"
+               "balance         BIGINT       NOT NULL CHECK (balance >= 0),"
+               "seqnum          BIGINT       NOT NULL,"
+               "numsubentries   INT          NOT NULL CHECK (numsubentries >= 0),"
+               "inflationdest   VARCHAR(56),"
+               "homedomain      VARCHAR(32),"
+               "thresholds      TEXT,"
+               "flags           INT          NOT NULL"
+               ")";
+    session << "CREATE TABLE signers"
+               "("
+               "accountid       VARCHAR(56) NOT NULL,"
+               "publickey       VARCHAR(56) NOT NULL,"
+               "weight          INT         NOT NULL,"
+               "PRIMARY KEY (accountid, publickey)"
+               ")";
+    session << "DROP TABLE trustlines";
+    session << "CREATE TABLE trustlines"
+               "("
+               "accountid     VARCHAR(56)     NOT NULL,"
+               "assettype     INT             NOT NULL,"
+               "issuer        VARCHAR(56)     NOT NULL,"
+               "assetcode     VARCHAR(12)     NOT NULL,"
+               "tlimit        BIGINT          NOT NULL DEFAULT 0,"
+               "balance       BIGINT          NOT NULL DEFAULT 0,"
+               "flags         INT             NOT NULL,"
+               "PRIMARY KEY (accountid, issuer, assetcode)"
+               ")";
+    session << "DROP TABLE offers";
+    session << "CREATE TABLE offers"
+               "("
+               "sellerid        VARCHAR(56)  NOT NULL,"
+               "offerid         BIGINT       NOT NULL,"
+               "sellingassettype    INT,"
+               "sellingassetcode    VARCHAR(12),"
+               "sellingissuer       VARCHAR(56),"
+               "buyingassettype    INT,"
+               "buyingassetcode    VARCHAR(12),"
+               "buyingissuer       VARCHAR(56),"
+               "amount          BIGINT       NOT NULL,"
+               "pricen          INT          NOT NULL,"
+               "priced          INT          NOT NULL,"
+               "price           BIGINT       NOT NULL,"
+               "flags           INT          NOT NULL,"
+               "PRIMARY KEY (offerid)"
+               ")";
+}
+
+TEST_CASE("schema upgrade converts txhistory to binary", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    REQUIRE(db.getDBSchemaVersion() == SCHEMA_VERSION);
+
+    // recreate the version 1 layout, with base64 text columns
+    session << "DROP TABLE txhistory";
+    session << "CREATE TABLE txhistory ("
+               "txid          CHARACTER(64) NOT NULL,"
+               "ledgerseq     INT NOT NULL CHECK (ledgerseq >= 0),"
+               "txindex         INT NOT NULL,"
+               "txbody        TEXT NOT NULL,"
+               "txresult      TEXT NOT NULL,"
+               "txmeta        TEXT NOT NULL,"
+               "PRIMARY KEY (txid, ledgerseq),"
+               "UNIQUE      (ledgerseq, txindex)"
+               ")";
+    std::vector<uint8_t> body = {1, 2, 3, 0, 4}, result = {0, 0, 0, 9},
+                         meta = {7};
+    std::string id(64, 'a'), b64Body, b64Result, b64Meta;
+    b64Body = bn::encode_b64(body);
+    b64Result = bn::encode_b64(result);
+    b64Meta = bn::encode_b64(meta);
+    session << "INSERT INTO txhistory (txid, ledgerseq, txindex, txbody, "
+               "txresult, txmeta) VALUES (:id, 2, 1, :b, :r, :m)",
+        soci::use(id), soci::use(b64Body), soci::use(b64Result),
+        soci::use(b64Meta);
+    createStrKeyLayout(session);
+    db.putSchemaVersion(1);
+
+    db.upgradeToCurrentSchema();
+    REQUIRE(db.getDBSchemaVersion() == SCHEMA_VERSION);
+
+    BinaryColumn b(db, session), r(db, session), m(db, session);
+    soci::statement st(session);
+    b.bindInto(st);
+    r.bindInto(st);
+    m.bindInto(st);
+    st.alloc();
+    st.prepare("SELECT txbody, txresult, txmeta FROM txhistory");
+    st.define_and_bind();
+    st.execute(true);
+    REQUIRE(st.got_data());
+    std::vector<uint8_t> out;
+    b.get(out);
+    CHECK(out == body);
+    r.get(out);
+    CHECK(out == result);
+    m.get(out);
+    CHECK(out == meta);
+}
+
+TEST_CASE("schema upgrade moves signers into accounts", "[db]")
+{
+    using xdr::operator==;
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    createStrKeyLayout(session);
+    auto multi = SecretKey::random().getPublicKey();
+    auto single = SecretKey::random().getPublicKey();
+    std::string multiStr = PubKeyUtils::toStrKey(multi);
+    std::string singleStr = PubKeyUtils::toStrKey(single);
+    for (auto const& id : {multiStr, singleStr})
+    {
+        session << "INSERT INTO accounts (accountid, balance, seqnum, "
+                   "numsubentries, thresholds, flags) "
+                   "VALUES (:id, 100, 1, 2, 'AQAAAA==', 0)",
+            soci::use(id);
+    }
+    std::vector<PublicKey> signerKeys = {SecretKey::random().getPublicKey(),
+                                         SecretKey::random().getPublicKey()};
+    int weight = 1;
+    for (auto const& k : signerKeys)
+    {
+        std::string kStr = PubKeyUtils::toStrKey(k);
+        session << "INSERT INTO signers (accountid, publickey, weight) "
+                   "VALUES (:id, :pk, :w)",
+            soci::use(multiStr), soci::use(kStr), soci::use(weight);
+        ++weight;
+    }
+    db.putSchemaVersion(3);
+
+    db.upgradeToCurrentSchema();
+    REQUIRE(db.getDBSchemaVersion() == SCHEMA_VERSION);
+
+    auto multiFrame = AccountFrame::loadAccount(multi, db);
+    REQUIRE(multiFrame);
+    auto const& signers = multiFrame->getAccount().signers;
+    REQUIRE(signers.size() == 2);
+    for (auto const& s : signers)
+    {
+        auto it = std::find(signerKeys.begin(), signerKeys.end(), s.pubKey);
+        REQUIRE(it != signerKeys.end());
+        auto expected = static_cast<uint32_t>(it - signerKeys.begin()) + 1;
+        REQUIRE(s.weight == expected);
+    }
+
+    auto singleFrame = AccountFrame::loadAccount(single, db);
+    REQUIRE(singleFrame);
+    REQUIRE(singleFrame->getAccount().signers.empty());
+}
+
+TEST_CASE("schema upgrade stores keys as binary", "[db]")
+{
+    using xdr::operator==;
+    Config const& cfg = getTestConfig(0, Config::TESTDB_IN_MEMORY_SQLITE);
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    createStrKeyLayout(session);
+    auto holder = SecretKey::random().getPublicKey();
+    auto issuer = SecretKey::random().getPublicKey();
+    std::string holderStr = PubKeyUtils::toStrKey(holder);
+    std::string issuerStr = PubKeyUtils::toStrKey(issuer);
+    session << "INSERT INTO accounts (accountid, balance, seqnum, "
+               "numsubentries, inflationdest, thresholds, flags) "
+               "VALUES (:id, 2000000000, 1, 2, :d, 'AQAAAA==', 0)",
+        soci::use(holderStr), soci::use(issuerStr);
+    session << "INSERT INTO accounts (accountid, balance, seqnum, "
+               "numsubentries, thresholds, flags) "
+               "VALUES (:id, 100, 1, 0, 'AQAAAA==', 0)",
+        soci::use(issuerStr);
+    session << "INSERT INTO trustlines (accountid, assettype, issuer, "
+               "assetcode, tlimit, balance, flags) "
+               "VALUES (:id, 1, :i, 'USD', 1000, 10, 1)",
+        soci::use(holderStr), soci::use(issuerStr);
+    // the native side of an offer has empty code and issuer
+    session << "INSERT INTO offers (sellerid, offerid, sellingassettype, "
+               "sellingassetcode, sellingissuer, buyingassettype, "
+               "buyingassetcode, buyingissuer, amount, pricen, priced, price, "
+               "flags) "
+               "VALUES (:id, 7, 1, 'USD', :i, 0, '', '', 5, 1, 2, 5000000, 0)",
+        soci::use(holderStr), soci::use(issuerStr);
+    db.putSchemaVersion(4);
+    session << "ALTER TABLE accounts ADD COLUMN signers " +
+                   db.getBinaryColumnType();
+    session << "DROP TABLE signers";
+
+    db.upgradeToCurrentSchema();
+    REQUIRE(db.getDBSchemaVersion() == SCHEMA_VERSION);
+
+    auto holderFrame = AccountFrame::loadAccount(holder, db);
+    REQUIRE(holderFrame);
+    REQUIRE(holderFrame->getAccount().inflationDest);
+    REQUIRE(*holderFrame->getAccount().inflationDest == issuer);
+    REQUIRE(AccountFrame::loadAccount(issuer, db));
+    AccountFrame::checkInflationVotes(db);
+
+    Asset usd;
+    usd.type(ASSET_TYPE_CREDIT_ALPHANUM4);
+    strToAssetCode(usd.alphaNum4().assetCode, "USD");
+    usd.alphaNum4().issuer = issuer;
+    auto line = TrustFrame::loadTrustLine(holder, usd, db);
+    REQUIRE(line);
+    REQUIRE(line->getBalance() == 10);
+
+    auto offer = OfferFrame::loadOffer(holder, 7, db);
+    REQUIRE(offer);
+    REQUIRE(offer->getSelling() == usd);
+    REQUIRE(offer->getBuying().type() == ASSET_TYPE_NATIVE);
+    std::vector<OfferFrame::pointer> offers;
+    OfferFrame::loadBestOffers(5, 0, usd, offer->getBuying(), offers, db);
+    REQUIRE(offers.size() == 1);
+}
+
 #ifdef USE_POSTGRES
 TEST_CASE("postgres smoketest", "[db]")
 {
@@ -227,6 +556,11 @@ TEST_CASE("postgres smoketest", "[db]")
             tx.commit();
         }
 
+        SECTION("bytea storage")
+        {
+            binaryColumnTest(app);
+        }
+
         SECTION("postgres MVCC test")
         {
             app->getDatabase().getSession() << "drop table if exists test";
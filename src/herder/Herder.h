@@ -79,13 +79,24 @@ class Herder
     virtual void recvTxSet(Hash hash, TxSetFrame const& txset) = 0;
     // We are learning about a new transaction.
     virtual TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) = 0;
+    // Same as recvTransaction on each of `txs` in turn, with the source
+    // accounts loaded once and the signatures checked on the worker threads
+    // first. Returns at once; `handler` gets the statuses, in the order of
+    // `txs`, on the main thread once they have all been received.
+    typedef std::function<void(std::vector<TransactionSubmitStatus> const&)>
+        BatchHandler;
+    virtual void
+    recvTransactionBatch(std::vector<TransactionFramePtr> const& txs,
+                         BatchHandler handler) = 0;
     virtual void peerDoesntHave(stellar::MessageType type,
                                 uint256 const& itemID, PeerPtr peer) = 0;
     virtual TxSetFramePtr getTxSet(Hash hash) = 0;
     virtual SCPQuorumSetPtr getQSet(Hash const& qSetHash) = 0;
 
-    // We are learning about a new envelope.
-    virtual void recvSCPEnvelope(SCPEnvelope const& envelope) = 0;
+    // We are learning about a new envelope. Returns false if it was ignored
+    // (outside of the ledgers the herder accepts envelopes for), in which
+    // case it may be accepted if received again later.
+    virtual bool recvSCPEnvelope(SCPEnvelope const& envelope) = 0;
 
     // returns the latest known ledger seq using consensus information
     // and local state
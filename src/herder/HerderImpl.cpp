@@ -7,6 +7,7 @@
 #include "crypto/SHA.h"
 #include "herder/TxSetFrame.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -14,6 +15,7 @@
 #include "scp/Slot.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
+#include "util/Tracing.h"
 #include "util/make_unique.h"
 #include "lib/json/json.h"
 #include "scp/LocalNode.h"
@@ -21,9 +23,13 @@
 #include "medida/meter.h"
 #include "medida/counter.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
+#include <thread>
 
 #define MAX_SLOTS_TO_REMEMBER 4
 
@@ -87,16 +93,22 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
                          {"herder", "state", "current"}))
     , mHerderStateChanges(app.getMetrics().NewTimer(
                          {"herder", "state", "changes"}))
+    , mTriggerLatency(app.getMetrics().NewTimer(
+                         {"herder", "trigger", "latency"}))
+    , mExternalizeLatency(app.getMetrics().NewTimer(
+          {"scp", "timing", "externalized"}))
 {
 }
 
 HerderImpl::HerderImpl(Application& app)
     : mSCP(*this, app.getConfig().VALIDATION_KEY, app.getConfig().QUORUM_SET)
     , mReceivedTransactions(4)
+    , mAlive(std::make_shared<bool>(true))
     , mPendingEnvelopes(app, *this)
     , mLastStateChange(app.getClock().now())
     , mTrackingTimer(app)
     , mLastTrigger(app.getClock().now())
+    , mLastTriggeredSlot(0)
     , mTriggerTimer(app)
     , mRebroadcastTimer(app)
     , mApp(app)
@@ -109,6 +121,7 @@ HerderImpl::HerderImpl(Application& app)
 
 HerderImpl::~HerderImpl()
 {
+    *mAlive = false;
 }
 
 Herder::State
@@ -467,8 +480,18 @@ HerderImpl::updateSCPCounters()
 void
 HerderImpl::valueExternalized(uint64 slotIndex, Value const& value)
 {
+    auto& tracer = mApp.getTracer();
+    tracer.beginLedger(static_cast<uint32_t>(slotIndex));
+    TraceSpan span(tracer, "valueExternalized", "herder");
+
     updateSCPCounters();
     mSCPMetrics.mValueExternalize.Mark();
+    if (slotIndex == mLastTriggeredSlot)
+    {
+        mSCPMetrics.mExternalizeLatency.Update(mApp.getClock().now() -
+                                               mLastTrigger);
+        mLastTriggeredSlot = 0;
+    }
     mSCPTimers.erase(slotIndex); // cancels all timers for this slot
     StellarValue b;
     try
@@ -514,6 +537,7 @@ HerderImpl::valueExternalized(uint64 slotIndex, Value const& value)
     mLedgerManager.externalizeValue(ledgerData);
 
     // perform cleanups
+    TraceSpan cleanupSpan(tracer, "cleanup", "herder");
 
     // remove all these tx from mReceivedTransactions
     for (auto tx : externalizedSet->mTransactions)
@@ -771,23 +795,18 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
     int64_t totFee = tx->getFee();
     SequenceNumber highSeq = 0;
 
-    for (auto& list : mReceivedTransactions)
+    auto it = mAccountTxs.find(tx->getSourceID());
+    if (it != mAccountTxs.end())
     {
-        for (auto oldTX : list)
+        for (auto const& oldTX : it->second.mTxs)
         {
             if (txID == oldTX->getFullHash())
             {
                 return TX_STATUS_DUPLICATE;
             }
-            if (oldTX->getSourceID() == tx->getSourceID())
-            {
-                totFee += oldTX->getFee();
-                if (oldTX->getSeqNum() > highSeq)
-                {
-                    highSeq = oldTX->getSeqNum();
-                }
-            }
         }
+        totFee += it->second.mTotalFees;
+        highSeq = it->second.mTxs.back()->getSeqNum();
     }
 
     if (!tx->checkValid(mApp, highSeq))
@@ -802,16 +821,117 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
     }
 
     mReceivedTransactions[0].push_back(tx);
+    auto& accountTxs = mAccountTxs[tx->getSourceID()];
+    accountTxs.mTxs.push_back(tx);
+    accountTxs.mTotalFees += tx->getFee();
+    mTxsByFee.insert(tx);
 
     return TX_STATUS_PENDING;
 }
 
 void
+HerderImpl::recvTransactionBatch(std::vector<TransactionFramePtr> const& txs,
+                                 BatchHandler handler)
+{
+    auto batch = std::make_shared<TxBatch>();
+    batch->mTxs = txs;
+    batch->mStatuses.reserve(txs.size());
+    batch->mHandler = handler;
+    checkTxBatch(batch);
+}
+
+void
+HerderImpl::checkTxBatch(std::shared_ptr<TxBatch> batch)
+{
+    // transactions checked at once; well below the capacity of the signature
+    // cache, so that the verified signatures are still there when needed
+    size_t const chunkSize = 1024;
+    size_t const threads = std::max(1u, std::thread::hardware_concurrency());
+
+    size_t begin = batch->mStatuses.size();
+    if (begin == batch->mTxs.size())
+    {
+        batch->mHandler(batch->mStatuses);
+        return;
+    }
+    size_t end = std::min(batch->mTxs.size(), begin + chunkSize);
+
+    // each source account is loaded once; hashes are computed here as
+    // they are cached without synchronization
+    std::map<AccountID, AccountFrame::pointer> accounts;
+    auto work = std::make_shared<
+        std::vector<std::pair<TransactionFramePtr, AccountFrame::pointer>>>();
+    for (size_t i = begin; i < end; i++)
+    {
+        auto const& tx = batch->mTxs[i];
+        auto it = accounts.find(tx->getSourceID());
+        if (it == accounts.end())
+        {
+            it = accounts.insert(std::make_pair(
+                                     tx->getSourceID(),
+                                     AccountFrame::loadAccount(
+                                         tx->getSourceID(),
+                                         mApp.getDatabase()))).first;
+        }
+        if (it->second)
+        {
+            tx->getContentsHash();
+            work->push_back(std::make_pair(tx, it->second));
+        }
+    }
+
+    size_t slices = std::min(threads, work->size());
+    if (slices == 0)
+    {
+        recvTxBatchChunk(batch, end);
+        return;
+    }
+
+    // the last slice to finish hands the chunk back to the main thread,
+    // which is not held up meanwhile
+    auto pending = std::make_shared<std::atomic<size_t>>(slices);
+    auto& mainIOService = mApp.getClock().getIOService();
+    auto alive = mAlive;
+    for (size_t s = 0; s < slices; s++)
+    {
+        mApp.getWorkerIOService().post(
+            [this, alive, batch, end, work, s, slices, pending,
+             &mainIOService]()
+            {
+                for (size_t i = s; i < work->size(); i += slices)
+                {
+                    (*work)[i].first->preverifySignatures(*(*work)[i].second);
+                }
+                if (--*pending == 0)
+                {
+                    mainIOService.post([this, alive, batch, end]()
+                                       {
+                                           if (*alive)
+                                           {
+                                               recvTxBatchChunk(batch, end);
+                                           }
+                                       });
+                }
+            });
+    }
+}
+
+void
+HerderImpl::recvTxBatchChunk(std::shared_ptr<TxBatch> batch, size_t end)
+{
+    for (size_t i = batch->mStatuses.size(); i < end; i++)
+    {
+        batch->mStatuses.push_back(recvTransaction(batch->mTxs[i]));
+    }
+    checkTxBatch(batch);
+}
+
+bool
 HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 {
     if (mApp.getConfig().MANUAL_CLOSE)
     {
-        return;
+        return false;
     }
 
     CLOG(DEBUG, "Herder") << "recvSCPEnvelope"
@@ -839,11 +959,12 @@ HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
             CLOG(DEBUG, "Herder") << "Ignoring SCPEnvelope outside of range: "
                                   << envelope.statement.slotIndex << "( "
                                   << minLedgerSeq << "," << maxLedgerSeq << ")";
-            return;
+            return false;
         }
     }
 
     mPendingEnvelopes.recvSCPEnvelope(envelope);
+    return true;
 }
 
 void
@@ -965,21 +1086,147 @@ HerderImpl::ledgerClosed()
 void
 HerderImpl::removeReceivedTx(TransactionFramePtr dropTx)
 {
+    auto accountIt = mAccountTxs.find(dropTx->getSourceID());
+    if (accountIt == mAccountTxs.end())
+    {
+        return;
+    }
+    auto& accountTxs = accountIt->second;
+    auto txIt = std::find_if(accountTxs.mTxs.begin(), accountTxs.mTxs.end(),
+                             [&](TransactionFramePtr const& tx)
+                             {
+                                 return tx->getFullHash() ==
+                                        dropTx->getFullHash();
+                             });
+    if (txIt == accountTxs.mTxs.end())
+    {
+        return;
+    }
+    // dropTx may be another frame for the same envelope
+    TransactionFramePtr tx = *txIt;
+    accountTxs.mTxs.erase(txIt);
+    accountTxs.mTotalFees -= tx->getFee();
+    if (accountTxs.mTxs.empty())
+    {
+        mAccountTxs.erase(accountIt);
+    }
+    mTxsByFee.erase(tx);
+
     for (auto& list : mReceivedTransactions)
     {
-        for (auto iter = list.begin(); iter != list.end();)
+        auto iter = std::find(list.begin(), list.end(), tx);
+        if (iter != list.end())
         {
-            if ((iter.operator->())->get()->getFullHash() ==
-                dropTx->getFullHash())
-            {
-                list.erase(iter);
-                return;
-            }
-            else
+            list.erase(iter);
+            return;
+        }
+    }
+}
+
+bool
+HerderImpl::FeeRatioLess::operator()(TransactionFramePtr const& tx1,
+                                     TransactionFramePtr const& tx2) const
+{
+    // compares fee1 / ops1 with fee2 / ops2, as getFeeRatio does
+    auto ops = [](TransactionFramePtr const& tx)
+    {
+        return std::max<int64_t>(tx->getEnvelope().tx.operations.size(), 1);
+    };
+    int64_t r1 = tx1->getFee() * ops(tx2);
+    int64_t r2 = tx2->getFee() * ops(tx1);
+    if (r1 != r2)
+    {
+        return r1 < r2;
+    }
+    return tx1->getFullHash() < tx2->getFullHash();
+}
+
+void
+HerderImpl::trimInvalidReceivedTxs()
+{
+    auto const& lcl = mLedgerManager.getLastClosedLedgerHeader().header;
+    if (lcl.ledgerSeq == mTxsCheckedHeader.ledgerSeq)
+    {
+        return;
+    }
+
+    // transactions were checked against the state of the ledger before, so
+    // they can only have become invalid if the ledger changed their accounts
+    // (including those of their operations), or their time bounds
+    auto changed = mLedgerManager.getChangedAccounts(lcl.ledgerSeq);
+    bool checkAll = !changed ||
+                    lcl.ledgerSeq != mTxsCheckedHeader.ledgerSeq + 1 ||
+                    lcl.baseFee != mTxsCheckedHeader.baseFee ||
+                    lcl.baseReserve != mTxsCheckedHeader.baseReserve ||
+                    lcl.ledgerVersion != mTxsCheckedHeader.ledgerVersion;
+
+    std::vector<AccountID> toCheck;
+    for (auto const& accountTxs : mAccountTxs)
+    {
+        bool check = checkAll;
+        for (auto it = accountTxs.second.mTxs.begin();
+             !check && it != accountTxs.second.mTxs.end(); ++it)
+        {
+            auto const& txBody = (*it)->getEnvelope().tx;
+            check = txBody.timeBounds || changed->count(txBody.sourceAccount);
+            for (auto const& op : txBody.operations)
             {
-                ++iter;
+                check = check ||
+                        (op.sourceAccount && changed->count(*op.sourceAccount));
             }
         }
+        if (check)
+        {
+            toCheck.push_back(accountTxs.first);
+        }
+    }
+
+    CLOG(DEBUG, "Herder") << "checking the received transactions of "
+                          << toCheck.size() << " of " << mAccountTxs.size()
+                          << " accounts";
+    for (auto const& account : toCheck)
+    {
+        trimInvalidAccountTxs(account);
+    }
+    mTxsCheckedHeader = lcl;
+}
+
+void
+HerderImpl::trimInvalidAccountTxs(AccountID const& account)
+{
+    // a copy, as removeReceivedTx changes it
+    auto txs = mAccountTxs[account].mTxs;
+
+    std::vector<TransactionFramePtr> removed;
+    TransactionFramePtr lastTx;
+    SequenceNumber lastSeq = 0;
+    int64_t totFee = 0;
+    for (auto& tx : txs)
+    {
+        if (!tx->checkValid(mApp, lastSeq))
+        {
+            removed.push_back(tx);
+            continue;
+        }
+        totFee += tx->getFee();
+
+        lastTx = tx;
+        lastSeq = tx->getSeqNum();
+    }
+    if (lastTx)
+    {
+        // make sure account can pay the fee for all these tx
+        int64_t newBalance = lastTx->getSourceAccount().getBalance() - totFee;
+        if (newBalance <
+            lastTx->getSourceAccount().getMinimumBalance(mLedgerManager))
+        {
+            removed = txs;
+        }
+    }
+
+    for (auto& tx : removed)
+    {
+        removeReceivedTx(tx);
     }
 }
 
@@ -1031,18 +1278,12 @@ HerderImpl::getCurrentLedgerSeq() const
 SequenceNumber
 HerderImpl::getMaxSeqInPendingTxs(AccountID const& acc)
 {
-    SequenceNumber highSeq = 0;
-    for (auto& list : mReceivedTransactions)
+    auto it = mAccountTxs.find(acc);
+    if (it == mAccountTxs.end())
     {
-        for (auto oldTX : list)
-        {
-            if (oldTX->getSourceID() == acc && oldTX->getSeqNum() > highSeq)
-            {
-                highSeq = oldTX->getSeqNum();
-            }
-        }
+        return 0;
     }
-    return highSeq;
+    return it->second.mTxs.back()->getSeqNum();
 }
 
 // called to take a position during the next round
@@ -1056,35 +1297,32 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
                               << mApp.getStateHuman();
         return;
     }
+    auto triggerTime = mSCPMetrics.mTriggerLatency.TimeScope();
     updateSCPCounters();
 
     // our first choice for this round's set is all the tx we have collected
-    // during last ledger close
+    // during last ledger close that are still valid; they stay received in
+    // case they don't get in this ledger
     auto const& lcl = mLedgerManager.getLastClosedLedgerHeader();
     TxSetFramePtr proposedSet = std::make_shared<TxSetFrame>(lcl.hash);
 
-    for (auto& list : mReceivedTransactions)
+    trimInvalidReceivedTxs();
+
+    // surge pricing: leave out those paying the least per operation
+    size_t maxTxs = mApp.getConfig().DESIRED_MAX_TX_PER_LEDGER;
+    if (mTxsByFee.size() > maxTxs)
     {
-        for (auto& tx : list)
-        {
-            proposedSet->add(tx);
-        }
+        CLOG(DEBUG, "Herder") << "surge pricing in effect! "
+                              << mTxsByFee.size();
     }
-
-    std::vector<TransactionFramePtr> removed;
-    proposedSet->trimInvalid(mApp, removed);
-    for (auto& tx : removed)
+    for (auto it = mTxsByFee.rbegin();
+         it != mTxsByFee.rend() && proposedSet->size() < maxTxs; ++it)
     {
-        removeReceivedTx(tx);
+        proposedSet->add(*it);
     }
 
-    proposedSet->surgePricingFilter(mApp);
-
     auto txSetHash = proposedSet->getContentsHash();
 
-    // add all txs to next set in case they don't get in this ledger
-    recvTransactions(proposedSet);
-
     // Inform the item fetcher so queries from other peers about his txSet
     // can be answered. Note this can trigger SCP callbacks, externalize, etc
     // if we happen to build a txset that we were trying to download.
@@ -1103,6 +1341,7 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
 
     // We store at which time we triggered consensus
     mLastTrigger = mApp.getClock().now();
+    mLastTriggeredSlot = slotIndex;
 
     // We pick as next close time the current time unless it's before the last
     // close time. We don't know how much time it will take to reach consensus
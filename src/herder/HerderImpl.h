@@ -5,7 +5,9 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include <vector>
+#include <map>
 #include <memory>
+#include <set>
 #include "herder/Herder.h"
 #include "scp/SCP.h"
 #include "util/Timer.h"
@@ -85,8 +87,10 @@ class HerderImpl : public Herder, public SCPDriver
     void acceptedCommit(uint64 slotIndex, SCPBallot const& ballot) override;
 
     TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) override;
+    void recvTransactionBatch(std::vector<TransactionFramePtr> const& txs,
+                              BatchHandler handler) override;
 
-    void recvSCPEnvelope(SCPEnvelope const& envelope) override;
+    bool recvSCPEnvelope(SCPEnvelope const& envelope) override;
 
     void recvSCPQuorumSet(Hash hash, const SCPQuorumSet& qset) override;
     void recvTxSet(Hash hash, const TxSetFrame& txset) override;
@@ -133,6 +137,53 @@ class HerderImpl : public Herder, public SCPDriver
     // 2- two ledgers ago.
     std::vector<std::vector<TransactionFramePtr>> mReceivedTransactions;
 
+    // the same transactions by source account, in sequence number order,
+    // along with the fees they commit the account to
+    struct AccountTxs
+    {
+        std::vector<TransactionFramePtr> mTxs;
+        int64_t mTotalFees;
+
+        AccountTxs() : mTotalFees(0)
+        {
+        }
+    };
+    std::map<AccountID, AccountTxs> mAccountTxs;
+
+    // and by fee per operation, lowest first, for surge pricing
+    struct FeeRatioLess
+    {
+        bool operator()(TransactionFramePtr const& tx1,
+                        TransactionFramePtr const& tx2) const;
+    };
+    std::set<TransactionFramePtr, FeeRatioLess> mTxsByFee;
+
+    // the last closed ledger the received transactions were checked against
+    LedgerHeader mTxsCheckedHeader;
+
+    // drops the received transactions that the ledgers closed since the
+    // last call made invalid; only the accounts these ledgers changed are
+    // checked again, unless a ledger was missed or the fees changed
+    void trimInvalidReceivedTxs();
+    void trimInvalidAccountTxs(AccountID const& account);
+
+    // transactions of recvTransactionBatch, received a chunk at a time
+    struct TxBatch
+    {
+        std::vector<TransactionFramePtr> mTxs;
+        std::vector<TransactionSubmitStatus> mStatuses;
+        BatchHandler mHandler;
+    };
+
+    // has the signatures of the next chunk of `batch` checked on the worker
+    // threads, then receives it; calls the handler once none is left
+    void checkTxBatch(std::shared_ptr<TxBatch> batch);
+    void recvTxBatchChunk(std::shared_ptr<TxBatch> batch, size_t end);
+
+    // set to false when this is destroyed, for the chunks still on the
+    // worker threads
+    std::shared_ptr<bool> mAlive;
+
     PendingEnvelopes mPendingEnvelopes;
 
     std::map<SCPBallot,
@@ -185,6 +236,8 @@ class HerderImpl : public Herder, public SCPDriver
     void trackingHeartBeat();
 
     VirtualClock::time_point mLastTrigger;
+    // slot we last proposed a value for, at mLastTrigger
+    uint64 mLastTriggeredSlot;
     VirtualTimer mTriggerTimer;
 
     VirtualTimer mRebroadcastTimer;
@@ -237,6 +290,12 @@ class HerderImpl : public Herder, public SCPDriver
         medida::Counter& mHerderStateCurrent;
         medida::Timer& mHerderStateChanges;
 
+        // time spent building our proposed value in triggerNextLedger
+        medida::Timer& mTriggerLatency;
+
+        // time from proposing a value for a slot to externalizing the slot
+        medida::Timer& mExternalizeLatency;
+
         SCPMetrics(Application& app);
     };
 
@@ -13,7 +13,16 @@
 #include "crypto/SHA.h"
 #include "transactions/TxTests.h"
 #include "database/Database.h"
+#include "herder/LedgerCloseData.h"
 #include "ledger/LedgerManager.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <functional>
 
 using namespace stellar;
 using namespace stellar::txtest;
@@ -64,6 +73,13 @@ TEST_CASE("standalone", "[herder]")
             b1Account = loadAccount(b1, *app);
             REQUIRE(a1Account->getBalance() == paymentAmount);
             REQUIRE(b1Account->getBalance() == paymentAmount);
+
+            // applied transactions are no longer pending
+            REQUIRE(app->getHerder().getMaxSeqInPendingTxs(
+                        root.getPublicKey()) == 0);
+            REQUIRE(app->getMetrics()
+                        .NewTimer({"herder", "trigger", "latency"})
+                        .count() > 0);
         };
 
         auto setup = [&](asio::error_code const& error)
@@ -105,6 +121,210 @@ TEST_CASE("recvTx", "[herder]")
 {
 }
 
+TEST_CASE("recvTransactionBatch", "[herder]")
+{
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, getTestConfig());
+    app->start();
+
+    SecretKey root = getRoot();
+    SecretKey a1 = getAccount("A");
+    SecretKey b1 = getAccount("B");
+    int64_t amount = app->getLedgerManager().getMinBalance(0);
+    SequenceNumber rootSeq = getAccountSeqNum(root, *app) + 1;
+
+    auto createA = createCreateAccountTx(root, a1, rootSeq, amount);
+    std::vector<TransactionFramePtr> txs{
+        createA,
+        createCreateAccountTx(root, b1, rootSeq + 1, amount),
+        // same transaction again
+        TransactionFrame::makeTransactionFromWire(createA->getEnvelope()),
+        // skips a sequence number
+        createPaymentTx(root, a1, rootSeq + 3, amount),
+        // from an account that doesn't exist yet
+        createPaymentTx(a1, b1, 1, 10)};
+
+    std::vector<Herder::TransactionSubmitStatus> statuses;
+    bool received = false;
+    app->getHerder().recvTransactionBatch(
+        txs, [&](std::vector<Herder::TransactionSubmitStatus> const& s)
+        {
+            statuses = s;
+            received = true;
+        });
+    // the signatures are being checked on the worker threads
+    REQUIRE(!received);
+    while (!received)
+    {
+        clock.crank(true);
+    }
+
+    std::vector<Herder::TransactionSubmitStatus> expected{
+        Herder::TX_STATUS_PENDING, Herder::TX_STATUS_PENDING,
+        Herder::TX_STATUS_DUPLICATE, Herder::TX_STATUS_ERROR,
+        Herder::TX_STATUS_ERROR};
+    REQUIRE(statuses == expected);
+    REQUIRE(txs[3]->getResultCode() == txBAD_SEQ);
+    REQUIRE(txs[4]->getResultCode() == txNO_ACCOUNT);
+    REQUIRE(app->getHerder().getMaxSeqInPendingTxs(root.getPublicKey()) ==
+            rootSeq + 1);
+}
+
+// closes the next ledger with `txs`, `secondsLater` after the last one
+static void
+closeLedgerWith(Application& app, std::vector<TransactionFramePtr> const& txs,
+                uint64_t secondsLater = 1,
+                std::vector<LedgerUpgrade> const& upgrades = {})
+{
+    auto& lm = app.getLedgerManager();
+    auto const& lcl = lm.getLastClosedLedgerHeader();
+    TxSetFramePtr txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    for (auto const& tx : txs)
+    {
+        txSet->add(tx);
+    }
+    StellarValue sv(txSet->getContentsHash(),
+                    lcl.header.scpValue.closeTime + secondsLater,
+                    emptyUpgradeSteps, 0);
+    for (auto const& upgrade : upgrades)
+    {
+        Value v(xdr::xdr_to_opaque(upgrade));
+        sv.upgrades.emplace_back(v.begin(), v.end());
+    }
+    LedgerCloseData ledgerData(lcl.header.ledgerSeq + 1, txSet, sv);
+    lm.closeLedger(ledgerData);
+}
+
+// `tx` signed again by `key` after `change` to its envelope
+static TransactionFramePtr
+resign(TransactionFramePtr tx, SecretKey const& key,
+       std::function<void(TransactionEnvelope&)> change)
+{
+    change(tx->getEnvelope());
+    tx->getEnvelope().signatures.clear();
+    tx->addSignature(key);
+    return tx;
+}
+
+TEST_CASE("pending transactions are checked again as ledgers close",
+          "[herder]")
+{
+    Config cfg(getTestConfig());
+    cfg.DESIRED_MAX_TX_PER_LEDGER = 2;
+
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& herder = app->getHerder();
+    SecretKey root = getRoot();
+    SecretKey a1 = getAccount("A");
+    SecretKey b1 = getAccount("B");
+    SecretKey c1 = getAccount("C");
+    int64_t amount = app->getLedgerManager().getMinBalance(0) * 10;
+    SequenceNumber rootSeq = getAccountSeqNum(root, *app) + 1;
+    closeLedgerWith(*app, {createCreateAccountTx(root, a1, rootSeq, amount),
+                           createCreateAccountTx(root, b1, rootSeq + 1, amount),
+                           createCreateAccountTx(root, c1, rootSeq + 2,
+                                                 amount)});
+
+    SequenceNumber aSeq = getAccountSeqNum(a1, *app) + 1;
+    SequenceNumber bSeq = getAccountSeqNum(b1, *app) + 1;
+    SequenceNumber cSeq = getAccountSeqNum(c1, *app) + 1;
+    auto txA = createPaymentTx(a1, root, aSeq, 100);
+    auto txB = resign(createPaymentTx(b1, root, bSeq, 100), b1,
+                      [](TransactionEnvelope& e)
+                      {
+                          e.tx.fee = 20;
+                      });
+    REQUIRE(herder.recvTransaction(txA) == Herder::TX_STATUS_PENDING);
+    REQUIRE(herder.recvTransaction(txB) == Herder::TX_STATUS_PENDING);
+
+    // triggering an older ledger checks the pending transactions and builds
+    // a transaction set without nominating it
+    herder.triggerNextLedger(0);
+    REQUIRE(herder.getMaxSeqInPendingTxs(a1.getPublicKey()) == aSeq);
+    REQUIRE(herder.getMaxSeqInPendingTxs(b1.getPublicKey()) == bSeq);
+
+    SECTION("account changed by the ledger")
+    {
+        // another transaction of A takes the sequence number of txA
+        closeLedgerWith(*app, {createPaymentTx(a1, root, aSeq, 1)});
+        herder.triggerNextLedger(0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(a1.getPublicKey()) == 0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(b1.getPublicKey()) == bSeq);
+    }
+
+    SECTION("time bounds")
+    {
+        uint64_t closeTime = app->getLedgerManager()
+                                 .getLastClosedLedgerHeader()
+                                 .header.scpValue.closeTime;
+        auto txC = resign(createPaymentTx(c1, root, cSeq, 100), c1,
+                          [closeTime](TransactionEnvelope& e)
+                          {
+                              e.tx.timeBounds.activate() =
+                                  TimeBounds(0, closeTime + 5);
+                          });
+        REQUIRE(herder.recvTransaction(txC) == Herder::TX_STATUS_PENDING);
+
+        // C is unchanged, but its transaction is now too late
+        closeLedgerWith(*app, {}, 10);
+        herder.triggerNextLedger(0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(c1.getPublicKey()) == 0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(a1.getPublicKey()) == aSeq);
+        REQUIRE(herder.getMaxSeqInPendingTxs(b1.getPublicKey()) == bSeq);
+    }
+
+    SECTION("missed ledger")
+    {
+        // the last ledger doesn't change B, the one before does
+        closeLedgerWith(*app, {createPaymentTx(b1, root, bSeq, 1)});
+        closeLedgerWith(*app, {});
+        herder.triggerNextLedger(0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(b1.getPublicKey()) == 0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(a1.getPublicKey()) == aSeq);
+    }
+
+    SECTION("base fee change")
+    {
+        // changes no account, but neither transaction pays enough anymore
+        LedgerUpgrade up(LEDGER_UPGRADE_BASE_FEE);
+        up.newBaseFee() = 100;
+        closeLedgerWith(*app, {}, 1, {up});
+        herder.triggerNextLedger(0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(a1.getPublicKey()) == 0);
+        REQUIRE(herder.getMaxSeqInPendingTxs(b1.getPublicKey()) == 0);
+    }
+
+    SECTION("surge pricing")
+    {
+        auto txC = resign(createPaymentTx(c1, root, cSeq, 100), c1,
+                          [](TransactionEnvelope& e)
+                          {
+                              e.tx.fee = 30;
+                          });
+        REQUIRE(herder.recvTransaction(txC) == Herder::TX_STATUS_PENDING);
+        herder.triggerNextLedger(0);
+
+        // the two paying the most make the proposed set
+        auto const& lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+        TxSetFrame expected(lcl.hash);
+        expected.add(txB);
+        expected.add(txC);
+        REQUIRE(herder.getTxSet(expected.getContentsHash()));
+
+        TxSetFrame all(lcl.hash);
+        all.add(txA);
+        all.add(txB);
+        all.add(txC);
+        REQUIRE(!herder.getTxSet(all.getContentsHash()));
+
+        // and the other one stays pending
+        REQUIRE(herder.getMaxSeqInPendingTxs(a1.getPublicKey()) == aSeq);
+    }
+}
+
 TEST_CASE("txset", "[herder]")
 {
     Config cfg(getTestConfig());
@@ -274,3 +494,74 @@ TEST_CASE("surge", "[herder]")
     {
     }
 }
+
+static TransactionSet
+makeRandomTxSet(size_t nAccounts, size_t nTxPerAccount)
+{
+    SecretKey root = getRoot();
+    TxSetFrame txSet(sha256("previous ledger"));
+    for (size_t i = 0; i < nAccounts; i++)
+    {
+        SecretKey from = getAccount(("from" + std::to_string(i)).c_str());
+        for (size_t j = 0; j < nTxPerAccount; j++)
+        {
+            txSet.add(createPaymentTx(from, root, j + 1, 100));
+        }
+    }
+    txSet.sortForHash();
+    TransactionSet res;
+    txSet.toXDR(res);
+    return res;
+}
+
+TEST_CASE("txset from the wire", "[herder]")
+{
+    TransactionSet xdrSet = makeRandomTxSet(10, 5);
+
+    TxSetFrame wire(xdrSet);
+    TxSetFrame local(xdrSet.previousLedgerHash);
+    for (auto const& env : xdrSet.txs)
+    {
+        local.add(std::make_shared<TransactionFrame>(env));
+    }
+    // added out of order
+    std::reverse(local.mTransactions.begin(), local.mTransactions.end());
+
+    auto hasher = SHA256::create();
+    hasher->add(xdrSet.previousLedgerHash);
+    for (auto const& env : xdrSet.txs)
+    {
+        hasher->add(xdr::xdr_to_opaque(env));
+    }
+    Hash expected = hasher->finish();
+
+    REQUIRE(wire.getContentsHash() == expected);
+    REQUIRE(local.getContentsHash() == expected);
+
+    auto wireOrder = wire.sortForApply();
+    auto localOrder = local.sortForApply();
+    REQUIRE(wireOrder.size() == xdrSet.txs.size());
+    for (size_t i = 0; i < wireOrder.size(); i++)
+    {
+        REQUIRE(wireOrder[i]->getFullHash() == localOrder[i]->getFullHash());
+    }
+}
+
+TEST_CASE("txset sort and hash benchmark", "[herder][bench][hide]")
+{
+    size_t const nAccounts = 1000;
+    size_t const nTxPerAccount = 10;
+    size_t const nRounds = 20;
+
+    LOG(INFO) << "Signing " << nAccounts * nTxPerAccount << " transactions";
+    TransactionSet xdrSet = makeRandomTxSet(nAccounts, nTxPerAccount);
+
+    LOG(INFO) << "Hashing and sorting " << nRounds << " sets";
+    TIMED_SCOPE(timerBlkObj, "txset sort and hash");
+    for (size_t i = 0; i < nRounds; i++)
+    {
+        TxSetFrame txSet(xdrSet);
+        txSet.getContentsHash();
+        REQUIRE(txSet.sortForApply().size() == nAccounts * nTxPerAccount);
+    }
+}
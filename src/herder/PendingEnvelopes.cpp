@@ -2,6 +2,7 @@
 #include "main/Application.h"
 #include "herder/HerderImpl.h"
 #include "crypto/Hex.h"
+#include "crypto/SHA.h"
 #include <overlay/OverlayManager.h>
 #include <xdrpp/marshal.h>
 #include "util/Logging.h"
@@ -9,6 +10,9 @@
 #include "herder/TxSetFrame.h"
 #include "main/Application.h"
 
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
 using namespace std;
 
 #define QSET_CACHE_SIZE 10000
@@ -26,7 +30,12 @@ PendingEnvelopes::PendingEnvelopes(Application& app, HerderImpl& herder)
     , mTxSetCache(TXSET_CACHE_SIZE)
     , mPendingEnvelopesSize(
           app.getMetrics().NewCounter({"scp", "memory", "pending-envelopes"}))
+    , mEnvelopeDuplicate(app.getMetrics().NewMeter(
+          {"scp", "envelope", "duplicate"}, "envelope"))
 {
+    mQsetCache.trackMetrics(app.getShardedMetrics(), "herder", "qset-cache");
+    mTxSetCache.trackMetrics(app.getShardedMetrics(), "herder",
+                             "txset-cache");
 }
 
 PendingEnvelopes::~PendingEnvelopes()
@@ -79,37 +88,40 @@ PendingEnvelopes::recvSCPEnvelope(SCPEnvelope const& envelope)
 
     try
     {
-        auto& set = mFetchingEnvelopes[envelope.statement.slotIndex];
+        Hash envelopeHash = sha256(xdr::xdr_to_opaque(envelope));
+        auto& fetching = mFetchingEnvelopes[envelope.statement.slotIndex];
+        auto fetchingIt = fetching.find(envelopeHash);
 
-        if (find(set.begin(), set.end(), envelope) == set.end())
+        if (fetchingIt == fetching.end())
         { // we aren't fetching this envelop
 
-            auto& receivedList =
-                mReceivedEnvelopes[envelope.statement.slotIndex];
-            if (find(receivedList.begin(), receivedList.end(), envelope) ==
-                receivedList.end())
+            auto& received = mReceivedEnvelopes[envelope.statement.slotIndex];
+            if (received.insert(envelopeHash).second)
             { // we haven't seen this envelope before
 
-                receivedList.push_back(envelope);
                 if (startFetch(envelope))
                 { // fully fetched
                     envelopeReady(envelope);
                 }
                 else
                 {
-                    mFetchingEnvelopes[envelope.statement.slotIndex].insert(
-                        envelope);
+                    fetching.insert(envelopeHash);
                 }
 
                 CLOG(DEBUG, "Herder") << "PendingEnvelopes::recvSCPEnvelope";
 
-            } // else we already have this one
+            }
+            else
+            { // we already have this one
+                mEnvelopeDuplicate.Mark();
+            }
         }
         else
         { // we are fetching this envelope
             // check if we are done fetching it
             if (isFullyFetched(envelope))
             {
+                fetching.erase(fetchingIt);
                 envelopeReady(envelope);
             } // else just keep waiting for it to come in
         }
@@ -260,23 +272,17 @@ PendingEnvelopes::slotClosed(uint64 slotIndex)
 TxSetFramePtr
 PendingEnvelopes::getTxSet(Hash hash)
 {
-    if (mTxSetCache.exists(hash))
-    {
-        return mTxSetCache.get(hash);
-    }
-
-    return TxSetFramePtr();
+    TxSetFramePtr txset;
+    mTxSetCache.maybeGet(hash, txset);
+    return txset;
 }
 
 SCPQuorumSetPtr
 PendingEnvelopes::getQSet(Hash hash)
 {
-    if (mQsetCache.exists(hash))
-    {
-        return mQsetCache.get(hash);
-    }
-
-    return SCPQuorumSetPtr();
+    SCPQuorumSetPtr qset;
+    mQsetCache.maybeGet(hash, qset);
+    return qset;
 }
 
 void
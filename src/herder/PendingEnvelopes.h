@@ -5,10 +5,12 @@
 #include <medida/medida.h>
 #include <util/optional.h>
 #include <set>
+#include <unordered_set>
 #include <xdr/Stellar-SCP.h>
+#include "util/HashOfHash.h"
 #include "overlay/ItemFetcher.h"
 #include "lib/json/json.h"
-#include "lib/util/lrucache.hpp"
+#include "util/SegmentedCache.h"
 
 /*
 SCP messages that you have received but are waiting to get the info of
@@ -25,25 +27,28 @@ class PendingEnvelopes
     Application& mApp;
     HerderImpl& mHerder;
 
-    // ledger# and list of envelopes we have received if they are fetched or not
-    std::map<uint64, std::vector<SCPEnvelope>> mReceivedEnvelopes;
+    // envelopes are known by the hash of their XDR, computed once on receive
 
-    // ledger# and list of envelopes we are fetching right now
-    std::map<uint64, std::set<SCPEnvelope>> mFetchingEnvelopes;
+    // ledger# and envelopes we have received if they are fetched or not
+    std::map<uint64, std::unordered_set<Hash>> mReceivedEnvelopes;
+
+    // ledger# and envelopes we are fetching right now
+    std::map<uint64, std::unordered_set<Hash>> mFetchingEnvelopes;
 
     // ledger# and list of envelopes that haven't been sent to SCP yet
     std::map<uint64, std::vector<SCPEnvelope>> mPendingEnvelopes;
 
     // all the quorum sets we have learned about
-    cache::lru_cache<uint256, SCPQuorumSetPtr> mQsetCache;
+    SegmentedCache<uint256, SCPQuorumSetPtr> mQsetCache;
 
     ItemFetcher<TxSetTracker> mTxSetFetcher;
     ItemFetcher<QuorumSetTracker> mQuorumSetFetcher;
 
     // all the txsets we have learned about per ledger#
-    cache::lru_cache<uint256, TxSetFramePtr> mTxSetCache;
+    SegmentedCache<uint256, TxSetFramePtr> mTxSetCache;
 
     medida::Counter& mPendingEnvelopesSize;
+    medida::Meter& mEnvelopeDuplicate;
 
   public:
     PendingEnvelopes(Application& app, HerderImpl& herder);
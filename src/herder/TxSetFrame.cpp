@@ -28,6 +28,7 @@ TxSetFrame::TxSetFrame(Hash const& previousLedgerHash)
 
 TxSetFrame::TxSetFrame(TransactionSet const& xdrSet) : mHashIsValid(false)
 {
+    mTransactions.reserve(xdrSet.txs.size());
     for (auto const& txEnvelope : xdrSet.txs)
     {
         TransactionFramePtr tx =
@@ -50,36 +51,26 @@ HashTxSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
 void
 TxSetFrame::sortForHash()
 {
-    std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
+    // sets received from peers are sorted already; the hashes are cached,
+    // so checking is a cheap pass
+    if (!std::is_sorted(mTransactions.begin(), mTransactions.end(),
+                        HashTxSorter))
+    {
+        std::sort(mTransactions.begin(), mTransactions.end(), HashTxSorter);
+    }
     mHashIsValid = false;
 }
 
 // We want to XOR the tx hash with the set hash.
-// This way people can't predict the order that txs will be applied in
-struct ApplyTxSorter
-{
-    Hash const& mSetHash;
-    ApplyTxSorter(Hash const& h) : mSetHash(h)
-    {
-    }
+// This way people can't predict the order that txs will be applied in.
+// The keys are computed once per transaction rather than per comparison.
+typedef std::pair<Hash, TransactionFramePtr> ApplyTxKey;
 
-    bool operator()(TransactionFramePtr const& tx1,
-                    TransactionFramePtr const& tx2) const
-    {
-        // need to use the hash of whole tx here since multiple txs could have
-        // the same Contents
-        Hash h1 = tx1->getFullHash();
-        Hash h2 = tx2->getFullHash();
-        Hash v1, v2;
-        for (int n = 0; n < 32; n++)
-        {
-            v1[n] = mSetHash[n] ^ h1[n];
-            v2[n] = mSetHash[n] ^ h2[n];
-        }
-
-        return v1 < v2;
-    }
-};
+static bool
+ApplyTxSorter(ApplyTxKey const& tx1, ApplyTxKey const& tx2)
+{
+    return tx1.first < tx2.first;
+}
 
 static bool
 SeqSorter(TransactionFramePtr const& tx1, TransactionFramePtr const& tx2)
@@ -123,15 +114,29 @@ TxSetFrame::sortForApply()
 
     retList.clear();
 
+    // randomize each batch using the hash of the transaction set
+    // as a way to randomize even more
+    Hash const setHash = getContentsHash();
+    vector<ApplyTxKey> keys;
     for (auto& batch : txBatches)
     {
-        // randomize each batch using the hash of the transaction set
-        // as a way to randomize even more
-        ApplyTxSorter s(getContentsHash());
-        std::sort(batch.begin(), batch.end(), s);
-        for (auto tx : batch)
+        keys.clear();
+        for (auto const& tx : batch)
+        {
+            // need to use the hash of whole tx here since multiple txs could
+            // have the same Contents
+            Hash const& h = tx->getFullHash();
+            keys.emplace_back(Hash(), tx);
+            Hash& v = keys.back().first;
+            for (size_t n = 0; n < v.size(); n++)
+            {
+                v[n] = setHash[n] ^ h[n];
+            }
+        }
+        std::sort(keys.begin(), keys.end(), ApplyTxSorter);
+        for (auto const& key : keys)
         {
-            retList.push_back(tx);
+            retList.push_back(key.second);
         }
     }
 
@@ -174,17 +179,15 @@ TxSetFrame::surgePricingFilter(Application& app)
 // TODO.3 this and checkValid share a lot of code
 void
 TxSetFrame::trimInvalid(Application& app,
-                        std::vector<TransactionFramePtr> trimmed)
+                        std::vector<TransactionFramePtr>& trimmed)
 {
     sortForHash();
 
     map<AccountID, vector<TransactionFramePtr>> accountTxMap;
 
-    Hash lastHash;
-    for (auto tx : mTransactions)
+    for (auto const& tx : mTransactions)
     {
         accountTxMap[tx->getSourceID()].push_back(tx);
-        lastHash = tx->getFullHash();
     }
 
     for (auto& item : accountTxMap)
@@ -246,19 +249,18 @@ TxSetFrame::checkValid(Application& app) const
 
     map<AccountID, vector<TransactionFramePtr>> accountTxMap;
 
-    Hash lastHash;
-    for (auto tx : mTransactions)
+    // make sure the set is sorted correctly
+    if (!std::is_sorted(mTransactions.begin(), mTransactions.end(),
+                        HashTxSorter))
+    {
+        CLOG(INFO, "Herder") << "bad txSet: " << hexAbbrev(mPreviousLedgerHash)
+                             << " not sorted correctly";
+        return false;
+    }
+
+    for (auto const& tx : mTransactions)
     {
-        // make sure the set is sorted correctly
-        if (tx->getFullHash() < lastHash)
-        {
-            CLOG(INFO, "Herder")
-                << "bad txSet: " << hexAbbrev(mPreviousLedgerHash)
-                << " not sorted correctly";
-            return false;
-        }
         accountTxMap[tx->getSourceID()].push_back(tx);
-        lastHash = tx->getFullHash();
     }
 
     for (auto& item : accountTxMap)
@@ -333,11 +335,12 @@ TxSetFrame::getContentsHash()
     if (!mHashIsValid)
     {
         sortForHash();
+        // a single pass over the encodings cached by each frame
         auto hasher = SHA256::create();
         hasher->add(mPreviousLedgerHash);
-        for (unsigned int n = 0; n < mTransactions.size(); n++)
+        for (auto const& tx : mTransactions)
         {
-            hasher->add(xdr::xdr_to_opaque(mTransactions[n]->getEnvelope()));
+            hasher->add(tx->getEnvelopeBytes());
         }
         mHash = hasher->finish();
         mHashIsValid = true;
@@ -39,8 +39,9 @@ class TxSetFrame
     std::vector<TransactionFramePtr> sortForApply();
 
     bool checkValid(Application& app) const;
+    // removes the transactions that aren't valid, appending them to trimmed
     void trimInvalid(Application& app,
-                     std::vector<TransactionFramePtr> trimmed);
+                     std::vector<TransactionFramePtr>& trimmed);
     void surgePricingFilter(Application& app);
 
     void removeTx(TransactionFramePtr tx);
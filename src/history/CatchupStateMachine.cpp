@@ -23,6 +23,9 @@
 #include "xdrpp/printer.h"
 #include "util/Math.h"
 
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
 #include <random>
 #include <memory>
 
@@ -49,6 +52,11 @@ CatchupStateMachine::CatchupStateMachine(
     , mRetryCount(0)
     , mRetryTimer(app)
     , mDownloadDir(app.getTmpDirManager().tmpDir("catchup"))
+    , mFetchTimer(app.getMetrics().NewTimer({"history", "catchup", "fetch"}))
+    , mVerifyTimer(
+          app.getMetrics().NewTimer({"history", "catchup", "verify"}))
+    , mApplyTimer(app.getMetrics().NewTimer({"history", "catchup", "apply"}))
+    , mPhaseStart(std::chrono::steady_clock::now())
     , mLocalState(localState)
 {
     mLocalState.resolveAllFutures();
@@ -66,6 +74,14 @@ CatchupStateMachine::begin()
     enterBeginState();
 }
 
+void
+CatchupStateMachine::recordPhase(medida::Timer& timer)
+{
+    auto now = std::chrono::steady_clock::now();
+    timer.Update(now - mPhaseStart);
+    mPhaseStart = now;
+}
+
 
 /**
  * Select any readable history archive. If there are more than one,
@@ -383,6 +399,7 @@ CatchupStateMachine::enterAnchoredState(HistoryArchiveState const& has)
     assert(mState == CATCHUP_BEGIN || mState == CATCHUP_RETRYING);
     mState = CATCHUP_ANCHORED;
     mArchiveState = has;
+    mPhaseStart = std::chrono::steady_clock::now();
 
     CLOG(DEBUG, "History") << "Catchup ANCHORED, anchor ledger = "
                            << mArchiveState.currentLedger;
@@ -528,6 +545,16 @@ void
 CatchupStateMachine::enterVerifyingState()
 {
     assert(mState == CATCHUP_RETRYING || mState == CATCHUP_FETCHING);
+    if (mState == CATCHUP_FETCHING)
+    {
+        recordPhase(mFetchTimer);
+    }
+    else
+    {
+        // Time spent waiting out a VERIFY_HASH_UNKNOWN retry is not
+        // verification work.
+        mPhaseStart = std::chrono::steady_clock::now();
+    }
     mState = CATCHUP_VERIFYING;
 
     if (mMode == HistoryManager::CATCHUP_COMPLETE)
@@ -745,6 +772,7 @@ void
 CatchupStateMachine::enterApplyingState()
 {
     assert(mState == CATCHUP_VERIFYING);
+    recordPhase(mVerifyTimer);
     mState = CATCHUP_APPLYING;
     try
     {
@@ -1106,6 +1134,7 @@ void
 CatchupStateMachine::enterEndState()
 {
     assert(mState == CATCHUP_APPLYING);
+    recordPhase(mApplyTimer);
     mState = CATCHUP_END;
     CLOG(DEBUG, "History") << "Completed catchup from '" << mArchive->getName()
                            << "', at nextLedger=" << mNextLedger;
@@ -10,9 +10,15 @@
 #include "util/Timer.h"
 #include "util/TmpDir.h"
 
+#include <chrono>
 #include <map>
 #include <memory>
 
+namespace medida
+{
+class Timer;
+}
+
 namespace stellar
 {
 
@@ -113,6 +119,14 @@ private:
     VirtualTimer mRetryTimer;
     TmpDir mDownloadDir;
 
+    // Wall-clock time spent in each phase of a single pass through the state
+    // machine, measured from the moment the previous phase finished.
+    medida::Timer& mFetchTimer;
+    medida::Timer& mVerifyTimer;
+    medida::Timer& mApplyTimer;
+    std::chrono::steady_clock::time_point mPhaseStart;
+    void recordPhase(medida::Timer& timer);
+
     std::shared_ptr<HistoryArchive> mArchive;
     HistoryArchiveState mLocalState;
     HistoryArchiveState mArchiveState;
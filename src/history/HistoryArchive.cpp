@@ -300,6 +300,12 @@ HistoryArchive::getName() const
     return mName;
 }
 
+std::string const&
+HistoryArchive::getGetCmd() const
+{
+    return mGetCmd;
+}
+
 void
 HistoryArchive::getMostRecentState(
     Application& app,
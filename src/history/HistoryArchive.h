@@ -148,6 +148,7 @@ class HistoryArchive : public std::enable_shared_from_this<HistoryArchive>
     bool hasPutCmd() const;
     bool hasMkdirCmd() const;
     std::string const& getName() const;
+    std::string const& getGetCmd() const;
     std::string qualifiedFilename(Application& app,
                                   std::string const& basename) const;
 
@@ -412,6 +412,11 @@ StateSnapshot::writeHistoryBlocks() const
             : nullptr);
     soci::session& sess(snapSess ? *snapSess : mApp.getDatabase().getSession());
     soci::transaction tx(sess);
+    std::unique_ptr<StatementCache> snapStmts(
+        snapSess ? make_unique<StatementCache>(mApp.getDatabase(), sess)
+                 : nullptr);
+    StatementCache& stmts(snapStmts ? *snapStmts
+                                    : mApp.getDatabase().getStatementCache());
 
     // The current "history block" is stored in _three_ files, one just ledger
     // headers, one TransactionHistoryEntry (which contain txSets) and
@@ -434,9 +439,9 @@ StateSnapshot::writeHistoryBlocks() const
                            << " ledgers worth of history, from " << begin;
 
     size_t nHeaders = LedgerHeaderFrame::copyLedgerHeadersToStream(
-        mApp.getDatabase(), sess, begin, count, ledgerOut);
+        mApp.getDatabase(), stmts, begin, count, ledgerOut);
     size_t nTxs = TransactionFrame::copyTransactionsToStream(
-        mApp.getDatabase(), sess, begin, count, txOut, txResultOut);
+        mApp.getDatabase(), stmts, begin, count, txOut, txResultOut);
     CLOG(DEBUG, "History") << "Wrote " << nHeaders << " ledger headers to "
                            << mLedgerSnapFile->localPath_nogz();
     CLOG(DEBUG, "History") << "Wrote " << nTxs << " transactions to "
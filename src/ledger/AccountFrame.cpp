@@ -8,7 +8,10 @@
 #include "database/Database.h"
 #include "LedgerDelta.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerState.h"
 #include "util/basen.h"
+#include "util/Logging.h"
+#include "xdrpp/marshal.h"
 #include <algorithm>
 
 using namespace soci;
@@ -17,46 +20,118 @@ using namespace std;
 namespace stellar
 {
 using xdr::operator<;
+using xdr::operator==;
+
+// Account IDs are stored as their raw 32 bytes. signers holds the XDR of
+// AccountEntry::signers, so that an account is loaded and stored as a single
+// row.
+static void
+createAccountsTable(Database& db, std::string const& name)
+{
+    std::string bin = db.getBinaryColumnType();
+    db.getSession()
+        << "CREATE TABLE " + name +
+               "("
+               "accountid       " + bin + " PRIMARY KEY,"
+               "balance         BIGINT       NOT NULL CHECK (balance >= 0),"
+               "seqnum          BIGINT       NOT NULL,"
+               "numsubentries   INT          NOT NULL CHECK (numsubentries >= 0),"
+               "inflationdest   " + bin + ","
+               "homedomain      VARCHAR(32),"
+               "thresholds      TEXT,"
+               "flags           INT          NOT NULL,"
+               "signers         " + bin +
+               ");";
+}
 
 const char* AccountFrame::kSQLCreateStatement1 =
-    "CREATE TABLE accounts"
-    "("
-    "accountid       VARCHAR(56)  PRIMARY KEY,"
-    "balance         BIGINT       NOT NULL CHECK (balance >= 0),"
-    "seqnum          BIGINT       NOT NULL,"
-    "numsubentries   INT          NOT NULL CHECK (numsubentries >= 0),"
-    "inflationdest   VARCHAR(56),"
-    "homedomain      VARCHAR(32),"
-    "thresholds      TEXT,"
-    "flags           INT          NOT NULL"
-    ");";
+    "CREATE INDEX accountbalances ON Accounts (balance)";
 
+// Running total of the inflation votes of every destination, kept in sync with
+// the accounts table by the code writing to it. Destinations are kept as StrKey
+// as the winners are ordered by it when they have the same number of votes.
 const char* AccountFrame::kSQLCreateStatement2 =
-    "CREATE TABLE signers"
+    "CREATE TABLE inflationvotes"
     "("
-    "accountid       VARCHAR(56) NOT NULL,"
-    "publickey       VARCHAR(56) NOT NULL,"
-    "weight          INT         NOT NULL,"
-    "PRIMARY KEY (accountid, publickey)"
+    "inflationdest   VARCHAR(56)  PRIMARY KEY,"
+    "votes           BIGINT       NOT NULL CHECK (votes > 0)"
     ");";
 
 const char* AccountFrame::kSQLCreateStatement3 =
-    "CREATE INDEX signersaccount ON signers (accountid)";
-
-const char* AccountFrame::kSQLCreateStatement4 =
-    "CREATE INDEX accountbalances ON Accounts (balance)";
+    "CREATE INDEX inflationvotesorder ON inflationvotes (votes, inflationdest)";
+
+static StatementId const kLoadAccount = StatementId::registerStatement(
+    "account-load", "SELECT balance, seqnum, numsubentries, "
+                    "inflationdest, homedomain, thresholds, flags, signers "
+                    "FROM accounts WHERE accountid=:v1");
+
+static StatementId const kAccountExists = StatementId::registerStatement(
+    "account-exists",
+    "SELECT EXISTS (SELECT NULL FROM accounts WHERE accountid=:v1)");
+
+static StatementId const kLoadAccountKeys = StatementId::registerStatement(
+    "account-keys", "SELECT accountid FROM accounts");
+
+static StatementId const kDeleteAccount = StatementId::registerStatement(
+    "account-delete", "DELETE from accounts where accountid= :v1");
+
+static StatementId const kInsertAccount = StatementId::registerStatement(
+    "account-insert",
+    "INSERT INTO accounts ( accountid, balance, seqnum, "
+    "numsubentries, inflationdest, homedomain, thresholds, flags, "
+    "signers) "
+    "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8 )");
+
+static StatementId const kUpdateAccount = StatementId::registerStatement(
+    "account-update",
+    "UPDATE accounts SET balance = :v1, seqnum = :v2, "
+    "numsubentries = :v3, "
+    "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
+    "flags = :v7, signers = :v8 WHERE accountid = :id");
+
+static StatementId const kLoadInflationVote = StatementId::registerStatement(
+    "account-vote",
+    "SELECT balance, inflationdest FROM accounts WHERE accountid=:v1");
+
+// leaves the total of :v2 alone if adding :v1 votes leaves none
+static StatementId const kAddInflationVotes = StatementId::registerStatement(
+    "inflationvotes-add", "UPDATE inflationvotes SET votes = votes + :v1 "
+                          "WHERE inflationdest = :v2 AND votes + :v3 > 0");
+
+static StatementId const kInsertInflationVotes =
+    StatementId::registerStatement("inflationvotes-insert",
+                                   "INSERT INTO inflationvotes "
+                                   "(inflationdest, votes) VALUES (:v1, :v2)");
+
+// deletes the total of :v1 if taking :v2 votes away leaves exactly none
+static StatementId const kDeleteInflationVotes =
+    StatementId::registerStatement("inflationvotes-delete",
+                                   "DELETE FROM inflationvotes WHERE "
+                                   "inflationdest = :v1 AND votes = :v2");
+
+static StatementId const kInflationWinners = StatementId::registerStatement(
+    "inflationvotes-winners", "SELECT votes, inflationdest FROM inflationvotes"
+                              " ORDER BY votes DESC, inflationdest DESC"
+                              " LIMIT :lim");
+
+static StatementId const kTallyInflationVotes = StatementId::registerStatement(
+    "inflationvotes-tally",
+    "SELECT inflationdest, sum(balance) FROM accounts"
+    " WHERE inflationdest IS NOT NULL AND balance >= 1000000000"
+    " GROUP BY inflationdest");
+
+// accounts with less than this don't take part in the vote
+static const int64 INFLATION_MIN_VOTER_BALANCE = 1000000000;
 
 AccountFrame::AccountFrame()
     : EntryFrame(ACCOUNT), mAccountEntry(mEntry.account())
 {
     mAccountEntry.thresholds[0] = 1; // by default, master key's weight is 1
-    mUpdateSigners = false;
 }
 
 AccountFrame::AccountFrame(LedgerEntry const& from)
     : EntryFrame(from), mAccountEntry(mEntry.account())
 {
-    mUpdateSigners = !mAccountEntry.signers.empty();
 }
 
 AccountFrame::AccountFrame(AccountFrame const& from) : AccountFrame(from.mEntry)
@@ -171,38 +246,55 @@ AccountFrame::getLowThreshold() const
 
 AccountFrame::pointer
 AccountFrame::loadAccount(AccountID const& accountID, Database& db)
+{
+    if (auto state = db.getLedgerState())
+    {
+        LedgerKey key;
+        key.type(ACCOUNT);
+        key.account().accountID = accountID;
+        auto p = state->load(key);
+        return p ? std::make_shared<AccountFrame>(*p) : nullptr;
+    }
+    return loadAccountFromDatabase(accountID, db);
+}
+
+AccountFrame::pointer
+AccountFrame::loadAccountFromDatabase(AccountID const& accountID, Database& db)
 {
     LedgerKey key;
     key.type(ACCOUNT);
     key.account().accountID = accountID;
-    if (cachedEntryExists(key, db))
+    std::shared_ptr<LedgerEntry const> p;
+    if (getCachedEntry(key, db, p))
     {
-        auto p = getCachedEntry(key, db);
         return p ? std::make_shared<AccountFrame>(*p) : nullptr;
     }
+    auto& filter = db.getEntryFilter();
+    if (!filter.mayContain(key))
+    {
+        return nullptr;
+    }
 
-    std::string actIDStrKey = PubKeyUtils::toStrKey(accountID);
-
-    std::string publicKey, inflationDest, creditAuthKey;
     std::string homeDomain, thresholds;
-    soci::indicator inflationDestInd, homeDomainInd, thresholdsInd;
+    soci::indicator homeDomainInd, thresholdsInd;
 
     AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
     AccountEntry& account = res->getAccount();
+    BinaryColumn actID(db, db.getSession()), inflationDest(db, db.getSession()),
+        signers(db, db.getSession());
+    actID.set(accountID);
 
-    auto prep = db.getPreparedStatement(
-        "SELECT balance, seqnum, numsubentries, "
-        "inflationdest, homedomain, thresholds, flags "
-        "FROM accounts WHERE accountid=:v1");
+    auto prep = db.getPreparedStatement(kLoadAccount);
     auto& st = prep.statement();
     st.exchange(into(account.balance));
     st.exchange(into(account.seqNum));
     st.exchange(into(account.numSubEntries));
-    st.exchange(into(inflationDest, inflationDestInd));
+    inflationDest.bindInto(st);
     st.exchange(into(homeDomain, homeDomainInd));
     st.exchange(into(thresholds, thresholdsInd));
     st.exchange(into(account.flags));
-    st.exchange(use(actIDStrKey));
+    signers.bindInto(st);
+    actID.bindUse(st);
     st.define_and_bind();
     {
         auto timer = db.getSelectTimer("account");
@@ -211,6 +303,7 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
 
     if (!st.got_data())
     {
+        filter.recordFalsePositive();
         putCachedEntry(key, nullptr, db);
         return nullptr;
     }
@@ -226,42 +319,16 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
                        res->mAccountEntry.thresholds.begin());
     }
 
-    if (inflationDestInd == soci::i_ok)
+    if (!inflationDest.isNull())
     {
-        account.inflationDest.activate() =
-            PubKeyUtils::fromStrKey(inflationDest);
+        inflationDest.get(account.inflationDest.activate());
     }
 
-    account.signers.clear();
-
-    if (account.numSubEntries != 0)
-    {
-        string pubKey;
-        Signer signer;
-
-        auto prep = db.getPreparedStatement("SELECT publickey, weight from "
-                                            "signers where accountid =:id");
-        auto& st = prep.statement();
-        st.exchange(use(actIDStrKey));
-        st.exchange(into(pubKey));
-        st.exchange(into(signer.weight));
-        st.define_and_bind();
-        {
-            auto timer = db.getSelectTimer("signer");
-            st.execute(true);
-        }
-        while (st.got_data())
-        {
-            signer.pubKey = PubKeyUtils::fromStrKey(pubKey);
-
-            account.signers.push_back(signer);
-
-            st.fetch();
-        }
-    }
+    std::vector<uint8_t> signersBytes;
+    signers.get(signersBytes);
+    xdr::xdr_from_opaque(signersBytes, account.signers);
 
     res->normalize();
-    res->mUpdateSigners = false;
 
     res->mKeyCalculated = false;
     res->putCachedEntry(db);
@@ -271,18 +338,32 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
 bool
 AccountFrame::exists(Database& db, LedgerKey const& key)
 {
-    if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
+    std::shared_ptr<LedgerEntry const> p;
+    if (getCachedEntry(key, db, p) && p)
     {
         return true;
     }
+    auto& filter = db.getEntryFilter();
+    if (!filter.mayContain(key))
+    {
+        return false;
+    }
 
-    std::string actIDStrKey = PubKeyUtils::toStrKey(key.account().accountID);
+    BinaryColumn actID(db, db.getSession());
+    actID.set(key.account().accountID);
     int exists = 0;
+    auto prep = db.getPreparedStatement(kAccountExists);
+    auto& st = prep.statement();
+    actID.bindUse(st);
+    st.exchange(into(exists));
+    st.define_and_bind();
     {
         auto timer = db.getSelectTimer("account-exists");
-        db.getSession() << "SELECT EXISTS (SELECT NULL FROM accounts "
-                           "WHERE accountid=:v1)",
-            use(actIDStrKey), into(exists);
+        st.execute(true);
+    }
+    if (exists == 0)
+    {
+        filter.recordFalsePositive();
     }
     return exists != 0;
 }
@@ -295,6 +376,27 @@ AccountFrame::countObjects(soci::session& sess)
     return count;
 }
 
+void
+AccountFrame::loadKeys(Database& db,
+                       std::function<void(LedgerKey const&)> keyProcessor)
+{
+    BinaryColumn actID(db, db.getSession());
+    LedgerKey key;
+    key.type(ACCOUNT);
+
+    auto prep = db.getPreparedStatement(kLoadAccountKeys);
+    auto& st = prep.statement();
+    actID.bindInto(st);
+    st.define_and_bind();
+    st.execute(true);
+    while (st.got_data())
+    {
+        actID.get(key.account().accountID);
+        keyProcessor(key);
+        st.fetch();
+    }
+}
+
 void
 AccountFrame::storeDelete(LedgerDelta& delta, Database& db) const
 {
@@ -304,72 +406,240 @@ AccountFrame::storeDelete(LedgerDelta& delta, Database& db) const
 void
 AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
                           LedgerKey const& key)
+{
+    if (auto state = db.getLedgerState())
+    {
+        state->storeDelete(key);
+    }
+    else
+    {
+        deleteFromDatabase(key, db);
+    }
+    delta.deleteEntry(key);
+}
+
+void
+AccountFrame::deleteFromDatabase(LedgerKey const& key, Database& db)
 {
     flushCachedEntry(key, db);
 
-    std::string actIDStrKey = PubKeyUtils::toStrKey(key.account().accountID);
-    soci::session& session = db.getSession();
+    AccountID const& accountID = key.account().accountID;
+
+    InflationVote before;
+    loadInflationVote(accountID, before, db);
+    updateInflationVotes(before, InflationVote(), db);
+
+    BinaryColumn actID(db, db.getSession());
+    actID.set(accountID);
+    auto prep = db.getPreparedStatement(kDeleteAccount);
+    auto& st = prep.statement();
+    actID.bindUse(st);
+    st.define_and_bind();
     {
         auto timer = db.getDeleteTimer("account");
-        session << "DELETE from accounts where accountid= :v1",
-            soci::use(actIDStrKey);
+        st.execute(true);
+    }
+}
+
+void
+AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert) const
+{
+    if (auto state = db.getLedgerState())
+    {
+        if (insert)
+        {
+            state->storeAdd(mEntry);
+        }
+        else
+        {
+            state->storeChange(mEntry);
+        }
     }
+    else
     {
-        auto timer = db.getDeleteTimer("signer");
-        session << "DELETE from signers where accountid= :v1",
-            soci::use(actIDStrKey);
+        storeUpdateInDatabase(db, insert);
+    }
+
+    if (insert)
+    {
+        delta.addEntry(*this);
+    }
+    else
+    {
+        delta.modEntry(*this);
     }
-    delta.deleteEntry(key);
 }
 
 void
-AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert) const
+AccountFrame::storeInDatabase(LedgerEntry const* previous,
+                              LedgerEntry const& entry, Database& db)
 {
-    flushCachedEntry(db);
+    AccountFrame account(entry);
+    InflationVote before;
+    if (previous)
+    {
+        before = InflationVote(previous->account());
+    }
+    account.storeUpdateInDatabase(db, previous == nullptr, &before);
+}
 
-    std::string actIDStrKey = PubKeyUtils::toStrKey(mAccountEntry.accountID);
-    std::string sql;
+AccountFrame::InflationVote::InflationVote() : mBalance(0)
+{
+}
 
-    if (insert)
+AccountFrame::InflationVote::InflationVote(AccountEntry const& account)
+    : mBalance(0)
+{
+    if (account.inflationDest &&
+        account.balance >= INFLATION_MIN_VOTER_BALANCE)
+    {
+        mDest = PubKeyUtils::toStrKey(*account.inflationDest);
+        mBalance = account.balance;
+    }
+}
+
+void
+AccountFrame::loadInflationVote(AccountID const& accountID,
+                                InflationVote& vote, Database& db)
+{
+    AccountEntry account;
+    BinaryColumn actID(db, db.getSession()), inflationDest(db, db.getSession());
+    actID.set(accountID);
+
+    auto prep = db.getPreparedStatement(kLoadInflationVote);
+    auto& st = prep.statement();
+    st.exchange(into(account.balance));
+    inflationDest.bindInto(st);
+    actID.bindUse(st);
+    st.define_and_bind();
+    {
+        auto timer = db.getSelectTimer("account-vote");
+        st.execute(true);
+    }
+    if (st.got_data() && !inflationDest.isNull())
+    {
+        inflationDest.get(account.inflationDest.activate());
+        vote = InflationVote(account);
+    }
+    else
+    {
+        vote = InflationVote();
+    }
+}
+
+static void
+addInflationVotes(std::string const& dest, int64 votes, Database& db)
+{
+    if (votes == 0)
+    {
+        return;
+    }
+    long long affected;
+    if (votes < 0)
+    {
+        // totals are kept positive: one dropping to 0 is deleted rather than
+        // updated, one that would drop below is out of sync with the accounts
+        int64 removed = -votes;
+        auto prep = db.getPreparedStatement(kDeleteInflationVotes);
+        auto& st = prep.statement();
+        st.exchange(use(dest));
+        st.exchange(use(removed));
+        st.define_and_bind();
+        auto timer = db.getDeleteTimer("inflationvotes");
+        st.execute(true);
+        if (st.get_affected_rows() != 0)
+        {
+            return;
+        }
+    }
+    {
+        auto prep = db.getPreparedStatement(kAddInflationVotes);
+        auto& st = prep.statement();
+        st.exchange(use(votes));
+        st.exchange(use(dest));
+        st.exchange(use(votes));
+        st.define_and_bind();
+        auto timer = db.getUpdateTimer("inflationvotes");
+        st.execute(true);
+        affected = st.get_affected_rows();
+    }
+    if (affected == 0)
     {
-        sql = std::string(
-            "INSERT INTO accounts ( accountid, balance, seqnum, "
-            "numsubentries, inflationdest, homedomain, thresholds, flags) "
-            "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7 )");
+        if (votes < 0)
+        {
+            throw std::runtime_error("inflation votes out of sync");
+        }
+        auto prep = db.getPreparedStatement(kInsertInflationVotes);
+        auto& st = prep.statement();
+        st.exchange(use(dest));
+        st.exchange(use(votes));
+        st.define_and_bind();
+        auto timer = db.getInsertTimer("inflationvotes");
+        st.execute(true);
+    }
+}
+
+void
+AccountFrame::updateInflationVotes(InflationVote const& before,
+                                   InflationVote const& after, Database& db)
+{
+    if (before.mDest == after.mDest)
+    {
+        addInflationVotes(after.mDest, after.mBalance - before.mBalance, db);
     }
     else
     {
-        sql = std::string(
-            "UPDATE accounts SET balance = :v1, seqnum = :v2, "
-            "numsubentries = :v3, "
-            "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
-            "flags = :v7 WHERE accountid = :id");
+        addInflationVotes(before.mDest, -before.mBalance, db);
+        addInflationVotes(after.mDest, after.mBalance, db);
     }
+}
+
+void
+AccountFrame::storeUpdateInDatabase(Database& db, bool insert,
+                                    InflationVote const* before) const
+{
+    flushCachedEntry(db);
 
-    auto prep = db.getPreparedStatement(sql);
+    InflationVote loaded;
+    if (!before)
+    {
+        if (!insert)
+        {
+            loadInflationVote(mAccountEntry.accountID, loaded, db);
+        }
+        before = &loaded;
+    }
 
-    soci::indicator inflation_ind = soci::i_null;
-    string inflationDestStrKey;
+    auto prep =
+        db.getPreparedStatement(insert ? kInsertAccount : kUpdateAccount);
 
+    BinaryColumn actID(db, db.getSession()), inflationDest(db, db.getSession()),
+        signers(db, db.getSession());
+    actID.set(mAccountEntry.accountID);
     if (mAccountEntry.inflationDest)
     {
-        inflationDestStrKey =
-            PubKeyUtils::toStrKey(*mAccountEntry.inflationDest);
-        inflation_ind = soci::i_ok;
+        inflationDest.set(*mAccountEntry.inflationDest);
+    }
+    else
+    {
+        inflationDest.setNull();
     }
 
+    string homeDomain(mAccountEntry.homeDomain);
     string thresholds(bn::encode_b64(mAccountEntry.thresholds));
+    signers.set(xdr::xdr_to_opaque(mAccountEntry.signers));
 
     {
         soci::statement& st = prep.statement();
-        st.exchange(use(actIDStrKey, "id"));
+        actID.bindUse(st, "id");
         st.exchange(use(mAccountEntry.balance, "v1"));
         st.exchange(use(mAccountEntry.seqNum, "v2"));
         st.exchange(use(mAccountEntry.numSubEntries, "v3"));
-        st.exchange(use(inflationDestStrKey, inflation_ind, "v4"));
-        st.exchange(use(string(mAccountEntry.homeDomain), "v5"));
+        inflationDest.bindUse(st, "v4");
+        st.exchange(use(homeDomain, "v5"));
         st.exchange(use(thresholds, "v6"));
         st.exchange(use(mAccountEntry.flags, "v7"));
+        signers.bindUse(st, "v8");
         st.define_and_bind();
         {
             auto timer = insert ? db.getInsertTimer("account")
@@ -381,138 +651,13 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert) const
         {
             throw std::runtime_error("Could not update data in SQL");
         }
-        if (insert)
-        {
-            delta.addEntry(*this);
-        }
-        else
-        {
-            delta.modEntry(*this);
-        }
     }
-
-    if (mUpdateSigners)
+    if (insert)
     {
-        // instead separate signatures from account, just like offers are
-        // separate entities
-        AccountFrame::pointer startAccountFrame;
-        startAccountFrame = loadAccount(getID(), db);
-        if (!startAccountFrame)
-        {
-            throw runtime_error("could not load account!");
-        }
-        AccountEntry& startAccount = startAccountFrame->mAccountEntry;
-
-        // deal with changes to Signers
-        if (mAccountEntry.signers.size() < startAccount.signers.size())
-        { // some signers were removed
-            for (auto const& startSigner : startAccount.signers)
-            {
-                bool found = false;
-                for (auto const& finalSigner : mAccountEntry.signers)
-                {
-                    if (finalSigner.pubKey == startSigner.pubKey)
-                    {
-                        if (finalSigner.weight != startSigner.weight)
-                        {
-                            std::string signerStrKey =
-                                PubKeyUtils::toStrKey(finalSigner.pubKey);
-                            {
-                                auto timer = db.getUpdateTimer("signer");
-                                db.getSession()
-                                    << "UPDATE signers set weight=:v1 where "
-                                       "accountid=:v2 and publickey=:v3",
-                                    use(finalSigner.weight), use(actIDStrKey),
-                                    use(signerStrKey);
-                            }
-                        }
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found)
-                { // delete signer
-                    std::string signerStrKey =
-                        PubKeyUtils::toStrKey(startSigner.pubKey);
-
-                    soci::statement st =
-                        (db.getSession().prepare << "DELETE from signers where "
-                                                    "accountid=:v2 and "
-                                                    "publickey=:v3",
-                         use(actIDStrKey), use(signerStrKey));
-
-                    {
-                        auto timer = db.getDeleteTimer("signer");
-                        st.execute(true);
-                    }
-
-                    if (st.get_affected_rows() != 1)
-                    {
-                        throw std::runtime_error(
-                            "Could not update data in SQL");
-                    }
-                }
-            }
-        }
-        else
-        { // signers added or the same
-            for (auto const& finalSigner : mAccountEntry.signers)
-            {
-                bool found = false;
-                for (auto const& startSigner : startAccount.signers)
-                {
-                    if (finalSigner.pubKey == startSigner.pubKey)
-                    {
-                        if (finalSigner.weight != startSigner.weight)
-                        {
-                            std::string signerStrKey =
-                                PubKeyUtils::toStrKey(finalSigner.pubKey);
-
-                            soci::statement st =
-                                (db.getSession().prepare
-                                     << "UPDATE signers set weight=:v1 where "
-                                        "accountid=:v2 and publickey=:v3",
-                                 use(finalSigner.weight), use(actIDStrKey),
-                                 use(signerStrKey));
-
-                            st.execute(true);
-
-                            if (st.get_affected_rows() != 1)
-                            {
-                                throw std::runtime_error(
-                                    "Could not update data in SQL");
-                            }
-                        }
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found)
-                { // new signer
-                    std::string signerStrKey =
-                        PubKeyUtils::toStrKey(finalSigner.pubKey);
-
-                    soci::statement st = (db.getSession().prepare
-                                              << "INSERT INTO signers "
-                                                 "(accountid,publickey,weight) "
-                                                 "VALUES (:v1,:v2,:v3)",
-                                          use(actIDStrKey), use(signerStrKey),
-                                          use(finalSigner.weight));
-
-                    st.execute(true);
-
-                    if (st.get_affected_rows() != 1)
-                    {
-                        throw std::runtime_error(
-                            "Could not update data in SQL");
-                    }
-                }
-            }
-        }
-
-        // Flush again to ensure changed signers are reloaded.
-        flushCachedEntry(db);
+        db.getEntryFilter().add(getKey());
     }
+
+    updateInflationVotes(*before, InflationVote(mAccountEntry), db);
 }
 
 void
@@ -532,21 +677,23 @@ AccountFrame::processForInflation(
     std::function<bool(AccountFrame::InflationVotes const&)> inflationProcessor,
     int maxWinners, Database& db)
 {
-    soci::session& session = db.getSession();
-
+    if (auto state = db.getLedgerState())
+    {
+        state->flush();
+    }
     InflationVotes v;
     std::string inflationDest;
 
-    soci::statement st =
-        (session.prepare
-             << "SELECT"
-                " sum(balance) AS votes, inflationdest FROM accounts WHERE"
-                " inflationdest IS NOT NULL"
-                " AND balance >= 1000000000 GROUP BY inflationdest"
-                " ORDER BY votes DESC, inflationdest DESC LIMIT :lim",
-         into(v.mVotes), into(inflationDest), use(maxWinners));
-
-    st.execute(true);
+    auto prep = db.getPreparedStatement(kInflationWinners);
+    auto& st = prep.statement();
+    st.exchange(into(v.mVotes));
+    st.exchange(into(inflationDest));
+    st.exchange(use(maxWinners));
+    st.define_and_bind();
+    {
+        auto timer = db.getSelectTimer("inflation");
+        st.execute(true);
+    }
 
     while (st.got_data())
     {
@@ -559,15 +706,176 @@ AccountFrame::processForInflation(
     }
 }
 
+// sums the votes of every destination from the accounts table
+static std::map<std::string, int64>
+tallyInflationVotes(Database& db)
+{
+    std::map<std::string, int64> res;
+    BinaryColumn dest(db, db.getSession());
+    PublicKey destKey;
+    int64 votes;
+
+    auto prep = db.getPreparedStatement(kTallyInflationVotes);
+    auto& st = prep.statement();
+    dest.bindInto(st);
+    st.exchange(into(votes));
+    st.define_and_bind();
+    {
+        auto timer = db.getSelectTimer("inflation-tally");
+        st.execute(true);
+    }
+    while (st.got_data())
+    {
+        dest.get(destKey);
+        res[PubKeyUtils::toStrKey(destKey)] = votes;
+        st.fetch();
+    }
+    return res;
+}
+
+void
+AccountFrame::rebuildInflationVotes(Database& db)
+{
+    soci::session& session = db.getSession();
+    session << "DROP TABLE IF EXISTS inflationvotes;";
+    session << kSQLCreateStatement2;
+    session << kSQLCreateStatement3;
+
+    std::string dest;
+    int64 votes;
+    soci::statement ins =
+        (session.prepare << "INSERT INTO inflationvotes (inflationdest, votes) "
+                            "VALUES (:v1, :v2)",
+         use(dest), use(votes));
+    for (auto const& v : tallyInflationVotes(db))
+    {
+        dest = v.first;
+        votes = v.second;
+        ins.execute(true);
+    }
+}
+
+void
+AccountFrame::checkInflationVotes(Database& db)
+{
+    std::map<std::string, int64> actual;
+    std::string dest;
+    int64 votes;
+
+    soci::statement table =
+        (db.getSession().prepare
+             << "SELECT inflationdest, votes FROM inflationvotes",
+         into(dest), into(votes));
+    table.execute();
+    while (table.fetch())
+    {
+        actual[dest] = votes;
+    }
+
+    if (tallyInflationVotes(db) != actual)
+    {
+        throw std::runtime_error(
+            "Inconsistent state ; inflationvotes doesn't match accounts");
+    }
+}
+
+void
+AccountFrame::convertSignersToBinary(Database& db)
+{
+    auto& sess = db.getSession();
+    sess << "ALTER TABLE accounts ADD COLUMN signers " +
+                db.getBinaryColumnType();
+
+    BinaryColumn signers(db, sess);
+    std::string actIDStrKey;
+
+    soci::statement upd(sess);
+    signers.bindUse(upd);
+    upd.exchange(use(actIDStrKey));
+    upd.alloc();
+    upd.prepare("UPDATE accounts SET signers = :v1 WHERE accountid = :v2");
+    upd.define_and_bind();
+
+    // rows come grouped by account; each group is written with one update
+    std::string rowAccount, pubKey;
+    Signer signer;
+    AccountEntry current;
+    size_t n = 0;
+    auto flush = [&]()
+    {
+        signers.set(xdr::xdr_to_opaque(current.signers));
+        upd.execute(true);
+        ++n;
+    };
+
+    soci::statement sel =
+        (sess.prepare << "SELECT accountid, publickey, weight FROM signers "
+                         "ORDER BY accountid",
+         into(rowAccount), into(pubKey), into(signer.weight));
+    sel.execute(true);
+    while (sel.got_data())
+    {
+        if (rowAccount != actIDStrKey)
+        {
+            if (!actIDStrKey.empty())
+            {
+                flush();
+            }
+            actIDStrKey = rowAccount;
+            current.signers.clear();
+        }
+        signer.pubKey = PubKeyUtils::fromStrKey(pubKey);
+        current.signers.push_back(signer);
+        sel.fetch();
+    }
+    if (!actIDStrKey.empty())
+    {
+        flush();
+    }
+
+    // every other account has no signers
+    AccountEntry none;
+    signers.set(xdr::xdr_to_opaque(none.signers));
+    soci::statement rest(sess);
+    signers.bindUse(rest);
+    rest.alloc();
+    rest.prepare("UPDATE accounts SET signers = :v1 WHERE signers IS NULL");
+    rest.define_and_bind();
+    rest.execute(true);
+
+    sess << "DROP TABLE signers";
+    CLOG(INFO, "Database") << "Moved the signers of " << n
+                           << " accounts into the accounts table";
+}
+
+void
+AccountFrame::convertKeysToBinary(Database& db)
+{
+    auto& sess = db.getSession();
+    sess << "DROP TABLE IF EXISTS accountsbin";
+    createAccountsTable(db, "accountsbin");
+    sess << "INSERT INTO accountsbin (accountid, balance, seqnum, "
+            "numsubentries, inflationdest, homedomain, thresholds, flags, "
+            "signers) "
+            "SELECT k.rawkey, a.balance, a.seqnum, a.numsubentries, d.rawkey, "
+            "a.homedomain, a.thresholds, a.flags, a.signers "
+            "FROM accounts a JOIN strkeys k ON k.strkey = a.accountid "
+            "LEFT JOIN strkeys d ON d.strkey = a.inflationdest";
+    sess << "DROP TABLE accounts";
+    sess << "ALTER TABLE accountsbin RENAME TO accounts";
+    sess << kSQLCreateStatement1;
+}
+
 void
 AccountFrame::dropAll(Database& db)
 {
     db.getSession() << "DROP TABLE IF EXISTS accounts;";
     db.getSession() << "DROP TABLE IF EXISTS signers;";
+    db.getSession() << "DROP TABLE IF EXISTS inflationvotes;";
 
+    createAccountsTable(db, "accounts");
     db.getSession() << kSQLCreateStatement1;
     db.getSession() << kSQLCreateStatement2;
     db.getSession() << kSQLCreateStatement3;
-    db.getSession() << kSQLCreateStatement4;
 }
 }
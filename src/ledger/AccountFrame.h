@@ -7,6 +7,7 @@
 #include "ledger/EntryFrame.h"
 #include <functional>
 #include <map>
+#include <string>
 
 namespace soci
 {
@@ -23,8 +24,27 @@ class LedgerManager;
 
 class AccountFrame : public EntryFrame
 {
+    // what an account contributes to the inflationvotes table: nothing
+    // (empty mDest) unless it sets an inflation destination and holds enough
+    struct InflationVote
+    {
+        std::string mDest;
+        int64 mBalance;
+
+        InflationVote();
+        explicit InflationVote(AccountEntry const& account);
+    };
+
+    static void loadInflationVote(AccountID const& accountID,
+                                  InflationVote& vote, Database& db);
+    static void updateInflationVotes(InflationVote const& before,
+                                     InflationVote const& after, Database& db);
+
     void storeUpdate(LedgerDelta& delta, Database& db, bool insert) const;
-    bool mUpdateSigners;
+    // `before` is the vote of the account as currently stored; it is loaded
+    // from the database when not known
+    void storeUpdateInDatabase(Database& db, bool insert,
+                               InflationVote const* before = nullptr) const;
 
     AccountEntry& mAccountEntry;
 
@@ -48,11 +68,11 @@ class AccountFrame : public EntryFrame
         return EntryFrame::pointer(new AccountFrame(*this));
     }
 
+    // to be called after changing the signers: they are stored sorted
     void
     setUpdateSigners()
     {
         normalize();
-        mUpdateSigners = true;
     }
 
     // actual balance for the account
@@ -111,11 +131,22 @@ class AccountFrame : public EntryFrame
                             LedgerKey const& key);
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
+    // calls keyProcessor with the key of every account in the database
+    static void
+    loadKeys(Database& db,
+             std::function<void(LedgerKey const&)> keyProcessor);
 
     // database utilities
     static AccountFrame::pointer loadAccount(AccountID const& accountID,
                                              Database& db);
 
+    // see EntryFrame::loadFromDatabase and friends
+    static AccountFrame::pointer
+    loadAccountFromDatabase(AccountID const& accountID, Database& db);
+    static void storeInDatabase(LedgerEntry const* previous,
+                                LedgerEntry const& entry, Database& db);
+    static void deleteFromDatabase(LedgerKey const& key, Database& db);
+
     // inflation helper
 
     struct InflationVotes
@@ -124,15 +155,26 @@ class AccountFrame : public EntryFrame
         AccountID mInflationDest;
     };
 
-    // inflationProcessor returns true to continue processing, false otherwise
+    // inflationProcessor returns true to continue processing, false otherwise;
+    // destinations are visited by decreasing number of votes
     static void processForInflation(
         std::function<bool(InflationVotes const&)> inflationProcessor,
         int maxWinners, Database& db);
 
+    // recreates the inflationvotes table from the accounts table
+    static void rebuildInflationVotes(Database& db);
+    // throws if the inflationvotes table doesn't match the accounts table
+    static void checkInflationVotes(Database& db);
+
     static void dropAll(Database& db);
+    // moves the rows of the former signers table into accounts.signers
+    static void convertSignersToBinary(Database& db);
+    // rewrites the StrKey columns as binary, mapping them through the strkeys
+    // table set up by Database::convertKeysToBinary
+    static void convertKeysToBinary(Database& db);
+
     static const char* kSQLCreateStatement1;
     static const char* kSQLCreateStatement2;
     static const char* kSQLCreateStatement3;
-    static const char* kSQLCreateStatement4;
 };
 }
@@ -11,6 +11,7 @@
 #include "xdrpp/marshal.h"
 #include "crypto/Hex.h"
 #include "database/Database.h"
+#include "ledger/LedgerState.h"
 
 namespace stellar
 {
@@ -65,26 +66,83 @@ EntryFrame::storeLoad(LedgerKey const& key, Database& db)
     return res;
 }
 
+EntryFrame::pointer
+EntryFrame::loadFromDatabase(LedgerKey const& key, Database& db)
+{
+    EntryFrame::pointer res;
+
+    switch (key.type())
+    {
+    case ACCOUNT:
+        res = std::static_pointer_cast<EntryFrame>(
+            AccountFrame::loadAccountFromDatabase(key.account().accountID, db));
+        break;
+    case TRUSTLINE:
+    {
+        auto const& tl = key.trustLine();
+        res = std::static_pointer_cast<EntryFrame>(
+            TrustFrame::loadTrustLineFromDatabase(tl.accountID, tl.asset, db));
+    }
+    break;
+    case OFFER:
+    {
+        auto const& off = key.offer();
+        res = std::static_pointer_cast<EntryFrame>(
+            OfferFrame::loadOfferFromDatabase(off.sellerID, off.offerID, db));
+    }
+    break;
+    }
+    return res;
+}
+
 void
-EntryFrame::flushCachedEntry(LedgerKey const& key, Database& db)
+EntryFrame::storeInDatabase(LedgerEntry const* previous,
+                            LedgerEntry const& entry, Database& db)
 {
-    auto s = binToHex(xdr::xdr_to_opaque(key));
-    db.getEntryCache().erase_if_exists(s);
+    switch (entry.type())
+    {
+    case ACCOUNT:
+        AccountFrame::storeInDatabase(previous, entry, db);
+        break;
+    case TRUSTLINE:
+        TrustFrame::storeInDatabase(previous, entry, db);
+        break;
+    case OFFER:
+        OfferFrame::storeInDatabase(previous, entry, db);
+        break;
+    }
 }
 
+void
+EntryFrame::deleteFromDatabase(LedgerKey const& key, Database& db)
+{
+    switch (key.type())
+    {
+    case ACCOUNT:
+        AccountFrame::deleteFromDatabase(key, db);
+        break;
+    case TRUSTLINE:
+        TrustFrame::deleteFromDatabase(key, db);
+        break;
+    case OFFER:
+        OfferFrame::deleteFromDatabase(key, db);
+        break;
+    }
+}
 
-bool
-EntryFrame::cachedEntryExists(LedgerKey const& key, Database& db)
+void
+EntryFrame::flushCachedEntry(LedgerKey const& key, Database& db)
 {
     auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().exists(s);
+    db.getEntryCache().erase(s);
 }
 
-std::shared_ptr<LedgerEntry const>
-EntryFrame::getCachedEntry(LedgerKey const& key, Database& db)
+bool
+EntryFrame::getCachedEntry(LedgerKey const& key, Database& db,
+                           std::shared_ptr<LedgerEntry const>& entry)
 {
     auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().get(s);
+    return db.getEntryCache().maybeGet(s, entry);
 }
 
 void
@@ -160,6 +218,10 @@ EntryFrame::storeAddOrChange(LedgerDelta& delta, Database& db) const
 bool
 EntryFrame::exists(Database& db, LedgerKey const& key)
 {
+    if (auto state = db.getLedgerState())
+    {
+        return state->load(key) != nullptr;
+    }
     switch (key.type())
     {
     case ACCOUNT:
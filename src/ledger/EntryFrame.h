@@ -42,11 +42,20 @@ class EntryFrame : public NonMovableOrCopyable
     static pointer FromXDR(LedgerEntry const& from);
     static pointer storeLoad(LedgerKey const& key, Database& db);
 
+    // Database access bypassing any active LedgerState, for use by it:
+    // storeInDatabase writes `entry` over `previous`, the version currently
+    // in the database (null if there is none).
+    static pointer loadFromDatabase(LedgerKey const& key, Database& db);
+    static void storeInDatabase(LedgerEntry const* previous,
+                                LedgerEntry const& entry, Database& db);
+    static void deleteFromDatabase(LedgerKey const& key, Database& db);
+
     // Static helpers for working with the DB LedgerEntry cache.
     static void flushCachedEntry(LedgerKey const& key, Database& db);
-    static bool cachedEntryExists(LedgerKey const& key, Database& db);
-    static std::shared_ptr<LedgerEntry const> getCachedEntry(
-        LedgerKey const& key, Database& db);
+    // Returns false if `key` is not cached; otherwise sets `entry`, to null
+    // if `key` is cached as absent from the database.
+    static bool getCachedEntry(LedgerKey const& key, Database& db,
+                               std::shared_ptr<LedgerEntry const>& entry);
     static void putCachedEntry(LedgerKey const& key,
                                std::shared_ptr<LedgerEntry const> p,
                                Database& db);
@@ -3,13 +3,17 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/LedgerDelta.h"
+#include "ledger/AccountFrame.h"
 #include "xdr/Stellar-ledger.h"
 #include "main/Application.h"
 #include "main/Config.h"
-#include "medida/metrics_registry.h"
-#include "medida/meter.h"
+#include "util/ShardedMetrics.h"
+#include "util/make_unique.h"
 #include "xdrpp/printer.h"
 
+#include <algorithm>
+#include <cassert>
+
 namespace stellar
 {
 using xdr::operator==;
@@ -19,6 +23,8 @@ LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
     , mHeader(&outerDelta.getHeader())
     , mCurrentHeader(outerDelta.getHeader())
     , mPreviousHeaderValue(outerDelta.getHeader())
+    , mArena(outerDelta.mArena)
+    , mSortedValid(false)
 {
 }
 
@@ -27,6 +33,9 @@ LedgerDelta::LedgerDelta(LedgerHeader& header)
     , mHeader(&header)
     , mCurrentHeader(header)
     , mPreviousHeaderValue(header)
+    , mOwnArena(make_unique<Arena>())
+    , mArena(*mOwnArena)
+    , mSortedValid(false)
 {
 }
 
@@ -52,94 +61,157 @@ LedgerDelta::checkState()
     }
 }
 
+LedgerDelta::Change*
+LedgerDelta::find(LedgerKey const& key, size_t hash)
+{
+    if (mIndex.empty())
+    {
+        return nullptr;
+    }
+    size_t mask = mIndex.size() - 1;
+    for (size_t i = hash & mask; mIndex[i] != 0; i = (i + 1) & mask)
+    {
+        auto& c = mChanges[mIndex[i] - 1];
+        if (c.mHash == hash && c.mKey == key)
+        {
+            return &c;
+        }
+    }
+    return nullptr;
+}
+
+void
+LedgerDelta::growIndex()
+{
+    std::vector<uint32_t> index(mIndex.empty() ? 16 : mIndex.size() * 2, 0);
+    size_t mask = index.size() - 1;
+    for (uint32_t pos = 0; pos < mChanges.size(); ++pos)
+    {
+        size_t i = mChanges[pos].mHash & mask;
+        while (index[i] != 0)
+        {
+            i = (i + 1) & mask;
+        }
+        index[i] = pos + 1;
+    }
+    mIndex.swap(index);
+}
+
+LedgerDelta::Change&
+LedgerDelta::insert(LedgerKey const& key, size_t hash, ChangeType type,
+                    LedgerEntry const* entry)
+{
+    // keep the index at most half full
+    if ((mChanges.size() + 1) * 2 > mIndex.size())
+    {
+        mChanges.push_back(Change{key, hash, entry, type});
+        growIndex();
+    }
+    else
+    {
+        mChanges.push_back(Change{key, hash, entry, type});
+        size_t mask = mIndex.size() - 1;
+        size_t i = hash & mask;
+        while (mIndex[i] != 0)
+        {
+            i = (i + 1) & mask;
+        }
+        mIndex[i] = static_cast<uint32_t>(mChanges.size());
+    }
+    return mChanges.back();
+}
+
 void
 LedgerDelta::addEntry(EntryFrame const& entry)
 {
-    addEntry(entry.copy());
+    addEntry(entry.getKey(), mArena.copy(entry.mEntry));
 }
 
 void
 LedgerDelta::deleteEntry(EntryFrame const& entry)
 {
-    deleteEntry(entry.copy());
+    deleteEntry(entry.getKey());
 }
 
 void
 LedgerDelta::modEntry(EntryFrame const& entry)
 {
-    modEntry(entry.copy());
+    modEntry(entry.getKey(), mArena.copy(entry.mEntry));
 }
 
 void
-LedgerDelta::addEntry(EntryFrame::pointer entry)
+LedgerDelta::addEntry(LedgerKey const& k, LedgerEntry const* entry)
 {
     checkState();
-    auto k = entry->getKey();
-    auto del_it = mDelete.find(k);
-    if (del_it != mDelete.end())
+    mSortedValid = false;
+    auto h = LedgerEntryIdHash()(k);
+    auto c = find(k, h);
+    if (!c)
+    {
+        insert(k, h, CHANGE_NEW, entry);
+    }
+    else if (c->mType == CHANGE_DELETE)
     {
         // delete + new is an update
-        mDelete.erase(del_it);
-        mMod[k] = entry;
+        c->mType = CHANGE_MOD;
+        c->mEntry = entry;
     }
     else
     {
-        assert(mNew.find(k) == mNew.end()); // double new
-        assert(mMod.find(k) == mMod.end()); // mod + new is invalid
-        mNew[k] = entry;
+        assert(c->mType != CHANGE_NEW); // double new
+        assert(c->mType != CHANGE_MOD); // mod + new is invalid
+        c->mType = CHANGE_NEW;
+        c->mEntry = entry;
     }
 }
 
-void
-LedgerDelta::deleteEntry(EntryFrame::pointer entry)
-{
-    auto k = entry->getKey();
-    deleteEntry(k);
-}
-
 void
 LedgerDelta::deleteEntry(LedgerKey const& k)
 {
     checkState();
-    auto new_it = mNew.find(k);
-    if (new_it != mNew.end())
+    mSortedValid = false;
+    auto h = LedgerEntryIdHash()(k);
+    auto c = find(k, h);
+    if (!c)
+    {
+        insert(k, h, CHANGE_DELETE, nullptr);
+    }
+    else if (c->mType == CHANGE_NEW)
     {
         // new + delete -> don't add it in the first place
-        mNew.erase(new_it);
+        c->mType = CHANGE_NONE;
+        c->mEntry = nullptr;
     }
     else
     {
-        assert(mDelete.find(k) == mDelete.end()); // double delete is invalid
+        assert(c->mType != CHANGE_DELETE); // double delete is invalid
         // only keep the delete
-        mMod.erase(k);
-        mDelete.insert(k);
+        c->mType = CHANGE_DELETE;
+        c->mEntry = nullptr;
     }
 }
 
 void
-LedgerDelta::modEntry(EntryFrame::pointer entry)
+LedgerDelta::modEntry(LedgerKey const& k, LedgerEntry const* entry)
 {
     checkState();
-    auto k = entry->getKey();
-    auto mod_it = mMod.find(k);
-    if (mod_it != mMod.end())
+    mSortedValid = false;
+    auto h = LedgerEntryIdHash()(k);
+    auto c = find(k, h);
+    if (!c)
     {
-        // collapse mod
-        mod_it->second = entry;
+        insert(k, h, CHANGE_MOD, entry);
+    }
+    else if (c->mType == CHANGE_MOD || c->mType == CHANGE_NEW)
+    {
+        // collapse mod; new + mod = new (with latest value)
+        c->mEntry = entry;
     }
     else
     {
-        auto new_it = mNew.find(k);
-        if (new_it != mNew.end())
-        {
-            // new + mod = new (with latest value)
-            new_it->second = entry;
-        }
-        else
-        {
-            assert(mDelete.find(k) == mDelete.end()); // delete + mod is illegal
-            mMod[k] = entry;
-        }
+        assert(c->mType != CHANGE_DELETE); // delete + mod is illegal
+        c->mType = CHANGE_MOD;
+        c->mEntry = entry;
     }
 }
 
@@ -147,17 +219,46 @@ void
 LedgerDelta::mergeEntries(LedgerDelta& other)
 {
     checkState();
-    for (auto& d : other.mDelete)
-    {
-        deleteEntry(d);
-    }
-    for (auto& n : other.mNew)
+    // entries live in the shared arena, so only pointers are passed on
+    for (auto const& c : other.mChanges)
     {
-        addEntry(n.second);
+        switch (c.mType)
+        {
+        case CHANGE_NONE:
+            break;
+        case CHANGE_NEW:
+            addEntry(c.mKey, c.mEntry);
+            break;
+        case CHANGE_MOD:
+            modEntry(c.mKey, c.mEntry);
+            break;
+        case CHANGE_DELETE:
+            deleteEntry(c.mKey);
+            break;
+        }
     }
-    for (auto& m : other.mMod)
+}
+
+void
+LedgerDelta::mergeDelta(LedgerDelta const& other)
+{
+    checkState();
+    for (auto const& c : other.mChanges)
     {
-        modEntry(m.second);
+        switch (c.mType)
+        {
+        case CHANGE_NONE:
+            break;
+        case CHANGE_NEW:
+            addEntry(c.mKey, mArena.copy(*c.mEntry));
+            break;
+        case CHANGE_MOD:
+            modEntry(c.mKey, mArena.copy(*c.mEntry));
+            break;
+        case CHANGE_DELETE:
+            deleteEntry(c.mKey);
+            break;
+        }
     }
 }
 
@@ -187,26 +288,62 @@ LedgerDelta::rollback()
     mHeader = nullptr;
 }
 
+std::vector<uint32_t> const&
+LedgerDelta::sortedChanges() const
+{
+    if (!mSortedValid)
+    {
+        mSorted.clear();
+        for (uint32_t pos = 0; pos < mChanges.size(); ++pos)
+        {
+            if (mChanges[pos].mType != CHANGE_NONE)
+            {
+                mSorted.push_back(pos);
+            }
+        }
+        LedgerEntryIdCmp cmp;
+        std::sort(mSorted.begin(), mSorted.end(),
+                  [this, &cmp](uint32_t a, uint32_t b)
+                  {
+                      return cmp(mChanges[a].mKey, mChanges[b].mKey);
+                  });
+        mSortedValid = true;
+    }
+    return mSorted;
+}
+
 LedgerEntryChanges
 LedgerDelta::getChanges() const
 {
     LedgerEntryChanges changes;
+    auto const& sorted = sortedChanges();
 
-    for (auto const& k : mNew)
+    for (auto pos : sorted)
     {
-        changes.emplace_back(LEDGER_ENTRY_CREATED);
-        changes.back().created() = k.second->mEntry;
+        auto const& c = mChanges[pos];
+        if (c.mType == CHANGE_NEW)
+        {
+            changes.emplace_back(LEDGER_ENTRY_CREATED);
+            changes.back().created() = *c.mEntry;
+        }
     }
-    for (auto const& k : mMod)
+    for (auto pos : sorted)
     {
-        changes.emplace_back(LEDGER_ENTRY_UPDATED);
-        changes.back().updated() = k.second->mEntry;
+        auto const& c = mChanges[pos];
+        if (c.mType == CHANGE_MOD)
+        {
+            changes.emplace_back(LEDGER_ENTRY_UPDATED);
+            changes.back().updated() = *c.mEntry;
+        }
     }
-
-    for (auto const& k : mDelete)
+    for (auto pos : sorted)
     {
-        changes.emplace_back(LEDGER_ENTRY_REMOVED);
-        changes.back().removed() = k;
+        auto const& c = mChanges[pos];
+        if (c.mType == CHANGE_DELETE)
+        {
+            changes.emplace_back(LEDGER_ENTRY_REMOVED);
+            changes.back().removed() = c.mKey;
+        }
     }
 
     return changes;
@@ -216,16 +353,16 @@ std::vector<LedgerEntry>
 LedgerDelta::getLiveEntries() const
 {
     std::vector<LedgerEntry> live;
+    auto const& sorted = sortedChanges();
 
-    live.reserve(mNew.size() + mMod.size());
-
-    for (auto const& k : mNew)
+    live.reserve(sorted.size());
+    for (auto pos : sorted)
     {
-        live.push_back(k.second->mEntry);
-    }
-    for (auto const& k : mMod)
-    {
-        live.push_back(k.second->mEntry);
+        auto const& c = mChanges[pos];
+        if (c.mType == CHANGE_NEW || c.mType == CHANGE_MOD)
+        {
+            live.push_back(*c.mEntry);
+        }
     }
 
     return live;
@@ -236,83 +373,100 @@ LedgerDelta::getDeadEntries() const
 {
     std::vector<LedgerKey> dead;
 
-    dead.reserve(mDelete.size());
-
-    for (auto const& k : mDelete)
+    for (auto pos : sortedChanges())
     {
-        dead.push_back(k);
+        auto const& c = mChanges[pos];
+        if (c.mType == CHANGE_DELETE)
+        {
+            dead.push_back(c.mKey);
+        }
     }
     return dead;
 }
 
-void
-LedgerDelta::markMeters(Application& app) const
+std::vector<LedgerKey>
+LedgerDelta::getChangedKeys() const
 {
-    for (auto const& ke : mNew)
+    std::vector<LedgerKey> keys;
+    keys.reserve(mChanges.size());
+    for (auto const& c : mChanges)
     {
-        switch (ke.first.type())
+        if (c.mType != CHANGE_NONE)
         {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "add"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "add"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "add"}, "entry")
-                .Mark();
-            break;
+            keys.push_back(c.mKey);
         }
     }
+    return keys;
+}
+
+namespace
+{
+// metrics marked for every delta: looked up once per application
+struct DeltaMeters
+{
+    // indexed by LedgerEntryType, then by change type
+    std::vector<std::vector<ShardedMeter*>> mEntries;
+    ShardedHistogram& mAllocations;
 
-    for (auto const& ke : mMod)
+    explicit DeltaMeters(ShardedMetrics& metrics)
+        : mAllocations(metrics.NewHistogram({"ledger", "delta", "allocations"}))
     {
-        switch (ke.first.type())
+        char const* types[] = {"account", "trust", "offer"};
+        char const* actions[] = {"add", "modify", "delete"};
+        for (auto type : types)
         {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "modify"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "modify"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "modify"}, "entry")
-                .Mark();
-            break;
+            mEntries.emplace_back();
+            for (auto action : actions)
+            {
+                mEntries.back().push_back(
+                    &metrics.NewMeter({"ledger", type, action}, "entry"));
+            }
         }
     }
+};
+}
 
-    for (auto const& ke : mDelete)
+void
+LedgerDelta::markMeters(Application& app) const
+{
+    auto& meters = app.getShardedMetrics().getHandles<DeltaMeters>();
+    for (auto const& c : mChanges)
     {
-        switch (ke.type())
+        size_t action;
+        switch (c.mType)
+        {
+        case CHANGE_NEW:
+            action = 0;
+            break;
+        case CHANGE_MOD:
+            action = 1;
+            break;
+        case CHANGE_DELETE:
+            action = 2;
+            break;
+        default:
+            continue;
+        }
+        size_t type;
+        switch (c.mKey.type())
         {
         case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "delete"}, "entry")
-                .Mark();
+            type = 0;
             break;
         case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "delete"}, "entry")
-                .Mark();
+            type = 1;
             break;
         case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "delete"}, "entry")
-                .Mark();
+            type = 2;
             break;
+        default:
+            continue;
         }
+        meters.mEntries[type][action]->Mark();
     }
+
+    // entries copied into the arena while closing the ledger
+    meters.mAllocations.Update(mArena.size());
 }
 
 void
@@ -339,5 +493,16 @@ LedgerDelta::checkAgainstDatabase(Application& app) const
             throw std::runtime_error(s);
         }
     }
+
+    bool accountsChanged =
+        std::any_of(mChanges.begin(), mChanges.end(), [](Change const& c)
+                    {
+                        return c.mType != CHANGE_NONE &&
+                               c.mKey.type() == ACCOUNT;
+                    });
+    if (accountsChanged)
+    {
+        AccountFrame::checkInflationVotes(db);
+    }
 }
 }
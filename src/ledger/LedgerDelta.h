@@ -4,11 +4,13 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
-#include <map>
-#include <set>
+#include <deque>
+#include <memory>
+#include <vector>
 #include "ledger/EntryFrame.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "bucket/LedgerCmp.h"
+#include "util/NonCopyable.h"
 #include "xdrpp/marshal.h"
 
 namespace stellar
@@ -17,8 +19,45 @@ class Application;
 
 class LedgerDelta
 {
-    typedef std::map<LedgerKey, EntryFrame::pointer, LedgerEntryIdCmp>
-        KeyEntryMap;
+  public:
+    // Copies of the entries recorded by a top-level delta and by all the
+    // deltas nested in it. Nothing is freed before the top-level delta goes
+    // away, so nested deltas hand entries to their outer delta by pointer.
+    class Arena : NonMovableOrCopyable
+    {
+        std::deque<LedgerEntry> mEntries;
+
+      public:
+        LedgerEntry const*
+        copy(LedgerEntry const& entry)
+        {
+            mEntries.push_back(entry);
+            return &mEntries.back();
+        }
+
+        size_t
+        size() const
+        {
+            return mEntries.size();
+        }
+    };
+
+  private:
+    enum ChangeType
+    {
+        CHANGE_NONE, // created then deleted within this delta
+        CHANGE_NEW,
+        CHANGE_MOD,
+        CHANGE_DELETE
+    };
+
+    struct Change
+    {
+        LedgerKey mKey;
+        size_t mHash;
+        LedgerEntry const* mEntry; // null unless NEW or MOD
+        ChangeType mType;
+    };
 
     LedgerDelta*
         mOuterDelta;       // set when this delta is nested inside another delta
@@ -28,15 +67,29 @@ class LedgerDelta
     // ledger header itself
     LedgerHeaderFrame mCurrentHeader;
     LedgerHeader mPreviousHeaderValue;
-    // ledger entries
-    KeyEntryMap mNew;
-    KeyEntryMap mMod;
-    std::set<LedgerKey, LedgerEntryIdCmp> mDelete;
+
+    std::unique_ptr<Arena> mOwnArena; // only for top-level deltas
+    Arena& mArena;
+
+    // ledger entries, one Change per key in order of first use, found by
+    // key through an open-addressing hash index holding positions + 1 in
+    // mChanges (0 marks a free slot)
+    std::vector<Change> mChanges;
+    std::vector<uint32_t> mIndex;
+
+    // positions in mChanges sorted by key, built on demand for output
+    mutable std::vector<uint32_t> mSorted;
+    mutable bool mSortedValid;
 
     void checkState();
-    void addEntry(EntryFrame::pointer entry);
-    void deleteEntry(EntryFrame::pointer entry);
-    void modEntry(EntryFrame::pointer entry);
+    Change* find(LedgerKey const& key, size_t hash);
+    Change& insert(LedgerKey const& key, size_t hash, ChangeType type,
+                   LedgerEntry const* entry);
+    void growIndex();
+    std::vector<uint32_t> const& sortedChanges() const;
+
+    void addEntry(LedgerKey const& key, LedgerEntry const* entry);
+    void modEntry(LedgerKey const& key, LedgerEntry const* entry);
 
     // merge "other" into current ledgerDelta
     void mergeEntries(LedgerDelta& other);
@@ -59,6 +112,12 @@ class LedgerDelta
     void deleteEntry(LedgerKey const& key);
     void modEntry(EntryFrame const& entry);
 
+    // records the entry changes of `other`, a top-level delta started from
+    // this delta's header, as if it had been nested in this one and
+    // committed; entries are copied into this delta's arena. The header of
+    // `other` is ignored.
+    void mergeDelta(LedgerDelta const& other);
+
     // commits this delta into outer delta
     void commit();
     // aborts any changes pending
@@ -66,11 +125,16 @@ class LedgerDelta
 
     void markMeters(Application& app) const;
 
+    // these are sorted by key
     std::vector<LedgerEntry> getLiveEntries() const;
     std::vector<LedgerKey> getDeadEntries() const;
 
     LedgerEntryChanges getChanges() const;
 
+    // keys of the entries created, modified or deleted, in no particular
+    // order
+    std::vector<LedgerKey> getChangedKeys() const;
+
     // performs sanity checks against the local state
     void checkAgainstDatabase(Application& app) const;
 };
@@ -0,0 +1,142 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerEntryFilter.h"
+#include "bucket/LedgerCmp.h"
+#include "database/Database.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/TrustFrame.h"
+#include "util/Logging.h"
+
+#include "medida/counter.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <algorithm>
+
+namespace stellar
+{
+
+LedgerEntryFilter::LedgerEntryFilter(medida::MetricsRegistry& metrics)
+    : mFilter(DEFAULT_CAPACITY)
+    , mEnabled(false)
+    , mNeedsRebuild(false)
+    , mNegative(
+          metrics.NewMeter({"ledger", "filter", "negative"}, "lookup"))
+    , mFalsePositive(
+          metrics.NewMeter({"ledger", "filter", "false-positive"}, "lookup"))
+    , mBytes(metrics.NewCounter({"ledger", "filter", "bytes"}))
+{
+    mBytes.set_count(mFilter.memoryUsage());
+}
+
+bool
+LedgerEntryFilter::isTracked(LedgerKey const& key)
+{
+    return key.type() == ACCOUNT || key.type() == TRUSTLINE;
+}
+
+uint64_t
+LedgerEntryFilter::hashKey(LedgerKey const& key)
+{
+    // all 64 bits of LedgerEntryIdHash are well mixed: the bucket index and
+    // the fingerprint can each take some of them
+    return LedgerEntryIdHash()(key);
+}
+
+bool
+LedgerEntryFilter::mayContain(LedgerKey const& key)
+{
+    if (!mEnabled || !isTracked(key) || mFilter.contains(hashKey(key)))
+    {
+        return true;
+    }
+    mNegative.Mark();
+    return false;
+}
+
+void
+LedgerEntryFilter::recordFalsePositive()
+{
+    if (mEnabled)
+    {
+        mFalsePositive.Mark();
+    }
+}
+
+void
+LedgerEntryFilter::add(LedgerKey const& key)
+{
+    if (!mEnabled || !isTracked(key))
+    {
+        return;
+    }
+    if (!mFilter.insert(hashKey(key)))
+    {
+        CLOG(INFO, "Ledger") << "Ledger entry filter is full ("
+                             << mFilter.size() << " keys), disabling it "
+                             << "until rebuilt";
+        mEnabled = false;
+        mNeedsRebuild = true;
+    }
+}
+
+void
+LedgerEntryFilter::erase(std::vector<LedgerKey> const& keys)
+{
+    if (!mEnabled)
+    {
+        return;
+    }
+    for (auto const& key : keys)
+    {
+        if (isTracked(key))
+        {
+            mFilter.erase(hashKey(key));
+        }
+    }
+}
+
+void
+LedgerEntryFilter::resize(size_t capacity)
+{
+    mFilter = CuckooFilter(capacity);
+    mBytes.set_count(mFilter.memoryUsage());
+}
+
+void
+LedgerEntryFilter::rebuild(Database& db)
+{
+    auto& sess = db.getSession();
+    size_t count = static_cast<size_t>(AccountFrame::countObjects(sess) +
+                                       TrustFrame::countObjects(sess));
+    resize(std::max<size_t>(DEFAULT_CAPACITY, count * 2));
+    mEnabled = true;
+    mNeedsRebuild = false;
+
+    auto adder = [this](LedgerKey const& key)
+    {
+        add(key);
+    };
+    AccountFrame::loadKeys(db, adder);
+    TrustFrame::loadKeys(db, adder);
+
+    CLOG(DEBUG, "Ledger") << "Rebuilt ledger entry filter: " << mFilter.size()
+                          << " keys, " << mFilter.memoryUsage() << " bytes";
+}
+
+void
+LedgerEntryFilter::reset()
+{
+    resize(DEFAULT_CAPACITY);
+    mEnabled = true;
+    mNeedsRebuild = false;
+}
+
+void
+LedgerEntryFilter::disable()
+{
+    mEnabled = false;
+}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/CuckooFilter.h"
+#include "util/NonCopyable.h"
+
+#include <vector>
+
+namespace medida
+{
+class MetricsRegistry;
+class Meter;
+class Counter;
+}
+
+namespace stellar
+{
+class Database;
+
+/**
+ * In-memory filter over the keys of the accounts and trust lines stored in
+ * the database, so that looking up one that doesn't exist -- a common case
+ * when validating transactions -- doesn't cost an SQL query.
+ *
+ * The filter may answer "maybe" for a key that isn't in the database, but
+ * never "no" for one that is. To keep it that way, keys are added as soon as
+ * their row is inserted, and only removed once the ledger that deleted them
+ * is committed (see erase()). While the filter can't be trusted (the
+ * database is being upgraded, or the filter overflowed) it is disabled and
+ * answers "maybe" for everything until the next rebuild().
+ *
+ * Held by the Database, next to the entry cache.
+ */
+class LedgerEntryFilter : NonMovableOrCopyable
+{
+  public:
+    LedgerEntryFilter(medida::MetricsRegistry& metrics);
+
+    // Whether `key` may be in the database. Always true for entry types
+    // other than accounts and trust lines.
+    bool mayContain(LedgerKey const& key);
+
+    // To be called when mayContain returned true for a key that turned out
+    // not to exist; only feeds the false-positive metric.
+    void recordFalsePositive();
+
+    // To be called after a row for `key` was inserted.
+    void add(LedgerKey const& key);
+
+    // To be called with the keys deleted by a ledger once its SQL
+    // transaction is committed. Keys must have been in the database before
+    // the ledger, or the fingerprint of another key may be erased instead.
+    void erase(std::vector<LedgerKey> const& keys);
+
+    // Reload every key from the database, sized for growth; also re-enables
+    // the filter. Must not be called while a transaction with uncommitted
+    // deletions is open.
+    void rebuild(Database& db);
+
+    // Start over with an empty, enabled filter; for a new database.
+    void reset();
+
+    // Answer "maybe" until the next rebuild().
+    void disable();
+
+    bool
+    isEnabled() const
+    {
+        return mEnabled;
+    }
+
+    // Whether the filter was disabled because it overflowed, and should be
+    // rebuilt at the next opportunity.
+    bool
+    needsRebuild() const
+    {
+        return mNeedsRebuild;
+    }
+
+  private:
+    static const size_t DEFAULT_CAPACITY = 1 << 16;
+
+    CuckooFilter mFilter;
+    bool mEnabled;
+    bool mNeedsRebuild;
+
+    medida::Meter& mNegative;
+    medida::Meter& mFalsePositive;
+    medida::Counter& mBytes;
+
+    static bool isTracked(LedgerKey const& key);
+    static uint64_t hashKey(LedgerKey const& key);
+    void resize(size_t capacity);
+};
+}
@@ -19,6 +19,28 @@ namespace stellar
 using namespace soci;
 using namespace std;
 
+// note: columns other than "data" are there to faciliate lookup/processing
+static StatementId const kInsertHeader = StatementId::registerStatement(
+    "ledger-header-insert",
+    "INSERT INTO ledgerheaders "
+    "(ledgerhash, prevhash, bucketlisthash, ledgerseq, closetime, data) "
+    "VALUES "
+    "(:h,        :ph,      :blh,            :seq,     :ct,       :data)");
+
+static StatementId const kLoadHeaderByHash = StatementId::registerStatement(
+    "ledger-header-load-hash", "SELECT data FROM ledgerheaders "
+                               "WHERE ledgerhash = :h");
+
+static StatementId const kLoadHeaderBySeq = StatementId::registerStatement(
+    "ledger-header-load-seq", "SELECT data FROM ledgerheaders "
+                              "WHERE ledgerseq = :s");
+
+static StatementId const kLoadHeaderRange = StatementId::registerStatement(
+    "ledger-header-range",
+    "SELECT data FROM ledgerheaders "
+    "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
+    "BY ledgerseq ASC");
+
 LedgerHeaderFrame::LedgerHeaderFrame(LedgerHeader const& lh) : mHeader(lh)
 {
     mHash.fill(0);
@@ -81,12 +103,7 @@ LedgerHeaderFrame::storeInsert(LedgerManager& ledgerManager) const
 
     auto& db = ledgerManager.getDatabase();
 
-    // note: columns other than "data" are there to faciliate lookup/processing
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO ledgerheaders "
-        "(ledgerhash, prevhash, bucketlisthash, ledgerseq, closetime, data) "
-        "VALUES "
-        "(:h,        :ph,      :blh,            :seq,     :ct,       :data)");
+    auto prep = db.getPreparedStatement(kInsertHeader);
     auto& st = prep.statement();
     st.exchange(use(hash));
     st.exchange(use(prevHash));
@@ -127,9 +144,7 @@ LedgerHeaderFrame::loadByHash(Hash const& hash, Database& db)
     string hash_s(binToHex(hash));
     string headerEncoded;
 
-    auto prep = db.getPreparedStatement(
-        "SELECT data FROM ledgerheaders "
-        "WHERE ledgerhash = :h");
+    auto prep = db.getPreparedStatement(kLoadHeaderByHash);
     auto& st = prep.statement();
     st.exchange(into(headerEncoded));
     st.exchange(use(hash_s));
@@ -152,19 +167,18 @@ LedgerHeaderFrame::loadByHash(Hash const& hash, Database& db)
 }
 
 LedgerHeaderFrame::pointer
-LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
-                                  soci::session& sess)
+LedgerHeaderFrame::loadBySequence(uint32_t seq, StatementCache& stmts)
 {
     LedgerHeaderFrame::pointer lhf;
 
     string headerEncoded;
-    {
-        auto timer = db.getSelectTimer("ledger-header");
-        sess << "SELECT data FROM ledgerheaders "
-                "WHERE ledgerseq = :s",
-            into(headerEncoded), use(seq);
-    }
-    if (sess.got_data())
+    auto prep = stmts.get(kLoadHeaderBySeq);
+    auto& st = prep.statement();
+    st.exchange(into(headerEncoded));
+    st.exchange(use(seq));
+    st.define_and_bind();
+    st.execute(true);
+    if (st.got_data())
     {
         lhf = decodeFromData(headerEncoded);
 
@@ -179,7 +193,8 @@ LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
 }
 
 size_t
-LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
+LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db,
+                                             StatementCache& stmts,
                                              uint32_t ledgerSeq,
                                              uint32_t ledgerCount,
                                              XDROutputFileStream& headersOut)
@@ -192,11 +207,12 @@ LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
 
     assert(begin <= end);
 
-    soci::statement st =
-        (sess.prepare << "SELECT data FROM ledgerheaders "
-                         "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
-                         "BY ledgerseq ASC",
-         into(headerEncoded), use(begin), use(end));
+    auto prep = stmts.get(kLoadHeaderRange);
+    auto& st = prep.statement();
+    st.exchange(into(headerEncoded));
+    st.exchange(use(begin));
+    st.exchange(use(end));
+    st.define_and_bind();
 
     st.execute(true);
     while (st.got_data())
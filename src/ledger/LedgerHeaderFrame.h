@@ -15,6 +15,7 @@ namespace stellar
 {
 class LedgerManager;
 class Database;
+class StatementCache;
 class XDROutputFileStream;
 
 class LedgerHeaderFrame
@@ -46,10 +47,11 @@ class LedgerHeaderFrame
 
     static LedgerHeaderFrame::pointer loadByHash(Hash const& hash,
                                                  Database& db);
-    static LedgerHeaderFrame::pointer loadBySequence(uint32_t seq, Database& db,
-                                                     soci::session& sess);
+    static LedgerHeaderFrame::pointer loadBySequence(uint32_t seq,
+                                                     StatementCache& stmts);
 
-    static size_t copyLedgerHeadersToStream(Database& db, soci::session& sess,
+    static size_t copyLedgerHeadersToStream(Database& db,
+                                            StatementCache& stmts,
                                             uint32_t ledgerSeq,
                                             uint32_t ledgerCount,
                                             XDROutputFileStream& headersOut);
@@ -6,6 +6,7 @@
 
 #include "history/HistoryManager.h"
 #include <memory>
+#include <set>
 
 namespace stellar
 {
@@ -102,6 +103,11 @@ class LedgerManager
     // epoch.
     virtual uint64_t getCloseTime() const = 0;
 
+    // Return the accounts created, modified or deleted when closing ledger
+    // `ledgerSeq`, or null unless it is the last ledger closeLedger closed.
+    virtual std::set<AccountID> const*
+    getChangedAccounts(uint32_t ledgerSeq) const = 0;
+
     // Return the fee required to apply a transaction to the current ledger. The
     // current ledger's baseFee is a 32bit value in stroops, but it is returned
     // as a 64bit value here to minimize the chance of overflow in a subsequent
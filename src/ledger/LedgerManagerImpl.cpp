@@ -14,10 +14,13 @@
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManagerImpl.h"
+#include "ledger/LedgerState.h"
+#include "ledger/ParallelTxApply.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
 #include "util/Logging.h"
+#include "util/Tracing.h"
 #include "util/make_unique.h"
 
 #include "medida/meter.h"
@@ -56,6 +59,7 @@ namespace stellar
 {
 
 using xdr::operator==;
+using xdr::operator<;
 
 std::unique_ptr<LedgerManager>
 LedgerManager::create(Application& app)
@@ -95,8 +99,6 @@ LedgerManager::ledgerAbbrev(LedgerHeaderHistoryEntry he)
 
 LedgerManagerImpl::LedgerManagerImpl(Application& app)
     : mApp(app)
-    , mTransactionApply(
-          app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
     , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
     , mLedgerAgeClosed(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
     , mLedgerAge(app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
@@ -106,6 +108,7 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLastStateChange(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "syncing-ledgers"}))
+    , mChangedAccountsLedger(0)
     , mState(LM_BOOTING_STATE)
 
 {
@@ -194,6 +197,8 @@ LedgerManagerImpl::loadLastKnownLedger(
             throw std::runtime_error("Could not load ledger from database");
         }
 
+        getDatabase().getEntryFilter().rebuild(getDatabase());
+
         if (handler)
         {
             string hasString = mApp.getPersistentState().getState(
@@ -255,6 +260,12 @@ LedgerManagerImpl::getTxFee() const
     return mCurrentLedger->mHeader.baseFee;
 }
 
+std::set<AccountID> const*
+LedgerManagerImpl::getChangedAccounts(uint32_t ledgerSeq) const
+{
+    return ledgerSeq == mChangedAccountsLedger ? &mChangedAccounts : nullptr;
+}
+
 int64_t
 LedgerManagerImpl::getMinBalance(uint32_t ownerCount) const
 {
@@ -447,6 +458,14 @@ LedgerManagerImpl::verifyCatchupCandidate(
     }
 
 #undef CHECK_PAIR
+
+    if (mApp.getConfig().CATCHUP_TRUST_ARCHIVE)
+    {
+        // Offline replay: there is no consensus to compare against, so the
+        // archive is the authority. The retrieved chain is still checked for
+        // internal consistency by CatchupStateMachine.
+        return HistoryManager::VERIFY_HASH_OK;
+    }
     return HistoryManager::VERIFY_HASH_UNKNOWN;
 }
 
@@ -626,6 +645,10 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         throw std::runtime_error("corrupt transaction set");
     }
 
+    auto& tracer = mApp.getTracer();
+    tracer.beginLedger(ledgerData.mLedgerSeq);
+    TraceSpan closeSpan(tracer, "closeLedger", "ledger");
+
     soci::transaction txscope(getDatabase().getSession());
 
     auto ledgerTime = mLedgerClose.TimeScope();
@@ -635,65 +658,29 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
 
     LedgerDelta ledgerDelta(mCurrentLedger->mHeader);
 
+    // ledger entries are read and written in memory until the end of the
+    // ledger, see LedgerState
+    auto ledgerState = make_unique<LedgerState>(getDatabase());
+
     // the transaction set that was agreed upon by consensus
     // was sorted by hash; we reorder it so that transactions are
     // sorted such that sequence numbers are respected
     vector<TransactionFramePtr> txs = ledgerData.mTxSet->sortForApply();
-    int index = 0;
+    vector<TransactionMeta> metas;
 
     TransactionResultSet txResultSet;
     txResultSet.results.reserve(txs.size());
-    for (auto tx : txs)
+    TraceSpan applySpan(tracer, "applyTransactions", "ledger");
     {
-        auto txTime = mTransactionApply.TimeScope();
-        LedgerDelta delta(ledgerDelta);
-        TransactionMeta tm;
-        try
-        {
-            CLOG(DEBUG, "Tx")
-                << "APPLY: ledger " << mCurrentLedger->mHeader.ledgerSeq
-                << " tx#" << index << " = " << hexAbbrev(tx->getFullHash())
-                << " txseq=" << tx->getSeqNum() << " (@ "
-                << PubKeyUtils::toShortString(tx->getSourceID()) << ")";
-
-            // note that success here just means it got processed
-            // a failed transaction collecting a fee is successful at this layer
-            if (tx->apply(delta, tm, mApp))
-            {
-                delta.commit();
-            }
-            else
-            {
-                // transaction failed validation and cannot have side effects
-                tx->getResult().feeCharged = 0;
-            }
-        }
-        catch (std::runtime_error& e)
-        {
-            CLOG(ERROR, "Ledger") << "Exception during tx->apply: " << e.what();
-            tx->getResult().result.code(txINTERNAL_ERROR);
-            tx->getResult().feeCharged = 0;
-        }
-        catch (...)
-        {
-            CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
-            tx->getResult().result.code(txINTERNAL_ERROR);
-            tx->getResult().feeCharged = 0;
-        }
-        if (tx->getResult().feeCharged == 0)
-        {
-            CLOG(ERROR, "Tx") << "invalid tx";
-            CLOG(ERROR, "Tx")
-                << "Transaction: " << xdr::xdr_to_string(tx->getEnvelope());
-            CLOG(ERROR, "Tx")
-                << "Result: " << xdr::xdr_to_string(tx->getResult());
-            // ensures that this transaction doesn't have any side effects
-            delta.rollback();
-            tm.v0().changes.clear();
-            tm.v0().operations.clear();
-        }
-        tx->storeTransaction(*this, delta, tm, ++index, txResultSet);
+        ParallelTxApply applier(mApp, ledgerDelta, *ledgerState);
+        applier.apply(txs, metas);
     }
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        txs[i]->storeTransaction(*this, ledgerDelta, metas[i],
+                                 static_cast<int>(i + 1), txResultSet);
+    }
+    applySpan.end();
 
     ledgerDelta.getHeader().txSetResultHash =
         sha256(xdr::xdr_to_opaque(txResultSet));
@@ -729,20 +716,63 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         }
     }
 
-    ledgerDelta.checkAgainstDatabase(mApp);
+    {
+        TraceSpan span(tracer, "flushLedgerState", "database");
+        ledgerState->flush();
+        ledgerState.reset();
+    }
+
+    {
+        TraceSpan span(tracer, "checkAgainstDatabase", "ledger");
+        ledgerDelta.checkAgainstDatabase(mApp);
+    }
 
     ledgerDelta.commit();
 
     closeLedgerHelper(ledgerDelta);
-    txscope.commit();
+    {
+        TraceSpan span(tracer, "commit", "database");
+        txscope.commit();
+    }
+
+    // lets the herder recheck only the pending transactions of these
+    mChangedAccounts.clear();
+    for (auto const& key : ledgerDelta.getChangedKeys())
+    {
+        if (key.type() == ACCOUNT)
+        {
+            mChangedAccounts.insert(key.account().accountID);
+        }
+    }
+    mChangedAccountsLedger = mLastClosedLedger.header.ledgerSeq;
+
+    // deletions are only final now that they are committed
+    {
+        auto& filter = getDatabase().getEntryFilter();
+        if (filter.needsRebuild())
+        {
+            filter.rebuild(getDatabase());
+        }
+        else
+        {
+            filter.erase(ledgerDelta.getDeadEntries());
+        }
+    }
 
     // Notify ledger close to other components.
-    mApp.getHistoryManager().maybePublishHistory([](asio::error_code const&)
-                                                 {
-                                                 });
+    {
+        TraceSpan span(tracer, "maybePublishHistory", "history");
+        mApp.getHistoryManager().maybePublishHistory(
+            [](asio::error_code const&)
+            {
+            });
+    }
 
     // Permit BucketManager to forget buckets that are no longer in use.
-    mApp.getBucketManager().forgetUnreferencedBuckets();
+    {
+        TraceSpan span(tracer, "forgetUnreferencedBuckets", "bucket");
+        mApp.getBucketManager().forgetUnreferencedBuckets();
+    }
 }
 
 void
@@ -762,17 +792,35 @@ LedgerManagerImpl::advanceLedgerPointers()
 void
 LedgerManagerImpl::closeLedgerHelper(LedgerDelta const& delta)
 {
+    auto& tracer = mApp.getTracer();
+    TraceSpan helperSpan(tracer, "closeLedgerHelper", "ledger");
+
     delta.markMeters(mApp);
-    mApp.getBucketManager().addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq,
-                                     delta.getLiveEntries(),
-                                     delta.getDeadEntries());
+    {
+        TraceSpan span(tracer, "addBatch", "bucket");
+        mApp.getBucketManager().addBatch(
+            mApp, mCurrentLedger->mHeader.ledgerSeq, delta.getLiveEntries(),
+            delta.getDeadEntries());
+    }
 
-    mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
+    {
+        TraceSpan span(tracer, "snapshotLedger", "bucket");
+        mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
+    }
 
-    mCurrentLedger->storeInsert(*this);
+    {
+        TraceSpan span(tracer, "storeInsert", "ledger");
+        mCurrentLedger->storeInsert(*this);
+    }
+
+    {
+        TraceSpan span(tracer, "setState", "ledger");
+        mApp.getPersistentState().setState(
+            PersistentState::kLastClosedLedger,
+            binToHex(mCurrentLedger->getHash()));
+    }
 
-    mApp.getPersistentState().setState(PersistentState::kLastClosedLedger,
-                                       binToHex(mCurrentLedger->getHash()));
+    TraceSpan hasSpan(tracer, "storeHistoryArchiveState", "history");
 
     // Store the current HAS in the database; this is really just to checkpoint
     // the bucketlist so we can survive a restart and re-attach to the buckets.
@@ -791,6 +839,7 @@ LedgerManagerImpl::closeLedgerHelper(LedgerDelta const& delta)
 
     mApp.getPersistentState().setState(PersistentState::kHistoryArchiveState,
                                        has.toString());
+    hasSpan.end();
 
     advanceLedgerPointers();
 }
@@ -36,7 +36,6 @@ class LedgerManagerImpl : public LedgerManager
     LedgerHeaderFrame::pointer mCurrentLedger;
 
     Application& mApp;
-    medida::Timer& mTransactionApply;
     medida::Timer& mLedgerClose;
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
@@ -49,6 +48,11 @@ class LedgerManagerImpl : public LedgerManager
 
     std::vector<LedgerCloseData> mSyncingLedgers;
 
+    // accounts changed by ledger mChangedAccountsLedger, see
+    // getChangedAccounts
+    std::set<AccountID> mChangedAccounts;
+    uint32_t mChangedAccountsLedger;
+
     void historyCaughtup(asio::error_code const& ec,
                          HistoryManager::CatchupMode mode,
                          LedgerHeaderHistoryEntry const& lastClosed);
@@ -71,6 +75,8 @@ class LedgerManagerImpl : public LedgerManager
     uint32_t getLastClosedLedgerNum() const override;
     int64_t getMinBalance(uint32_t ownerCount) const override;
     int64_t getTxFee() const override;
+    std::set<AccountID> const*
+    getChangedAccounts(uint32_t ledgerSeq) const override;
     uint64_t getCloseTime() const override;
     uint64_t secondsSinceLastLedgerClose() const override;
     void syncMetrics() override;
@@ -10,6 +10,8 @@
 #include "util/Logging.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/AccountFrame.h"
 #include "transactions/TxTests.h"
 #include "database/Database.h"
 #include "main/Config.h"
@@ -224,3 +226,119 @@ TEST_CASE("ledger performance test", "[performance][hide]")
         LOG(INFO) << "done";
     }
 }
+
+TEST_CASE("account load performance", "[performance][accountload][hide]")
+{
+    int const nAccounts = 100000;
+    size_t const nSigners = 5;
+    int const nRounds = 5;
+
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+    auto& db = app->getDatabase();
+
+    LOG(INFO) << "Creating " << nAccounts << " accounts with " << nSigners
+              << " signers each";
+    std::vector<AccountID> ids;
+    {
+        LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader());
+        soci::transaction sqlTx(db.getSession());
+        for (int i = 0; i < nAccounts; i++)
+        {
+            AccountFrame act(SecretKey::random().getPublicKey());
+            act.getAccount().balance = 1000000000;
+            act.getAccount().numSubEntries = static_cast<uint32>(nSigners);
+            for (size_t j = 0; j < nSigners; j++)
+            {
+                Signer signer;
+                signer.pubKey = SecretKey::random().getPublicKey();
+                signer.weight = 1;
+                act.getAccount().signers.push_back(signer);
+            }
+            act.setUpdateSigners();
+            act.storeAdd(delta, db);
+            ids.push_back(act.getID());
+        }
+        sqlTx.commit();
+    }
+
+    Timer& loadTimer =
+        app->getMetrics().NewTimer({"performance-test", "account", "load"});
+    for (int r = 0; r < nRounds; r++)
+    {
+        // every load goes to the database
+        db.getEntryCache().clear();
+        auto scope = loadTimer.TimeScope();
+        for (auto const& id : ids)
+        {
+            auto act = AccountFrame::loadAccount(id, db);
+            REQUIRE(act->getAccount().signers.size() == nSigners);
+        }
+    }
+    LOG(INFO) << "Account loads/sec: "
+              << nAccounts * nRounds * 1000.0 / loadTimer.sum();
+}
+
+TEST_CASE("payment apply performance", "[performance][applypayments][hide]")
+{
+    using namespace txtest;
+    int const nAccounts = 1000;
+    int const nLedgers = 10;
+
+    VirtualClock clock;
+    Config cfg(getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE));
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto root = getRoot();
+    std::vector<SecretKey> keys;
+    std::vector<SequenceNumber> seqs;
+    uint32 ledgerSeq = app->getLedgerManager().getLedgerNum();
+
+    auto closeWith = [&](TxSetFramePtr txSet)
+    {
+        txSet->sortForHash();
+        StellarValue sv(txSet->getContentsHash(), getTestDate(1, 7, 2014),
+                        emptyUpgradeSteps, 0);
+        LedgerCloseData ledgerData(ledgerSeq, txSet, sv);
+        app->getLedgerManager().closeLedger(ledgerData);
+        ++ledgerSeq;
+    };
+
+    {
+        auto txSet = std::make_shared<TxSetFrame>(
+            app->getLedgerManager().getLastClosedLedgerHeader().hash);
+        auto rootSeq = getAccountSeqNum(root, *app) + 1;
+        for (int i = 0; i < nAccounts; i++)
+        {
+            keys.emplace_back(SecretKey::random());
+            txSet->add(createCreateAccountTx(root, keys.back(), rootSeq++,
+                                             1000000000));
+        }
+        closeWith(txSet);
+    }
+    for (auto const& k : keys)
+    {
+        seqs.push_back(getAccountSeqNum(k, *app) + 1);
+    }
+
+    Timer& closeTimer = app->getMetrics().NewTimer(
+        {"performance-test", "ledger", "apply-payments"});
+    for (int l = 0; l < nLedgers; l++)
+    {
+        auto txSet = std::make_shared<TxSetFrame>(
+            app->getLedgerManager().getLastClosedLedgerHeader().hash);
+        for (int i = 0; i < nAccounts; i++)
+        {
+            txSet->add(createPaymentTx(keys[i], keys[(i + 1) % nAccounts],
+                                       seqs[i]++, 100));
+        }
+        auto scope = closeTimer.TimeScope();
+        closeWith(txSet);
+    }
+    REQUIRE(app->getLedgerManager().getLedgerNum() == ledgerSeq);
+    LOG(INFO) << "Payments applied/sec: "
+              << nAccounts * nLedgers * 1000.0 / closeTimer.sum();
+}
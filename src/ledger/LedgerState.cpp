@@ -0,0 +1,248 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerState.h"
+#include "database/Database.h"
+#include "ledger/EntryFrame.h"
+#include "util/make_unique.h"
+#include "xdrpp/printer.h"
+
+#include <cassert>
+
+namespace stellar
+{
+
+static thread_local LedgerState* gThreadState = nullptr;
+
+LedgerState::LedgerState(Database& db) : mDb(db), mIsolated(false)
+{
+    if (mDb.getLedgerState())
+    {
+        throw std::runtime_error("a LedgerState is already active");
+    }
+    mDb.setLedgerState(this);
+}
+
+LedgerState::LedgerState(Database& db, Isolated) : mDb(db), mIsolated(true)
+{
+}
+
+LedgerState::~LedgerState()
+{
+    if (!mIsolated)
+    {
+        mDb.setLedgerState(nullptr);
+    }
+}
+
+LedgerState*
+LedgerState::getThreadState()
+{
+    return gThreadState;
+}
+
+void
+LedgerState::preload(LedgerKey const& key, EntryPtr value, bool writable)
+{
+    assert(mIsolated);
+    mEntries[key] = Slot{value, value, writable};
+}
+
+void
+LedgerState::commitTo(LedgerState& other)
+{
+    assert(mIsolated);
+    for (auto const& key : mDirty)
+    {
+        auto& slot = mEntries.find(key)->second;
+        if (slot.mCurrent == slot.mStored)
+        {
+            continue;
+        }
+        if (!slot.mCurrent)
+        {
+            other.storeDelete(key);
+        }
+        else if (slot.mStored)
+        {
+            other.storeChange(*slot.mCurrent);
+        }
+        else
+        {
+            other.storeAdd(*slot.mCurrent);
+        }
+    }
+}
+
+LedgerState::Slot&
+LedgerState::getSlot(LedgerKey const& key)
+{
+    auto it = mEntries.find(key);
+    if (it == mEntries.end())
+    {
+        if (mIsolated)
+        {
+            throw FootprintError("entry not preloaded: " +
+                                 xdr::xdr_to_string(key));
+        }
+        EntryPtr stored;
+        auto frame = EntryFrame::loadFromDatabase(key, mDb);
+        if (frame)
+        {
+            stored = std::make_shared<LedgerEntry const>(frame->mEntry);
+        }
+        it = mEntries.emplace(key, Slot{stored, stored, true}).first;
+    }
+    return it->second;
+}
+
+void
+LedgerState::set(LedgerKey const& key, Slot& slot, EntryPtr value)
+{
+    if (!slot.mWritable)
+    {
+        throw FootprintError("entry preloaded as read-only: " +
+                             xdr::xdr_to_string(key));
+    }
+    mUndoLog.push_back(UndoRecord{key, slot.mCurrent});
+    slot.mCurrent = value;
+    mDirty.insert(key);
+}
+
+LedgerState::EntryPtr
+LedgerState::load(LedgerKey const& key)
+{
+    return getSlot(key).mCurrent;
+}
+
+void
+LedgerState::storeAdd(LedgerEntry const& entry)
+{
+    auto key = LedgerEntryKey(entry);
+    auto& slot = getSlot(key);
+    if (slot.mCurrent)
+    {
+        throw std::runtime_error("Could not add entry, it already exists: " +
+                                 xdr::xdr_to_string(key));
+    }
+    set(key, slot, std::make_shared<LedgerEntry const>(entry));
+}
+
+void
+LedgerState::storeChange(LedgerEntry const& entry)
+{
+    auto key = LedgerEntryKey(entry);
+    auto& slot = getSlot(key);
+    if (!slot.mCurrent)
+    {
+        throw std::runtime_error("Could not update entry, it doesn't exist: " +
+                                 xdr::xdr_to_string(key));
+    }
+    set(key, slot, std::make_shared<LedgerEntry const>(entry));
+}
+
+void
+LedgerState::storeDelete(LedgerKey const& key)
+{
+    auto& slot = getSlot(key);
+    if (!slot.mCurrent)
+    {
+        throw std::runtime_error("Could not delete entry, it doesn't exist: " +
+                                 xdr::xdr_to_string(key));
+    }
+    set(key, slot, nullptr);
+}
+
+void
+LedgerState::rollback(size_t checkpoint)
+{
+    assert(checkpoint <= mUndoLog.size());
+    while (mUndoLog.size() > checkpoint)
+    {
+        auto& rec = mUndoLog.back();
+        // every key in the undo log has a slot: slots are never dropped
+        auto& slot = mEntries.find(rec.mKey)->second;
+        slot.mCurrent = rec.mPrevious;
+        mDirty.insert(rec.mKey);
+        mUndoLog.pop_back();
+    }
+}
+
+void
+LedgerState::clearUndoLog()
+{
+    mUndoLog.clear();
+}
+
+void
+LedgerState::flush()
+{
+    if (mIsolated)
+    {
+        throw FootprintError("isolated LedgerState can't be flushed");
+    }
+    for (auto const& key : mDirty)
+    {
+        auto& slot = mEntries.find(key)->second;
+        if (slot.mCurrent == slot.mStored)
+        {
+            continue;
+        }
+        if (slot.mCurrent)
+        {
+            EntryFrame::storeInDatabase(slot.mStored.get(), *slot.mCurrent,
+                                        mDb);
+        }
+        else
+        {
+            EntryFrame::deleteFromDatabase(key, mDb);
+        }
+        slot.mStored = slot.mCurrent;
+    }
+    mDirty.clear();
+}
+
+LedgerStateThreadScope::LedgerStateThreadScope(LedgerState& state)
+    : mPrevious(gThreadState)
+{
+    gThreadState = &state;
+}
+
+LedgerStateThreadScope::~LedgerStateThreadScope()
+{
+    gThreadState = mPrevious;
+}
+
+LedgerStateScope::LedgerStateScope(Database& db)
+    : mState(db.getLedgerState()), mCheckpoint(0), mCommitted(false)
+{
+    if (mState)
+    {
+        mCheckpoint = mState->checkpoint();
+    }
+    else
+    {
+        mSqlTx = make_unique<soci::transaction>(db.getSession());
+    }
+}
+
+LedgerStateScope::~LedgerStateScope()
+{
+    // an uncommitted mSqlTx rolls itself back
+    if (!mCommitted && mState)
+    {
+        mState->rollback(mCheckpoint);
+    }
+}
+
+void
+LedgerStateScope::commit()
+{
+    mCommitted = true;
+    if (mSqlTx)
+    {
+        mSqlTx->commit();
+    }
+}
+}
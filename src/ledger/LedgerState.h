@@ -0,0 +1,170 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/LedgerCmp.h"
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace soci
+{
+class transaction;
+}
+
+namespace stellar
+{
+class Database;
+
+/**
+ * In-memory view of the ledger entries touched while closing a ledger.
+ *
+ * While a LedgerState is alive it is registered with the Database, and the
+ * EntryFrame load/store helpers go through it instead of issuing SQL: entries
+ * are read from the database once, on first access, and modified entries are
+ * only written back by flush(). The LedgerManager flushes once at the end of
+ * the ledger; queries that can't be answered by key (order book, account
+ * lines and offers, inflation votes) flush first so the database they read is
+ * current.
+ *
+ * Changes can be undone back to a checkpoint(). Every modification appends
+ * the entry's previous value to an undo log, so discarding a failed
+ * transaction or operation costs time proportional to what it changed.
+ * Rolling back past a flush is fine: the restored entries are simply written
+ * again by the next flush.
+ *
+ * An isolated LedgerState never touches the database, so that it can be used
+ * from a worker thread (see ParallelTxApply): it only knows the entries it
+ * was given by preload(), and throws FootprintError when asked for any other
+ * entry, to change an entry preloaded as read-only, or to flush. A thread
+ * makes it current for itself with LedgerStateThreadScope.
+ */
+class LedgerState : NonMovableOrCopyable
+{
+  public:
+    typedef std::shared_ptr<LedgerEntry const> EntryPtr;
+
+    class FootprintError : public std::runtime_error
+    {
+      public:
+        explicit FootprintError(std::string const& what)
+            : std::runtime_error(what)
+        {
+        }
+    };
+
+    struct Isolated
+    {
+    };
+
+    // Registers itself with `db` for its lifetime.
+    explicit LedgerState(Database& db);
+    LedgerState(Database& db, Isolated);
+    ~LedgerState();
+
+    // The LedgerState made current for this thread, if any.
+    static LedgerState* getThreadState();
+
+    // Isolated only: make `value` the current and stored value of `key`.
+    void preload(LedgerKey const& key, EntryPtr value, bool writable);
+
+    // Isolated only: apply every change made so far to `other`.
+    void commitTo(LedgerState& other);
+
+    // Current value of `key`, or null if it doesn't exist.
+    EntryPtr load(LedgerKey const& key);
+
+    // These throw if the entry respectively exists already, doesn't exist.
+    void storeAdd(LedgerEntry const& entry);
+    void storeChange(LedgerEntry const& entry);
+    void storeDelete(LedgerKey const& key);
+
+    size_t
+    checkpoint() const
+    {
+        return mUndoLog.size();
+    }
+
+    // Undo every change made since `checkpoint`.
+    void rollback(size_t checkpoint);
+
+    // Forget the undo log; changes made so far can no longer be rolled back.
+    void clearUndoLog();
+
+    // Write every entry modified since the last flush to the database.
+    void flush();
+
+    size_t
+    getDirtyCount() const
+    {
+        return mDirty.size();
+    }
+
+  private:
+    struct Slot
+    {
+        // mCurrent is the live value; mStored is the value currently in the
+        // database. Both point to immutable entries and are null if the entry
+        // doesn't exist, so the slot is clean when they are the same pointer.
+        EntryPtr mCurrent;
+        EntryPtr mStored;
+        bool mWritable;
+    };
+
+    struct UndoRecord
+    {
+        LedgerKey mKey;
+        EntryPtr mPrevious;
+    };
+
+    Database& mDb;
+    bool mIsolated;
+    std::map<LedgerKey, Slot, LedgerEntryIdCmp> mEntries;
+    std::set<LedgerKey, LedgerEntryIdCmp> mDirty;
+    std::vector<UndoRecord> mUndoLog;
+
+    Slot& getSlot(LedgerKey const& key);
+    void set(LedgerKey const& key, Slot& slot, EntryPtr value);
+};
+
+/**
+ * Makes an isolated LedgerState current for the calling thread, in place of
+ * the one registered with the Database, until destroyed.
+ */
+class LedgerStateThreadScope : NonMovableOrCopyable
+{
+    LedgerState* mPrevious;
+
+  public:
+    explicit LedgerStateThreadScope(LedgerState& state);
+    ~LedgerStateThreadScope();
+};
+
+/**
+ * Shields the enclosing scope from the effects of a transaction or operation
+ * until commit() is called. With a LedgerState active this is a checkpoint in
+ * its undo log; otherwise (e.g. transactions applied directly by tests) it
+ * falls back to a nested SQL transaction.
+ */
+class LedgerStateScope : NonMovableOrCopyable
+{
+    LedgerState* mState;
+    size_t mCheckpoint;
+    std::unique_ptr<soci::transaction> mSqlTx;
+    bool mCommitted;
+
+  public:
+    explicit LedgerStateScope(Database& db);
+    ~LedgerStateScope();
+
+    void commit();
+};
+}
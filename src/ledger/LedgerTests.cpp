@@ -9,11 +9,16 @@
 #include "lib/catch.hpp"
 #include "database/Database.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerEntryFilter.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerState.h"
 #include "ledger/EntryFrame.h"
 #include "util/Logging.h"
 #include "util/types.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include <xdrpp/autocheck.h>
+#include <algorithm>
 
 using namespace stellar;
 
@@ -106,6 +111,205 @@ TEST_CASE("Ledger entry db lifecycle", "[ledger]")
     }
 }
 
+TEST_CASE("Ledger entries buffered in LedgerState", "[ledger][ledgerstate]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+
+    app->start();
+    LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader());
+    auto& db = app->getDatabase();
+
+    std::vector<EntryFrame::pointer> kept, discarded;
+    {
+        LedgerState state(db);
+        for (size_t i = 0; i < 20; ++i)
+        {
+            auto le = EntryFrame::FromXDR(validLedgerEntryGenerator(3));
+            le->storeAdd(delta, db);
+            kept.push_back(le);
+        }
+
+        // changes made in a scope that isn't committed are undone
+        {
+            LedgerStateScope scope(db);
+            for (size_t i = 0; i < 10; ++i)
+            {
+                auto le = EntryFrame::FromXDR(validLedgerEntryGenerator(3));
+                le->storeAdd(delta, db);
+                discarded.push_back(le);
+            }
+            kept[0]->storeDelete(delta, db);
+            CHECK(!EntryFrame::exists(db, kept[0]->getKey()));
+        }
+        CHECK(EntryFrame::exists(db, kept[0]->getKey()));
+        for (auto const& le : discarded)
+        {
+            CHECK(!EntryFrame::exists(db, le->getKey()));
+        }
+
+        // nothing reached the database yet
+        for (auto const& le : kept)
+        {
+            CHECK(EntryFrame::exists(db, le->getKey()));
+            CHECK(!EntryFrame::loadFromDatabase(le->getKey(), db));
+        }
+
+        // rolling back past a flush restores the database on the next one
+        auto checkpoint = state.checkpoint();
+        kept.back()->storeDelete(delta, db);
+        state.flush();
+        CHECK(!EntryFrame::loadFromDatabase(kept.back()->getKey(), db));
+        state.rollback(checkpoint);
+        state.flush();
+        CHECK(state.getDirtyCount() == 0);
+    }
+
+    for (auto const& le : kept)
+    {
+        CHECK(EntryFrame::loadFromDatabase(le->getKey(), db));
+    }
+    for (auto const& le : discarded)
+    {
+        CHECK(!EntryFrame::exists(db, le->getKey()));
+    }
+}
+
+TEST_CASE("ledger entry filter skips lookups of missing entries",
+          "[ledger][entryfilter]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+
+    app->start();
+    LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader());
+    auto& db = app->getDatabase();
+    auto& filter = db.getEntryFilter();
+    auto& negative =
+        app->getMetrics().NewMeter({"ledger", "filter", "negative"}, "lookup");
+    REQUIRE(filter.isEnabled());
+
+    std::vector<EntryFrame::pointer> entries;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        auto le = EntryFrame::FromXDR(validLedgerEntryGenerator(3));
+        if (le->mEntry.type() != OFFER)
+        {
+            entries.push_back(le);
+        }
+    }
+
+    auto before = negative.count();
+    for (auto const& le : entries)
+    {
+        CHECK(!EntryFrame::exists(db, le->getKey()));
+        le->storeAdd(delta, db);
+        CHECK(EntryFrame::exists(db, le->getKey()));
+    }
+    CHECK(negative.count() > before);
+
+    // deleted keys are only dropped from the filter by a ledger close,
+    // until then the database answers
+    for (auto const& le : entries)
+    {
+        le->storeDelete(delta, db);
+        CHECK(filter.mayContain(le->getKey()));
+        CHECK(!EntryFrame::exists(db, le->getKey()));
+    }
+
+    // barring a rare false positive, rebuilding forgets them
+    filter.rebuild(db);
+    size_t maybe = 0;
+    for (auto const& le : entries)
+    {
+        if (filter.mayContain(le->getKey()))
+        {
+            ++maybe;
+        }
+    }
+    CHECK(maybe <= 1);
+
+    filter.disable();
+    for (auto const& le : entries)
+    {
+        CHECK(filter.mayContain(le->getKey()));
+    }
+}
+
+TEST_CASE("LedgerDelta collapses nested changes", "[ledger][ledgerdelta]")
+{
+    LedgerHeader header;
+    LedgerDelta delta(header);
+
+    std::vector<EntryFrame::pointer> entries;
+    for (size_t i = 0; i < 200; ++i)
+    {
+        entries.push_back(EntryFrame::FromXDR(validLedgerEntryGenerator(3)));
+    }
+
+    for (size_t i = 0; i < 100; ++i)
+    {
+        delta.addEntry(*entries[i]);
+    }
+    {
+        LedgerDelta inner(delta);
+        // new + mod stays new, new + delete disappears
+        for (size_t i = 0; i < 50; ++i)
+        {
+            inner.modEntry(*entries[i]);
+        }
+        for (size_t i = 50; i < 100; ++i)
+        {
+            inner.deleteEntry(*entries[i]);
+        }
+        // delete + new is a mod
+        for (size_t i = 100; i < 200; ++i)
+        {
+            inner.deleteEntry(*entries[i]);
+        }
+        for (size_t i = 150; i < 200; ++i)
+        {
+            inner.addEntry(*entries[i]);
+        }
+        inner.commit();
+    }
+
+    LedgerEntryIdCmp cmp;
+    auto live = delta.getLiveEntries();
+    auto dead = delta.getDeadEntries();
+    REQUIRE(live.size() == 100);
+    REQUIRE(dead.size() == 50);
+    REQUIRE(std::is_sorted(live.begin(), live.end(), cmp));
+    REQUIRE(std::is_sorted(dead.begin(), dead.end(), cmp));
+
+    auto changes = delta.getChanges();
+    REQUIRE(changes.size() == 150);
+    size_t created = 0, updated = 0, removed = 0;
+    for (auto const& c : changes)
+    {
+        switch (c.type())
+        {
+        case LEDGER_ENTRY_CREATED:
+            REQUIRE(updated == 0);
+            REQUIRE(removed == 0);
+            ++created;
+            break;
+        case LEDGER_ENTRY_UPDATED:
+            REQUIRE(removed == 0);
+            ++updated;
+            break;
+        case LEDGER_ENTRY_REMOVED:
+            ++removed;
+            break;
+        }
+    }
+    REQUIRE(created == 50);
+    REQUIRE(updated == 50);
+    REQUIRE(removed == 50);
+}
+
 TEST_CASE("single ledger entry insert SQL", "[singlesql][entrysql][hide]")
 {
     Config::TestDbMode mode = Config::TESTDB_ON_DISK_SQLITE;
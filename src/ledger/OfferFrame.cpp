@@ -8,6 +8,7 @@
 #include "crypto/SecretKey.h"
 #include "crypto/SHA.h"
 #include "LedgerDelta.h"
+#include "ledger/LedgerState.h"
 #include "util/types.h"
 
 using namespace std;
@@ -15,38 +16,127 @@ using namespace soci;
 
 namespace stellar
 {
-const char* OfferFrame::kSQLCreateStatement1 =
-    "CREATE TABLE offers"
-    "("
-    "sellerid       VARCHAR(56)  NOT NULL,"
-    "offerid         BIGINT       NOT NULL CHECK (offerid >= 0),"
-    "sellingassettype    INT,"
-    "sellingassetcode    VARCHAR(12),"
-    "sellingissuer       VARCHAR(56),"
-    "buyingassettype    INT,"
-    "buyingassetcode    VARCHAR(12),"
-    "buyingissuer       VARCHAR(56),"
-    "amount          BIGINT       NOT NULL CHECK (amount >= 0),"
-    "pricen          INT          NOT NULL,"
-    "priced          INT          NOT NULL,"
-    "price           BIGINT       NOT NULL,"
-    "flags           INT          NOT NULL,"
-    "PRIMARY KEY (offerid)"
-    ");";
+// account IDs are stored as their raw 32 bytes; issuers are NULL for the
+// native asset
+static void
+createOffersTable(Database& db, std::string const& name)
+{
+    std::string bin = db.getBinaryColumnType();
+    db.getSession()
+        << "CREATE TABLE " + name +
+               "("
+               "sellerid        " + bin + "       NOT NULL,"
+               "offerid         BIGINT       NOT NULL CHECK (offerid >= 0),"
+               "sellingassettype    INT,"
+               "sellingassetcode    VARCHAR(12),"
+               "sellingissuer       " + bin + ","
+               "buyingassettype    INT,"
+               "buyingassetcode    VARCHAR(12),"
+               "buyingissuer       " + bin + ","
+               "amount          BIGINT       NOT NULL CHECK (amount >= 0),"
+               "pricen          INT          NOT NULL,"
+               "priced          INT          NOT NULL,"
+               "price           BIGINT       NOT NULL,"
+               "flags           INT          NOT NULL,"
+               "PRIMARY KEY (offerid)"
+               ");";
+}
 
-const char* OfferFrame::kSQLCreateStatement2 =
+const char* OfferFrame::kSQLCreateStatement1 =
     "CREATE INDEX sellingissuerindex ON offers (sellingissuer);";
 
-const char* OfferFrame::kSQLCreateStatement3 =
+const char* OfferFrame::kSQLCreateStatement2 =
     "CREATE INDEX buyingissuerindex ON offers (buyingissuer);";
 
-const char* OfferFrame::kSQLCreateStatement4 =
+const char* OfferFrame::kSQLCreateStatement3 =
     "CREATE INDEX priceindex ON offers (price);";
 
+// sets the asset code and issuer columns of a non native asset
+static void
+getAssetFields(Asset const& asset, std::string& assetCode,
+               BinaryColumn& issuer)
+{
+    if (asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
+    {
+        assetCodeToStr(asset.alphaNum4().assetCode, assetCode);
+        issuer.set(asset.alphaNum4().issuer);
+    }
+    else if (asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
+    {
+        assetCodeToStr(asset.alphaNum12().assetCode, assetCode);
+        issuer.set(asset.alphaNum12().issuer);
+    }
+    else
+    {
+        throw std::runtime_error("unknown asset type");
+    }
+}
+
 static const char* offerColumnSelector =
 "SELECT sellerid,offerid,sellingassettype,sellingassetcode,sellingissuer,"
 "buyingassettype,buyingassetcode,buyingissuer,amount,pricen,priced,flags FROM offers";
 
+static StatementId const kLoadOffer = StatementId::registerStatement(
+    "offer-load", std::string(offerColumnSelector) +
+                      " where sellerid=:id and offerid=:offerid");
+
+static StatementId const kLoadAccountOffers = StatementId::registerStatement(
+    "offer-load-account",
+    std::string(offerColumnSelector) + " WHERE sellerid=:id");
+
+static StatementId
+registerBestOffers(bool sellingNative, bool buyingNative)
+{
+    std::string name = "offer-best";
+    std::string query = offerColumnSelector;
+    if (sellingNative)
+    {
+        name += "-native";
+        query += " WHERE sellingassettype=0";
+    }
+    else
+    {
+        name += "-credit";
+        query += " WHERE sellingassetcode=:pcur AND sellingissuer = :pi";
+    }
+    if (buyingNative)
+    {
+        name += "-native";
+        query += " AND buyingassettype=0";
+    }
+    else
+    {
+        name += "-credit";
+        query += " AND buyingassetcode=:gcur AND buyingissuer = :gi";
+    }
+    query += " ORDER BY price,offerid LIMIT :n OFFSET :o";
+    return StatementId::registerStatement(name, query);
+}
+
+// indexed by whether the selling and buying assets are native
+static StatementId const kBestOffers[2][2] = {
+    {registerBestOffers(false, false), registerBestOffers(false, true)},
+    {registerBestOffers(true, false), registerBestOffers(true, true)}};
+
+static StatementId const kOfferExists = StatementId::registerStatement(
+    "offer-exists", "SELECT EXISTS (SELECT NULL FROM offers "
+                    "WHERE sellerid=:id AND offerid=:s)");
+
+static StatementId const kDeleteOffer = StatementId::registerStatement(
+    "offer-delete", "DELETE FROM offers WHERE offerid=:s");
+
+static StatementId const kUpdateOffer = StatementId::registerStatement(
+    "offer-update", "UPDATE offers SET amount=:a, pricen=:n, "
+                    "priced=:D, price=:p WHERE offerid=:s");
+
+static StatementId const kInsertOffer = StatementId::registerStatement(
+    "offer-insert",
+    "INSERT INTO offers (sellerid,offerid,"
+    "sellingassettype,sellingassetcode,sellingissuer,"
+    "buyingassettype,buyingassetcode,buyingissuer,"
+    "amount,pricen,priced,price,flags) VALUES "
+    "(:v1,:v2,:v3,:v4,:v5,:v6,:v7,:v8,:v9,:v10,:v11,:v12,:v13)");
+
 OfferFrame::OfferFrame() : EntryFrame(OFFER), mOffer(mEntry.offer())
 {
 }
@@ -132,20 +222,34 @@ OfferFrame::pointer
 OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID,
                       Database& db)
 {
-    OfferFrame::pointer retOffer;
+    if (auto state = db.getLedgerState())
+    {
+        LedgerKey key;
+        key.type(OFFER);
+        key.offer().sellerID = sellerID;
+        key.offer().offerID = offerID;
+        auto p = state->load(key);
+        return p ? make_shared<OfferFrame>(*p) : nullptr;
+    }
+    return loadOfferFromDatabase(sellerID, offerID, db);
+}
 
-    std::string actIDStrKey;
-    actIDStrKey = PubKeyUtils::toStrKey(sellerID);
+OfferFrame::pointer
+OfferFrame::loadOfferFromDatabase(AccountID const& sellerID, uint64_t offerID,
+                                  Database& db)
+{
+    OfferFrame::pointer retOffer;
 
-    soci::session& session = db.getSession();
+    BinaryColumn actID(db, db.getSession());
+    actID.set(sellerID);
 
-    soci::details::prepare_temp_type sql =
-        (session.prepare << offerColumnSelector
-                         << " where sellerid=:id and offerid=:offerid",
-         use(actIDStrKey), use(offerID));
+    auto prep = db.getPreparedStatement(kLoadOffer);
+    auto& st = prep.statement();
+    actID.bindUse(st);
+    st.exchange(use(offerID));
 
     auto timer = db.getSelectTimer("offer");
-    loadOffers(sql, [&retOffer](LedgerEntry const& offer)
+    loadOffers(db, prep, [&retOffer](LedgerEntry const& offer)
                {
                    retOffer = make_shared<OfferFrame>(offer);
                });
@@ -154,35 +258,39 @@ OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID,
 }
 
 void
-OfferFrame::loadOffers(soci::details::prepare_temp_type& prep,
+OfferFrame::loadOffers(Database& db, StatementContext& prep,
                        std::function<void(LedgerEntry const&)> offerProcessor)
 {
-    string actIDStrKey;
     unsigned int sellingAssetType, buyingAssetType;
-    std::string sellingAssetCode, buyingAssetCode, sellingIssuerStrKey,
-        buyingIssuerStrKey;
+    std::string sellingAssetCode, buyingAssetCode;
+    BinaryColumn actID(db, db.getSession()),
+        sellingIssuer(db, db.getSession()), buyingIssuer(db, db.getSession());
 
-    soci::indicator sellingAssetCodeIndicator, buyingAssetCodeIndicator,
-        sellingIssuerIndicator, buyingIssuerIndicator;
+    soci::indicator sellingAssetCodeIndicator, buyingAssetCodeIndicator;
 
     LedgerEntry le;
     le.type(OFFER);
     OfferEntry& oe = le.offer();
 
-    statement st =
-        (prep, into(actIDStrKey), into(oe.offerID),
-         into(sellingAssetType),
-         into(sellingAssetCode, sellingAssetCodeIndicator),
-         into(sellingIssuerStrKey, sellingIssuerIndicator),
-         into(buyingAssetType),
-         into(buyingAssetCode, buyingAssetCodeIndicator),
-         into(buyingIssuerStrKey, buyingIssuerIndicator), into(oe.amount),
-         into(oe.price.n), into(oe.price.d), into(oe.flags));
+    auto& st = prep.statement();
+    actID.bindInto(st);
+    st.exchange(into(oe.offerID));
+    st.exchange(into(sellingAssetType));
+    st.exchange(into(sellingAssetCode, sellingAssetCodeIndicator));
+    sellingIssuer.bindInto(st);
+    st.exchange(into(buyingAssetType));
+    st.exchange(into(buyingAssetCode, buyingAssetCodeIndicator));
+    buyingIssuer.bindInto(st);
+    st.exchange(into(oe.amount));
+    st.exchange(into(oe.price.n));
+    st.exchange(into(oe.price.d));
+    st.exchange(into(oe.flags));
+    st.define_and_bind();
 
     st.execute(true);
     while(st.got_data())
     {
-        oe.sellerID = PubKeyUtils::fromStrKey(actIDStrKey);
+        actID.get(oe.sellerID);
         if( (buyingAssetType > ASSET_TYPE_CREDIT_ALPHANUM12) ||
             (sellingAssetType > ASSET_TYPE_CREDIT_ALPHANUM12) )
             throw std::runtime_error("bad database state");
@@ -192,21 +300,19 @@ OfferFrame::loadOffers(soci::details::prepare_temp_type& prep,
         if(sellingAssetType != ASSET_TYPE_NATIVE)
         {
             if((sellingAssetCodeIndicator != soci::i_ok) ||
-                (sellingIssuerIndicator != soci::i_ok))
+                sellingIssuer.isNull())
             {
                 throw std::runtime_error("bad database state");
             }
             
             if(sellingAssetType == ASSET_TYPE_CREDIT_ALPHANUM12)
             {
-                oe.selling.alphaNum12().issuer =
-                    PubKeyUtils::fromStrKey(sellingIssuerStrKey);
+                sellingIssuer.get(oe.selling.alphaNum12().issuer);
                 strToAssetCode(oe.selling.alphaNum12().assetCode,
                     sellingAssetCode);
             } else if(sellingAssetType == ASSET_TYPE_CREDIT_ALPHANUM4)
             {
-                oe.selling.alphaNum4().issuer =
-                    PubKeyUtils::fromStrKey(sellingIssuerStrKey);
+                sellingIssuer.get(oe.selling.alphaNum4().issuer);
                 strToAssetCode(oe.selling.alphaNum4().assetCode,
                     sellingAssetCode);
             }
@@ -216,21 +322,19 @@ OfferFrame::loadOffers(soci::details::prepare_temp_type& prep,
         if(buyingAssetType != ASSET_TYPE_NATIVE)
         {
             if((buyingAssetCodeIndicator != soci::i_ok) ||
-                (buyingIssuerIndicator != soci::i_ok))
+                buyingIssuer.isNull())
             {
                 throw std::runtime_error("bad database state");
             }
 
             if(buyingAssetType == ASSET_TYPE_CREDIT_ALPHANUM12)
             {
-                oe.buying.alphaNum12().issuer =
-                    PubKeyUtils::fromStrKey(buyingIssuerStrKey);
+                buyingIssuer.get(oe.buying.alphaNum12().issuer);
                 strToAssetCode(oe.buying.alphaNum12().assetCode,
                     buyingAssetCode);
             } else if(buyingAssetType == ASSET_TYPE_CREDIT_ALPHANUM4)
             {
-                oe.buying.alphaNum4().issuer =
-                    PubKeyUtils::fromStrKey(buyingIssuerStrKey);
+                buyingIssuer.get(oe.buying.alphaNum4().issuer);
                 strToAssetCode(oe.buying.alphaNum4().assetCode,
                     buyingAssetCode);
             }
@@ -246,58 +350,36 @@ OfferFrame::loadBestOffers(size_t numOffers, size_t offset,
                            Asset const& selling, Asset const& buying,
                            vector<OfferFrame::pointer>& retOffers, Database& db)
 {
-    soci::session& session = db.getSession();
-
-    soci::details::prepare_temp_type sql =
-        (session.prepare << offerColumnSelector);
-
-    std::string sellingAssetCode, sellingIssuerStrKey;
-    std::string buyingAssetCode, buyingIssuerStrKey;
-
-    if (selling.type() == ASSET_TYPE_NATIVE)
+    if (auto state = db.getLedgerState())
     {
-        sql << " WHERE sellingassettype=0";
+        state->flush();
     }
-    else
-    {
-        if(selling.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
-        {
-            assetCodeToStr(selling.alphaNum4().assetCode, sellingAssetCode);
-            sellingIssuerStrKey = PubKeyUtils::toStrKey(selling.alphaNum4().issuer);
-        } else if(selling.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
-        {
-            assetCodeToStr(selling.alphaNum12().assetCode, sellingAssetCode);
-            sellingIssuerStrKey = PubKeyUtils::toStrKey(selling.alphaNum12().issuer);
-        }else throw std::runtime_error("unknown asset type");
+    bool sellingNative = selling.type() == ASSET_TYPE_NATIVE;
+    bool buyingNative = buying.type() == ASSET_TYPE_NATIVE;
 
-        sql << " WHERE sellingassetcode=:pcur AND sellingissuer = :pi",
-            use(sellingAssetCode), use(sellingIssuerStrKey);
-    }
+    std::string sellingAssetCode, buyingAssetCode;
+    BinaryColumn sellingIssuer(db, db.getSession()),
+        buyingIssuer(db, db.getSession());
 
-    if (buying.type() == ASSET_TYPE_NATIVE)
+    auto prep = db.getPreparedStatement(kBestOffers[sellingNative][buyingNative]);
+    auto& st = prep.statement();
+    if (!sellingNative)
     {
-        sql << " AND buyingassettype=0";
+        getAssetFields(selling, sellingAssetCode, sellingIssuer);
+        st.exchange(use(sellingAssetCode));
+        sellingIssuer.bindUse(st);
     }
-    else
+    if (!buyingNative)
     {
-        if(buying.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
-        {
-            assetCodeToStr(buying.alphaNum4().assetCode, buyingAssetCode);
-            buyingIssuerStrKey = PubKeyUtils::toStrKey(buying.alphaNum4().issuer);
-        } else if(buying.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
-        {
-            assetCodeToStr(buying.alphaNum12().assetCode, buyingAssetCode);
-            buyingIssuerStrKey = PubKeyUtils::toStrKey(buying.alphaNum12().issuer);
-        }else throw std::runtime_error("unknown asset type");
-
-        sql << " AND buyingassetcode=:gcur AND buyingissuer = :gi",
-            use(buyingAssetCode), use(buyingIssuerStrKey);
+        getAssetFields(buying, buyingAssetCode, buyingIssuer);
+        st.exchange(use(buyingAssetCode));
+        buyingIssuer.bindUse(st);
     }
-    sql << " ORDER BY price,offerid LIMIT :n OFFSET :o", use(numOffers),
-        use(offset);
+    st.exchange(use(numOffers));
+    st.exchange(use(offset));
 
     auto timer = db.getSelectTimer("offer");
-    loadOffers(sql, [&retOffers](LedgerEntry const& of)
+    loadOffers(db, prep, [&retOffers](LedgerEntry const& of)
                {
                    retOffers.emplace_back(make_shared<OfferFrame>(of));
                });
@@ -308,17 +390,19 @@ OfferFrame::loadOffers(AccountID const& accountID,
                        std::vector<OfferFrame::pointer>& retOffers,
                        Database& db)
 {
-    soci::session& session = db.getSession();
-
-    std::string actIDStrKey;
-    actIDStrKey = PubKeyUtils::toStrKey(accountID);
+    if (auto state = db.getLedgerState())
+    {
+        state->flush();
+    }
+    BinaryColumn actID(db, db.getSession());
+    actID.set(accountID);
 
-    soci::details::prepare_temp_type sql =
-        (session.prepare << offerColumnSelector << " WHERE sellerid=:id",
-         use(actIDStrKey));
+    auto prep = db.getPreparedStatement(kLoadAccountOffers);
+    auto& st = prep.statement();
+    actID.bindUse(st);
 
     auto timer = db.getSelectTimer("offer");
-    loadOffers(sql, [&retOffers](LedgerEntry const& of)
+    loadOffers(db, prep, [&retOffers](LedgerEntry const& of)
                {
                    retOffers.emplace_back(make_shared<OfferFrame>(of));
                });
@@ -327,12 +411,17 @@ OfferFrame::loadOffers(AccountID const& accountID,
 bool
 OfferFrame::exists(Database& db, LedgerKey const& key)
 {
-    std::string actIDStrKey = PubKeyUtils::toStrKey(key.offer().sellerID);
+    BinaryColumn actID(db, db.getSession());
+    actID.set(key.offer().sellerID);
     int exists = 0;
     auto timer = db.getSelectTimer("offer-exists");
-    db.getSession() << "SELECT EXISTS (SELECT NULL FROM offers "
-                       "WHERE sellerid=:id AND offerid=:s)",
-        use(actIDStrKey), use(key.offer().offerID), into(exists);
+    auto prep = db.getPreparedStatement(kOfferExists);
+    auto& st = prep.statement();
+    actID.bindUse(st);
+    st.exchange(use(key.offer().offerID));
+    st.exchange(into(exists));
+    st.define_and_bind();
+    st.execute(true);
     return exists != 0;
 }
 
@@ -354,14 +443,28 @@ OfferFrame::storeDelete(LedgerDelta& delta, Database& db) const
 void
 OfferFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
 {
-    auto timer = db.getDeleteTimer("offer");
-
-    db.getSession() << "DELETE FROM offers WHERE offerid=:s",
-        use(key.offer().offerID);
-
+    if (auto state = db.getLedgerState())
+    {
+        state->storeDelete(key);
+    }
+    else
+    {
+        deleteFromDatabase(key, db);
+    }
     delta.deleteEntry(key);
 }
 
+void
+OfferFrame::deleteFromDatabase(LedgerKey const& key, Database& db)
+{
+    auto prep = db.getPreparedStatement(kDeleteOffer);
+    auto& st = prep.statement();
+    st.exchange(use(key.offer().offerID));
+    st.define_and_bind();
+    auto timer = db.getDeleteTimer("offer");
+    st.execute(true);
+}
+
 int64_t
 OfferFrame::computePrice() const
 {
@@ -371,100 +474,163 @@ OfferFrame::computePrice() const
 void
 OfferFrame::storeChange(LedgerDelta& delta, Database& db) const
 {
+    if (auto state = db.getLedgerState())
+    {
+        state->storeChange(mEntry);
+    }
+    else
+    {
+        storeUpdateInDatabase(db);
+    }
+    delta.modEntry(*this);
+}
 
-    auto timer = db.getUpdateTimer("offer");
+void
+OfferFrame::storeAdd(LedgerDelta& delta, Database& db) const
+{
+    if (auto state = db.getLedgerState())
+    {
+        state->storeAdd(mEntry);
+    }
+    else
+    {
+        storeInsertInDatabase(db);
+    }
+    delta.addEntry(*this);
+}
 
-    soci::statement st =
-        (db.getSession().prepare << "UPDATE offers SET amount=:a, pricen=:n, "
-                                    "priced=:D, price=:p WHERE offerid=:s",
-         use(mOffer.amount), use(mOffer.price.n), use(mOffer.price.d),
-         use(computePrice()), use(mOffer.offerID));
+void
+OfferFrame::storeInDatabase(LedgerEntry const* previous,
+                            LedgerEntry const& entry, Database& db)
+{
+    OfferFrame offer(entry);
+    if (previous)
+    {
+        offer.storeUpdateInDatabase(db);
+    }
+    else
+    {
+        offer.storeInsertInDatabase(db);
+    }
+}
 
-    st.execute(true);
+void
+OfferFrame::storeUpdateInDatabase(Database& db) const
+{
+    int64_t price = computePrice();
+
+    auto prep = db.getPreparedStatement(kUpdateOffer);
+    auto& st = prep.statement();
+    st.exchange(use(mOffer.amount));
+    st.exchange(use(mOffer.price.n));
+    st.exchange(use(mOffer.price.d));
+    st.exchange(use(price));
+    st.exchange(use(mOffer.offerID));
+    st.define_and_bind();
+    {
+        auto timer = db.getUpdateTimer("offer");
+        st.execute(true);
+    }
 
     if (st.get_affected_rows() != 1)
     {
         throw std::runtime_error("could not update SQL");
     }
-
-    delta.modEntry(*this);
 }
 
 void
-OfferFrame::storeAdd(LedgerDelta& delta, Database& db) const
+OfferFrame::storeInsertInDatabase(Database& db) const
 {
-    std::string actIDStrKey = PubKeyUtils::toStrKey(mOffer.sellerID);
-
-    soci::statement st(db.getSession().prepare << "select 1");
-
-    auto timer = db.getInsertTimer("offer");
+    BinaryColumn actID(db, db.getSession()),
+        sellingIssuer(db, db.getSession()), buyingIssuer(db, db.getSession());
+    actID.set(mOffer.sellerID);
 
     unsigned int sellingType = mOffer.selling.type();
     unsigned int buyingType = mOffer.buying.type();
-    std::string sellingIssuerStrKey, buyingIssuerStrKey;
     std::string sellingAssetCode, buyingAssetCode;
+    soci::indicator sellingAssetCodeIndicator = soci::i_null,
+                    buyingAssetCodeIndicator = soci::i_null;
 
-    if(sellingType == ASSET_TYPE_CREDIT_ALPHANUM4)
+    if (sellingType == ASSET_TYPE_NATIVE)
     {
-        sellingIssuerStrKey =
-            PubKeyUtils::toStrKey(mOffer.selling.alphaNum4().issuer); 
-        assetCodeToStr(mOffer.selling.alphaNum4().assetCode,
-            sellingAssetCode);
-       
-    } else if(sellingType == ASSET_TYPE_CREDIT_ALPHANUM12)
+        sellingIssuer.setNull();
+    }
+    else
     {
-        sellingIssuerStrKey =
-            PubKeyUtils::toStrKey(mOffer.selling.alphaNum12().issuer);
-        assetCodeToStr(mOffer.selling.alphaNum12().assetCode,
-            sellingAssetCode);
+        getAssetFields(mOffer.selling, sellingAssetCode, sellingIssuer);
+        sellingAssetCodeIndicator = soci::i_ok;
     }
 
-    if(buyingType == ASSET_TYPE_CREDIT_ALPHANUM4)
+    if (buyingType == ASSET_TYPE_NATIVE)
     {
-        buyingIssuerStrKey =
-            PubKeyUtils::toStrKey(mOffer.buying.alphaNum4().issuer);
-        assetCodeToStr(mOffer.buying.alphaNum4().assetCode,
-            buyingAssetCode);
+        buyingIssuer.setNull();
+    }
+    else
+    {
+        getAssetFields(mOffer.buying, buyingAssetCode, buyingIssuer);
+        buyingAssetCodeIndicator = soci::i_ok;
+    }
 
-    } else if(buyingType == ASSET_TYPE_CREDIT_ALPHANUM12)
+    int64_t price = computePrice();
+
+    auto prep = db.getPreparedStatement(kInsertOffer);
+    auto& st = prep.statement();
+    actID.bindUse(st);
+    st.exchange(use(mOffer.offerID));
+    st.exchange(use(sellingType));
+    st.exchange(use(sellingAssetCode, sellingAssetCodeIndicator));
+    sellingIssuer.bindUse(st);
+    st.exchange(use(buyingType));
+    st.exchange(use(buyingAssetCode, buyingAssetCodeIndicator));
+    buyingIssuer.bindUse(st);
+    st.exchange(use(mOffer.amount));
+    st.exchange(use(mOffer.price.n));
+    st.exchange(use(mOffer.price.d));
+    st.exchange(use(price));
+    st.exchange(use(mOffer.flags));
+    st.define_and_bind();
     {
-        buyingIssuerStrKey =
-            PubKeyUtils::toStrKey(mOffer.buying.alphaNum12().issuer);
-        assetCodeToStr(mOffer.buying.alphaNum12().assetCode,
-            buyingAssetCode);
+        auto timer = db.getInsertTimer("offer");
+        st.execute(true);
     }
-    
-   
-    
-    st = (db.getSession().prepare
-        << "INSERT INTO offers (sellerid,offerid,"
-        "sellingassettype,sellingassetcode,sellingissuer,"
-        "buyingassettype,buyingassetcode,buyingissuer,"
-        "amount,pricen,priced,price,flags) VALUES "
-        "(:v1,:v2,:v3,:v4,:v5,:v6,:v7,:v8,:v9,:v10,:v11,:v12,:v13)",
-        use(actIDStrKey), use(mOffer.offerID), use(sellingType), 
-        use(sellingAssetCode),
-        use(sellingIssuerStrKey), use(buyingType), use(buyingAssetCode),
-        use(buyingIssuerStrKey), use(mOffer.amount), use(mOffer.price.n),
-        use(mOffer.price.d), use(computePrice()), use(mOffer.flags));
-    st.execute(true);
-    
 
     if (st.get_affected_rows() != 1)
     {
         throw std::runtime_error("could not update SQL");
     }
+}
 
-    delta.addEntry(*this);
+void
+OfferFrame::convertKeysToBinary(Database& db)
+{
+    auto& sess = db.getSession();
+    sess << "DROP TABLE IF EXISTS offersbin";
+    createOffersTable(db, "offersbin");
+    sess << "INSERT INTO offersbin (sellerid, offerid, sellingassettype, "
+            "sellingassetcode, sellingissuer, buyingassettype, "
+            "buyingassetcode, buyingissuer, amount, pricen, priced, price, "
+            "flags) "
+            "SELECT k.rawkey, o.offerid, o.sellingassettype, "
+            "o.sellingassetcode, si.rawkey, o.buyingassettype, "
+            "o.buyingassetcode, bi.rawkey, o.amount, o.pricen, o.priced, "
+            "o.price, o.flags "
+            "FROM offers o JOIN strkeys k ON k.strkey = o.sellerid "
+            "LEFT JOIN strkeys si ON si.strkey = o.sellingissuer "
+            "LEFT JOIN strkeys bi ON bi.strkey = o.buyingissuer";
+    sess << "DROP TABLE offers";
+    sess << "ALTER TABLE offersbin RENAME TO offers";
+    sess << kSQLCreateStatement1;
+    sess << kSQLCreateStatement2;
+    sess << kSQLCreateStatement3;
 }
 
 void
 OfferFrame::dropAll(Database& db)
 {
     db.getSession() << "DROP TABLE IF EXISTS offers;";
+    createOffersTable(db, "offers");
     db.getSession() << kSQLCreateStatement1;
     db.getSession() << kSQLCreateStatement2;
     db.getSession() << kSQLCreateStatement3;
-    db.getSession() << kSQLCreateStatement4;
 }
 }
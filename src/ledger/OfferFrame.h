@@ -10,10 +10,6 @@
 namespace soci
 {
 class session;
-namespace details
-{
-class prepare_temp_type;
-}
 }
 
 #define OFFER_PRICE_DIVISOR 10000000
@@ -21,15 +17,19 @@ class prepare_temp_type;
 namespace stellar
 {
 class ManageOfferOpFrame;
+class StatementContext;
 
 class OfferFrame : public EntryFrame
 {
     static void
-    loadOffers(soci::details::prepare_temp_type& prep,
+    loadOffers(Database& db, StatementContext& prep,
                std::function<void(LedgerEntry const&)> offerProcessor);
 
     int64_t computePrice() const;
 
+    void storeUpdateInDatabase(Database& db) const;
+    void storeInsertInDatabase(Database& db) const;
+
     OfferEntry& mOffer;
 
     OfferFrame(OfferFrame const& from);
@@ -88,6 +88,13 @@ class OfferFrame : public EntryFrame
     static pointer loadOffer(AccountID const& accountID, uint64_t offerID,
                              Database& db);
 
+    // see EntryFrame::loadFromDatabase and friends
+    static pointer loadOfferFromDatabase(AccountID const& accountID,
+                                         uint64_t offerID, Database& db);
+    static void storeInDatabase(LedgerEntry const* previous,
+                                LedgerEntry const& entry, Database& db);
+    static void deleteFromDatabase(LedgerKey const& key, Database& db);
+
     static void loadBestOffers(size_t numOffers, size_t offset,
         Asset const& pays, Asset const& gets,
                                std::vector<OfferFrame::pointer>& retOffers,
@@ -97,10 +104,12 @@ class OfferFrame : public EntryFrame
                            std::vector<OfferFrame::pointer>& retOffers,
                            Database& db);
 
+    // see AccountFrame::convertKeysToBinary
+    static void convertKeysToBinary(Database& db);
+
     static void dropAll(Database& db);
     static const char* kSQLCreateStatement1;
     static const char* kSQLCreateStatement2;
     static const char* kSQLCreateStatement3;
-    static const char* kSQLCreateStatement4;
 };
 }
@@ -0,0 +1,550 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/ParallelTxApply.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/Hex.h"
+#include "crypto/SecretKey.h"
+#include "database/Database.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/LedgerState.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "transactions/TransactionFrame.h"
+#include "util/Logging.h"
+#include "util/make_unique.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "xdrpp/printer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace stellar
+{
+using xdr::operator<;
+using xdr::operator==;
+
+struct ParallelTxApply::Group
+{
+    // indices of the transactions, in apply order
+    std::vector<size_t> mTxs;
+    std::set<LedgerKey, LedgerEntryIdCmp> mKeys;
+
+    std::unique_ptr<LedgerState> mState;
+    LedgerHeader mHeader;
+    std::unique_ptr<LedgerDelta> mDelta;
+};
+
+namespace
+{
+// The apply threads running the groups of a phase along with the main thread.
+struct PhaseHelpers
+{
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    size_t mRunning{0};
+    bool mClosed{false};
+
+    // false once the phase is over
+    bool
+    enter()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mClosed)
+        {
+            return false;
+        }
+        mRunning++;
+        return true;
+    }
+
+    void
+    leave()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (--mRunning == 0)
+        {
+            mDone.notify_all();
+        }
+    }
+
+    // waits for the helpers that entered
+    void
+    close()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mClosed = true;
+        mDone.wait(lock, [this]()
+                   {
+                       return mRunning == 0;
+                   });
+    }
+};
+}
+
+ParallelTxApply::ParallelTxApply(Application& app, LedgerDelta& ledgerDelta,
+                                 LedgerState& ledgerState)
+    : mApp(app)
+    , mLedgerDelta(ledgerDelta)
+    , mLedgerState(ledgerState)
+    , mThreads(app.getConfig().APPLY_THREADS)
+    , mTransactionApply(
+          app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mParallelTxs(app.getMetrics().NewMeter(
+          {"ledger", "transaction", "parallel"}, "transaction"))
+    , mFallbacks(app.getMetrics().NewMeter(
+          {"ledger", "transaction", "parallel-fallback"}, "phase"))
+{
+}
+
+static LedgerKey
+accountKey(AccountID const& id)
+{
+    LedgerKey key;
+    key.type(ACCOUNT);
+    key.account().accountID = id;
+    return key;
+}
+
+static LedgerKey
+trustLineKey(AccountID const& id, Asset const& asset)
+{
+    LedgerKey key;
+    key.type(TRUSTLINE);
+    key.trustLine().accountID = id;
+    key.trustLine().asset = asset;
+    return key;
+}
+
+static AccountID const&
+getOwner(LedgerKey const& key)
+{
+    return key.type() == ACCOUNT ? key.account().accountID
+                                 : key.trustLine().accountID;
+}
+
+// adds the keys touched by a payment of `asset` from `source` to `dest`
+static void
+addCreditKeys(Asset const& asset, AccountID const& source,
+              AccountID const& dest, ParallelTxApply::Footprint& fp)
+{
+    AccountID const& issuer = asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4
+                                  ? asset.alphaNum4().issuer
+                                  : asset.alphaNum12().issuer;
+    fp.mReads.push_back(issuer);
+    fp.mKeys.push_back(accountKey(issuer));
+    fp.mKeys.push_back(trustLineKey(source, asset));
+    fp.mKeys.push_back(trustLineKey(dest, asset));
+}
+
+// leaves out the entries of other accounts than the source of `tx`
+static void
+shrinkFootprint(TransactionFrame const& tx, ParallelTxApply::Footprint& fp)
+{
+    AccountID const& source = tx.getEnvelope().tx.sourceAccount;
+    fp.mKeys.erase(std::remove_if(fp.mKeys.begin(), fp.mKeys.end(),
+                                  [&](LedgerKey const& key)
+                                  {
+                                      return !(getOwner(key) == source);
+                                  }),
+                   fp.mKeys.end());
+}
+
+bool
+ParallelTxApply::getFootprint(TransactionFrame const& tx, Footprint& fp)
+{
+    auto const& txBody = tx.getEnvelope().tx;
+    fp.mWrites.push_back(txBody.sourceAccount);
+    fp.mKeys.push_back(accountKey(txBody.sourceAccount));
+
+    for (auto const& op : txBody.operations)
+    {
+        AccountID const& source =
+            op.sourceAccount ? *op.sourceAccount : txBody.sourceAccount;
+        fp.mWrites.push_back(source);
+        fp.mKeys.push_back(accountKey(source));
+
+        switch (op.body.type())
+        {
+        case CREATE_ACCOUNT:
+        {
+            auto const& dest = op.body.createAccountOp().destination;
+            fp.mWrites.push_back(dest);
+            fp.mKeys.push_back(accountKey(dest));
+            break;
+        }
+        case PAYMENT:
+        {
+            auto const& payment = op.body.paymentOp();
+            fp.mWrites.push_back(payment.destination);
+            fp.mKeys.push_back(accountKey(payment.destination));
+            if (payment.asset.type() != ASSET_TYPE_NATIVE)
+            {
+                addCreditKeys(payment.asset, source, payment.destination, fp);
+            }
+            break;
+        }
+        case SET_OPTIONS:
+        {
+            auto const& setOptions = op.body.setOptionsOp();
+            // requiring authorization queries the trust lines by issuer
+            if (setOptions.setFlags &&
+                (*setOptions.setFlags &
+                 (AUTH_REQUIRED_FLAG | AUTH_REVOCABLE_FLAG)))
+            {
+                return false;
+            }
+            if (setOptions.inflationDest)
+            {
+                fp.mReads.push_back(*setOptions.inflationDest);
+                fp.mKeys.push_back(accountKey(*setOptions.inflationDest));
+            }
+            break;
+        }
+        case CHANGE_TRUST:
+        {
+            auto const& line = op.body.changeTrustOp().line;
+            if (line.type() == ASSET_TYPE_NATIVE)
+            {
+                return false;
+            }
+            addCreditKeys(line, source, source, fp);
+            break;
+        }
+        case ALLOW_TRUST:
+        {
+            auto const& allowTrust = op.body.allowTrustOp();
+            Asset asset;
+            asset.type(allowTrust.asset.type());
+            if (allowTrust.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
+            {
+                asset.alphaNum4().assetCode = allowTrust.asset.assetCode4();
+                asset.alphaNum4().issuer = source;
+            }
+            else if (allowTrust.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
+            {
+                asset.alphaNum12().assetCode = allowTrust.asset.assetCode12();
+                asset.alphaNum12().issuer = source;
+            }
+            else
+            {
+                return false;
+            }
+            fp.mWrites.push_back(allowTrust.trustor);
+            fp.mKeys.push_back(trustLineKey(allowTrust.trustor, asset));
+            break;
+        }
+        default:
+            // the order book, account merges and inflation touch entries
+            // that can't be listed upfront
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+ParallelTxApply::applyOne(TransactionFrame& tx, size_t pos,
+                          LedgerDelta& outerDelta, LedgerState& state,
+                          TransactionMeta& tm)
+{
+    auto txTime = mTransactionApply.TimeScope();
+    LedgerDelta delta(outerDelta);
+    auto stateCheckpoint = state.checkpoint();
+    tm = TransactionMeta();
+    try
+    {
+        CLOG(DEBUG, "Tx") << "APPLY: ledger "
+                          << outerDelta.getHeader().ledgerSeq << " tx#" << pos
+                          << " = "
+                          << hexAbbrev(tx.getFullHash())
+                          << " txseq=" << tx.getSeqNum() << " (@ "
+                          << PubKeyUtils::toShortString(tx.getSourceID())
+                          << ")";
+
+        // note that success here just means it got processed
+        // a failed transaction collecting a fee is successful at this layer
+        if (tx.apply(delta, tm, mApp))
+        {
+            delta.commit();
+        }
+        else
+        {
+            // transaction failed validation and cannot have side effects
+            tx.getResult().feeCharged = 0;
+        }
+    }
+    catch (LedgerState::FootprintError&)
+    {
+        throw;
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "Ledger") << "Exception during tx->apply: " << e.what();
+        tx.getResult().result.code(txINTERNAL_ERROR);
+        tx.getResult().feeCharged = 0;
+    }
+    catch (...)
+    {
+        CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
+        tx.getResult().result.code(txINTERNAL_ERROR);
+        tx.getResult().feeCharged = 0;
+    }
+    if (tx.getResult().feeCharged == 0)
+    {
+        CLOG(ERROR, "Tx") << "invalid tx";
+        CLOG(ERROR, "Tx") << "Transaction: "
+                          << xdr::xdr_to_string(tx.getEnvelope());
+        CLOG(ERROR, "Tx") << "Result: " << xdr::xdr_to_string(tx.getResult());
+        // ensures that this transaction doesn't have any side effects
+        delta.rollback();
+        state.rollback(stateCheckpoint);
+        tm.v0().changes.clear();
+        tm.v0().operations.clear();
+    }
+    state.clearUndoLog();
+}
+
+void
+ParallelTxApply::applySerial(std::vector<TransactionFramePtr> const& txs,
+                             size_t begin, size_t end,
+                             std::vector<TransactionMeta>& metas)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        applyOne(*txs[i], i, mLedgerDelta, mLedgerState, metas[i]);
+    }
+}
+
+void
+ParallelTxApply::apply(std::vector<TransactionFramePtr> const& txs,
+                       std::vector<TransactionMeta>& metas)
+{
+    metas.clear();
+    metas.resize(txs.size());
+    if (mThreads <= 1)
+    {
+        applySerial(txs, 0, txs.size(), metas);
+        return;
+    }
+
+    bool shrink = mApp.getConfig().ARTIFICIALLY_SHRINK_FOOTPRINTS_FOR_TESTING;
+    std::vector<Footprint> footprints(txs.size());
+    std::vector<bool> known(txs.size());
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        known[i] = getFootprint(*txs[i], footprints[i]);
+        if (known[i] && shrink)
+        {
+            shrinkFootprint(*txs[i], footprints[i]);
+        }
+    }
+
+    size_t begin = 0;
+    while (begin < txs.size())
+    {
+        if (!known[begin])
+        {
+            applySerial(txs, begin, begin + 1, metas);
+            ++begin;
+            continue;
+        }
+        size_t end = begin + 1;
+        while (end < txs.size() && known[end])
+        {
+            ++end;
+        }
+        if (!applyPhase(txs, footprints, begin, end, metas))
+        {
+            mFallbacks.Mark();
+            applySerial(txs, begin, end, metas);
+        }
+        begin = end;
+    }
+}
+
+bool
+ParallelTxApply::applyPhase(std::vector<TransactionFramePtr> const& txs,
+                            std::vector<Footprint> const& footprints,
+                            size_t begin, size_t end,
+                            std::vector<TransactionMeta>& metas)
+{
+    // union-find over the accounts of the phase
+    std::map<AccountID, size_t> units;
+    std::vector<size_t> parent;
+    auto unitOf = [&](AccountID const& id)
+    {
+        auto it = units.find(id);
+        if (it == units.end())
+        {
+            it = units.emplace(id, parent.size()).first;
+            parent.push_back(parent.size());
+        }
+        return it->second;
+    };
+    auto root = [&](size_t u)
+    {
+        while (parent[u] != u)
+        {
+            parent[u] = parent[parent[u]];
+            u = parent[u];
+        }
+        return u;
+    };
+    auto unite = [&](size_t a, size_t b)
+    {
+        a = root(a);
+        b = root(b);
+        if (a != b)
+        {
+            parent[std::max(a, b)] = std::min(a, b);
+        }
+    };
+
+    std::set<AccountID> written;
+    for (size_t i = begin; i < end; i++)
+    {
+        auto const& fp = footprints[i];
+        size_t u = unitOf(fp.mWrites.front());
+        for (auto const& id : fp.mWrites)
+        {
+            unite(u, unitOf(id));
+            written.insert(id);
+        }
+    }
+    // reading an account written in this phase must see the writes
+    for (size_t i = begin; i < end; i++)
+    {
+        auto const& fp = footprints[i];
+        for (auto const& id : fp.mReads)
+        {
+            if (written.find(id) != written.end())
+            {
+                unite(unitOf(fp.mWrites.front()), unitOf(id));
+            }
+        }
+    }
+
+    // groups are numbered in order of their first transaction
+    std::map<size_t, size_t> groupOfRoot;
+    std::vector<Group> groups;
+    for (size_t i = begin; i < end; i++)
+    {
+        auto const& fp = footprints[i];
+        size_t r = root(unitOf(fp.mWrites.front()));
+        auto it = groupOfRoot.find(r);
+        if (it == groupOfRoot.end())
+        {
+            it = groupOfRoot.emplace(r, groups.size()).first;
+            groups.emplace_back();
+        }
+        auto& group = groups[it->second];
+        group.mTxs.push_back(i);
+        group.mKeys.insert(fp.mKeys.begin(), fp.mKeys.end());
+    }
+
+    if (groups.size() < 2)
+    {
+        applySerial(txs, begin, end, metas);
+        return true;
+    }
+
+    // entries are loaded on the main thread; only accounts written in this
+    // phase, all by the same group, can be changed
+    Database& db = mApp.getDatabase();
+    for (auto& group : groups)
+    {
+        group.mState =
+            make_unique<LedgerState>(db, LedgerState::Isolated());
+        for (auto const& key : group.mKeys)
+        {
+            group.mState->preload(
+                key, mLedgerState.load(key),
+                written.find(getOwner(key)) != written.end());
+        }
+        group.mHeader = mLedgerDelta.getHeader();
+        group.mDelta = make_unique<LedgerDelta>(group.mHeader);
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&]()
+    {
+        for (size_t g = next++; g < groups.size() && !failed; g = next++)
+        {
+            auto& group = groups[g];
+            try
+            {
+                LedgerStateThreadScope scope(*group.mState);
+                for (auto i : group.mTxs)
+                {
+                    applyOne(*txs[i], i, *group.mDelta, *group.mState,
+                             metas[i]);
+                }
+            }
+            catch (std::exception& e)
+            {
+                CLOG(DEBUG, "Ledger")
+                    << "Parallel apply falls back to serial: " << e.what();
+                failed = true;
+            }
+        }
+    };
+
+    // the apply threads help the main thread; once it runs out of groups a
+    // helper that has not started yet has nothing left to do, so it is only
+    // waited for if it is already running
+    auto helpers = std::make_shared<PhaseHelpers>();
+    size_t nThreads = std::min(mThreads, groups.size());
+    for (size_t i = 1; i < nThreads; i++)
+    {
+        mApp.getApplyIOService().post([helpers, worker]()
+                                      {
+                                          if (helpers->enter())
+                                          {
+                                              worker();
+                                              helpers->leave();
+                                          }
+                                      });
+    }
+    worker();
+    helpers->close();
+    if (failed)
+    {
+        return false;
+    }
+
+    // the fee pool is the only part of the header these operations change
+    LedgerHeader& header = mLedgerDelta.getHeader();
+    int64 fees = 0;
+    for (auto const& group : groups)
+    {
+        LedgerHeader h = group.mDelta->getHeader();
+        fees += h.feePool - header.feePool;
+        h.feePool = header.feePool;
+        if (!(h == header))
+        {
+            return false;
+        }
+    }
+
+    for (auto& group : groups)
+    {
+        mLedgerDelta.mergeDelta(*group.mDelta);
+        group.mState->commitTo(mLedgerState);
+    }
+    mLedgerState.clearUndoLog();
+    header.feePool += fees;
+
+    mParallelTxs.Mark(end - begin);
+    return true;
+}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/StellarXDR.h"
+#include "util/NonCopyable.h"
+
+#include <memory>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
+namespace stellar
+{
+class Application;
+class LedgerDelta;
+class LedgerState;
+class TransactionFrame;
+typedef std::shared_ptr<TransactionFrame> TransactionFramePtr;
+
+/**
+ * Applies the transactions of a ledger, in the order given by
+ * TxSetFrame::sortForApply, on up to Config::APPLY_THREADS threads.
+ *
+ * The footprint of most transactions -- the accounts and trust lines they
+ * may read or write -- can be told from their operations. Consecutive
+ * transactions with known footprints form a phase, which is split into
+ * groups of transactions that don't touch each other's accounts; a
+ * transaction reading an account that another one writes joins its group.
+ * Transactions with unknown footprints (offers, merges, inflation, ...) are
+ * applied on their own, between phases.
+ *
+ * Every group of a phase is applied by the main thread or one of the
+ * Application's apply threads, in order, on top of an isolated LedgerState
+ * preloaded on the main thread with the entries of its footprint, and its
+ * own LedgerDelta. Once all groups are done their changes are merged, in
+ * group order, into the ledger's LedgerState and LedgerDelta, and the fees
+ * they collected are added to the header.
+ *
+ * Application is speculative: if a transaction steps outside its footprint
+ * (the isolated state throws LedgerState::FootprintError), or a group
+ * changed the header beyond the fee pool, the results of the whole phase
+ * are dropped and it is applied again serially. Either way the resulting
+ * ledger is the same as if all transactions had been applied serially.
+ */
+class ParallelTxApply : NonMovableOrCopyable
+{
+  public:
+    // Accounts a transaction writes and reads, and the entries it may
+    // load; every key is owned by one of these accounts.
+    struct Footprint
+    {
+        std::vector<AccountID> mWrites;
+        std::vector<AccountID> mReads;
+        std::vector<LedgerKey> mKeys;
+    };
+
+    ParallelTxApply(Application& app, LedgerDelta& ledgerDelta,
+                    LedgerState& ledgerState);
+
+    // Applies `txs` and fills in their meta.
+    void apply(std::vector<TransactionFramePtr> const& txs,
+               std::vector<TransactionMeta>& metas);
+
+    // Returns false if the footprint of `tx` can't be told from its
+    // operations.
+    static bool getFootprint(TransactionFrame const& tx, Footprint& fp);
+
+  private:
+    struct Group;
+
+    Application& mApp;
+    LedgerDelta& mLedgerDelta;
+    LedgerState& mLedgerState;
+    size_t mThreads;
+
+    medida::Timer& mTransactionApply;
+    medida::Meter& mParallelTxs;
+    medida::Meter& mFallbacks;
+
+    // Applies `tx` on top of `delta` and `state`, the way closeLedger
+    // always did: a transaction that fails or throws leaves no trace but
+    // its result. FootprintError is passed on.
+    void applyOne(TransactionFrame& tx, size_t pos, LedgerDelta& delta,
+                  LedgerState& state, TransactionMeta& tm);
+
+    void applySerial(std::vector<TransactionFramePtr> const& txs,
+                     size_t begin, size_t end,
+                     std::vector<TransactionMeta>& metas);
+
+    // Applies txs[begin, end), which all have known footprints; returns
+    // false if the phase must be applied serially instead.
+    bool applyPhase(std::vector<TransactionFramePtr> const& txs,
+                    std::vector<Footprint> const& footprints, size_t begin,
+                    size_t end, std::vector<TransactionMeta>& metas);
+};
+}
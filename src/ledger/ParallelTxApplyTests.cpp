@@ -0,0 +1,243 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/ParallelTxApply.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "lib/catch.hpp"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/test.h"
+#include "transactions/TransactionFrame.h"
+#include "transactions/TxTests.h"
+#include "util/Timer.h"
+
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+static void
+closeLedgerWith(Application& app, std::vector<TransactionFramePtr> const& txs)
+{
+    auto& lm = app.getLedgerManager();
+    TxSetFramePtr txSet =
+        std::make_shared<TxSetFrame>(lm.getLastClosedLedgerHeader().hash);
+    // each application gets its own frames
+    for (auto const& tx : txs)
+    {
+        txSet->add(
+            TransactionFrame::makeTransactionFromWire(tx->getEnvelope()));
+    }
+    txSet->sortForHash();
+
+    StellarValue sv(txSet->getContentsHash(),
+                    getTestDate(1, 7, 2015) + lm.getLedgerNum(),
+                    emptyUpgradeSteps, 0);
+    LedgerCloseData ledgerData(lm.getLedgerNum(), txSet, sv);
+    lm.closeLedger(ledgerData);
+}
+
+// closes a ledger with `txs` on both, which must end up with the same ledger
+static void
+closeBothWith(Application& serial, Application& parallel,
+              std::vector<TransactionFramePtr> const& txs)
+{
+    closeLedgerWith(serial, txs);
+    closeLedgerWith(parallel, txs);
+    auto const& s = serial.getLedgerManager().getLastClosedLedgerHeader();
+    auto const& p = parallel.getLedgerManager().getLastClosedLedgerHeader();
+    REQUIRE(s.header.txSetResultHash == p.header.txSetResultHash);
+    REQUIRE(s.header.bucketListHash == p.header.bucketListHash);
+    REQUIRE(s.header.feePool == p.header.feePool);
+    REQUIRE(s.hash == p.hash);
+}
+
+TEST_CASE("parallel apply matches serial apply", "[ledger][parallelapply]")
+{
+    Config cfgSerial(getTestConfig(0));
+    Config cfgParallel(getTestConfig(1));
+    cfgParallel.APPLY_THREADS = 4;
+
+    VirtualClock clockSerial, clockParallel;
+    auto serial = Application::create(clockSerial, cfgSerial);
+    auto parallel = Application::create(clockParallel, cfgParallel);
+    serial->start();
+    parallel->start();
+
+    auto closeBoth = [&](std::vector<TransactionFramePtr> const& txs)
+    {
+        closeBothWith(*serial, *parallel, txs);
+    };
+    auto nextSeq = [&](SecretKey const& k)
+    {
+        return getAccountSeqNum(k, *serial) + 1;
+    };
+
+    SecretKey root = getRoot();
+    SecretKey gateway = getAccount("gateway");
+    std::vector<SecretKey> accounts;
+    for (int i = 0; i < 12; i++)
+    {
+        accounts.push_back(getAccount(("account" + std::to_string(i)).c_str()));
+    }
+    Asset usd = makeAsset(gateway, "USD");
+    int64_t const amount = 1000000000;
+
+    // all created by root, so one group
+    {
+        std::vector<TransactionFramePtr> txs;
+        SequenceNumber rootSeq = nextSeq(root);
+        txs.push_back(createCreateAccountTx(root, gateway, rootSeq++, amount));
+        for (auto& a : accounts)
+        {
+            txs.push_back(createCreateAccountTx(root, a, rootSeq++, amount));
+        }
+        closeBoth(txs);
+    }
+
+    // independent trust lines, all reading the gateway
+    {
+        std::vector<TransactionFramePtr> txs;
+        for (auto& a : accounts)
+        {
+            txs.push_back(
+                createChangeTrust(a, gateway, nextSeq(a), "USD", amount));
+        }
+        closeBoth(txs);
+    }
+
+    // a mix of independent and conflicting transactions, some failing,
+    // and operations applied serially in between
+    {
+        std::vector<TransactionFramePtr> txs;
+        SequenceNumber gwSeq = nextSeq(gateway);
+        for (size_t i = 0; i < 6; i++)
+        {
+            txs.push_back(
+                createCreditPaymentTx(gateway, accounts[i], usd, gwSeq++, 100));
+        }
+        txs.push_back(createPaymentTx(accounts[6], accounts[7],
+                                      nextSeq(accounts[6]), 10));
+        txs.push_back(createPaymentTx(accounts[8], accounts[9],
+                                      nextSeq(accounts[8]), 10));
+        // underfunded
+        txs.push_back(createCreditPaymentTx(accounts[10], accounts[11], usd,
+                                            nextSeq(accounts[10]), 10));
+        // bad sequence number
+        txs.push_back(createPaymentTx(accounts[11], accounts[10],
+                                      nextSeq(accounts[11]) + 1, 10));
+        SecretKey newAccount = getAccount("new account");
+        txs.push_back(createCreateAccountTx(accounts[9], newAccount,
+                                            nextSeq(accounts[9]), amount / 2));
+        AccountID dest = accounts[5].getPublicKey();
+        txs.push_back(createSetOptions(accounts[4], nextSeq(accounts[4]), &dest,
+                                       nullptr, nullptr, nullptr, nullptr));
+        txs.push_back(createPathPaymentTx(accounts[3], accounts[2], Asset(),
+                                          10, Asset(), 10,
+                                          nextSeq(accounts[3])));
+        closeBoth(txs);
+    }
+
+    // chains of payments within a ledger
+    {
+        std::vector<TransactionFramePtr> txs;
+        for (size_t i = 0; i < 5; i++)
+        {
+            txs.push_back(createCreditPaymentTx(accounts[i], accounts[i + 1],
+                                                usd, nextSeq(accounts[i]), 50));
+        }
+        for (size_t i = 6; i < 11; i++)
+        {
+            txs.push_back(createPaymentTx(accounts[i], accounts[i + 1],
+                                          nextSeq(accounts[i]), 1000));
+        }
+        closeBoth(txs);
+    }
+
+    auto& parallelTxs = parallel->getMetrics().NewMeter(
+        {"ledger", "transaction", "parallel"}, "transaction");
+    REQUIRE(parallelTxs.count() > 0);
+}
+
+TEST_CASE("parallel apply falls back to serial apply",
+          "[ledger][parallelapply]")
+{
+    Config cfgSerial(getTestConfig(0));
+    Config cfgParallel(getTestConfig(1));
+    cfgParallel.APPLY_THREADS = 4;
+    // payments load their destination from outside their footprint
+    cfgParallel.ARTIFICIALLY_SHRINK_FOOTPRINTS_FOR_TESTING = true;
+
+    VirtualClock clockSerial, clockParallel;
+    auto serial = Application::create(clockSerial, cfgSerial);
+    auto parallel = Application::create(clockParallel, cfgParallel);
+    serial->start();
+    parallel->start();
+
+    auto nextSeq = [&](SecretKey const& k)
+    {
+        return getAccountSeqNum(k, *serial) + 1;
+    };
+
+    SecretKey root = getRoot();
+    std::vector<SecretKey> accounts;
+    for (int i = 0; i < 8; i++)
+    {
+        accounts.push_back(getAccount(("account" + std::to_string(i)).c_str()));
+    }
+    int64_t const amount = 1000000000;
+
+    // all created by root, so one group, applied serially
+    {
+        std::vector<TransactionFramePtr> txs;
+        SequenceNumber rootSeq = nextSeq(root);
+        for (auto& a : accounts)
+        {
+            txs.push_back(createCreateAccountTx(root, a, rootSeq++, amount));
+        }
+        closeBothWith(*serial, *parallel, txs);
+    }
+
+    auto& fallbacks = parallel->getMetrics().NewMeter(
+        {"ledger", "transaction", "parallel-fallback"}, "phase");
+    auto& parallelTxs = parallel->getMetrics().NewMeter(
+        {"ledger", "transaction", "parallel"}, "transaction");
+    REQUIRE(fallbacks.count() == 0);
+
+    // independent groups, some applied without trouble before others step
+    // outside their footprint
+    {
+        std::vector<TransactionFramePtr> txs;
+        for (size_t i = 0; i < 4; i++)
+        {
+            txs.push_back(createSetOptions(accounts[i], nextSeq(accounts[i]),
+                                           nullptr, nullptr, nullptr, nullptr,
+                                           nullptr));
+        }
+        for (size_t i = 4; i < 8; i += 2)
+        {
+            txs.push_back(createPaymentTx(accounts[i], accounts[i + 1],
+                                          nextSeq(accounts[i]), 1000));
+        }
+        closeBothWith(*serial, *parallel, txs);
+    }
+
+    REQUIRE(fallbacks.count() == 1);
+    REQUIRE(parallelTxs.count() == 0);
+
+    // and the ledgers keep matching afterwards
+    {
+        std::vector<TransactionFramePtr> txs;
+        for (size_t i = 0; i < 8; i += 2)
+        {
+            txs.push_back(createPaymentTx(accounts[i], accounts[i + 1],
+                                          nextSeq(accounts[i]), 1000));
+        }
+        closeBothWith(*serial, *parallel, txs);
+    }
+    REQUIRE(fallbacks.count() == 2);
+}
@@ -8,6 +8,7 @@
 #include "crypto/SHA.h"
 #include "database/Database.h"
 #include "LedgerDelta.h"
+#include "ledger/LedgerState.h"
 #include "util/types.h"
 
 using namespace std;
@@ -17,22 +18,69 @@ namespace stellar
 {
 using xdr::operator==;
 
+// account IDs are stored as their raw 32 bytes
+static void
+createTrustLinesTable(Database& db, std::string const& name)
+{
+    std::string bin = db.getBinaryColumnType();
+    db.getSession()
+        << "CREATE TABLE " + name +
+               "("
+               "accountid     " + bin + "          NOT NULL,"
+               "assettype     INT             NOT NULL,"
+               "issuer        " + bin + "          NOT NULL,"
+               "assetcode     VARCHAR(12)     NOT NULL,"
+               "tlimit        BIGINT          NOT NULL DEFAULT 0 CHECK (tlimit >= 0),"
+               "balance       BIGINT          NOT NULL DEFAULT 0 CHECK (balance >= 0),"
+               "flags         INT             NOT NULL,"
+               "PRIMARY KEY (accountid, issuer, assetcode)"
+               ");";
+}
+
 const char* TrustFrame::kSQLCreateStatement1 =
-    "CREATE TABLE trustlines"
-    "("
-    "accountid     VARCHAR(56)     NOT NULL,"
-    "assettype     INT             NOT NULL,"
-    "issuer        VARCHAR(56)     NOT NULL,"
-    "assetcode     VARCHAR(12)     NOT NULL,"
-    "tlimit        BIGINT          NOT NULL DEFAULT 0 CHECK (tlimit >= 0),"
-    "balance       BIGINT          NOT NULL DEFAULT 0 CHECK (balance >= 0),"
-    "flags         INT             NOT NULL,"
-    "PRIMARY KEY (accountid, issuer, assetcode)"
-    ");";
-
-const char* TrustFrame::kSQLCreateStatement2 =
     "CREATE INDEX accountlines ON trustlines (accountid);";
 
+static const char* trustLineColumnSelector =
+    "SELECT accountid, assettype, issuer, assetcode, tlimit,balance,flags FROM "
+    "trustlines";
+
+static StatementId const kLoadTrustLine = StatementId::registerStatement(
+    "trust-load", std::string(trustLineColumnSelector) +
+                      " WHERE accountid = :id "
+                      " AND issuer = :issuer "
+                      " AND assetcode = :asset");
+
+static StatementId const kLoadAccountLines = StatementId::registerStatement(
+    "trust-load-account",
+    std::string(trustLineColumnSelector) + " WHERE accountid = :id ");
+
+static StatementId const kLoadTrustLineKeys = StatementId::registerStatement(
+    "trust-keys", "SELECT accountid, assettype, issuer, assetcode "
+                  "FROM trustlines");
+
+static StatementId const kTrustLineExists = StatementId::registerStatement(
+    "trust-exists", "SELECT EXISTS (SELECT NULL FROM trustlines "
+                    "WHERE accountid=:v1 and issuer=:v2 and assetcode=:v3)");
+
+static StatementId const kDeleteTrustLine = StatementId::registerStatement(
+    "trust-delete", "DELETE FROM trustlines "
+                    "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3");
+
+static StatementId const kUpdateTrustLine = StatementId::registerStatement(
+    "trust-update", "UPDATE trustlines "
+                    "SET balance=:b, tlimit=:tl, flags=:a "
+                    "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3");
+
+static StatementId const kInsertTrustLine = StatementId::registerStatement(
+    "trust-insert",
+    "INSERT INTO trustlines "
+    "(accountid, assettype, issuer, assetcode, balance, tlimit, flags) VALUES "
+    "(:v1,      :v2,       :v3,    :v4,       :v5,     :v6,    :v7)");
+
+static StatementId const kHasIssued = StatementId::registerStatement(
+    "trust-issued", "SELECT balance FROM trustlines WHERE issuer=:id "
+                    "AND balance>0 LIMIT 1");
+
 TrustFrame::TrustFrame()
     : EntryFrame(TRUSTLINE), mTrustLine(mEntry.trustLine()), mIsIssuer(false)
 {
@@ -61,28 +109,32 @@ TrustFrame& TrustFrame::operator=(TrustFrame const& other)
 }
 
 void
-TrustFrame::getKeyFields(LedgerKey const& key, std::string& actIDStrKey,
-                         std::string& issuerStrKey, std::string& assetCode)
+TrustFrame::getKeyFields(LedgerKey const& key, BinaryColumn& actID,
+                         BinaryColumn& issuer, std::string& assetCode)
 {
-    actIDStrKey = PubKeyUtils::toStrKey(key.trustLine().accountID);
+    AccountID const* issuerID = nullptr;
     if(key.trustLine().asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
     {
-        issuerStrKey =
-            PubKeyUtils::toStrKey(key.trustLine().asset.alphaNum4().issuer);
+        issuerID = &key.trustLine().asset.alphaNum4().issuer;
         assetCodeToStr(key.trustLine().asset.alphaNum4().assetCode,
             assetCode);
     } else if(key.trustLine().asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
     {
-        issuerStrKey =
-            PubKeyUtils::toStrKey(key.trustLine().asset.alphaNum12().issuer);
+        issuerID = &key.trustLine().asset.alphaNum12().issuer;
         assetCodeToStr(key.trustLine().asset.alphaNum12().assetCode,
             assetCode);
     }
-    
-    if (actIDStrKey == issuerStrKey)
+    else
+    {
+        throw std::runtime_error("XLM TrustLine?");
+    }
+
+    if (key.trustLine().accountID == *issuerID)
         throw std::runtime_error("Issuer's own trustline should not be used "
                                  "outside of OperationFrame");
-   
+
+    actID.set(key.trustLine().accountID);
+    issuer.set(*issuerID);
 }
 
 int64_t
@@ -166,20 +218,28 @@ TrustFrame::isValid() const
 bool
 TrustFrame::exists(Database& db, LedgerKey const& key)
 {
-    std::string actIDStrKey, issuerStrKey, assetCode;
-    getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetCode;
+    getKeyFields(key, actID, issuer, assetCode);
+    auto& filter = db.getEntryFilter();
+    if (!filter.mayContain(key))
+    {
+        return false;
+    }
     int exists = 0;
     auto timer = db.getSelectTimer("trust-exists");
-    auto prep = db.getPreparedStatement(
-        "SELECT EXISTS (SELECT NULL FROM trustlines "
-        "WHERE accountid=:v1 and issuer=:v2 and assetcode=:v3)");
+    auto prep = db.getPreparedStatement(kTrustLineExists);
     auto& st = prep.statement();
-    st.exchange(use(actIDStrKey));
-    st.exchange(use(issuerStrKey));
+    actID.bindUse(st);
+    issuer.bindUse(st);
     st.exchange(use(assetCode));
     st.exchange(into(exists));
     st.define_and_bind();
     st.execute(true);
+    if (exists == 0)
+    {
+        filter.recordFalsePositive();
+    }
     return exists != 0;
 }
 
@@ -191,6 +251,45 @@ TrustFrame::countObjects(soci::session& sess)
     return count;
 }
 
+void
+TrustFrame::loadKeys(Database& db,
+                     std::function<void(LedgerKey const&)> keyProcessor)
+{
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetCode;
+    unsigned int assetType;
+
+    LedgerKey key;
+    key.type(TRUSTLINE);
+    auto& tl = key.trustLine();
+
+    auto prep = db.getPreparedStatement(kLoadTrustLineKeys);
+    auto& st = prep.statement();
+    actID.bindInto(st);
+    st.exchange(into(assetType));
+    issuer.bindInto(st);
+    st.exchange(into(assetCode));
+    st.define_and_bind();
+    st.execute(true);
+    while (st.got_data())
+    {
+        actID.get(tl.accountID);
+        tl.asset.type((AssetType)assetType);
+        if (assetType == ASSET_TYPE_CREDIT_ALPHANUM4)
+        {
+            issuer.get(tl.asset.alphaNum4().issuer);
+            strToAssetCode(tl.asset.alphaNum4().assetCode, assetCode);
+        }
+        else if (assetType == ASSET_TYPE_CREDIT_ALPHANUM12)
+        {
+            issuer.get(tl.asset.alphaNum12().issuer);
+            strToAssetCode(tl.asset.alphaNum12().assetCode, assetCode);
+        }
+        keyProcessor(key);
+        st.fetch();
+    }
+}
+
 void
 TrustFrame::storeDelete(LedgerDelta& delta, Database& db) const
 {
@@ -200,16 +299,32 @@ TrustFrame::storeDelete(LedgerDelta& delta, Database& db) const
 void
 TrustFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
 {
-    std::string actIDStrKey, issuerStrKey, assetCode;
-    getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
+    if (auto state = db.getLedgerState())
+    {
+        state->storeDelete(key);
+    }
+    else
+    {
+        deleteFromDatabase(key, db);
+    }
+    delta.deleteEntry(key);
+}
+
+void
+TrustFrame::deleteFromDatabase(LedgerKey const& key, Database& db)
+{
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetCode;
+    getKeyFields(key, actID, issuer, assetCode);
 
+    auto prep = db.getPreparedStatement(kDeleteTrustLine);
+    auto& st = prep.statement();
+    actID.bindUse(st);
+    issuer.bindUse(st);
+    st.exchange(use(assetCode));
+    st.define_and_bind();
     auto timer = db.getDeleteTimer("trust");
-    db.getSession()
-        << "DELETE FROM trustlines "
-           "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3",
-        use(actIDStrKey), use(issuerStrKey), use(assetCode);
-
-    delta.deleteEntry(key);
+    st.execute(true);
 }
 
 void
@@ -220,19 +335,65 @@ TrustFrame::storeChange(LedgerDelta& delta, Database& db) const
     if (mIsIssuer)
         return;
 
-    std::string actIDStrKey, issuerStrKey, assetCode;
-    getKeyFields(getKey(), actIDStrKey, issuerStrKey, assetCode);
+    if (auto state = db.getLedgerState())
+    {
+        state->storeChange(mEntry);
+    }
+    else
+    {
+        storeUpdateInDatabase(db);
+    }
+    delta.modEntry(*this);
+}
+
+void
+TrustFrame::storeAdd(LedgerDelta& delta, Database& db) const
+{
+    assert(isValid());
+
+    if (mIsIssuer)
+        return;
+
+    if (auto state = db.getLedgerState())
+    {
+        state->storeAdd(mEntry);
+    }
+    else
+    {
+        storeInsertInDatabase(db);
+    }
+    delta.addEntry(*this);
+}
+
+void
+TrustFrame::storeInDatabase(LedgerEntry const* previous,
+                            LedgerEntry const& entry, Database& db)
+{
+    TrustFrame line(entry);
+    if (previous)
+    {
+        line.storeUpdateInDatabase(db);
+    }
+    else
+    {
+        line.storeInsertInDatabase(db);
+    }
+}
 
-    auto prep = db.getPreparedStatement(
-        "UPDATE trustlines "
-        "SET balance=:b, tlimit=:tl, flags=:a "
-        "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3");
+void
+TrustFrame::storeUpdateInDatabase(Database& db) const
+{
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetCode;
+    getKeyFields(getKey(), actID, issuer, assetCode);
+
+    auto prep = db.getPreparedStatement(kUpdateTrustLine);
     auto& st = prep.statement();
     st.exchange(use(mTrustLine.balance));
     st.exchange(use(mTrustLine.limit));
     st.exchange(use(mTrustLine.flags));
-    st.exchange(use(actIDStrKey));
-    st.exchange(use(issuerStrKey));
+    actID.bindUse(st);
+    issuer.bindUse(st);
     st.exchange(use(assetCode));
     st.define_and_bind();
     {
@@ -243,30 +404,21 @@ TrustFrame::storeChange(LedgerDelta& delta, Database& db) const
     {
         throw std::runtime_error("Could not update data in SQL");
     }
-
-    delta.modEntry(*this);
 }
 
 void
-TrustFrame::storeAdd(LedgerDelta& delta, Database& db) const
+TrustFrame::storeInsertInDatabase(Database& db) const
 {
-    assert(isValid());
-
-    if (mIsIssuer)
-        return;
-
-    std::string actIDStrKey, issuerStrKey, assetCode;
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetCode;
     unsigned int assetType = getKey().trustLine().asset.type();
-    getKeyFields(getKey(), actIDStrKey, issuerStrKey, assetCode);
+    getKeyFields(getKey(), actID, issuer, assetCode);
 
-    auto prep = db.getPreparedStatement(
-        "INSERT INTO trustlines "
-        "(accountid, assettype, issuer, assetcode, balance, tlimit, flags) VALUES "
-        "(:v1,      :v2,       :v3,    :v4,       :v5,     :v6,    :v7)");
+    auto prep = db.getPreparedStatement(kInsertTrustLine);
     auto& st = prep.statement();
-    st.exchange(use(actIDStrKey));
+    actID.bindUse(st);
     st.exchange(use(assetType));
-    st.exchange(use(issuerStrKey));
+    issuer.bindUse(st);
     st.exchange(use(assetCode));
     st.exchange(use(mTrustLine.balance));
     st.exchange(use(mTrustLine.limit));
@@ -281,14 +433,9 @@ TrustFrame::storeAdd(LedgerDelta& delta, Database& db) const
     {
         throw std::runtime_error("Could not update data in SQL");
     }
-
-    delta.addEntry(*this);
+    db.getEntryFilter().add(getKey());
 }
 
-static const char* trustLineColumnSelector =
-    "SELECT accountid, assettype, issuer, assetcode, tlimit,balance,flags FROM "
-    "trustlines";
-
 TrustFrame::pointer
 TrustFrame::createIssuerFrame(Asset const& issuer)
 {
@@ -317,50 +464,80 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
             return createIssuerFrame(asset);
     } else throw std::runtime_error("XLM TrustLine?");
 
-    std::string accStr, issuerStr, assetStr;
+    if (auto state = db.getLedgerState())
+    {
+        LedgerKey key;
+        key.type(TRUSTLINE);
+        key.trustLine().accountID = accountID;
+        key.trustLine().asset = asset;
+        auto p = state->load(key);
+        return p ? make_shared<TrustFrame>(*p) : nullptr;
+    }
+    return loadTrustLineFromDatabase(accountID, asset, db);
+}
+
+TrustFrame::pointer
+TrustFrame::loadTrustLineFromDatabase(AccountID const& accountID,
+                                      Asset const& asset, Database& db)
+{
+    LedgerKey key;
+    key.type(TRUSTLINE);
+    key.trustLine().accountID = accountID;
+    key.trustLine().asset = asset;
+    auto& filter = db.getEntryFilter();
+    if (!filter.mayContain(key))
+    {
+        return nullptr;
+    }
+
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetStr;
 
-    accStr = PubKeyUtils::toStrKey(accountID);
+    actID.set(accountID);
     if(asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
     {
         assetCodeToStr(asset.alphaNum4().assetCode, assetStr);
-        issuerStr = PubKeyUtils::toStrKey(asset.alphaNum4().issuer);
+        issuer.set(asset.alphaNum4().issuer);
     } else if(asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
     {
         assetCodeToStr(asset.alphaNum12().assetCode, assetStr);
-        issuerStr = PubKeyUtils::toStrKey(asset.alphaNum12().issuer);
+        issuer.set(asset.alphaNum12().issuer);
     }
 
-    auto query = std::string(trustLineColumnSelector);
-    query += (" WHERE accountid = :id "
-              " AND issuer = :issuer "
-              " AND assetcode = :asset");
-    auto prep = db.getPreparedStatement(query);
+    auto prep = db.getPreparedStatement(kLoadTrustLine);
     auto& st = prep.statement();
-    st.exchange(use(accStr));
-    st.exchange(use(issuerStr));
+    actID.bindUse(st);
+    issuer.bindUse(st);
     st.exchange(use(assetStr));
 
     pointer retLine;
     auto timer = db.getSelectTimer("trust");
-    loadLines(prep, [&retLine](LedgerEntry const& trust)
+    loadLines(db, prep, [&retLine](LedgerEntry const& trust)
               {
                   retLine = make_shared<TrustFrame>(trust);
               });
+    if (!retLine)
+    {
+        filter.recordFalsePositive();
+    }
     return retLine;
 }
 
 bool
 TrustFrame::hasIssued(AccountID const& issuerID, Database& db)
 {
-    std::string accStrKey;
-    accStrKey = PubKeyUtils::toStrKey(issuerID);
+    if (auto state = db.getLedgerState())
+    {
+        state->flush();
+    }
+
+    BinaryColumn issuer(db, db.getSession());
+    issuer.set(issuerID);
     int balance = 0;
 
-    auto prep = db.getPreparedStatement(
-        "SELECT balance FROM trustlines WHERE issuer=:id "
-        "AND balance>0 LIMIT 1");
+    auto prep = db.getPreparedStatement(kHasIssued);
     auto& st = prep.statement();
-    st.exchange(use(accStrKey));
+    issuer.bindUse(st);
     st.exchange(into(balance));
     st.define_and_bind();
 
@@ -376,11 +553,11 @@ TrustFrame::hasIssued(AccountID const& issuerID, Database& db)
 }
 
 void
-TrustFrame::loadLines(StatementContext& prep,
+TrustFrame::loadLines(Database& db, StatementContext& prep,
                       std::function<void(LedgerEntry const&)> trustProcessor)
 {
-    string actIDStrKey;
-    std::string issuerStrKey, assetCode;
+    BinaryColumn actID(db, db.getSession()), issuer(db, db.getSession());
+    std::string assetCode;
     unsigned int assetType;
 
     LedgerEntry le;
@@ -389,9 +566,9 @@ TrustFrame::loadLines(StatementContext& prep,
     TrustLineEntry& tl = le.trustLine();
 
     auto& st = prep.statement();
-    st.exchange(into(actIDStrKey));
+    actID.bindInto(st);
     st.exchange(into(assetType));
-    st.exchange(into(issuerStrKey));
+    issuer.bindInto(st);
     st.exchange(into(assetCode));
     st.exchange(into(tl.limit));
     st.exchange(into(tl.balance));
@@ -401,15 +578,15 @@ TrustFrame::loadLines(StatementContext& prep,
     st.execute(true);
     while (st.got_data())
     {
-        tl.accountID = PubKeyUtils::fromStrKey(actIDStrKey);
+        actID.get(tl.accountID);
         tl.asset.type((AssetType)assetType);
         if(assetType == ASSET_TYPE_CREDIT_ALPHANUM4)
         {
-            tl.asset.alphaNum4().issuer = PubKeyUtils::fromStrKey(issuerStrKey);
+            issuer.get(tl.asset.alphaNum4().issuer);
             strToAssetCode(tl.asset.alphaNum4().assetCode, assetCode);
         } else if(assetType == ASSET_TYPE_CREDIT_ALPHANUM12)
         {
-            tl.asset.alphaNum12().issuer = PubKeyUtils::fromStrKey(issuerStrKey);
+            issuer.get(tl.asset.alphaNum12().issuer);
             strToAssetCode(tl.asset.alphaNum12().assetCode, assetCode);
         }
 
@@ -423,27 +600,47 @@ void
 TrustFrame::loadLines(AccountID const& accountID,
                       std::vector<TrustFrame::pointer>& retLines, Database& db)
 {
-    std::string actIDStrKey;
-    actIDStrKey = PubKeyUtils::toStrKey(accountID);
+    if (auto state = db.getLedgerState())
+    {
+        state->flush();
+    }
+
+    BinaryColumn actID(db, db.getSession());
+    actID.set(accountID);
 
-    auto query = std::string(trustLineColumnSelector);
-    query += (" WHERE accountid = :id ");
-    auto prep = db.getPreparedStatement(query);
+    auto prep = db.getPreparedStatement(kLoadAccountLines);
     auto& st = prep.statement();
-    st.exchange(use(actIDStrKey));
+    actID.bindUse(st);
 
     auto timer = db.getSelectTimer("trust");
-    loadLines(prep, [&retLines](LedgerEntry const& cur)
+    loadLines(db, prep, [&retLines](LedgerEntry const& cur)
               {
                   retLines.emplace_back(make_shared<TrustFrame>(cur));
               });
 }
 
+void
+TrustFrame::convertKeysToBinary(Database& db)
+{
+    auto& sess = db.getSession();
+    sess << "DROP TABLE IF EXISTS trustlinesbin";
+    createTrustLinesTable(db, "trustlinesbin");
+    sess << "INSERT INTO trustlinesbin (accountid, assettype, issuer, "
+            "assetcode, tlimit, balance, flags) "
+            "SELECT k.rawkey, t.assettype, i.rawkey, t.assetcode, t.tlimit, "
+            "t.balance, t.flags "
+            "FROM trustlines t JOIN strkeys k ON k.strkey = t.accountid "
+            "JOIN strkeys i ON i.strkey = t.issuer";
+    sess << "DROP TABLE trustlines";
+    sess << "ALTER TABLE trustlinesbin RENAME TO trustlines";
+    sess << kSQLCreateStatement1;
+}
+
 void
 TrustFrame::dropAll(Database& db)
 {
     db.getSession() << "DROP TABLE IF EXISTS trustlines;";
+    createTrustLinesTable(db, "trustlines");
     db.getSession() << kSQLCreateStatement1;
-    db.getSession() << kSQLCreateStatement2;
 }
 }
@@ -21,6 +21,7 @@ namespace stellar
 
 class TrustSetTx;
 class StatementContext;
+class BinaryColumn;
 
 class TrustFrame : public EntryFrame
 {
@@ -28,16 +29,18 @@ class TrustFrame : public EntryFrame
     typedef std::shared_ptr<TrustFrame> pointer;
 
   private:
-    static void getKeyFields(LedgerKey const& key, std::string& actIDStrKey,
-                             std::string& issuerStrKey,
-                             std::string& assetCode);
+    static void getKeyFields(LedgerKey const& key, BinaryColumn& actID,
+                             BinaryColumn& issuer, std::string& assetCode);
 
     static void
-    loadLines(StatementContext& prep,
+    loadLines(Database& db, StatementContext& prep,
               std::function<void(LedgerEntry const&)> trustProcessor);
 
     TrustLineEntry& mTrustLine;
 
+    void storeUpdateInDatabase(Database& db) const;
+    void storeInsertInDatabase(Database& db) const;
+
     static TrustFrame::pointer createIssuerFrame(Asset const& issuer);
     bool mIsIssuer; // the TrustFrame fakes an infinite trustline for issuers
 
@@ -64,11 +67,22 @@ class TrustFrame : public EntryFrame
                             LedgerKey const& key);
     static bool exists(Database& db, LedgerKey const& key);
     static uint64_t countObjects(soci::session& sess);
+    // calls keyProcessor with the key of every trust line in the database
+    static void
+    loadKeys(Database& db,
+             std::function<void(LedgerKey const&)> keyProcessor);
 
     // returns the specified trustline or a generated one for issuers
     static pointer loadTrustLine(AccountID const& accountID,
         Asset const& asset, Database& db);
 
+    // see EntryFrame::loadFromDatabase and friends
+    static pointer loadTrustLineFromDatabase(AccountID const& accountID,
+                                             Asset const& asset, Database& db);
+    static void storeInDatabase(LedgerEntry const* previous,
+                                LedgerEntry const& entry, Database& db);
+    static void deleteFromDatabase(LedgerKey const& key, Database& db);
+
     // note: only returns trust lines stored in the database
     static void loadLines(AccountID const& accountID,
                           std::vector<TrustFrame::pointer>& retLines,
@@ -98,8 +112,10 @@ class TrustFrame : public EntryFrame
 
     bool isValid() const;
 
+    // see AccountFrame::convertKeysToBinary
+    static void convertKeysToBinary(Database& db);
+
     static void dropAll(Database& db);
     static const char* kSQLCreateStatement1;
-    static const char* kSQLCreateStatement2;
 };
 }
@@ -31,6 +31,8 @@ class OverlayManager;
 class Database;
 class PersistentState;
 class LoadGenerator;
+class Tracer;
+class ShardedMetrics;
 
 /*
  * State of a single instance of the stellar-core application.
@@ -163,6 +165,14 @@ class Application
     // reported through the administrative HTTP interface, see CommandHandler.
     virtual medida::MetricsRegistry& getMetrics() = 0;
 
+    // Get the sharded front of that registry, for metrics updated on hot
+    // paths and from many threads. See util/ShardedMetrics.h.
+    virtual ShardedMetrics& getShardedMetrics() = 0;
+
+    // Get the span tracer recording the phases of recent ledger closes. See
+    // util/Tracing.h and the `trace` command.
+    virtual Tracer& getTracer() = 0;
+
     // Ensure any App-local metrics that are "current state" gauge-like counters
     // reflect the current reality as best as possible.
     virtual void syncOwnMetrics() = 0;
@@ -186,6 +196,12 @@ class Application
     // with caution.
     virtual asio::io_service& getWorkerIOService() = 0;
 
+    // Get the IO service of the Config::APPLY_THREADS - 1 threads helping the
+    // main thread apply the transactions of a ledger in parallel. They are
+    // kept apart from the worker threads so that a ledger close never waits
+    // behind a long background job.
+    virtual asio::io_service& getApplyIOService() = 0;
+
     // Perform actions necessary to transition from BOOTING_STATE to other
     // states. In particular: either reload or reinitialize the database, and
     // either restart or begin reacquiring SCP consensus (as instructed by
@@ -211,6 +227,12 @@ class Application
     virtual void generateLoad(uint32_t nAccounts, uint32_t nTxs,
                               uint32_t txRate, bool autoRate) = 0;
 
+    // As generateLoad, but submitting at a fixed rate independently of how
+    // fast transactions externalize, with signing done on worker threads. See
+    // LoadGenerator::generateOpenLoopLoad.
+    virtual void generateOpenLoopLoad(uint32_t nAccounts, uint32_t nTxs,
+                                      uint32_t txRate) = 0;
+
     // Run a consistency check between the database and the bucketlist.
     virtual void checkDB() = 0;
 
@@ -19,16 +19,20 @@
 #include "process/ProcessManager.h"
 #include "main/CommandHandler.h"
 #include "simulation/LoadGenerator.h"
+#include "crypto/SecretKey.h"
 #include "medida/metrics_registry.h"
 #include "medida/reporting/console_reporter.h"
 #include "medida/meter.h"
 #include "medida/counter.h"
 #include "medida/timer.h"
 
+#include "util/ShardedMetrics.h"
 #include "util/TmpDir.h"
+#include "util/Tracing.h"
 #include "util/Logging.h"
 #include "util/make_unique.h"
 
+#include <algorithm>
 #include <set>
 #include <string>
 
@@ -37,19 +41,35 @@ static const int SHUTDOWN_DELAY_SECONDS = 1;
 namespace stellar
 {
 
+// hardware_concurrency() is 0 when it can't tell; work posted to the workers
+// would then never run
+static unsigned
+workerThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
 ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     : mVirtualClock(clock)
     , mConfig(cfg)
-    , mWorkerIOService(std::thread::hardware_concurrency())
+    , mWorkerIOService(workerThreadCount())
     , mWork(make_unique<asio::io_service::work>(mWorkerIOService))
+    , mApplyIOService(std::max(1u, cfg.APPLY_THREADS))
+    , mApplyWork(make_unique<asio::io_service::work>(mApplyIOService))
     , mWorkerThreads()
     , mStopSignals(clock.getIOService(), SIGINT)
     , mStopping(false)
     , mStoppingTimer(*this)
     , mMetrics(make_unique<medida::MetricsRegistry>())
+    , mShardedMetrics(make_unique<ShardedMetrics>(*mMetrics))
     , mAppStateCurrent(mMetrics->NewCounter({"app", "state", "current"}))
     , mAppStateChanges(mMetrics->NewTimer({"app", "state", "changes"}))
     , mLastStateChange(clock.now())
+    , mVerifySigCacheHits(
+          mMetrics->NewCounter({"crypto", "verify-cache", "hit"}))
+    , mVerifySigCacheMisses(
+          mMetrics->NewCounter({"crypto", "verify-cache", "miss"}))
+    , mTracer(make_unique<Tracer>())
 {
 #ifdef SIGQUIT
     mStopSignals.add(SIGQUIT);
@@ -58,7 +78,7 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     mStopSignals.add(SIGTERM);
 #endif
 
-    unsigned t = std::thread::hardware_concurrency();
+    unsigned t = workerThreadCount();
     LOG(INFO) << "Application constructing "
               << "(worker threads: " << t << ")";
     mStopSignals.async_wait([this](asio::error_code const& ec, int sig)
@@ -97,6 +117,12 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
         mConfig.FORCE_SCP = true;
     }
 
+    if (mPersistentState->getState(PersistentState::kDatabaseInitialized) ==
+        "true")
+    {
+        mDatabase->upgradeToCurrentSchema();
+    }
+
     mTmpDirManager = make_unique<TmpDirManager>(cfg.TMP_DIR_PATH);
     mOverlayManager = OverlayManager::create(*this);
     mLedgerManager = LedgerManager::create(*this);
@@ -113,6 +139,14 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
                                         this->runWorkerThread(t);
                                     });
     }
+    // the main thread is the first of the apply threads
+    for (unsigned i = 1; i < mConfig.APPLY_THREADS; i++)
+    {
+        mApplyThreads.emplace_back([this]()
+                                   {
+                                       mApplyIOService.run();
+                                   });
+    }
 
     if (initializeDB)
     {
@@ -129,6 +163,7 @@ ApplicationImpl::reportCfgMetrics()
     {
         return;
     }
+    mShardedMetrics->flush();
 
     std::set<std::string> metricsToReport;
     std::set<std::string> allMetrics;
@@ -195,6 +230,8 @@ ApplicationImpl::~ApplicationImpl()
     LOG(INFO) << "Application destructing";
     reportCfgMetrics();
     shutdownMainIOService();
+    // stops the HTTP thread, which reads the metrics
+    mCommandHandler.reset();
     joinAllThreads();
     LOG(INFO) << "Application destroyed";
 }
@@ -212,6 +249,7 @@ ApplicationImpl::start()
     {
         throw std::invalid_argument("Quorum not configured");
     }
+    mCommandHandler->start();
     mOverlayManager->start();
 
     if (mPersistentState->getState(PersistentState::kDatabaseInitialized) !=
@@ -306,7 +344,16 @@ ApplicationImpl::joinAllThreads()
     {
         w.join();
     }
-    LOG(DEBUG) << "Joined all " << mWorkerThreads.size() << " threads";
+    if (mApplyWork)
+    {
+        mApplyWork.reset();
+    }
+    for (auto& w : mApplyThreads)
+    {
+        w.join();
+    }
+    LOG(DEBUG) << "Joined all " << mWorkerThreads.size() + mApplyThreads.size()
+               << " threads";
 }
 
 bool
@@ -333,6 +380,18 @@ ApplicationImpl::generateLoad(uint32_t nAccounts, uint32_t nTxs,
     mLoadGenerator->generateLoad(*this, nAccounts, nTxs, txRate, autoRate);
 }
 
+void
+ApplicationImpl::generateOpenLoopLoad(uint32_t nAccounts, uint32_t nTxs,
+                                      uint32_t txRate)
+{
+    if (!mLoadGenerator)
+    {
+        mLoadGenerator = make_unique<LoadGenerator>();
+    }
+    getMetrics().NewMeter({"loadgen", "run", "start"}, "run").Mark();
+    mLoadGenerator->generateOpenLoopLoad(*this, nAccounts, nTxs, txRate);
+}
+
 void
 ApplicationImpl::checkDB()
 {
@@ -420,6 +479,18 @@ ApplicationImpl::getMetrics()
     return *mMetrics;
 }
 
+ShardedMetrics&
+ApplicationImpl::getShardedMetrics()
+{
+    return *mShardedMetrics;
+}
+
+Tracer&
+ApplicationImpl::getTracer()
+{
+    return *mTracer;
+}
+
 void
 ApplicationImpl::syncOwnMetrics()
 {
@@ -432,6 +503,11 @@ ApplicationImpl::syncOwnMetrics()
         mAppStateChanges.Update(now - mLastStateChange);
         mLastStateChange = now;
     }
+
+    uint64_t hits, misses;
+    PubKeyUtils::getVerifySigCacheCounts(hits, misses);
+    mVerifySigCacheHits.set_count(static_cast<int64_t>(hits));
+    mVerifySigCacheMisses.set_count(static_cast<int64_t>(misses));
 }
 
 void
@@ -440,6 +516,7 @@ ApplicationImpl::syncAllMetrics()
     mHerder->syncMetrics();
     mLedgerManager->syncMetrics();
     syncOwnMetrics();
+    mShardedMetrics->flush();
 }
 
 TmpDirManager&
@@ -501,4 +578,10 @@ ApplicationImpl::getWorkerIOService()
 {
     return mWorkerIOService;
 }
+
+asio::io_service&
+ApplicationImpl::getApplyIOService()
+{
+    return mApplyIOService;
+}
 }
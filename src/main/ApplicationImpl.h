@@ -44,6 +44,8 @@ class ApplicationImpl : public Application
     virtual bool isStopping() const override;
     virtual VirtualClock& getClock() override;
     virtual medida::MetricsRegistry& getMetrics() override;
+    virtual ShardedMetrics& getShardedMetrics() override;
+    virtual Tracer& getTracer() override;
     virtual void syncOwnMetrics() override;
     virtual void syncAllMetrics() override;
     virtual TmpDirManager& getTmpDirManager() override;
@@ -57,6 +59,7 @@ class ApplicationImpl : public Application
     virtual PersistentState& getPersistentState() override;
 
     virtual asio::io_service& getWorkerIOService() override;
+    virtual asio::io_service& getApplyIOService() override;
 
     virtual void start() override;
 
@@ -76,6 +79,9 @@ class ApplicationImpl : public Application
     virtual void generateLoad(uint32_t nAccounts, uint32_t nTxs,
                               uint32_t txRate, bool autoRate) override;
 
+    virtual void generateOpenLoopLoad(uint32_t nAccounts, uint32_t nTxs,
+                                      uint32_t txRate) override;
+
     virtual void checkDB() override;
 
     virtual void applyCfgCommands() override;
@@ -101,6 +107,8 @@ class ApplicationImpl : public Application
 
     asio::io_service mWorkerIOService;
     std::unique_ptr<asio::io_service::work> mWork;
+    asio::io_service mApplyIOService;
+    std::unique_ptr<asio::io_service::work> mApplyWork;
 
     std::unique_ptr<Database> mDatabase;
     std::unique_ptr<TmpDirManager> mTmpDirManager;
@@ -115,6 +123,7 @@ class ApplicationImpl : public Application
     std::unique_ptr<LoadGenerator> mLoadGenerator;
 
     std::vector<std::thread> mWorkerThreads;
+    std::vector<std::thread> mApplyThreads;
 
     asio::signal_set mStopSignals;
 
@@ -123,9 +132,15 @@ class ApplicationImpl : public Application
     VirtualTimer mStoppingTimer;
 
     std::unique_ptr<medida::MetricsRegistry> mMetrics;
+    std::unique_ptr<ShardedMetrics> mShardedMetrics;
     medida::Counter& mAppStateCurrent;
     medida::Timer& mAppStateChanges;
     VirtualClock::time_point mLastStateChange;
+    // process-wide, see PubKeyUtils::getVerifySigCacheCounts
+    medida::Counter& mVerifySigCacheHits;
+    medida::Counter& mVerifySigCacheMisses;
+
+    std::unique_ptr<Tracer> mTracer;
 
     void shutdownMainIOService();
     void runWorkerThread(unsigned i);
@@ -2,6 +2,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include "util/asio.h"
 #include "crypto/Hex.h"
 #include "herder/Herder.h"
 #include "ledger/LedgerManager.h"
@@ -12,7 +13,10 @@
 #include "main/CommandHandler.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
+#include "overlay/PeerTable.h"
 #include "util/Logging.h"
+#include "util/ShardedMetrics.h"
+#include "util/Tracing.h"
 #include "util/make_unique.h"
 #include "StellarCoreVersion.h"
 
@@ -20,6 +24,9 @@
 #include "medida/reporting/json_reporter.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
+#include <cctype>
+#include <future>
 #include <regex>
 #include "transactions/TxTests.h"
 using namespace stellar::txtest;
@@ -29,9 +36,23 @@ using std::placeholders::_2;
 
 namespace stellar
 {
-CommandHandler::CommandHandler(Application& app) : mApp(app)
+
+// how old a snapshot of the read-only commands may be
+static std::chrono::seconds const SNAPSHOT_MAX_AGE{1};
+
+// how many transactions a txbatch request may submit
+static size_t const MAX_TX_BATCH_SIZE = 1000;
+
+CommandHandler::CommandHandler(Application& app)
+    : mApp(app)
+    , mMainThread(std::this_thread::get_id())
+    , mAlive(std::make_shared<bool>(true))
+    , mStopping(false)
+    , mSnapshotPending(false)
 {
-    if (!mApp.getConfig().RUN_STANDALONE && mApp.getConfig().HTTP_PORT)
+    bool listening =
+        !mApp.getConfig().RUN_STANDALONE && mApp.getConfig().HTTP_PORT;
+    if (listening)
     {
         std::string ipStr;
         if (mApp.getConfig().PUBLIC_HTTP_PORT)
@@ -46,40 +67,207 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
                   << mApp.getConfig().HTTP_PORT << " for HTTP requests";
 
         mServer = stellar::make_unique<http::server::server>(
-            app.getClock().getIOService(), ipStr, mApp.getConfig().HTTP_PORT);
+            mHttpIOService, ipStr, mApp.getConfig().HTTP_PORT);
     }
     else
     {
-        mServer = stellar::make_unique<http::server::server>(
-            app.getClock().getIOService());
+        mServer = stellar::make_unique<http::server::server>(mHttpIOService);
     }
 
     mServer->add404(std::bind(&CommandHandler::fileNotFound, this, _1, _2));
 
-    mServer->addRoute("catchup",
-                      std::bind(&CommandHandler::catchup, this, _1, _2));
-    mServer->addRoute("checkdb",
-                      std::bind(&CommandHandler::checkdb, this, _1, _2));
-    mServer->addRoute("checkpoint",
-                      std::bind(&CommandHandler::checkpoint, this, _1, _2));
-    mServer->addRoute("connect",
-                      std::bind(&CommandHandler::connect, this, _1, _2));
-    mServer->addRoute("generateload",
-                      std::bind(&CommandHandler::generateLoad, this, _1, _2));
-    mServer->addRoute("info", std::bind(&CommandHandler::info, this, _1, _2));
-    mServer->addRoute("ll", std::bind(&CommandHandler::ll, this, _1, _2));
-    mServer->addRoute("logrotate",
-                      std::bind(&CommandHandler::logRotate, this, _1, _2));
-    mServer->addRoute("manualclose",
-                      std::bind(&CommandHandler::manualClose, this, _1, _2));
+    addMainRoute("catchup", &CommandHandler::catchup);
+    addMainRoute("checkdb", &CommandHandler::checkdb);
+    addMainRoute("checkpoint", &CommandHandler::checkpoint);
+    addMainRoute("connect", &CommandHandler::connect);
+    addMainRoute("generateload", &CommandHandler::generateLoad);
+    addSnapshotRoute("info", &CommandHandler::info);
+    addMainRoute("ll", &CommandHandler::ll);
+    addMainRoute("logrotate", &CommandHandler::logRotate);
+    addMainRoute("manualclose", &CommandHandler::manualClose);
     mServer->addRoute("metrics",
                       std::bind(&CommandHandler::metrics, this, _1, _2));
-    mServer->addRoute("peers", std::bind(&CommandHandler::peers, this, _1, _2));
-    mServer->addRoute("scp", std::bind(&CommandHandler::scpInfo, this, _1, _2));
-    mServer->addRoute("stop", std::bind(&CommandHandler::stop, this, _1, _2));
-    mServer->addRoute("testtx",
-                      std::bind(&CommandHandler::testTx, this, _1, _2));
-    mServer->addRoute("tx", std::bind(&CommandHandler::tx, this, _1, _2));
+    addSnapshotRoute("peers", &CommandHandler::peers);
+    addSnapshotRoute("scp", &CommandHandler::scpInfo);
+    addMainRoute("stop", &CommandHandler::stop);
+    addMainRoute("testtx", &CommandHandler::testTx);
+    addMainRoute("trace", &CommandHandler::trace);
+    addMainRoute("tx", &CommandHandler::tx);
+    mServer->addRoute("txbatch",
+                      std::bind(&CommandHandler::txBatch, this, _1, _2));
+
+    if (listening)
+    {
+        mHttpThread = std::thread([this]()
+                                  {
+                                      mHttpIOService.run();
+                                  });
+    }
+}
+
+CommandHandler::~CommandHandler()
+{
+    *mAlive = false;
+    mStopping = true;
+    mHttpIOService.stop();
+    if (mHttpThread.joinable())
+    {
+        mHttpThread.join();
+    }
+}
+
+void
+CommandHandler::start()
+{
+    mMainThread = std::this_thread::get_id();
+}
+
+bool
+CommandHandler::onMainThread() const
+{
+    return std::this_thread::get_id() == mMainThread;
+}
+
+void
+CommandHandler::runOnMainThread(Handler handler, std::string const& params,
+                                std::string& retStr)
+{
+    if (onMainThread())
+    {
+        (this->*handler)(params, retStr);
+        return;
+    }
+
+    // the task may outlive this call if we give up waiting
+    auto reply = std::make_shared<std::string>();
+    auto alive = mAlive;
+    auto task = std::make_shared<std::packaged_task<void()>>(
+        [this, alive, handler, params, reply]()
+        {
+            if (*alive)
+            {
+                (this->*handler)(params, *reply);
+            }
+        });
+    auto done = task->get_future();
+    mApp.getClock().getIOService().post([task]()
+                                        {
+                                            (*task)();
+                                        });
+    if (!waitForMainThread(done))
+    {
+        retStr = "Shutting down";
+        return;
+    }
+    retStr = *reply;
+}
+
+bool
+CommandHandler::waitForMainThread(std::future<void>& done)
+{
+    while (done.wait_for(std::chrono::milliseconds(100)) !=
+           std::future_status::ready)
+    {
+        if (mStopping)
+        {
+            return false;
+        }
+    }
+    done.get();
+    return true;
+}
+
+void
+CommandHandler::addMainRoute(std::string const& name, Handler handler)
+{
+    mServer->addRoute(
+        name, [this, handler](std::string const& params, std::string& retStr)
+        {
+            runOnMainThread(handler, params, retStr);
+        });
+}
+
+void
+CommandHandler::addSnapshotRoute(std::string const& name, Handler handler)
+{
+    mSnapshotHandlers[name] = handler;
+    mServer->addRoute(name, [this, name, handler](std::string const& params,
+                                                  std::string& retStr)
+                      {
+                          if (onMainThread() || !params.empty())
+                          {
+                              runOnMainThread(handler, params, retStr);
+                              return;
+                          }
+                          auto snapshot = getSnapshot();
+                          auto it = snapshot->mReplies.find(name);
+                          if (it != snapshot->mReplies.end())
+                          {
+                              retStr = it->second;
+                          }
+                      });
+}
+
+void
+CommandHandler::publishSnapshot()
+{
+    mApp.syncAllMetrics();
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->mTime = std::chrono::steady_clock::now();
+    for (auto const& kv : mSnapshotHandlers)
+    {
+        (this->*kv.second)("", snapshot->mReplies[kv.first]);
+    }
+
+    std::lock_guard<std::mutex> guard(mSnapshotMutex);
+    mSnapshot = snapshot;
+    mSnapshotPending = false;
+}
+
+std::shared_ptr<CommandHandler::Snapshot const>
+CommandHandler::getSnapshot()
+{
+    std::shared_ptr<Snapshot const> snapshot;
+    {
+        std::lock_guard<std::mutex> guard(mSnapshotMutex);
+        snapshot = mSnapshot;
+    }
+
+    if (!snapshot)
+    {
+        // nothing to serve yet: wait for the first one
+        std::string ignored;
+        runOnMainThread(&CommandHandler::refreshSnapshot, "", ignored);
+        std::lock_guard<std::mutex> guard(mSnapshotMutex);
+        snapshot = mSnapshot;
+        if (!snapshot)
+        {
+            // shutting down
+            snapshot = std::make_shared<Snapshot>();
+        }
+    }
+    else if (std::chrono::steady_clock::now() - snapshot->mTime >
+                 SNAPSHOT_MAX_AGE &&
+             !mSnapshotPending.exchange(true))
+    {
+        // serve this one, the next request gets a fresh one
+        auto alive = mAlive;
+        mApp.getClock().getIOService().post([this, alive]()
+                                            {
+                                                if (*alive)
+                                                {
+                                                    publishSnapshot();
+                                                }
+                                            });
+    }
+    return snapshot;
+}
+
+void
+CommandHandler::refreshSnapshot(std::string const& params, std::string& retStr)
+{
+    publishSnapshot();
 }
 
 void
@@ -169,9 +357,13 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "</p><p><h1> /connect?peer=NAME&port=NNN</h1>"
         "triggers the instance to connect to peer NAME at port NNN."
         "</p><p><h1> "
-        "/generateload[?accounts=N&txs=M&txrate=(R|auto)]</h1>"
+        "/generateload[?accounts=N&txs=M&txrate=(R|auto)&mode=(closed|open)]"
+        "</h1>"
         "artificially generate load for testing; must be used with "
-        "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING set to true"
+        "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING set to true. In 'open' mode "
+        "transactions are pre-signed on worker threads and submitted at "
+        "exactly R tx/s, and submit-to-externalize latency is recorded in "
+        "the loadgen.latency.* metrics"
         "</p><p><h1> /help</h1>"
         "give a list of currently supported commands"
         "</p><p><h1> /info</h1>"
@@ -189,17 +381,30 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "returns a snapshot of the metrics registry (for monitoring and "
         "debugging purpose)"
         "</p><p><h1> /peers</h1>"
-        "returns the list of known peers in JSON format"
+        "returns the list of connected peers in JSON format, with how well "
+        "connected they are: fetch latency, bytes received per second, "
+        "flooded messages sent and how many of them first, and the score "
+        "used to prefer and replace peers"
         "</p><p><h1> /scp</h1>"
         "returns a JSON object with the internal state of the SCP engine"
         "</p><p><h1> /stop</h1>"
         "stops the instance"
+        "</p><p><h1> /trace[?ledgers=N]</h1>"
+        "returns the phase timings of the last N (default: all retained) "
+        "ledger closes in Chrome trace-event JSON, for chrome://tracing"
         "</p><p><h1> /tx?blob=HEX</h1>"
         "submit a transaction to the network.<br>"
         "blob is a hex encoded XDR serialized 'TransactionEnvelope'<br>"
         "returns a JSON object<br>"
         "wasReceived: boolean, true if transaction was queued properly<br>"
         "result: hex encoded, XDR serialized 'TransactionResult'<br>"
+        "</p><p><h1> /txbatch?blobs=B64,B64,...</h1>"
+        "submit many transactions at once; blobs is a comma separated list "
+        "of at most 1000 base64 encoded XDR serialized "
+        "'TransactionEnvelope', URL encoded ('+' as %2B; a '+' read as a "
+        "space is taken back)<br>"
+        "returns a JSON object with, in order, one entry per blob in "
+        "'results', formatted as the reply of /tx"
         "</p>"
 
         "<br>";
@@ -280,11 +485,42 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
                 return;
         }
 
+        bool openLoop = false;
+        {
+            auto i = map.find("mode");
+            if (i != map.end())
+            {
+                if (i->second == "open")
+                {
+                    openLoop = true;
+                }
+                else if (i->second != "closed")
+                {
+                    retStr = "mode must be 'open' or 'closed'";
+                    return;
+                }
+            }
+        }
+        if (openLoop && autoRate)
+        {
+            retStr = "txrate=auto is not supported in open mode";
+            return;
+        }
+
         double hours = ((nAccounts + nTxs) / txRate) / 3600.0;
-        mApp.generateLoad(nAccounts, nTxs, txRate, autoRate);
+        if (openLoop)
+        {
+            mApp.generateOpenLoopLoad(nAccounts, nTxs, txRate);
+        }
+        else
+        {
+            mApp.generateLoad(nAccounts, nTxs, txRate, autoRate);
+        }
         retStr = fmt::format(
-            "Generating load: {:d} accounts, {:d} txs, {:d} tx/s = {:f} hours",
-            nAccounts, nTxs, txRate, hours);
+            "Generating {} load: {:d} accounts, {:d} txs, {:d} tx/s = {:f} "
+            "hours",
+            openLoop ? "open-loop" : "closed-loop", nAccounts, nTxs, txRate,
+            hours);
     }
     else
     {
@@ -308,6 +544,14 @@ CommandHandler::peers(std::string const& params, std::string& retStr)
         root["peers"][counter]["olver"] = (int)peer->getRemoteOverlayVersion();
         root["peers"][counter]["id"] = PubKeyUtils::toStrKey(peer->getPeerID());
 
+        auto q = peer->getQuality();
+        auto& quality = root["peers"][counter]["quality"];
+        quality["latency_ms"] = static_cast<Json::Int64>(q.mLatency.count());
+        quality["bytes_per_second"] = q.mBytesPerSecond;
+        quality["flooded"] = static_cast<Json::UInt64>(q.mFloodReceived);
+        quality["flooded_first"] = static_cast<Json::UInt64>(q.mFloodFirst);
+        quality["score"] = q.getScore();
+
         counter++;
     }
 
@@ -334,10 +578,36 @@ CommandHandler::info(std::string const& params, std::string& retStr)
     retStr = root.toStyledString();
 }
 
+void
+CommandHandler::trace(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> map;
+    http::server::server::parseParams(params, map);
+
+    uint32_t nLedgers = 0;
+    if (!parseOptionalNumParam(map, "ledgers", nLedgers, retStr))
+        return;
+
+    Json::Value root;
+    mApp.getTracer().dumpChromeTrace(root, nLedgers);
+    Json::FastWriter fw;
+    retStr = fw.write(root);
+}
+
 void
 CommandHandler::metrics(std::string const& params, std::string& retStr)
 {
-    mApp.syncAllMetrics();
+    if (onMainThread())
+    {
+        mApp.syncAllMetrics();
+    }
+    else
+    {
+        // gauges are synced along with the snapshots; the sharded metrics
+        // can be folded in from any thread
+        getSnapshot();
+        mApp.getShardedMetrics().flush();
+    }
     medida::reporting::JsonReporter jr(mApp.getMetrics());
     retStr = jr.Report();
 }
@@ -595,4 +865,174 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
 
     retStr = output.str();
 }
+
+// Undoes the URL encoding of a base64 blob. '+' may come as %2B or, from
+// clients that leave it alone, as a '+' the server turned into a space.
+static std::string
+urlDecodeBlob(std::string const& blob)
+{
+    std::string res;
+    res.reserve(blob.size());
+    for (size_t i = 0; i < blob.size(); i++)
+    {
+        if (blob[i] == '%' && i + 2 < blob.size() &&
+            std::isxdigit(static_cast<unsigned char>(blob[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(blob[i + 2])))
+        {
+            res.push_back(static_cast<char>(
+                std::stoi(blob.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        }
+        else if (blob[i] == ' ')
+        {
+            res.push_back('+');
+        }
+        else
+        {
+            res.push_back(blob[i]);
+        }
+    }
+    return res;
+}
+
+// a txbatch request, handed from the HTTP thread to the main thread and back
+struct CommandHandler::TxBatchReply
+{
+    std::vector<TransactionFramePtr> mTxs;
+    // index of each of mTxs in the request
+    std::vector<size_t> mIndex;
+    Json::Value mRoot;
+    std::promise<void> mDone;
+};
+
+void
+CommandHandler::txBatch(std::string const& params, std::string& retStr)
+{
+    auto batch = std::make_shared<TxBatchReply>();
+    auto& root = batch->mRoot;
+
+    const std::string prefix("?blobs=");
+    if (params.compare(0, prefix.size(), prefix) != 0)
+    {
+        root["exception"] = "Must specify tx blobs: txbatch?blobs=<tx in xdr "
+                            "format>,<tx in xdr format>,...";
+        retStr = root.toStyledString();
+        return;
+    }
+
+    if (onMainThread())
+    {
+        // the statuses come back on this thread, after this returns
+        root["exception"] = "txbatch is only served over HTTP";
+        retStr = root.toStyledString();
+        return;
+    }
+
+    std::string blobList = params.substr(prefix.size());
+    if (std::count(blobList.begin(), blobList.end(), ',') >=
+        static_cast<std::ptrdiff_t>(MAX_TX_BATCH_SIZE))
+    {
+        root["exception"] = "Too many tx blobs, at most " +
+                            std::to_string(MAX_TX_BATCH_SIZE) + " allowed";
+        retStr = root.toStyledString();
+        return;
+    }
+
+    // decode everything first, here rather than on the main thread; entries
+    // that fail get their exception
+    auto& results = root["results"];
+    std::istringstream blobs(blobList);
+    std::string blob;
+    for (size_t i = 0; std::getline(blobs, blob, ','); i++)
+    {
+        try
+        {
+            std::vector<uint8_t> binBlob;
+            bn::decode_b64(urlDecodeBlob(blob), binBlob);
+
+            TransactionEnvelope envelope;
+            xdr::xdr_from_opaque(binBlob, envelope);
+            TransactionFramePtr transaction =
+                TransactionFrame::makeTransactionFromWire(envelope);
+            if (transaction)
+            {
+                batch->mTxs.push_back(transaction);
+                batch->mIndex.push_back(i);
+            }
+            results[static_cast<Json::ArrayIndex>(i)] = Json::objectValue;
+        }
+        catch (std::exception& e)
+        {
+            results[static_cast<Json::ArrayIndex>(i)]["exception"] = e.what();
+        }
+        catch (...)
+        {
+            results[static_cast<Json::ArrayIndex>(i)]["exception"] = "generic";
+        }
+    }
+
+    // the signatures are checked on the worker threads: wait for the
+    // statuses here rather than on the main thread
+    auto done = batch->mDone.get_future();
+    auto alive = mAlive;
+    mApp.getClock().getIOService().post([this, alive, batch]()
+                                        {
+                                            if (*alive)
+                                            {
+                                                submitTxBatch(batch);
+                                            }
+                                        });
+    if (!waitForMainThread(done))
+    {
+        retStr = "Shutting down";
+        return;
+    }
+    retStr = root.toStyledString();
+}
+
+void
+CommandHandler::submitTxBatch(std::shared_ptr<TxBatchReply> batch)
+{
+    auto alive = mAlive;
+    mApp.getHerder().recvTransactionBatch(
+        batch->mTxs,
+        [this, alive, batch](
+            std::vector<Herder::TransactionSubmitStatus> const& statuses)
+        {
+            if (*alive)
+            {
+                recvTxBatchStatuses(*batch, statuses);
+            }
+            batch->mDone.set_value();
+        });
+}
+
+void
+CommandHandler::recvTxBatchStatuses(
+    TxBatchReply& batch,
+    std::vector<Herder::TransactionSubmitStatus> const& statuses)
+{
+    auto const& txs = batch.mTxs;
+    auto& results = batch.mRoot["results"];
+    for (size_t j = 0; j < txs.size(); j++)
+    {
+        auto& res = results[static_cast<Json::ArrayIndex>(batch.mIndex[j])];
+        res["status"] = TX_STATUS_STRING[statuses[j]];
+        if (statuses[j] == Herder::TX_STATUS_ERROR)
+        {
+            res["error"] =
+                bn::encode_b64(xdr::xdr_to_opaque(txs[j]->getResult()));
+        }
+    }
+
+    // flood the accepted ones once they have all been checked
+    for (size_t j = 0; j < txs.size(); j++)
+    {
+        if (statuses[j] == Herder::TX_STATUS_PENDING)
+        {
+            mApp.getOverlayManager().broadcastMessage(
+                txs[j]->toStellarMessage());
+        }
+    }
+}
 }
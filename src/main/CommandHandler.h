@@ -4,11 +4,34 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+// ASIO is somewhat particular about when it gets included -- it wants to be the
+// first to include <windows.h> -- so we try to include it before everything
+// else.
+#include "util/asio.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include "lib/http/server.hpp"
+#include "herder/Herder.h"
 
 /*
 handler functions for the http commands this server supports
+
+The server runs on a thread of its own, so that slow clients and large replies
+don't hold up the main thread. Read-only commands (info, peers, scp) are
+answered from a snapshot of their replies, taken on the main thread at most
+once a second and only while someone asks; metrics are read directly, medida
+being thread-safe. Every other command runs on the main thread, the HTTP
+thread waiting for its reply; txbatch only hands its decoded transactions to
+the main thread, which replies once their signatures have been checked on the
+worker threads.
 */
 
 namespace stellar
@@ -17,12 +40,67 @@ class Application;
 
 class CommandHandler
 {
+    typedef void (CommandHandler::*Handler)(std::string const& params,
+                                           std::string& retStr);
+
+    // replies of the read-only commands at some point in time
+    struct Snapshot
+    {
+        std::chrono::steady_clock::time_point mTime;
+        std::map<std::string, std::string> mReplies;
+    };
 
     Application& mApp;
+    asio::io_service mHttpIOService;
     std::unique_ptr<http::server::server> mServer;
+    std::thread mHttpThread;
+    // the thread cranking the application, read by the HTTP thread
+    std::atomic<std::thread::id> mMainThread;
+
+    // set to false, on the main thread, when this is destroyed
+    std::shared_ptr<bool> mAlive;
+    std::atomic<bool> mStopping;
+
+    std::map<std::string, Handler> mSnapshotHandlers;
+    std::mutex mSnapshotMutex;
+    std::shared_ptr<Snapshot const> mSnapshot;
+    std::atomic<bool> mSnapshotPending;
+
+    bool onMainThread() const;
+
+    // runs `handler` on the main thread and waits for its reply
+    void runOnMainThread(Handler handler, std::string const& params,
+                         std::string& retStr);
+    // waits for `done`, unless this is being destroyed: returns false then
+    bool waitForMainThread(std::future<void>& done);
+
+    void addMainRoute(std::string const& name, Handler handler);
+    void addSnapshotRoute(std::string const& name, Handler handler);
+
+    // main thread: replaces the snapshot
+    void publishSnapshot();
+    // HTTP thread: returns the snapshot, refreshing it if it's stale
+    std::shared_ptr<Snapshot const> getSnapshot();
+    // publishSnapshot, as a command, to wait for it
+    void refreshSnapshot(std::string const& params, std::string& retStr);
+
+    // main thread: submits the transactions of a txbatch request, then
+    // fills in its reply with their statuses
+    struct TxBatchReply;
+    void submitTxBatch(std::shared_ptr<TxBatchReply> batch);
+    void recvTxBatchStatuses(
+        TxBatchReply& batch,
+        std::vector<Herder::TransactionSubmitStatus> const& statuses);
 
   public:
     CommandHandler(Application& app);
+    ~CommandHandler();
+
+    // Called by Application::start, from the thread that cranks the
+    // application from then on: commands run directly on that thread, which
+    // is not always the one that constructed this, as in a threaded
+    // Simulation.
+    void start();
 
     void manualCmd(std::string const& cmd);
 
@@ -41,7 +119,9 @@ class CommandHandler
     void peers(std::string const& params, std::string& retStr);
     void scpInfo(std::string const& params, std::string& retStr);
     void stop(std::string const& params, std::string& retStr);
+    void trace(std::string const& params, std::string& retStr);
     void tx(std::string const& params, std::string& retStr);
+    void txBatch(std::string const& params, std::string& retStr);
     void testTx(std::string const& params, std::string& retStr);
 };
 }
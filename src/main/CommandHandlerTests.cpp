@@ -0,0 +1,221 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "herder/Herder.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/test.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "transactions/TxTests.h"
+#include "util/GlobalChecks.h"
+#include "util/basen.h"
+#include "xdrpp/marshal.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+namespace
+{
+// an application serving HTTP requests, as in production
+Config
+getListeningConfig()
+{
+    Config cfg = getTestConfig();
+    cfg.RUN_STANDALONE = false;
+    return cfg;
+}
+
+// the body of the reply to GET `path`
+std::string
+httpGet(unsigned short port, std::string const& path)
+{
+    asio::io_service io;
+    asio::ip::tcp::socket socket(io);
+    socket.connect(asio::ip::tcp::endpoint(
+        asio::ip::address::from_string("127.0.0.1"), port));
+    std::string request = "GET " + path + " HTTP/1.0\r\n\r\n";
+    asio::write(socket, asio::buffer(request));
+
+    // the server closes the connection after its reply
+    std::string response;
+    std::array<char, 4096> buf;
+    asio::error_code ec;
+    while (!ec)
+    {
+        size_t n = socket.read_some(asio::buffer(buf), ec);
+        response.append(buf.data(), n);
+    }
+    auto body = response.find("\r\n\r\n");
+    return body == std::string::npos ? "" : response.substr(body + 4);
+}
+
+// runs on a client thread: a failure makes the reply rather than terminate
+void
+httpGetFromClient(unsigned short port, std::string const& path,
+                  std::string& reply, std::atomic<bool>& done)
+{
+    try
+    {
+        reply = httpGet(port, path);
+    }
+    catch (std::exception& e)
+    {
+        reply = e.what();
+    }
+    done = true;
+}
+
+// issues `path` from a client thread, cranking the clock of `app` meanwhile
+std::string
+httpRequest(Application& app, std::string const& path)
+{
+    std::string reply;
+    std::atomic<bool> done(false);
+    std::thread client(httpGetFromClient, app.getConfig().HTTP_PORT, path,
+                       std::ref(reply), std::ref(done));
+    while (!done)
+    {
+        app.getClock().crank(false);
+    }
+    client.join();
+    return reply;
+}
+
+Json::Value
+parseJson(std::string const& reply)
+{
+    Json::Value root;
+    REQUIRE(Json::Reader().parse(reply, root));
+    return root;
+}
+
+// a signed transaction creating `to`, whose base64 encoding has a '+'
+std::string
+createAccountBlobWithPlus(SecretKey& root, SecretKey& to, SequenceNumber seq,
+                          int64_t amount)
+{
+    for (;; amount++)
+    {
+        auto tx = createCreateAccountTx(root, to, seq, amount);
+        auto blob = bn::encode_b64(xdr::xdr_to_opaque(tx->getEnvelope()));
+        if (blob.find('+') != std::string::npos)
+        {
+            return blob;
+        }
+    }
+}
+}
+
+TEST_CASE("txbatch over HTTP", "[commandhandler]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app =
+        Application::create(clock, getListeningConfig());
+    app->start();
+
+    SecretKey root = getRoot();
+    SecretKey a1 = getAccount("A");
+    SecretKey b1 = getAccount("B");
+    int64_t amount = app->getLedgerManager().getMinBalance(0);
+    SequenceNumber rootSeq = getAccountSeqNum(root, *app) + 1;
+
+    SECTION("blobs with a '+'")
+    {
+        auto blob1 = createAccountBlobWithPlus(root, a1, rootSeq, amount);
+        auto blob2 = createAccountBlobWithPlus(root, b1, rootSeq + 1, amount);
+
+        // as is, and URL encoded
+        std::string encoded2;
+        for (auto c : blob2)
+        {
+            encoded2 += c == '+' ? std::string("%2B") : std::string(1, c);
+        }
+
+        auto reply = parseJson(
+            httpRequest(*app, "/txbatch?blobs=" + blob1 + "," + encoded2));
+        auto const& results = reply["results"];
+        REQUIRE(results.size() == 2);
+        REQUIRE(results[0]["status"].asString() == "PENDING");
+        REQUIRE(results[1]["status"].asString() == "PENDING");
+    }
+
+    SECTION("too many blobs")
+    {
+        // refused before any is decoded
+        std::string blobs = "AAAA";
+        for (int i = 0; i < 1000; i++)
+        {
+            blobs += ",AAAA";
+        }
+
+        auto reply = parseJson(httpRequest(*app, "/txbatch?blobs=" + blobs));
+        REQUIRE(reply.isMember("exception"));
+        REQUIRE(!reply.isMember("results"));
+    }
+}
+
+TEST_CASE("commands over HTTP", "[commandhandler]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Config cfg = getListeningConfig();
+    cfg.MANUAL_CLOSE = true;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    SECTION("snapshot, metrics and main thread commands")
+    {
+        REQUIRE(parseJson(httpRequest(*app, "/info")).isMember("info"));
+        REQUIRE(parseJson(httpRequest(*app, "/metrics")).isMember("metrics"));
+        REQUIRE(httpRequest(*app, "/manualclose") ==
+                "Forcing ledger to close...");
+    }
+
+    SECTION("application destroyed while a command waits")
+    {
+        // the clock isn't cranked, so the command can't run
+        std::string reply;
+        std::atomic<bool> done(false);
+        std::thread client(httpGetFromClient, cfg.HTTP_PORT, "/manualclose",
+                           std::ref(reply), std::ref(done));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        REQUIRE(!done);
+
+        app.reset();
+        client.join();
+        REQUIRE(reply != "Forcing ledger to close...");
+    }
+}
+
+TEST_CASE("commands from the thread cranking the application",
+          "[commandhandler]")
+{
+    // as in a threaded Simulation, the application is constructed on one
+    // thread and started and cranked on another
+    VirtualClock clock;
+    Config cfg = getTestConfig();
+    cfg.COMMANDS = {"info", "trace"};
+    Application::pointer app = Application::create(clock, cfg);
+
+    std::atomic<bool> done(false);
+    std::thread node([&]()
+                     {
+                         markThreadAsMain();
+                         app->start();
+                         // would wait for this thread to run them
+                         app->applyCfgCommands();
+                         done = true;
+                     });
+    node.join();
+    REQUIRE(done);
+}
@@ -23,10 +23,12 @@ Config::Config() : PEER_KEY(SecretKey::random())
     REBUILD_DB = false;
     DESIRED_BASE_RESERVE = 10000000;
     FORCE_SCP = false;
+    CATCHUP_TRUST_ARCHIVE = false;
 
     // configurable
     DESIRED_BASE_FEE = 10;
     DESIRED_MAX_TX_PER_LEDGER = 500;
+    APPLY_THREADS = 1;
     PEER_PORT = DEFAULT_PEER_PORT;
     RUN_STANDALONE = false;
     MANUAL_CLOSE = false;
@@ -34,11 +36,14 @@ Config::Config() : PEER_KEY(SecretKey::random())
     ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = false;
     ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = false;
     ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING = false;
+    ARTIFICIALLY_SHRINK_FOOTPRINTS_FOR_TESTING = false;
     BREAK_ASIO_LOOP_FOR_FAST_TESTS = false;
     TARGET_PEER_CONNECTIONS = 20;
     MAX_PEER_CONNECTIONS = 50;
     MAX_CONCURRENT_SUBPROCESSES = 8;
     LOG_FILE_PATH = "stellar-core.log";
+    LOG_ASYNC = true;
+    VERIFY_SIG_CACHE_SIZE = 4096;
     TMP_DIR_PATH = "tmp";
     BUCKET_DIR_PATH = "buckets";
     HTTP_PORT = 39132;
@@ -202,6 +207,19 @@ Config::load(std::string const& filename)
                 }
                 DESIRED_MAX_TX_PER_LEDGER = (uint32_t)f;
             }
+            else if (item.first == "APPLY_THREADS")
+            {
+                if (!item.second->as<int64_t>())
+                {
+                    throw std::invalid_argument("invalid APPLY_THREADS");
+                }
+                int64_t f = item.second->as<int64_t>()->value();
+                if (f <= 0 || f > 64)
+                {
+                    throw std::invalid_argument("invalid APPLY_THREADS");
+                }
+                APPLY_THREADS = (uint32_t)f;
+            }
             else if (item.first == "RUN_STANDALONE")
             {
                 if (!item.second->as<bool>())
@@ -255,6 +273,25 @@ Config::load(std::string const& filename)
                 }
                 LOG_FILE_PATH = item.second->as<std::string>()->value();
             }
+            else if (item.first == "LOG_ASYNC")
+            {
+                if (!item.second->as<bool>())
+                {
+                    throw std::invalid_argument("invalid LOG_ASYNC");
+                }
+                LOG_ASYNC = item.second->as<bool>()->value();
+            }
+            else if (item.first == "VERIFY_SIG_CACHE_SIZE")
+            {
+                if (!item.second->as<int64_t>() ||
+                    item.second->as<int64_t>()->value() < 0)
+                {
+                    throw std::invalid_argument(
+                        "invalid VERIFY_SIG_CACHE_SIZE");
+                }
+                VERIFY_SIG_CACHE_SIZE =
+                    (size_t)item.second->as<int64_t>()->value();
+            }
             else if (item.first == "TMP_DIR_PATH")
             {
                 if (!item.second->as<std::string>())
@@ -60,6 +60,12 @@ class Config : public std::enable_shared_from_this<Config>
     // meaning catchup "minimally", using deltas to the most recent snapshot.
     bool CATCHUP_COMPLETE;
 
+    // Accept the ledger chain found in the history archive during catchup
+    // without a consensus ledger to anchor it to. Used by the offline
+    // --replay mode, which never hears from the network. DO NOT INCLUDE THIS
+    // IN A CONFIG FILE
+    bool CATCHUP_TRUST_ARCHIVE;
+
     // A config parameter that enables synthetic load generation on demand,
     // using the `generateload` runtime command (see CommandHandler.cpp). This
     // option only exists for stress-testing and should not be enabled in
@@ -77,6 +83,13 @@ class Config : public std::enable_shared_from_this<Config>
     // and should be false in all normal cases.
     bool ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING;
 
+    // A config parameter that leaves out of the footprint of a transaction
+    // every entry not owned by its source account, so that applying it in
+    // parallel steps outside its footprint; this option exists only for
+    // testing the fall back to serial application, and should be false in
+    // all normal cases.
+    bool ARTIFICIALLY_SHRINK_FOOTPRINTS_FOR_TESTING;
+
     // With many `Application` running in the same process under the
     // virtual clock, asio pooling never relinquishes the event loop.
     // This option inserts a VirtualClock event after each read to
@@ -88,11 +101,18 @@ class Config : public std::enable_shared_from_this<Config>
     uint32_t OVERLAY_PROTOCOL_VERSION;
     std::string VERSION_STR;
     std::string LOG_FILE_PATH;
+    // write log lines on a thread of their own; see Logging::setAsync
+    bool LOG_ASYNC;
+    // entries in the signature verification cache; 0 turns it off
+    size_t VERIFY_SIG_CACHE_SIZE;
     std::string TMP_DIR_PATH;
     std::string BUCKET_DIR_PATH;
     uint32_t DESIRED_BASE_FEE;     // in stroops
     uint32_t DESIRED_BASE_RESERVE; // in stroops
     uint32_t DESIRED_MAX_TX_PER_LEDGER;
+    // number of threads the transactions of a ledger may be applied on; see
+    // ParallelTxApply. 1 applies them serially.
+    uint32_t APPLY_THREADS;
     unsigned short HTTP_PORT; // what port to listen for commands
     bool PUBLIC_HTTP_PORT;    // if you accept commands from not localhost
 
@@ -10,6 +10,7 @@
 #include "lib/util/getopt.h"
 #include "main/dumpxdr.h"
 #include "main/fuzz.h"
+#include "main/replay.h"
 #include "main/test.h"
 #include "main/Config.h"
 #include "lib/http/HttpClient.h"
@@ -44,6 +45,7 @@ enum opttag
     OPT_METRIC,
     OPT_NEWDB,
     OPT_NEWHIST,
+    OPT_REPLAY,
     OPT_TEST,
     OPT_VERSION
 };
@@ -63,6 +65,7 @@ static const struct option stellar_core_options[] = {
     {"metric", required_argument, nullptr, OPT_METRIC},
     {"newdb", no_argument, nullptr, OPT_NEWDB},
     {"newhist", required_argument, nullptr, OPT_NEWHIST},
+    {"replay", required_argument, nullptr, OPT_REPLAY},
     {"test", no_argument, nullptr, OPT_TEST},
     {"version", no_argument, nullptr, OPT_VERSION},
     {nullptr, 0, nullptr, 0}};
@@ -93,6 +96,10 @@ usage(int err = 1)
           "      --newdb         Creates or restores the DB to the genesis "
           "ledger\n"
           "      --newhist ARCH  Initialize the named history archive ARCH\n"
+          "      --replay FROM-TO  Offline benchmark: rebuild the DB and "
+          "replay ledgers\n"
+          "                      FROM-TO from the history archives, rounded "
+          "to checkpoints\n"
           "      --test          To run self-tests\n"
           "      --version       To print version information\n";
     exit(err);
@@ -274,6 +281,8 @@ main(int argc, char* const* argv)
     bool getInfo = false;
     std::vector<std::string> newHistories;
     std::vector<std::string> metrics;
+    bool doReplay = false;
+    uint32_t replayFrom = 0, replayTo = 0;
 
     int opt;
     while ((opt = getopt_long_only(argc, argv, "", stellar_core_options,
@@ -326,6 +335,17 @@ main(int argc, char* const* argv)
         case OPT_NEWHIST:
             newHistories.push_back(std::string(optarg));
             break;
+        case OPT_REPLAY:
+        {
+            char dash = 0;
+            std::istringstream iss(optarg);
+            if (!(iss >> replayFrom >> dash >> replayTo) || dash != '-')
+            {
+                usage();
+            }
+            doReplay = true;
+            break;
+        }
         case OPT_TEST:
         {
             rest.push_back(*argv);
@@ -371,6 +391,8 @@ main(int argc, char* const* argv)
         if (cfg.LOG_FILE_PATH.size())
             Logging::setLoggingToFile(cfg.LOG_FILE_PATH);
         Logging::setLogLevel(logLevel, nullptr);
+        Logging::setAsync(cfg.LOG_ASYNC);
+        PubKeyUtils::setVerifySigCacheSize(cfg.VERIFY_SIG_CACHE_SIZE);
 
         cfg.REBUILD_DB = newDB;
         cfg.REPORT_METRICS = metrics;
@@ -391,6 +413,10 @@ main(int argc, char* const* argv)
             setNoListen(cfg);
             return initializeHistories(cfg, newHistories);
         }
+        else if (doReplay)
+        {
+            return replay(cfg, replayFrom, replayTo);
+        }
 
         if (cfg.MANUAL_CLOSE)
         {
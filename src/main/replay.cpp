@@ -0,0 +1,232 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "main/replay.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryManager.h"
+#include "ledger/LedgerManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Logging.h"
+#include "util/Timer.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <chrono>
+#include <iomanip>
+#include <map>
+
+/**
+ * Offline ledger replay, for measuring ledger-close throughput against real
+ * history rather than synthetic load.
+ *
+ * The node runs standalone, never contacts peers and trusts whatever the
+ * configured history archives contain (see Config::CATCHUP_TRUST_ARCHIVE). The
+ * database is rebuilt from genesis so that successive runs start from the same
+ * state. If the range does not start at genesis, the node first catches up
+ * "minimally" (buckets only) to the checkpoint at or before `from`; that part
+ * is not measured. It then catches up "completely" to the checkpoint at or
+ * after `to`, replaying every transaction, and that part is measured.
+ *
+ * At the end it reports ledgers/s and tx/s over the measured part, plus every
+ * timer that ticked during it (ledger close, tx apply, bucket merges,
+ * database statements, the catchup fetch/verify/apply phases).
+ */
+
+namespace stellar
+{
+
+namespace
+{
+
+struct TimerSample
+{
+    uint64_t mCount;
+    double mSum;
+};
+
+typedef std::map<std::string, TimerSample> TimerSamples;
+
+TimerSamples
+sampleTimers(Application& app)
+{
+    TimerSamples samples;
+    for (auto const& kv : app.getMetrics().GetAllMetrics())
+    {
+        auto timer = std::dynamic_pointer_cast<medida::Timer>(kv.second);
+        if (timer)
+        {
+            samples[kv.first.ToString()] = {timer->count(), timer->sum()};
+        }
+    }
+    return samples;
+}
+
+bool
+getArchiveTip(Application& app, HistoryArchive const& archive, uint32_t& tip)
+{
+    bool done = false;
+    bool ok = false;
+    archive.getMostRecentState(
+        app, [&](asio::error_code const& ec, HistoryArchiveState const& has)
+        {
+            if (!ec)
+            {
+                tip = has.currentLedger;
+                ok = true;
+            }
+            done = true;
+        });
+    while (!done && !app.getClock().getIOService().stopped())
+    {
+        app.getClock().crank(true);
+    }
+    return ok;
+}
+
+bool
+catchup(Application& app, uint32_t initLedger,
+        HistoryManager::CatchupMode mode)
+{
+    auto& hm = app.getHistoryManager();
+    auto successes = hm.getCatchupSuccessCount();
+    auto failures = hm.getCatchupFailureCount();
+
+    app.getLedgerManager().startCatchUp(initLedger, mode);
+    while (hm.getCatchupSuccessCount() == successes &&
+           hm.getCatchupFailureCount() == failures &&
+           !app.getClock().getIOService().stopped())
+    {
+        app.getClock().crank(true);
+    }
+    return hm.getCatchupSuccessCount() != successes;
+}
+}
+
+int
+replay(Config cfg, uint32_t from, uint32_t to)
+{
+    if (from == 0 || from > to)
+    {
+        LOG(FATAL) << "Invalid replay range " << from << "-" << to;
+        return 1;
+    }
+
+    // Only read from the archives: replaying closes ledgers on checkpoint
+    // boundaries, which would otherwise publish them right back.
+    std::map<std::string, std::shared_ptr<HistoryArchive>> readable;
+    for (auto const& kv : cfg.HISTORY)
+    {
+        if (kv.second->hasGetCmd())
+        {
+            readable[kv.first] = std::make_shared<HistoryArchive>(
+                kv.first, kv.second->getGetCmd(), "", "");
+        }
+    }
+    if (readable.empty())
+    {
+        LOG(FATAL) << "No readable history archive configured";
+        return 1;
+    }
+    cfg.HISTORY = readable;
+
+    cfg.RUN_STANDALONE = true;
+    cfg.HTTP_PORT = 0;
+    cfg.MANUAL_CLOSE = true;
+    cfg.REBUILD_DB = true;
+    cfg.CATCHUP_TRUST_ARCHIVE = true;
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& hm = app->getHistoryManager();
+    auto& lm = app->getLedgerManager();
+
+    // Catchup anchors on the last ledger of the checkpoint containing
+    // initLedger, so round the range out to whole checkpoints.
+    uint32_t target = hm.nextCheckpointLedger(to + 1) - 1;
+    for (auto const& kv : cfg.HISTORY)
+    {
+        uint32_t tip = 0;
+        if (!getArchiveTip(*app, *kv.second, tip))
+        {
+            LOG(FATAL) << "Could not read state of history archive '"
+                       << kv.first << "'";
+            return 1;
+        }
+        if (tip < target)
+        {
+            LOG(FATAL) << "History archive '" << kv.first
+                       << "' only reaches ledger " << tip << ", need "
+                       << target;
+            return 1;
+        }
+    }
+
+    uint32_t start = hm.prevCheckpointLedger(from);
+    if (start > lm.getLedgerNum())
+    {
+        LOG(INFO) << "Replay: fast-forwarding to ledger " << start - 1;
+        if (!catchup(*app, start, HistoryManager::CATCHUP_MINIMAL))
+        {
+            LOG(FATAL) << "Replay: catchup to ledger " << start - 1
+                       << " failed";
+            return 1;
+        }
+    }
+
+    uint32_t firstLedger = lm.getLedgerNum();
+    LOG(INFO) << "Replay: applying ledgers " << firstLedger << "-" << target;
+
+    auto before = sampleTimers(*app);
+    auto& txApply =
+        app->getMetrics().NewTimer({"ledger", "transaction", "apply"});
+    uint64_t txBefore = txApply.count();
+    auto begin = std::chrono::steady_clock::now();
+
+    bool ok = catchup(*app, target, HistoryManager::CATCHUP_COMPLETE);
+
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - begin;
+    double elapsed = duration.count();
+    if (!ok)
+    {
+        LOG(FATAL) << "Replay: catchup to ledger " << target << " failed";
+        return 1;
+    }
+
+    uint32_t ledgers = lm.getLastClosedLedgerNum() + 1 - firstLedger;
+    uint64_t txs = txApply.count() - txBefore;
+
+    LOG(INFO) << "Replay: " << ledgers << " ledgers, " << txs << " txs in "
+              << std::fixed << std::setprecision(3) << elapsed << "s";
+    LOG(INFO) << "Replay: " << std::setprecision(1) << ledgers / elapsed
+              << " ledgers/s, " << txs / elapsed << " tx/s";
+
+    auto after = sampleTimers(*app);
+    LOG(INFO) << "Replay: timers (count, total ms, mean ms)";
+    for (auto const& kv : after)
+    {
+        auto prev = before.find(kv.first);
+        uint64_t count = kv.second.mCount;
+        double sum = kv.second.mSum;
+        if (prev != before.end())
+        {
+            count -= prev->second.mCount;
+            sum -= prev->second.mSum;
+        }
+        if (count == 0)
+        {
+            continue;
+        }
+        LOG(INFO) << "    " << std::left << std::setw(48) << kv.first
+                  << std::right << std::setw(10) << count << std::setw(12)
+                  << std::setprecision(1) << sum << std::setw(10)
+                  << std::setprecision(3) << sum / count;
+    }
+    return 0;
+}
+}
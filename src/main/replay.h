@@ -0,0 +1,18 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#pragma once
+
+#include <cstdint>
+
+namespace stellar
+{
+
+class Config;
+
+// Replays the ledgers [from, to] out of the history archives named in `cfg`,
+// with no network, and reports throughput and per-phase timings. The
+// configured DATABASE is reinitialized. Returns a process exit code.
+int replay(Config cfg, uint32_t from, uint32_t to);
+}
@@ -73,6 +73,13 @@ Floodgate::addRecord(StellarMessage const& msg, Peer::pointer peer)
     }
 }
 
+void
+Floodgate::forgetRecord(StellarMessage const& msg)
+{
+    mFloodMap.erase(sha256(xdr::xdr_to_opaque(msg)));
+    mFloodMapSize.set_count(mFloodMap.size());
+}
+
 // send message to anyone you haven't gotten it from
 void
 Floodgate::broadcast(StellarMessage const& msg, bool force)
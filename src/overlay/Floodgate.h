@@ -55,6 +55,8 @@ class Floodgate
     void clearBelow(uint32_t currentLedger);
     // returns true if this is a new record
     bool addRecord(StellarMessage const& msg, Peer::pointer fromPeer);
+    // the next copy of `msg` received will be new again
+    void forgetRecord(StellarMessage const& msg);
 
     void broadcast(StellarMessage const& msg, bool force);
 
@@ -7,6 +7,8 @@
 #include "overlay/OverlayManager.h"
 #include "util/Logging.h"
 #include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "util/Math.h"
 #include "herder/TxSetFrame.h"
 #include "overlay/StellarXDR.h"
 #include <crypto/Hex.h>
@@ -15,6 +17,9 @@
 namespace stellar
 {
 
+// fetch latencies needed before the hedging timeout follows them
+static uint64_t const MIN_FETCH_LATENCY_SAMPLES = 20;
+
 template <class TrackerT>
 ItemFetcher<TrackerT>::ItemFetcher(Application& app)
     : mApp(app)
@@ -100,6 +105,15 @@ ItemFetcher<TrackerT>::recv(uint256 itemID)
             waiting.pop_back();
             mApp.getHerder().recvSCPEnvelope(env);
         }
+
+        // stop asking peers, unless someone started waiting for the item
+        // again in the meantime
+        auto it = mTrackers.find(itemID);
+        if (it != mTrackers.end() && it->second->mWaitingEnvelopes.empty())
+        {
+            it->second->mTimer.cancel();
+            mTrackers.erase(it);
+        }
     }
 }
 
@@ -147,54 +161,84 @@ Tracker::doesntHave(Peer::pointer peer)
     }
 }
 
-
-
-void
-Tracker::tryNextPeer()
+Peer::pointer
+Tracker::pickPeer() const
 {
-    // will be called by some timer or when we get a
-    // response saying they don't have it
-    Peer::pointer peer;
-
-    if (!mPeersAsked.empty())
+    Peer::pointer best;
+    size_t ties = 0;
+    for (auto const& peer : mApp.getOverlayManager().getPeers())
     {
-        while (!peer && !mPeersAsked.empty())
+        if (peer->getState() != Peer::GOT_HELLO ||
+            find(mPeersAsked.begin(), mPeersAsked.end(), peer) !=
+                mPeersAsked.end())
+        {
+            continue;
+        }
+        if (!best || peer->getFetchLatency() < best->getFetchLatency())
         {
-            peer = mApp.getOverlayManager().getNextPeer(mPeersAsked.back());
-            if (!peer)
+            best = peer;
+            ties = 1;
+        }
+        else if (peer->getFetchLatency() == best->getFetchLatency())
+        {
+            // spread requests over equally fast (or unknown) peers
+            if (rand_uniform<size_t>(0, ties++) == 0)
             {
-                // no longer connected to this peer.
-                // try another.
-                mPeersAsked.pop_back();
+                best = peer;
             }
         }
     }
-    else
+    return best;
+}
+
+std::chrono::milliseconds
+Tracker::getHedgeTimeout() const
+{
+    if (mFetchLatency.count() < MIN_FETCH_LATENCY_SAMPLES)
     {
-        peer = mApp.getOverlayManager().getRandomPeer();
+        return MS_TO_WAIT_FOR_FETCH_REPLY;
     }
+    std::chrono::milliseconds timeout(static_cast<int64_t>(
+        mFetchLatency.GetSnapshot().get95thPercentile()));
+    return std::min(std::max(timeout, MS_MIN_TO_WAIT_FOR_FETCH_REPLY),
+                    MS_TO_WAIT_FOR_FETCH_REPLY);
+}
+
+void
+Tracker::tryNextPeer()
+{
+    // will be called by some timer or when we get a
+    // response saying they don't have it
+    Peer::pointer peer = pickPeer();
 
     std::chrono::milliseconds nextTry;
-    if (!peer ||
-        find(mPeersAsked.begin(), mPeersAsked.end(), peer) != mPeersAsked.end())
+    if (!peer)
     { // we have asked all our peers
         // clear list and try again in a bit
         mPeersAsked.clear();
+        mLastAskedPeer = nullptr;
         nextTry = MS_TO_WAIT_FOR_FETCH_REPLY * 2;
     }
     else
     {
+        // requests already sent stay outstanding: whichever peer answers
+        // first provides the item
         askPeer(peer);
 
         mLastAskedPeer = peer;
         mPeersAsked.push_back(peer);
-        nextTry = MS_TO_WAIT_FOR_FETCH_REPLY;
+        nextTry = getHedgeTimeout();
     }
 
     mTimer.expires_from_now(nextTry);
     mTimer.async_wait(
-        [this]()
+        [this, nextTry]()
     {
+        if (mLastAskedPeer)
+        {
+            // so that it isn't asked first next time
+            mLastAskedPeer->fetchTimedOut(nextTry);
+        }
         this->tryNextPeer();
         },
         VirtualTimer::onFailureNoop);
@@ -207,12 +251,24 @@ Tracker::listen(const SCPEnvelope& env)
     mWaitingEnvelopes.push_back(env);
 }
 
+TxSetTracker::TxSetTracker(Application& app, uint256 id)
+    : Tracker(app, id,
+              app.getMetrics().NewTimer({"overlay", "fetch", "txset-latency"}))
+{
+}
+
 void
 TxSetTracker::askPeer(Peer::pointer peer)
 {
     peer->sendGetTxSet(mItemID);
 }
 
+QuorumSetTracker::QuorumSetTracker(Application& app, uint256 id)
+    : Tracker(app, id,
+              app.getMetrics().NewTimer({"overlay", "fetch", "qset-latency"}))
+{
+}
+
 void
 QuorumSetTracker::askPeer(Peer::pointer peer)
 {
@@ -24,11 +24,18 @@ extra code to keep track of the different clients, ItemFetcher stops
 fetching an item when all the shared_ptrs to the item's tracker have
 been released.
 
+Peers are asked one at a time, the one that answered fetch requests the
+fastest so far first. If it hasn't answered after about as long as it takes
+most peers (the 95th percentile of the fetch latencies seen), the next
+fastest is asked as well, without cancelling the first request; whichever
+answers first wins.
+
 */
 
 namespace medida
 {
 class Counter;
+class Timer;
 }
 
 namespace stellar
@@ -39,6 +46,7 @@ using TxSetFramePtr = std::shared_ptr<TxSetFrame>;
 using SCPQuorumSetPtr = std::shared_ptr<SCPQuorumSet>;
 
 static std::chrono::milliseconds const MS_TO_WAIT_FOR_FETCH_REPLY{500};
+static std::chrono::milliseconds const MS_MIN_TO_WAIT_FOR_FETCH_REPLY{50};
 
 class Tracker
 {
@@ -51,6 +59,8 @@ class Tracker
     bool mIsStopped = false;
     std::vector<SCPEnvelope> mWaitingEnvelopes;
     uint256 mItemID;
+    // latency of the replies to requests for this kind of item
+    medida::Timer& mFetchLatency;
 
     bool clearEnvelopesBelow(uint64 slotIndex);
 
@@ -61,9 +71,15 @@ class Tracker
     void doesntHave(Peer::pointer peer);
     void tryNextPeer();
 
+    // fastest authenticated peer not asked yet, if any
+    Peer::pointer pickPeer() const;
+    // how long to wait for an answer before asking another peer as well
+    std::chrono::milliseconds getHedgeTimeout() const;
+
   public:
-    explicit Tracker(Application& app, uint256 const& id)
-        : mApp(app), mTimer(app), mItemID(id)
+    explicit Tracker(Application& app, uint256 const& id,
+                     medida::Timer& fetchLatency)
+        : mApp(app), mTimer(app), mItemID(id), mFetchLatency(fetchLatency)
     {
     }
 
@@ -103,9 +119,7 @@ template <class TrackerT> class ItemFetcher : private NonMovableOrCopyable
 class TxSetTracker : public Tracker
 {
   public:
-    TxSetTracker(Application& app, uint256 id) : Tracker(app, id)
-    {
-    }
+    TxSetTracker(Application& app, uint256 id);
 
     void askPeer(Peer::pointer peer) override;
 };
@@ -113,9 +127,7 @@ class TxSetTracker : public Tracker
 class QuorumSetTracker : public Tracker
 {
   public:
-    QuorumSetTracker(Application& app, uint256 id) : Tracker(app, id)
-    {
-    }
+    QuorumSetTracker(Application& app, uint256 id);
 
     void askPeer(Peer::pointer peer) override;
 };
@@ -9,8 +9,16 @@
 #include "overlay/ItemFetcher.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/LoopbackPeer.h"
+#include "main/Config.h"
 #include <crypto/SHA.h>
 #include <crypto/Hex.h>
+#include "xdrpp/marshal.h"
+
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace stellar
 {
@@ -127,4 +135,147 @@ activity")
     }
 }
 */
+
+TEST_CASE("fetch replies are timed per peer", "[overlay][fetch]")
+{
+    VirtualClock clock;
+    auto app = Application::create(clock, getTestConfig(0));
+    auto other = Application::create(clock, getTestConfig(1));
+
+    LoopbackPeerConnection connection(*app, *other);
+    auto peer = connection.getInitiator();
+    auto guess = peer->getFetchLatency();
+    for (size_t i = 0; i < 100 && peer->getState() != Peer::GOT_HELLO; i++)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(peer->getState() == Peer::GOT_HELLO);
+
+    // answering that it doesn't have an item isn't timed
+    peer->sendGetQuorumSet(sha256(ByteSlice("unknown")));
+    for (size_t i = 0; i < 100; i++)
+    {
+        clock.crank(false);
+    }
+    REQUIRE(peer->getFetchLatency() == guess);
+
+    // the other node knows its own quorum set
+    Hash qSetHash = sha256(xdr::xdr_to_opaque(other->getConfig().QUORUM_SET));
+    peer->sendGetQuorumSet(qSetHash);
+
+    auto& latency =
+        app->getMetrics().NewTimer({"overlay", "fetch", "qset-latency"});
+    for (size_t i = 0; i < 100 && latency.count() == 0; i++)
+    {
+        clock.crank(false);
+    }
+
+    REQUIRE(latency.count() == 1);
+    REQUIRE(peer->getFetchLatency() < guess);
+
+    // a request that times out counts against the peer
+    peer->fetchTimedOut(MS_TO_WAIT_FOR_FETCH_REPLY);
+    REQUIRE(peer->getFetchLatency() > guess / 8);
+}
+
+namespace
+{
+// asks nothing over the wire, so peers never answer
+class RecordingTracker : public Tracker
+{
+  public:
+    std::vector<Peer::pointer> mAsked;
+
+    RecordingTracker(Application& app, uint256 const& id)
+        : Tracker(app, id, app.getMetrics().NewTimer(
+                               {"overlay", "fetch", "test-latency"}))
+    {
+    }
+
+    void
+    askPeer(Peer::pointer peer) override
+    {
+        mAsked.push_back(peer);
+    }
+
+    using Tracker::pickPeer;
+    using Tracker::tryNextPeer;
+    using Tracker::mPeersAsked;
+};
+
+void
+crankUntilHello(VirtualClock& clock, std::vector<Peer::pointer> const& peers)
+{
+    for (size_t i = 0; i < 100; i++)
+    {
+        if (std::all_of(peers.begin(), peers.end(), [](Peer::pointer const& p)
+                        {
+                            return p->getState() == Peer::GOT_HELLO;
+                        }))
+        {
+            return;
+        }
+        clock.crank(false);
+    }
+    FAIL("peers did not say hello");
+}
+}
+
+TEST_CASE("fetch peers are picked by latency", "[overlay][fetch]")
+{
+    VirtualClock clock;
+    auto app = Application::create(clock, getTestConfig(0));
+    auto other1 = Application::create(clock, getTestConfig(1));
+    auto other2 = Application::create(clock, getTestConfig(2));
+    auto other3 = Application::create(clock, getTestConfig(3));
+
+    LoopbackPeerConnection connection1(*app, *other1);
+    LoopbackPeerConnection connection2(*app, *other2);
+    LoopbackPeerConnection connection3(*app, *other3);
+    Peer::pointer slow = connection1.getInitiator();
+    Peer::pointer medium = connection2.getInitiator();
+    Peer::pointer fast = connection3.getInitiator();
+
+    RecordingTracker tracker(*app, sha256(ByteSlice("item")));
+
+    // only peers that said hello are asked
+    REQUIRE(!tracker.pickPeer());
+    crankUntilHello(clock, {slow, medium, fast});
+
+    slow->fetchTimedOut(std::chrono::milliseconds(400));
+    medium->fetchTimedOut(std::chrono::milliseconds(300));
+    REQUIRE(fast->getFetchLatency() < medium->getFetchLatency());
+
+    SECTION("fastest peer not asked yet")
+    {
+        REQUIRE(tracker.pickPeer() == fast);
+        tracker.mPeersAsked.push_back(fast);
+        REQUIRE(tracker.pickPeer() == medium);
+        tracker.mPeersAsked.push_back(medium);
+        REQUIRE(tracker.pickPeer() == slow);
+        tracker.mPeersAsked.push_back(slow);
+        REQUIRE(!tracker.pickPeer());
+    }
+
+    SECTION("a peer that doesn't answer in time is hedged")
+    {
+        tracker.tryNextPeer();
+        REQUIRE(tracker.mAsked.size() == 1);
+        REQUIRE(tracker.mAsked[0] == fast);
+
+        // without enough samples the timeout is MS_TO_WAIT_FOR_FETCH_REPLY
+        auto asked = clock.now();
+        for (size_t i = 0; i < 1000 && tracker.mAsked.size() < 2; i++)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(tracker.mAsked.size() == 2);
+        REQUIRE(tracker.mAsked[1] == medium);
+        REQUIRE(clock.now() - asked >= MS_TO_WAIT_FOR_FETCH_REPLY);
+
+        // the silent peer is now slower than the one asked in its place
+        REQUIRE(fast->getFetchLatency() == MS_TO_WAIT_FOR_FETCH_REPLY);
+        REQUIRE(fast->getFetchLatency() > medium->getFetchLatency());
+    }
+}
 }
@@ -40,14 +40,17 @@
  * Broadcasts are initiated by the Herder and sent to both the Herder _and_ the
  * local FloodGate, for propagation to other peers.
  *
- * The OverlayManager tracks its known peers in the Database and shares peer
- * records with other peers when asked.
+ * The OverlayManager tracks its known peers in a PeerTable, backed by the
+ * Database, and shares peer records with other peers when asked. It prefers
+ * the peers that have been the best connected, and replaces connected peers
+ * that are consistently slower than the others.
  */
 
 namespace stellar
 {
 
 class PeerRecord;
+class PeerTable;
 
 class OverlayManager
 {
@@ -70,10 +73,15 @@ class OverlayManager
     // Make a note in the FloodGate that a given peer has provided us with a
     // given broadcast message, so that it is inhibited from being resent to
     // that peer. This does _not_ cause the message to be broadcast anew; to do
-    // that, call broadcastMessage, above.
-    virtual void recvFloodedMsg(StellarMessage const& msg,
+    // that, call broadcastMessage, above. Returns false if the message was
+    // already received or broadcast.
+    virtual bool recvFloodedMsg(StellarMessage const& msg,
                                 Peer::pointer peer) = 0;
 
+    // Drops what the FloodGate knows of a broadcast message, so that the next
+    // copy received counts as new again.
+    virtual void forgetFloodedMsg(StellarMessage const& msg) = 0;
+
     // Return a random peer from the set of connected peers.
     virtual Peer::pointer getRandomPeer() = 0;
 
@@ -105,6 +113,9 @@ class OverlayManager
     // Return the current in-memory set of connected peers.
     virtual std::vector<Peer::pointer>& getPeers() = 0;
 
+    // The peers this node knows about.
+    virtual PeerTable& getPeerTable() = 0;
+
     // Attempt to connect to a peer identified by string. The form of the string
     // should be an IP address or hostname, optionally followed by a colon and
     // a TCP port number.
@@ -15,6 +15,7 @@
 #include "medida/meter.h"
 #include "medida/counter.h"
 
+#include <algorithm>
 #include <random>
 
 /*
@@ -35,6 +36,11 @@ namespace stellar
 using namespace soci;
 using namespace std;
 
+// how often a slow peer may be replaced, and how long it then waits before
+// being connected to again
+static std::chrono::seconds const PEER_ROTATION_INTERVAL{60};
+static std::chrono::minutes const ROTATED_PEER_BACKOFF{10};
+
 std::unique_ptr<OverlayManager>
 OverlayManager::create(Application& app)
 {
@@ -44,9 +50,12 @@ OverlayManager::create(Application& app)
 OverlayManagerImpl::OverlayManagerImpl(Application& app)
     : mApp(app)
     , mDoor(make_shared<PeerDoor>(mApp))
+    , mPeerTable(app)
     , mShuttingDown(false)
     , mMessagesReceived(app.getMetrics().NewMeter(
           {"overlay", "message", "receive"}, "message"))
+    , mMessagesDuplicate(app.getMetrics().NewMeter(
+          {"overlay", "message", "duplicate"}, "message"))
     , mMessagesBroadcast(app.getMetrics().NewMeter(
           {"overlay", "message", "broadcast"}, "message"))
     , mConnectionsAttempted(app.getMetrics().NewMeter(
@@ -57,6 +66,8 @@ OverlayManagerImpl::OverlayManagerImpl(Application& app)
           {"overlay", "connection", "drop"}, "connection"))
     , mConnectionsRejected(app.getMetrics().NewMeter(
           {"overlay", "connection", "reject"}, "connection"))
+    , mConnectionsRotated(app.getMetrics().NewMeter(
+          {"overlay", "connection", "rotate"}, "connection"))
     , mPeersSize(app.getMetrics().NewCounter({"overlay", "memory", "peers"}))
     , mTimer(app)
     , mFloodGate(app)
@@ -71,6 +82,7 @@ void
 OverlayManagerImpl::start()
 {
     mDoor->start();
+    mNextRotation = mApp.getClock().now() + PEER_ROTATION_INTERVAL;
     mTimer.expires_from_now(std::chrono::seconds(2));
 
     if (!mApp.getConfig().RUN_STANDALONE)
@@ -116,7 +128,7 @@ OverlayManagerImpl::connectTo(PeerRecord& pr)
     if (!getConnectedPeer(pr.mIP, pr.mPort))
     {
         pr.backOff(mApp.getClock());
-        pr.storePeerRecord(mApp.getDatabase());
+        mPeerTable.store(pr);
 
         addConnectedPeer(TCPPeer::initiate(mApp, pr.mIP, pr.mPort));
     }
@@ -138,7 +150,7 @@ OverlayManagerImpl::storePeerList(std::vector<std::string> const& list,
         PeerRecord pr;
         if (PeerRecord::parseIPPort(peerStr, mApp, pr))
         {
-            pr.insertIfNew(mApp.getDatabase());
+            mPeerTable.insertIfNew(pr);
         }
         else
         {
@@ -158,8 +170,7 @@ void
 OverlayManagerImpl::connectToMorePeers(int max)
 {
     vector<PeerRecord> peers;
-    PeerRecord::loadPeerRecords(mApp.getDatabase(), max, mApp.getClock().now(),
-                                peers);
+    mPeerTable.loadCandidates(max, mApp.getClock().now(), peers);
     for (auto& pr : peers)
     {
         if (mPeers.size() >= mApp.getConfig().TARGET_PEER_CONNECTIONS)
@@ -178,6 +189,7 @@ void
 OverlayManagerImpl::tick()
 {
     CLOG(TRACE, "Overlay") << "OverlayManagerImpl tick";
+    rotateSlowPeer();
     if (mPeers.size() < mApp.getConfig().TARGET_PEER_CONNECTIONS)
     {
         connectToMorePeers(static_cast<int>(
@@ -193,6 +205,73 @@ OverlayManagerImpl::tick()
         VirtualTimer::onFailureNoop);
 }
 
+void
+OverlayManagerImpl::rotateSlowPeer()
+{
+    auto now = mApp.getClock().now();
+    if (mPeers.size() < mApp.getConfig().TARGET_PEER_CONNECTIONS ||
+        now < mNextRotation)
+    {
+        return;
+    }
+    mNextRotation = now + PEER_ROTATION_INTERVAL;
+
+    std::vector<double> scores;
+    Peer::pointer worst;
+    double worstScore = 0;
+    for (auto const& peer : mPeers)
+    {
+        auto q = peer->getQuality();
+        if (peer->getState() != Peer::GOT_HELLO || !q.isSignificant())
+        {
+            continue;
+        }
+        double score = q.getScore();
+        scores.push_back(score);
+        if ((!worst || score < worstScore) && !isPeerPreferred(peer))
+        {
+            worst = peer;
+            worstScore = score;
+        }
+    }
+    // too few peers to tell what slow is
+    if (!worst || scores.size() < 3)
+    {
+        return;
+    }
+    auto mid = scores.begin() + scores.size() / 2;
+    std::nth_element(scores.begin(), mid, scores.end());
+    if (worstScore >= *mid / 2)
+    {
+        return;
+    }
+
+    std::vector<PeerRecord> candidates;
+    mPeerTable.loadCandidates(mApp.getConfig().TARGET_PEER_CONNECTIONS, now,
+                              candidates);
+    bool replaceable = std::any_of(
+        candidates.begin(), candidates.end(), [this](PeerRecord const& pr)
+        {
+            return !getConnectedPeer(pr.mIP, pr.mPort);
+        });
+    if (!replaceable)
+    {
+        return;
+    }
+
+    CLOG(INFO, "Overlay") << "Replacing slow peer " << worst->toString()
+                          << " (score " << worstScore << ", median " << *mid
+                          << ")";
+    mConnectionsRotated.Mark();
+    auto pr = mPeerTable.load(worst->getIP(), worst->getRemoteListeningPort());
+    if (pr)
+    {
+        pr->mNextAttempt = now + ROTATED_PEER_BACKOFF;
+        mPeerTable.store(*pr);
+    }
+    worst->drop();
+}
+
 Peer::pointer
 OverlayManagerImpl::getConnectedPeer(std::string const& ip, unsigned short port)
 {
@@ -231,6 +310,12 @@ OverlayManagerImpl::dropPeer(Peer::pointer peer)
 {
     mConnectionsDropped.Mark();
     CLOG(DEBUG, "Overlay") << "Dropping peer " << peer->toString();
+    if (peer->getRemoteListeningPort() != 0)
+    {
+        // remembered to pick the best connected peers next time
+        mPeerTable.setQuality(peer->getIP(), peer->getRemoteListeningPort(),
+                              peer->getQuality());
+    }
     auto iter = find(mPeers.begin(), mPeers.end(), peer);
     if (iter != mPeers.end())
         mPeers.erase(iter);
@@ -258,12 +343,17 @@ OverlayManagerImpl::getPeers()
     return mPeers;
 }
 
+PeerTable&
+OverlayManagerImpl::getPeerTable()
+{
+    return mPeerTable;
+}
+
 bool
 OverlayManagerImpl::isPeerPreferred(Peer::pointer peer)
 {
-    auto pr = PeerRecord::loadPeerRecord(mApp.getDatabase(), peer->getIP(),
-                                         peer->getRemoteListeningPort());
-    return pr->mRank > 9;
+    auto pr = mPeerTable.load(peer->getIP(), peer->getRemoteListeningPort());
+    return pr && pr->mRank > 9;
 }
 
 Peer::pointer
@@ -297,12 +387,27 @@ OverlayManagerImpl::getNextPeer(Peer::pointer peer)
         return *(index + 1);
 }
 
-void
+bool
 OverlayManagerImpl::recvFloodedMsg(StellarMessage const& msg,
                                    Peer::pointer peer)
 {
     mMessagesReceived.Mark();
-    mFloodGate.addRecord(msg, peer);
+    bool isNew = mFloodGate.addRecord(msg, peer);
+    if (peer)
+    {
+        peer->recvFlooded(isNew);
+    }
+    if (!isNew)
+    {
+        mMessagesDuplicate.Mark();
+    }
+    return isNew;
+}
+
+void
+OverlayManagerImpl::forgetFloodedMsg(StellarMessage const& msg)
+{
+    mFloodGate.forgetRecord(msg);
 }
 
 void
@@ -331,6 +436,7 @@ OverlayManagerImpl::shutdown()
         mDoor->close();
     }
     mFloodGate.shutdown();
+    mPeerTable.flush();
     auto peersToStop = mPeers;
     for (auto& p : peersToStop)
     {
@@ -7,6 +7,7 @@
 #include "Peer.h"
 #include "PeerDoor.h"
 #include "PeerRecord.h"
+#include "PeerTable.h"
 #include "overlay/ItemFetcher.h"
 #include "overlay/Floodgate.h"
 #include <vector>
@@ -34,18 +35,26 @@ class OverlayManagerImpl : public OverlayManager
     // peers we are connected to
     std::vector<Peer::pointer> mPeers;
     PeerDoor::pointer mDoor;
+    PeerTable mPeerTable;
     bool mShuttingDown;
 
     medida::Meter& mMessagesReceived;
+    medida::Meter& mMessagesDuplicate;
     medida::Meter& mMessagesBroadcast;
     medida::Meter& mConnectionsAttempted;
     medida::Meter& mConnectionsEstablished;
     medida::Meter& mConnectionsDropped;
     medida::Meter& mConnectionsRejected;
+    medida::Meter& mConnectionsRotated;
     medida::Counter& mPeersSize;
 
     void tick();
     VirtualTimer mTimer;
+    VirtualClock::time_point mNextRotation;
+
+    // drops the worst connected peer if it is much slower than the others
+    // and another peer can take its place
+    void rotateSlowPeer();
 
     void storePeerList(std::vector<std::string> const& list, int rank);
     void storeConfigPeers();
@@ -60,7 +69,8 @@ class OverlayManagerImpl : public OverlayManager
     ~OverlayManagerImpl();
 
     void ledgerClosed(uint32_t lastClosedledgerSeq) override;
-    void recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
+    bool recvFloodedMsg(StellarMessage const& msg, Peer::pointer peer) override;
+    void forgetFloodedMsg(StellarMessage const& msg) override;
     void broadcastMessage(StellarMessage const& msg,
                           bool force = false) override;
     void connectTo(std::string const& addr) override;
@@ -70,6 +80,7 @@ class OverlayManagerImpl : public OverlayManager
     void dropPeer(Peer::pointer peer) override;
     bool isPeerAccepted(Peer::pointer peer) override;
     std::vector<Peer::pointer>& getPeers() override;
+    PeerTable& getPeerTable() override;
 
     // returns NULL if the passed peer isn't found
     Peer::pointer getNextPeer(Peer::pointer peer) override;
@@ -62,7 +62,7 @@ class OverlayManagerStub : public OverlayManagerImpl
         if (!getConnectedPeer(pr.mIP, pr.mPort))
         {
             pr.backOff(mApp.getClock());
-            pr.storePeerRecord(mApp.getDatabase());
+            getPeerTable().store(pr);
 
             addConnectedPeer(Peer::pointer(new PeerStub(mApp)));
         }
@@ -109,6 +109,7 @@ class OverlayManagerTests
 
         pm.storePeerList(fourPeers, 10);
         pm.storePeerList(threePeers, 3);
+        pm.getPeerTable().flush();
 
         rowset<row> rs = app.getDatabase().getSession().prepare
                          << "SELECT ip,port FROM peers ORDER BY rank LIMIT 5 ";
@@ -122,6 +123,55 @@ class OverlayManagerTests
         REQUIRE(actual == expected);
     }
 
+    void
+    test_peerTable()
+    {
+        OverlayManagerStub& pm = app.getOverlayManager();
+        PeerTable& table = pm.getPeerTable();
+        auto countStored = [&]()
+        {
+            int count;
+            app.getDatabase().getSession() << "SELECT COUNT(*) FROM peers",
+                into(count);
+            return count;
+        };
+
+        pm.storePeerList(fourPeers, 2);
+        REQUIRE(countStored() == 0);
+        REQUIRE(table.load("127.0.0.1", 2013));
+        REQUIRE(!table.insertIfNew(*table.load("127.0.0.1", 2013)));
+
+        // better connected peers come first, at equal rank and failures
+        PeerQuality slow;
+        slow.mLatency = std::chrono::milliseconds(2000);
+        PeerQuality first;
+        first.mFloodReceived = 100;
+        first.mFloodFirst = 90;
+        table.setQuality("127.0.0.1", 2011, slow);
+        table.setQuality("127.0.0.1", 2014, first);
+
+        vector<PeerRecord> candidates;
+        table.loadCandidates(4, clock.now(), candidates);
+        REQUIRE(candidates.size() == 4);
+        REQUIRE(candidates.front().mPort == 2014);
+        REQUIRE(candidates.back().mPort == 2011);
+
+        // but rank and failures go first
+        auto backedOff = table.load("127.0.0.1", 2014);
+        backedOff->mNumFailures = 1;
+        table.store(*backedOff);
+        candidates.clear();
+        table.loadCandidates(4, clock.now(), candidates);
+        REQUIRE(candidates.back().mPort == 2014);
+
+        table.flush();
+        REQUIRE(countStored() == 4);
+        auto stored = PeerRecord::loadPeerRecord(app.getDatabase(),
+                                                 "127.0.0.1", 2014);
+        REQUIRE(stored);
+        REQUIRE(stored->mNumFailures == 1);
+    }
+
     vector<int>
     sentCounts(OverlayManagerImpl& pm)
     {
@@ -146,12 +196,19 @@ class OverlayManagerTests
         SecretKey d = getAccount("d");
 
         StellarMessage AtoC = createPaymentTx(a, b, 1, 10)->toStellarMessage();
-        pm.recvFloodedMsg(AtoC, *(pm.mPeers.begin() + 2));
+        REQUIRE(pm.recvFloodedMsg(AtoC, *(pm.mPeers.begin() + 2)));
         pm.broadcastMessage(AtoC);
         vector<int> expected{1, 1, 0, 1, 1};
         REQUIRE(sentCounts(pm) == expected);
         pm.broadcastMessage(AtoC);
         REQUIRE(sentCounts(pm) == expected);
+        // relayed back by another peer
+        REQUIRE(!pm.recvFloodedMsg(AtoC, *(pm.mPeers.begin() + 3)));
+        pm.broadcastMessage(AtoC);
+        REQUIRE(sentCounts(pm) == expected);
+        // forgotten, as when the herder ignores an envelope
+        pm.forgetFloodedMsg(AtoC);
+        REQUIRE(pm.recvFloodedMsg(AtoC, *(pm.mPeers.begin() + 3)));
         StellarMessage CtoD = createPaymentTx(c, d, 1, 10)->toStellarMessage();
         pm.broadcastMessage(CtoD);
         vector<int> expectedFinal{2, 2, 1, 2, 2};
@@ -164,6 +221,12 @@ TEST_CASE_METHOD(OverlayManagerTests, "addPeerList() adds", "[overlay]")
     test_addPeerList();
 }
 
+TEST_CASE_METHOD(OverlayManagerTests, "peer table orders and persists peers",
+                 "[overlay]")
+{
+    test_peerTable();
+}
+
 TEST_CASE_METHOD(OverlayManagerTests, "broadcast() broadcasts", "[overlay]")
 {
     test_broadcast();
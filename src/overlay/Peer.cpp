@@ -14,10 +14,14 @@
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerRecord.h"
+#include "overlay/PeerTable.h"
 #include "util/Logging.h"
 
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
 #include "xdrpp/marshal.h"
 
+#include <algorithm>
 #include <soci.h>
 #include <time.h>
 
@@ -30,10 +34,26 @@ namespace stellar
 using namespace std;
 using namespace soci;
 
+// what a peer is assumed to take to answer a fetch request until it does
+static std::chrono::milliseconds const FETCH_LATENCY_GUESS{250};
+
+// requests outstanding to one peer that are remembered; more means the
+// peer isn't answering, and the oldest are forgotten
+static size_t const MAX_FETCH_REQUESTS = 64;
+
 Peer::Peer(Application& app, PeerRole role)
     : mApp(app)
     , mRole(role)
     , mState(role == ACCEPTOR ? CONNECTING : CONNECTED)
+    , mFetchLatency(FETCH_LATENCY_GUESS)
+    , mFetchLatencyMeasured(false)
+    , mTxSetLatency(
+          app.getMetrics().NewTimer({"overlay", "fetch", "txset-latency"}))
+    , mQSetLatency(
+          app.getMetrics().NewTimer({"overlay", "fetch", "qset-latency"}))
+    , mBytesReceived(0)
+    , mFloodReceived(0)
+    , mFloodFirst(0)
     , mRemoteOverlayVersion(0)
     , mRemoteListeningPort(0)
 {
@@ -108,7 +128,7 @@ Peer::sendGetTxSet(uint256 const& setID)
     newMsg.type(GET_TX_SET);
     newMsg.txSetHash() = setID;
 
-    sendMessage(newMsg);
+    sendFetchRequest(newMsg, setID);
 }
 void
 Peer::sendGetQuorumSet(uint256 const& setID)
@@ -119,7 +139,105 @@ Peer::sendGetQuorumSet(uint256 const& setID)
     newMsg.type(GET_SCP_QUORUMSET);
     newMsg.qSetHash() = setID;
 
-    sendMessage(newMsg);
+    sendFetchRequest(newMsg, setID);
+}
+
+void
+Peer::sendFetchRequest(StellarMessage const& msg, uint256 const& itemID)
+{
+    if (mFetchRequests.size() >= MAX_FETCH_REQUESTS &&
+        mFetchRequests.find(itemID) == mFetchRequests.end())
+    {
+        using value_type = decltype(mFetchRequests)::value_type;
+        mFetchRequests.erase(std::min_element(
+            mFetchRequests.begin(), mFetchRequests.end(),
+            [](value_type const& a, value_type const& b)
+            {
+                return a.second < b.second;
+            }));
+    }
+    // a request sent again is timed from the first one
+    mFetchRequests.insert(std::make_pair(itemID, mApp.getClock().now()));
+
+    sendMessage(msg);
+}
+
+void
+Peer::recvFetchReply(uint256 const& itemID, medida::Timer& latencyTimer)
+{
+    auto it = mFetchRequests.find(itemID);
+    if (it == mFetchRequests.end())
+    {
+        // unsolicited, or asked for by the other side
+        return;
+    }
+    auto latency = mApp.getClock().now() - it->second;
+    mFetchRequests.erase(it);
+
+    updateFetchLatency(
+        std::chrono::duration_cast<std::chrono::milliseconds>(latency));
+    latencyTimer.Update(latency);
+}
+
+void
+Peer::updateFetchLatency(std::chrono::milliseconds sample)
+{
+    // smoothed like TCP's round-trip time estimate
+    if (mFetchLatencyMeasured)
+    {
+        mFetchLatency = (mFetchLatency * 7 + sample) / 8;
+    }
+    else
+    {
+        mFetchLatency = sample;
+        mFetchLatencyMeasured = true;
+    }
+}
+
+std::chrono::milliseconds
+Peer::getFetchLatency() const
+{
+    return mFetchLatency;
+}
+
+void
+Peer::fetchTimedOut(std::chrono::milliseconds elapsed)
+{
+    // it takes at least that long; a late answer will correct this
+    if (elapsed > mFetchLatency)
+    {
+        updateFetchLatency(elapsed);
+    }
+}
+
+void
+Peer::recvFlooded(bool first)
+{
+    mFloodReceived++;
+    if (first)
+    {
+        mFloodFirst++;
+    }
+}
+
+PeerQuality
+Peer::getQuality() const
+{
+    PeerQuality q;
+    q.mLatency = mFetchLatency;
+    q.mFloodReceived = mFloodReceived;
+    q.mFloodFirst = mFloodFirst;
+    if (mHelloTime != VirtualClock::time_point())
+    {
+        auto connected = mApp.getClock().now() - mHelloTime;
+        q.mConnected =
+            std::chrono::duration_cast<std::chrono::seconds>(connected);
+        if (q.mConnected.count() > 0)
+        {
+            q.mBytesPerSecond = double(mBytesReceived) / q.mConnected.count();
+        }
+    }
+    return q;
 }
 
 void
@@ -127,8 +245,8 @@ Peer::sendPeers()
 {
     // send top 50 peers we know about
     vector<PeerRecord> peerList;
-    PeerRecord::loadPeerRecords(mApp.getDatabase(), 50, mApp.getClock().now(),
-                                peerList);
+    mApp.getOverlayManager().getPeerTable().loadCandidates(
+        50, mApp.getClock().now(), peerList);
     StellarMessage newMsg;
     newMsg.type(PEERS);
     newMsg.peers().resize(xdr::size32(peerList.size()));
@@ -157,6 +275,7 @@ void
 Peer::recvMessage(xdr::msg_ptr const& msg)
 {
     CLOG(TRACE, "Overlay") << "received xdr::msg_ptr";
+    mBytesReceived += msg->raw_size();
     StellarMessage sm;
     try
     {
@@ -267,6 +386,9 @@ Peer::recvMessage(StellarMessage const& stellarMsg)
 void
 Peer::recvDontHave(StellarMessage const& msg)
 {
+    // no latency sample: a peer quick to say it doesn't have an item isn't
+    // a peer to ask first
+    mFetchRequests.erase(msg.dontHave().reqHash);
     mApp.getHerder().peerDoesntHave(msg.dontHave().type, msg.dontHave().reqHash,
                                     shared_from_this());
 }
@@ -293,7 +415,9 @@ void
 Peer::recvTxSet(StellarMessage const& msg)
 {
     TxSetFrame frame(msg.txSet());
-    mApp.getHerder().recvTxSet(frame.getContentsHash(), frame);
+    Hash hash = frame.getContentsHash();
+    recvFetchReply(hash, mTxSetLatency);
+    mApp.getHerder().recvTxSet(hash, frame);
 }
 
 void
@@ -335,20 +459,31 @@ void
 Peer::recvSCPQuorumSet(StellarMessage const& msg)
 {
     Hash hash = sha256(xdr::xdr_to_opaque(msg.qSet()));
+    recvFetchReply(hash, mQSetLatency);
     mApp.getHerder().recvSCPQuorumSet(hash, msg.qSet());
 }
 
 void
 Peer::recvSCPMessage(StellarMessage const& msg)
 {
-    SCPEnvelope envelope = msg.envelope();
     CLOG(TRACE, "Overlay") << "recvSCPMessage node: "
                            << PubKeyUtils::toShortString(
                                   msg.envelope().statement.nodeID);
 
-    mApp.getOverlayManager().recvFloodedMsg(msg, shared_from_this());
+    // each envelope is relayed by every peer; only the first copy reaches
+    // the herder. An envelope the herder ignored is forgotten by the flood
+    // gate, so a later copy reaches the herder again: only copies of
+    // envelopes the herder kept are dropped here.
+    auto& om = mApp.getOverlayManager();
+    if (!om.recvFloodedMsg(msg, shared_from_this()))
+    {
+        return;
+    }
 
-    mApp.getHerder().recvSCPEnvelope(envelope);
+    if (!mApp.getHerder().recvSCPEnvelope(msg.envelope()))
+    {
+        om.forgetFloodedMsg(msg);
+    }
 }
 
 void
@@ -380,13 +515,14 @@ Peer::recvHello(StellarMessage const& msg)
         static_cast<unsigned short>(msg.hello().listeningPort);
     CLOG(DEBUG, "Overlay") << "recvHello from " << toString();
     mState = GOT_HELLO;
+    mHelloTime = mApp.getClock().now();
     mPeerID = msg.hello().peerID;
     if (mRole == INITIATOR)
     {
         PeerRecord pr(getIP(), mRemoteListeningPort, mApp.getClock().now(), 0,
                       1);
 
-        pr.insertIfNew(mApp.getDatabase());
+        mApp.getOverlayManager().getPeerTable().insertIfNew(pr);
     }
     return true;
 }
@@ -421,7 +557,7 @@ Peer::recvPeers(StellarMessage const& msg)
         }
         else
         {
-            pr.insertIfNew(mApp.getDatabase());
+            mApp.getOverlayManager().getPeerTable().insertIfNew(pr);
         }
     }
 }
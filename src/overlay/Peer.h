@@ -11,9 +11,18 @@
 #include "database/Database.h"
 #include "util/NonCopyable.h"
 
+#include <map>
+
+namespace medida
+{
+class Timer;
+}
+
 namespace stellar
 {
 
+struct PeerQuality;
+
 typedef std::shared_ptr<SCPQuorumSet> SCPQuorumSetPtr;
 
 class Application;
@@ -54,6 +63,26 @@ class Peer : public std::enable_shared_from_this<Peer>,
     uint32_t mRemoteOverlayVersion;
     unsigned short mRemoteListeningPort;
 
+    // GET_TX_SET and GET_SCP_QUORUMSET requests awaiting an answer, by item,
+    // and how fast this peer delivered the items asked for before
+    std::map<uint256, VirtualClock::time_point> mFetchRequests;
+    std::chrono::milliseconds mFetchLatency;
+    bool mFetchLatencyMeasured;
+    // latency of the replies carrying the item, for all peers
+    medida::Timer& mTxSetLatency;
+    medida::Timer& mQSetLatency;
+
+    // link quality since the hello, see getQuality
+    VirtualClock::time_point mHelloTime;
+    uint64_t mBytesReceived;
+    uint64_t mFloodReceived;
+    uint64_t mFloodFirst;
+
+    void sendFetchRequest(StellarMessage const& msg, uint256 const& itemID);
+    // a reply carrying the item
+    void recvFetchReply(uint256 const& itemID, medida::Timer& latencyTimer);
+    void updateFetchLatency(std::chrono::milliseconds sample);
+
     bool shouldAbort() const;
     void recvMessage(StellarMessage const& msg);
     void recvMessage(xdr::msg_ptr const& xdrBytes);
@@ -102,6 +131,18 @@ class Peer : public std::enable_shared_from_this<Peer>,
     void sendGetTxSet(uint256 const& setID);
     void sendGetQuorumSet(uint256 const& setID);
 
+    // smoothed time this peer takes to send the item asked for by GET_TX_SET
+    // and GET_SCP_QUORUMSET, or a neutral guess until it has sent one
+    std::chrono::milliseconds getFetchLatency() const;
+    // notes that a request has gone unanswered for `elapsed`
+    void fetchTimedOut(std::chrono::milliseconds elapsed);
+
+    // notes that the peer sent a flooded message, and whether it was the
+    // first to
+    void recvFlooded(bool first);
+
+    PeerQuality getQuality() const;
+
     void sendMessage(StellarMessage const& msg);
 
     PeerRole
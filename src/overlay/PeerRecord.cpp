@@ -196,6 +196,33 @@ PeerRecord::loadPeerRecords(Database& db, uint32_t max,
     }
 }
 
+void
+PeerRecord::loadAllPeerRecords(Database& db, vector<PeerRecord>& retList)
+{
+    tm tm;
+    PeerRecord pr;
+    uint32_t lport;
+    auto prep = db.getPreparedStatement(
+        "SELECT ip, port, nextattempt, numfailures, rank FROM peers");
+    auto& st = prep.statement();
+    st.exchange(into(pr.mIP));
+    st.exchange(into(lport));
+    st.exchange(into(tm));
+    st.exchange(into(pr.mNumFailures));
+    st.exchange(into(pr.mRank));
+    st.define_and_bind();
+    {
+        auto timer = db.getSelectTimer("peer");
+        st.execute();
+    }
+    while (st.fetch())
+    {
+        pr.mPort = static_cast<unsigned short>(lport);
+        pr.mNextAttempt = VirtualClock::tmToPoint(tm);
+        retList.push_back(pr);
+    }
+}
+
 bool
 PeerRecord::isPrivateAddress()
 {
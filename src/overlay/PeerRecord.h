@@ -55,6 +55,7 @@ class PeerRecord
     static void loadPeerRecords(Database& db, uint32_t max,
                                 VirtualClock::time_point nextAttemptCutoff,
                                 vector<PeerRecord>& retList);
+    static void loadAllPeerRecords(Database& db, vector<PeerRecord>& retList);
 
     bool isPrivateAddress();
 
@@ -0,0 +1,200 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerTable.h"
+#include "database/Database.h"
+#include "main/Application.h"
+#include "util/Logging.h"
+
+#include <algorithm>
+#include <soci.h>
+
+namespace stellar
+{
+
+// how long changed records wait to be written back
+static std::chrono::seconds const PEER_TABLE_FLUSH_DELAY{2};
+
+// flooded messages and connection time after which a peer can be judged
+static uint64_t const MIN_FLOOD_RECEIVED = 100;
+static std::chrono::seconds const MIN_CONNECTED{60};
+
+double
+PeerQuality::getScore() const
+{
+    // share of the flooded messages it was the first to deliver, pulled
+    // toward one half while it has delivered few...
+    double first = (mFloodFirst + 1.0) / (mFloodReceived + 2.0);
+    // ...and divided by one plus the seconds it takes to answer a request:
+    // halved at one second, a third at two, and so on
+    return first / (1.0 + mLatency.count() / 1000.0);
+}
+
+bool
+PeerQuality::isSignificant() const
+{
+    return mFloodReceived >= MIN_FLOOD_RECEIVED && mConnected >= MIN_CONNECTED;
+}
+
+PeerTable::PeerTable(Application& app)
+    : mApp(app), mLoaded(false), mFlushTimer(app)
+{
+}
+
+void
+PeerTable::ensureLoaded()
+{
+    if (mLoaded)
+    {
+        return;
+    }
+    std::vector<PeerRecord> records;
+    PeerRecord::loadAllPeerRecords(mApp.getDatabase(), records);
+    for (auto const& pr : records)
+    {
+        mEntries[std::make_pair(pr.mIP, pr.mPort)] = Entry{pr, false, {}};
+    }
+    mLoaded = true;
+    CLOG(DEBUG, "Overlay") << "Loaded " << mEntries.size() << " peer records";
+}
+
+void
+PeerTable::markDirty(Key const& key)
+{
+    bool wasClean = mDirty.empty();
+    mDirty.insert(key);
+    if (wasClean)
+    {
+        mFlushTimer.expires_from_now(PEER_TABLE_FLUSH_DELAY);
+        mFlushTimer.async_wait(
+            [this]()
+            {
+                flush();
+            },
+            VirtualTimer::onFailureNoop);
+    }
+}
+
+optional<PeerRecord>
+PeerTable::load(std::string const& ip, unsigned short port)
+{
+    ensureLoaded();
+    auto it = mEntries.find(std::make_pair(ip, port));
+    if (it == mEntries.end())
+    {
+        return nullopt<PeerRecord>();
+    }
+    return make_optional<PeerRecord>(it->second.mRecord);
+}
+
+bool
+PeerTable::insertIfNew(PeerRecord const& pr)
+{
+    ensureLoaded();
+    auto key = std::make_pair(pr.mIP, pr.mPort);
+    if (!mEntries.insert(std::make_pair(key, Entry{pr, false, {}})).second)
+    {
+        return false;
+    }
+    markDirty(key);
+    return true;
+}
+
+void
+PeerTable::store(PeerRecord const& pr)
+{
+    ensureLoaded();
+    auto key = std::make_pair(pr.mIP, pr.mPort);
+    auto it = mEntries.find(key);
+    if (it == mEntries.end())
+    {
+        mEntries[key] = Entry{pr, false, {}};
+    }
+    else
+    {
+        it->second.mRecord = pr;
+    }
+    markDirty(key);
+}
+
+void
+PeerTable::loadCandidates(size_t max,
+                          VirtualClock::time_point nextAttemptCutoff,
+                          std::vector<PeerRecord>& retList)
+{
+    ensureLoaded();
+    std::vector<Entry const*> due;
+    for (auto const& kv : mEntries)
+    {
+        if (kv.second.mRecord.mNextAttempt <= nextAttemptCutoff)
+        {
+            due.push_back(&kv.second);
+        }
+    }
+
+    // peers never connected to are assumed as good as the average one
+    double neutral = PeerQuality().getScore();
+    auto score = [neutral](Entry const* e)
+    {
+        return e->mHasQuality ? e->mQuality.getScore() : neutral;
+    };
+    auto better = [&score](Entry const* a, Entry const* b)
+    {
+        if (a->mRecord.mRank != b->mRecord.mRank)
+        {
+            return a->mRecord.mRank > b->mRecord.mRank;
+        }
+        if (a->mRecord.mNumFailures != b->mRecord.mNumFailures)
+        {
+            return a->mRecord.mNumFailures < b->mRecord.mNumFailures;
+        }
+        return score(a) > score(b);
+    };
+
+    size_t n = std::min(max, due.size());
+    std::partial_sort(due.begin(), due.begin() + n, due.end(), better);
+    for (size_t i = 0; i < n; i++)
+    {
+        retList.push_back(due[i]->mRecord);
+    }
+}
+
+void
+PeerTable::setQuality(std::string const& ip, unsigned short port,
+                      PeerQuality const& quality)
+{
+    ensureLoaded();
+    auto it = mEntries.find(std::make_pair(ip, port));
+    if (it != mEntries.end())
+    {
+        it->second.mHasQuality = true;
+        it->second.mQuality = quality;
+    }
+}
+
+void
+PeerTable::flush()
+{
+    mFlushTimer.cancel();
+    if (mDirty.empty())
+    {
+        return;
+    }
+
+    auto& db = mApp.getDatabase();
+    soci::transaction tx(db.getSession());
+    for (auto const& key : mDirty)
+    {
+        auto it = mEntries.find(key);
+        if (it != mEntries.end())
+        {
+            it->second.mRecord.storePeerRecord(db);
+        }
+    }
+    tx.commit();
+
+    CLOG(DEBUG, "Overlay") << "Stored " << mDirty.size() << " peer records";
+    mDirty.clear();
+}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "overlay/PeerRecord.h"
+#include "util/NonCopyable.h"
+#include "util/Timer.h"
+#include "util/optional.h"
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace stellar
+{
+
+// How well connected a peer is, measured over a connection to it.
+struct PeerQuality
+{
+    // smoothed time it takes to answer GET_TX_SET and GET_SCP_QUORUMSET
+    std::chrono::milliseconds mLatency{0};
+    // bytes received from it per second of connection; reported only, as it
+    // mostly tells how much traffic there was
+    double mBytesPerSecond{0};
+    // flooded messages it sent, and how many of them it was the first to
+    uint64_t mFloodReceived{0};
+    uint64_t mFloodFirst{0};
+    std::chrono::seconds mConnected{0};
+
+    // share of flooded messages it was first to deliver, discounted by its
+    // latency; higher is better
+    double getScore() const;
+
+    // whether it has been observed long enough to judge it
+    bool isSignificant() const;
+};
+
+/**
+ * The peers known to this node, kept in memory and written back to the
+ * `peers` table in the background.
+ *
+ * The table is read from the database once, on first use. Changed records are
+ * written back in a single transaction a little while after the first
+ * change (or on flush()), so that connecting, backing off and learning about
+ * new peers doesn't cost a query each.
+ *
+ * Alongside each record it keeps the quality of the last connection to the
+ * peer, which isn't persisted; among candidates of the same rank and number
+ * of failures, the better connected peers come first.
+ */
+class PeerTable : NonMovableOrCopyable
+{
+  public:
+    explicit PeerTable(Application& app);
+
+    optional<PeerRecord> load(std::string const& ip, unsigned short port);
+
+    // returns true if the record wasn't known
+    bool insertIfNew(PeerRecord const& pr);
+
+    // inserts or replaces the record
+    void store(PeerRecord const& pr);
+
+    // up to `max` records whose next attempt is due by `nextAttemptCutoff`,
+    // best first
+    void loadCandidates(size_t max, VirtualClock::time_point nextAttemptCutoff,
+                        std::vector<PeerRecord>& retList);
+
+    // records how the last connection to a known peer went
+    void setQuality(std::string const& ip, unsigned short port,
+                    PeerQuality const& quality);
+
+    // writes the changed records to the database now
+    void flush();
+
+  private:
+    typedef std::pair<std::string, unsigned short> Key;
+
+    struct Entry
+    {
+        PeerRecord mRecord;
+        bool mHasQuality;
+        PeerQuality mQuality;
+    };
+
+    Application& mApp;
+    bool mLoaded;
+    std::map<Key, Entry> mEntries;
+    std::set<Key> mDirty;
+    VirtualTimer mFlushTimer;
+
+    void ensureLoaded();
+    void markDirty(Key const& key);
+};
+}
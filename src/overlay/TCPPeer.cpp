@@ -9,9 +9,10 @@
 #include "xdrpp/marshal.h"
 #include "overlay/OverlayManager.h"
 #include "database/Database.h"
-#include "overlay/PeerRecord.h"
+#include "overlay/PeerTable.h"
 #include "medida/metrics_registry.h"
 #include "medida/meter.h"
+#include "util/ShardedMetrics.h"
 #include "main/Config.h"
 
 #define IO_TIMEOUT_SECONDS 30
@@ -35,13 +36,14 @@ TCPPeer::TCPPeer(Application& app, Peer::PeerRole role,
     , mReadIdle(app)
     , mWriteIdle(app)
     , mStrand(app.getClock().getIOService())
-    , mMessageRead(
-          app.getMetrics().NewMeter({"overlay", "message", "read"}, "message"))
-    , mMessageWrite(
-          app.getMetrics().NewMeter({"overlay", "message", "write"}, "message"))
-    , mByteRead(app.getMetrics().NewMeter({"overlay", "byte", "read"}, "byte"))
-    , mByteWrite(
-          app.getMetrics().NewMeter({"overlay", "byte", "write"}, "byte"))
+    , mMessageRead(app.getShardedMetrics().NewMeter(
+          {"overlay", "message", "read"}, "message"))
+    , mMessageWrite(app.getShardedMetrics().NewMeter(
+          {"overlay", "message", "write"}, "message"))
+    , mByteRead(
+          app.getShardedMetrics().NewMeter({"overlay", "byte", "read"}, "byte"))
+    , mByteWrite(app.getShardedMetrics().NewMeter({"overlay", "byte", "write"},
+                                                  "byte"))
     , mErrorRead(
           app.getMetrics().NewMeter({"overlay", "error", "read"}, "error"))
     , mErrorWrite(
@@ -393,6 +395,7 @@ TCPPeer::recvMessage()
         xdr::xdr_get g(mIncomingBody.data(),
                        mIncomingBody.data() + mIncomingBody.size());
         mMessageRead.Mark();
+        mBytesReceived += mIncomingBody.size();
         StellarMessage sm;
         xdr::xdr_argpack_archive(g, sm);
         Peer::recvMessage(sm);
@@ -412,13 +415,13 @@ TCPPeer::recvHello(StellarMessage const& msg)
 
     if (mRole == INITIATOR)
     {
-        if (!PeerRecord::loadPeerRecord(mApp.getDatabase(), getIP(),
-                                        getRemoteListeningPort()))
+        auto& peerTable = mApp.getOverlayManager().getPeerTable();
+        if (!peerTable.load(getIP(), getRemoteListeningPort()))
         {
             PeerRecord pr;
             PeerRecord::fromIPPort(getIP(), getRemoteListeningPort(),
                                    mApp.getClock(), pr);
-            pr.storePeerRecord(mApp.getDatabase());
+            peerTable.store(pr);
         }
 
         if (mApp.getOverlayManager().isPeerAccepted(shared_from_this()))
@@ -435,8 +438,8 @@ TCPPeer::recvHello(StellarMessage const& msg)
     else
     { // we called this guy
         // only lower numFailures if we were successful connecting out to him
-        auto pr = PeerRecord::loadPeerRecord(mApp.getDatabase(), getIP(),
-                                             getRemoteListeningPort());
+        auto& peerTable = mApp.getOverlayManager().getPeerTable();
+        auto pr = peerTable.load(getIP(), getRemoteListeningPort());
         if (!pr)
         {
             pr = make_optional<PeerRecord>();
@@ -445,7 +448,7 @@ TCPPeer::recvHello(StellarMessage const& msg)
         }
         pr->mNumFailures = 0;
         pr->mNextAttempt = mApp.getClock().now();
-        pr->storePeerRecord(mApp.getDatabase());
+        peerTable.store(*pr);
     }
     return true;
 }
@@ -15,6 +15,8 @@ class Meter;
 
 namespace stellar
 {
+class ShardedMeter;
+
 // Peer that communicates via a TCP socket.
 class TCPPeer : public Peer
 {
@@ -28,10 +30,11 @@ class TCPPeer : public Peer
 
     std::queue<std::shared_ptr<xdr::msg_ptr>> mWriteQueue;
 
-    medida::Meter& mMessageRead;
-    medida::Meter& mMessageWrite;
-    medida::Meter& mByteRead;
-    medida::Meter& mByteWrite;
+    // marked for every message, so sharded: see util/ShardedMetrics.h
+    ShardedMeter& mMessageRead;
+    ShardedMeter& mMessageWrite;
+    ShardedMeter& mByteRead;
+    ShardedMeter& mByteWrite;
     medida::Meter& mErrorRead;
     medida::Meter& mErrorWrite;
     medida::Meter& mTimeoutRead;
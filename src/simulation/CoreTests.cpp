@@ -14,6 +14,9 @@
 #include "util/types.h"
 #include "herder/Herder.h"
 #include "transactions/TransactionFrame.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "medida/stats/snapshot.h"
 
 using namespace stellar;
 
@@ -41,8 +44,6 @@ printStats(int& nLedgers, std::chrono::system_clock::time_point tBegin,
     LOG(INFO) << sim->metricsSummary("scp");
 }
 
-#include "lib/util/lrucache.hpp"
-
 TEST_CASE("3 nodes. 2 running. threshold 2", "[simulation][core3]")
 {
     Simulation::Mode mode = Simulation::OVER_LOOPBACK;
@@ -110,6 +111,10 @@ TEST_CASE("core topology: 4 ledgers at scales 2..4", "[simulation]")
     {
         mode = Simulation::OVER_TCP;
     }
+    SECTION("Over tcp, a thread per node")
+    {
+        mode = Simulation::OVER_TCP_THREADED;
+    }
 
     for (int size = 2; size <= 4; size++)
     {
@@ -192,6 +197,47 @@ TEST_CASE("cycle4 topology", "[simulation]")
     REQUIRE(simulation->haveAllExternalized(2));
 }
 
+static void
+benchConsensus(std::string const& name, Simulation::pointer sim, int nLedgers)
+{
+    auto tBegin = std::chrono::steady_clock::now();
+    sim->startAllNodes();
+    sim->crankUntil(
+        [&sim, nLedgers]()
+        {
+            return sim->haveAllExternalized(nLedgers + 1);
+        },
+        20 * nLedgers * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - tBegin;
+    auto stats = sim->getConsensusStats();
+    sim->stopAllNodes();
+
+    LOG(INFO) << name << ": " << sim->getNodes().size() << " nodes closed "
+              << stats.mLedgers << " ledgers in " << elapsed.count()
+              << "s; externalize over " << stats.mSamples << " slots p50 "
+              << stats.mMedian << "ms, p90 " << stats.m90thPercentile
+              << "ms, p99 " << stats.m99thPercentile << "ms, max "
+              << stats.mMax << "ms; " << stats.mMessagesPerLedger
+              << " messages, " << stats.mBytesPerLedger
+              << " bytes per ledger";
+}
+
+TEST_CASE("consensus latency with a thread per node",
+          "[simulation][bench][hide]")
+{
+    auto mode = Simulation::OVER_TCP_THREADED;
+    int const nLedgers = 5;
+    for (int size : {4, 16, 50})
+    {
+        benchConsensus("core " + std::to_string(size),
+                       Topologies::core(size, 0.75, mode), nLedgers);
+    }
+    benchConsensus("hierarchical 3", Topologies::hierarchicalQuorum(3, mode),
+                   nLedgers);
+    benchConsensus("cycle4", Topologies::cycle4(mode), nLedgers);
+}
+
 TEST_CASE("Stress test on 2 nodes 3 accounts 10 random transactions 10tx/sec",
           "[stress100][simulation][stress][long][hide]")
 {
@@ -264,3 +310,37 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][hide]")
         clock.crank();
     }
 }
+
+TEST_CASE("Open-loop single node load test", "[openload][hide]")
+{
+    Config cfg =
+#ifdef USE_POSTGRES
+        !force_sqlite
+        ? getTestConfig(0, Config::TESTDB_POSTGRESQL) :
+#endif
+        getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+    cfg.RUN_STANDALONE = false;
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer appPtr = Application::create(clock, cfg);
+    appPtr->start();
+    appPtr->generateOpenLoopLoad(1000, 10000, 200);
+    auto& io = clock.getIOService();
+    asio::io_service::work mainWork(io);
+    auto& complete = appPtr->getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+    while (!io.stopped() && complete.count() == 0)
+    {
+        clock.crank();
+    }
+    auto& m = appPtr->getMetrics();
+    for (auto type : {"create-account", "native-payment", "credit-payment",
+                      "path-payment"})
+    {
+        auto& latency = m.NewTimer({"loadgen", "latency", type});
+        auto snap = latency.GetSnapshot();
+        LOG(INFO) << type << ": " << latency.count() << " txs, latency p50 "
+                  << snap.getMedian() << "ms, p99 " << snap.get99thPercentile()
+                  << "ms";
+    }
+    LOG(INFO) << m.NewMeter({"loadgen", "openloop", "starved"}, "step").count()
+              << " steps starved of signed transactions";
+}
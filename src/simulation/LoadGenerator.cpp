@@ -4,6 +4,8 @@
 
 #include "simulation/LoadGenerator.h"
 #include "main/Config.h"
+#include "crypto/Hex.h"
+#include "database/Database.h"
 #include "transactions/TxTests.h"
 #include "herder/Herder.h"
 #include "ledger/LedgerManager.h"
@@ -25,7 +27,9 @@
 
 #include "medida/metrics_registry.h"
 #include "medida/meter.h"
+#include "medida/timer.h"
 
+#include <map>
 #include <set>
 #include <iomanip>
 #include <cmath>
@@ -47,6 +51,52 @@ static const uint64_t LOADGEN_TRUSTLINE_LIMIT = 1000 * LOADGEN_ACCOUNT_BALANCE;
 // Units of load are is scheduled at 100ms intervals.
 const uint32_t LoadGenerator::STEP_MSECS = 100;
 
+// Open-loop submission is paced at a finer grain, so that high rates are not
+// delivered in 100ms bursts.
+const uint32_t LoadGenerator::OPEN_LOOP_STEP_MSECS = 10;
+
+// Transactions are handed to the worker threads for signing in batches of
+// this size.
+const size_t LoadGenerator::OPEN_LOOP_BATCH_SIZE = 100;
+
+// If in-flight transactions have not externalized after this many ledgers,
+// they are counted as lost and the run moves on.
+static const uint32_t OPEN_LOOP_MAX_IDLE_LEDGERS = 5;
+
+struct LoadGenerator::OpenLoopState
+{
+    struct Batch
+    {
+        std::vector<TxInfo> mTxs;
+        // Written by a worker thread; only read on the main thread once
+        // mReady has been set (by a completion posted back to it).
+        std::vector<TransactionFramePtr> mFrames;
+        bool mReady;
+    };
+
+    struct InFlight
+    {
+        VirtualClock::time_point mSubmitted;
+        medida::Timer* mLatency;
+    };
+
+    bool mCreatingAccounts;
+    uint32_t mTxsToPlan;
+    uint32_t mTxRate;
+
+    std::vector<std::shared_ptr<Batch>> mBatches;
+    size_t mNextBatch;
+    size_t mNextTx;
+
+    VirtualClock::time_point mStart;
+    uint64_t mSubmitted;
+
+    // Submitted transactions that have not externalized yet, by hex txid.
+    std::map<std::string, InFlight> mInFlight;
+    uint32_t mLastLedgerSeen;
+    uint32_t mIdleLedgers;
+};
+
 LoadGenerator::LoadGenerator() : mMinBalance(0), mLastSecond(0)
 {
     // Root account gets enough XLM to create 100 million (10^8) accounts, which
@@ -404,6 +454,239 @@ LoadGenerator::generateLoad(Application& app, uint32_t nAccounts, uint32_t nTxs,
     }
 }
 
+void
+LoadGenerator::generateOpenLoopLoad(Application& app, uint32_t nAccounts,
+                                    uint32_t nTxs, uint32_t txRate)
+{
+    updateMinBalance(app);
+    loadAccount(app, mAccounts.at(0));
+
+    mOpenLoop = make_unique<OpenLoopState>();
+    mOpenLoop->mCreatingAccounts = true;
+    mOpenLoop->mTxsToPlan = nTxs;
+    mOpenLoop->mTxRate = std::max<uint32_t>(txRate, 1);
+    mOpenLoop->mLastLedgerSeen =
+        app.getLedgerManager().getLastClosedLedgerNum();
+    mOpenLoop->mIdleLedgers = 0;
+
+    uint32_t ledgerNum = app.getLedgerManager().getLedgerNum();
+    vector<TxInfo> txs;
+    while (txs.size() < nAccounts)
+    {
+        maybeCreateAccount(ledgerNum, txs);
+    }
+
+    CLOG(INFO, "LoadGen") << "Open-loop load: " << nAccounts << " accounts, "
+                          << nTxs << " txs at " << mOpenLoop->mTxRate
+                          << " tx/s";
+    planOpenLoopBatches(app, txs);
+    scheduleOpenLoopStep(app);
+}
+
+// Assign each transaction its sequence number, as though all earlier ones
+// succeed, then split them into batches and build and sign each batch on a
+// worker thread.
+void
+LoadGenerator::planOpenLoopBatches(Application& app, vector<TxInfo>& txs)
+{
+    auto baseFee = app.getConfig().DESIRED_BASE_FEE;
+    for (auto& tx : txs)
+    {
+        tx.mSeqNum = tx.mFrom->mSeq + 1;
+        tx.recordExecution(baseFee);
+    }
+
+    auto& ol = *mOpenLoop;
+    ol.mBatches.clear();
+    ol.mNextBatch = 0;
+    ol.mNextTx = 0;
+    ol.mSubmitted = 0;
+    ol.mStart = app.getClock().now();
+
+    for (size_t i = 0; i < txs.size(); i += OPEN_LOOP_BATCH_SIZE)
+    {
+        auto batch = make_shared<OpenLoopState::Batch>();
+        auto end = std::min(txs.size(), i + OPEN_LOOP_BATCH_SIZE);
+        batch->mTxs.assign(txs.begin() + i, txs.begin() + end);
+        batch->mReady = false;
+        ol.mBatches.push_back(batch);
+
+        auto txm = make_shared<TxMetrics>(app.getMetrics());
+        auto& mainIO = app.getClock().getIOService();
+        app.getWorkerIOService().post([batch, txm, &mainIO]()
+                                      {
+                                          for (auto& tx : batch->mTxs)
+                                          {
+                                              tx.toTransactionFrames(
+                                                  batch->mFrames, *txm);
+                                          }
+                                          mainIO.post([batch]()
+                                                      {
+                                                          batch->mReady = true;
+                                                      });
+                                      });
+    }
+}
+
+void
+LoadGenerator::scheduleOpenLoopStep(Application& app)
+{
+    if (!mLoadTimer)
+    {
+        mLoadTimer = make_unique<VirtualTimer>(app.getClock());
+    }
+    mLoadTimer->expires_from_now(
+        std::chrono::milliseconds(OPEN_LOOP_STEP_MSECS));
+    mLoadTimer->async_wait([this, &app](asio::error_code const& error)
+                           {
+                               if (!error)
+                               {
+                                   this->openLoopStep(app);
+                               }
+                           });
+}
+
+void
+LoadGenerator::openLoopStep(Application& app)
+{
+    auto& ol = *mOpenLoop;
+    auto& m = app.getMetrics();
+    TxMetrics txm(m);
+    auto& submitted = m.NewMeter({"loadgen", "openloop", "submitted"}, "txn");
+    auto& starved = m.NewMeter({"loadgen", "openloop", "starved"}, "step");
+
+    // Submit however many transactions the target rate says should have gone
+    // out by now, regardless of what has happened to the earlier ones.
+    auto now = app.getClock().now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now - ol.mStart);
+    uint64_t due = static_cast<uint64_t>(elapsed.count()) * ol.mTxRate / 1000;
+    while (ol.mSubmitted < due && ol.mNextBatch < ol.mBatches.size())
+    {
+        auto& batch = *ol.mBatches[ol.mNextBatch];
+        if (!batch.mReady)
+        {
+            // Signing has fallen behind the target rate.
+            starved.Mark();
+            break;
+        }
+
+        auto& tx = batch.mTxs[ol.mNextTx];
+        auto& frame = batch.mFrames[ol.mNextTx];
+        txm.mTxnAttempted.Mark();
+        submitted.Mark();
+        if (app.getHerder().recvTransaction(frame) ==
+            Herder::TX_STATUS_PENDING)
+        {
+            auto& latency = m.NewTimer({"loadgen", "latency", tx.typeName()});
+            ol.mInFlight[binToHex(frame->getContentsHash())] = {now, &latency};
+        }
+        else
+        {
+            txm.mTxnRejected.Mark();
+        }
+        ol.mSubmitted++;
+
+        if (++ol.mNextTx == batch.mTxs.size())
+        {
+            ol.mNextTx = 0;
+            ol.mNextBatch++;
+        }
+    }
+
+    observeExternalized(app);
+
+    bool allSubmitted = ol.mNextBatch == ol.mBatches.size();
+    if (allSubmitted && !ol.mInFlight.empty() &&
+        ol.mIdleLedgers >= OPEN_LOOP_MAX_IDLE_LEDGERS)
+    {
+        CLOG(WARNING, "LoadGen") << ol.mInFlight.size()
+                                 << " txs did not externalize, giving up";
+        m.NewMeter({"loadgen", "openloop", "lost"}, "txn")
+            .Mark(ol.mInFlight.size());
+        ol.mInFlight.clear();
+    }
+
+    if (allSubmitted && ol.mInFlight.empty())
+    {
+        if (ol.mCreatingAccounts && ol.mTxsToPlan > 0)
+        {
+            // The accounts now exist with ledger-derived sequence numbers;
+            // pick those up before planning payments from them.
+            ol.mCreatingAccounts = false;
+            loadAccounts(app, mAccounts);
+            uint32_t ledgerNum = app.getLedgerManager().getLedgerNum();
+            vector<TxInfo> txs;
+            for (uint32_t i = 0; i < ol.mTxsToPlan; ++i)
+            {
+                txs.push_back(createRandomTransaction(0.5, ledgerNum));
+            }
+            planOpenLoopBatches(app, txs);
+        }
+        else
+        {
+            CLOG(INFO, "LoadGen") << "Open-loop load generation complete.";
+            m.NewMeter({"loadgen", "run", "complete"}, "run").Mark();
+            mOpenLoop.reset();
+            clear();
+            return;
+        }
+    }
+
+    scheduleOpenLoopStep(app);
+}
+
+// Match the transactions of any newly closed ledgers against those in flight.
+void
+LoadGenerator::observeExternalized(Application& app)
+{
+    auto& ol = *mOpenLoop;
+    uint32_t lcl = app.getLedgerManager().getLastClosedLedgerNum();
+    if (lcl == ol.mLastLedgerSeen)
+    {
+        return;
+    }
+
+    auto now = app.getClock().now();
+    size_t before = ol.mInFlight.size();
+    auto& db = app.getDatabase();
+    std::string txid;
+    uint32_t ledgerSeq;
+    auto prep = db.getPreparedStatement(
+        "SELECT txid FROM txhistory WHERE ledgerseq = :lseq");
+    auto& st = prep.statement();
+    st.exchange(soci::into(txid));
+    st.exchange(soci::use(ledgerSeq));
+    st.define_and_bind();
+    for (ledgerSeq = ol.mLastLedgerSeen + 1; ledgerSeq <= lcl; ++ledgerSeq)
+    {
+        {
+            auto timer = db.getSelectTimer("txhistory");
+            st.execute(true);
+        }
+        while (st.got_data())
+        {
+            auto it = ol.mInFlight.find(txid);
+            if (it != ol.mInFlight.end())
+            {
+                it->second.mLatency->Update(now - it->second.mSubmitted);
+                ol.mInFlight.erase(it);
+            }
+            st.fetch();
+        }
+    }
+
+    if (!ol.mInFlight.empty() && ol.mInFlight.size() == before)
+    {
+        ol.mIdleLedgers += lcl - ol.mLastLedgerSeen;
+    }
+    else
+    {
+        ol.mIdleLedgers = 0;
+    }
+    ol.mLastLedgerSeen = lcl;
+}
+
 void
 LoadGenerator::updateMinBalance(Application& app)
 {
@@ -669,8 +952,16 @@ LoadGenerator::AccountInfo::AccountInfo(size_t id, SecretKey key,
 LoadGenerator::TxInfo
 LoadGenerator::AccountInfo::creationTransaction()
 {
-    return TxInfo{mLoadGen.mAccounts[0], shared_from_this(),
-                  TxInfo::TX_CREATE_ACCOUNT, LOADGEN_ACCOUNT_BALANCE};
+    TxInfo tx{mLoadGen.mAccounts[0], shared_from_this(),
+              TxInfo::TX_CREATE_ACCOUNT, LOADGEN_ACCOUNT_BALANCE};
+    if (mBuyCredit)
+    {
+        tx.mOfferPrice.d = 10000;
+        uint32_t diff = rand_uniform(1, 200);
+        tx.mOfferPrice.n = rand_flip() ? (tx.mOfferPrice.d + diff)
+                                       : (tx.mOfferPrice.d - diff);
+    }
+    return tx;
 }
 
 void
@@ -780,6 +1071,7 @@ void
 LoadGenerator::TxInfo::toTransactionFrames(
     std::vector<TransactionFramePtr>& txs, TxMetrics& txm)
 {
+    SequenceNumber seq = mSeqNum != 0 ? mSeqNum : mFrom->mSeq + 1;
     switch (mType)
     {
     case TxInfo::TX_CREATE_ACCOUNT:
@@ -790,7 +1082,7 @@ LoadGenerator::TxInfo::toTransactionFrames(
 
             e.tx.sourceAccount = mFrom->mKey.getPublicKey();
             signingAccounts.insert(mFrom);
-            e.tx.seqNum = mFrom->mSeq + 1;
+            e.tx.seqNum = seq;
 
             // Add a CREATE_ACCOUNT op
             Operation createOp;
@@ -839,18 +1131,13 @@ LoadGenerator::TxInfo::toTransactionFrames(
                 Asset sellCi = txtest::makeAsset(
                     mTo->mSellCredit->mKey, mTo->mSellCredit->mIssuedAsset);
 
-                Price price;
-                price.d = 10000;
-                uint32_t diff = rand_uniform(1, 200);
-                price.n = rand_flip() ? (price.d + diff) : (price.d - diff);
-
                 offerOp.body.type(CREATE_PASSIVE_OFFER);
                 offerOp.sourceAccount.activate() = mTo->mKey.getPublicKey();
                 offerOp.body.createPassiveOfferOp().amount =
                     LOADGEN_ACCOUNT_BALANCE;
                 offerOp.body.createPassiveOfferOp().selling = sellCi;
                 offerOp.body.createPassiveOfferOp().buying = buyCi;
-                offerOp.body.createPassiveOfferOp().price = price;
+                offerOp.body.createPassiveOfferOp().price = mOfferPrice;
                 e.tx.operations.push_back(offerOp);
                 signingAccounts.insert(mTo);
             }
@@ -870,7 +1157,7 @@ LoadGenerator::TxInfo::toTransactionFrames(
         txm.mPayment.Mark();
         txm.mNativePayment.Mark();
         txs.push_back(txtest::createPaymentTx(mFrom->mKey, mTo->mKey,
-                                              mFrom->mSeq + 1, mAmount));
+                                              seq, mAmount));
         break;
 
     case TxInfo::TX_TRANSFER_CREDIT:
@@ -888,7 +1175,7 @@ LoadGenerator::TxInfo::toTransactionFrames(
         {
             txm.mCreditPayment.Mark();
             txs.emplace_back(txtest::createCreditPaymentTx(
-                mFrom->mKey, mTo->mKey, assetPath.front(), mFrom->mSeq + 1,
+                mFrom->mKey, mTo->mKey, assetPath.front(), seq,
                 mAmount));
         }
         else
@@ -913,7 +1200,7 @@ LoadGenerator::TxInfo::toTransactionFrames(
             auto sendMax = mAmount * 10;
             txs.emplace_back(txtest::createPathPaymentTx(
                 mFrom->mKey, mTo->mKey, sendAsset, sendMax, recvAsset,
-                mAmount, mFrom->mSeq + 1, &assetPath));
+                mAmount, seq, &assetPath));
         }
     }
     break;
@@ -923,6 +1210,23 @@ LoadGenerator::TxInfo::toTransactionFrames(
     }
 }
 
+char const*
+LoadGenerator::TxInfo::typeName() const
+{
+    switch (mType)
+    {
+    case TX_CREATE_ACCOUNT:
+        return "create-account";
+    case TX_TRANSFER_NATIVE:
+        return "native-payment";
+    case TX_TRANSFER_CREDIT:
+        return mPath.size() > 1 ? "path-payment" : "credit-payment";
+    default:
+        assert(false);
+        return "unknown";
+    }
+}
+
 void
 LoadGenerator::TxInfo::recordExecution(int64_t baseFee)
 {
@@ -36,6 +36,8 @@ class LoadGenerator
 
     static std::string pickRandomAsset();
     static const uint32_t STEP_MSECS;
+    static const uint32_t OPEN_LOOP_STEP_MSECS;
+    static const size_t OPEN_LOOP_BATCH_SIZE;
 
     // Primary store of accounts.
     std::vector<AccountInfoPtr> mAccounts;
@@ -62,6 +64,16 @@ class LoadGenerator
     void generateLoad(Application& app, uint32_t nAccounts, uint32_t nTxs,
                       uint32_t txRate, bool autoRate);
 
+    // Open-loop variant of generateLoad(). All transactions are planned up
+    // front on the main thread, then built and signed in batches on the worker
+    // threads, and submitted at a fixed txRate whether or not earlier ones
+    // have externalized yet. nAccounts accounts are created first; once they
+    // have externalized, nTxs random payments between them follow. The time
+    // from submission to externalization is recorded per transaction type in
+    // the loadgen.latency.* timers.
+    void generateOpenLoopLoad(Application& app, uint32_t nAccounts,
+                              uint32_t nTxs, uint32_t txRate);
+
     bool maybeCreateAccount(uint32_t ledgerNum, std::vector<TxInfo>& txs);
 
     std::vector<TxInfo> accountCreationTransactions(size_t n);
@@ -167,11 +179,30 @@ class LoadGenerator
         int64_t mAmount;
         std::vector<AccountInfoPtr> mPath;
 
+        // Sequence number to submit with; 0 means the source account's next
+        // one at the time the frames are built. Set when transactions are
+        // planned ahead of submission.
+        SequenceNumber mSeqNum;
+
+        // Price of the passive offer a new market-maker makes. Drawn on the
+        // main thread, as frames may be built on worker threads.
+        Price mOfferPrice;
+
         bool execute(Application& app);
 
         void toTransactionFrames(std::vector<TransactionFramePtr>& txs,
                                  TxMetrics& metrics);
         void recordExecution(int64_t baseFee);
+        char const* typeName() const;
     };
+
+  private:
+    struct OpenLoopState;
+    std::unique_ptr<OpenLoopState> mOpenLoop;
+
+    void planOpenLoopBatches(Application& app, std::vector<TxInfo>& txs);
+    void scheduleOpenLoopStep(Application& app);
+    void openLoopStep(Application& app);
+    void observeExternalized(Application& app);
 };
 }
@@ -10,13 +10,19 @@
 #include "main/test.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerRecord.h"
+#include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "util/Math.h"
+#include "util/ShardedMetrics.h"
+#include "util/make_unique.h"
 #include "util/types.h"
 
 #include "medida/medida.h"
 #include "medida/reporting/console_reporter.h"
+#include "medida/stats/snapshot.h"
 
+#include <algorithm>
+#include <future>
 #include <thread>
 
 namespace stellar
@@ -24,17 +30,23 @@ namespace stellar
 
 using namespace std;
 
+// with a thread per node, the topology rather than the connection limit
+// decides who talks to whom
+static unsigned const THREADED_MAX_PEER_CONNECTIONS = 1000;
+
 Simulation::Simulation(Mode mode)
-    : mClock(mode == OVER_TCP ? VirtualClock::REAL_TIME
-                              : VirtualClock::VIRTUAL_TIME)
+    : mClock(mode == OVER_LOOPBACK ? VirtualClock::VIRTUAL_TIME
+                                   : VirtualClock::REAL_TIME)
     , mMode(mode)
     , mConfigCount(0)
     , mIdleApp(Application::create(mClock, getTestConfig(++mConfigCount)))
+    , mThreadsRunning(false)
 {
 }
 
 Simulation::~Simulation()
 {
+    stopNodeThreads();
 
     // tear down
     mClock.getIOService().poll_one();
@@ -63,9 +75,20 @@ Simulation::addNode(SecretKey nodeKey, SCPQuorumSet qSet, VirtualClock& clock,
     cfg->FORCE_SCP = true;
     cfg->RUN_STANDALONE = (mMode == OVER_LOOPBACK);
 
-    Application::pointer result = Application::create(clock, *cfg);
-
     NodeID nodeID = nodeKey.getPublicKey();
+    VirtualClock* nodeClock = &clock;
+    if (mMode == OVER_TCP_THREADED)
+    {
+        cfg->MAX_PEER_CONNECTIONS =
+            max(cfg->MAX_PEER_CONNECTIONS, THREADED_MAX_PEER_CONNECTIONS);
+        auto& node = mNodeThreads[nodeID];
+        node = make_unique<NodeThread>();
+        node->mClock = make_unique<VirtualClock>(VirtualClock::REAL_TIME);
+        nodeClock = node->mClock.get();
+    }
+
+    Application::pointer result = Application::create(*nodeClock, *cfg);
+
     mConfigs[nodeID] = cfg;
     mNodes[nodeID] = result;
     updateMinBalance(*result);
@@ -120,20 +143,39 @@ Simulation::addLoopbackConnection(NodeID initiator, NodeID acceptor)
 void
 Simulation::addTCPConnection(NodeID initiator, NodeID acceptor)
 {
-    if (mMode != OVER_TCP)
+    if (mMode == OVER_LOOPBACK)
     {
         throw runtime_error("Cannot add a TCP connection");
     }
     auto from = getNode(initiator);
     auto to = getNode(acceptor);
-    PeerRecord pr{"127.0.0.1", to->getConfig().PEER_PORT,
-                  from->getClock().now(), 0, 10};
-    from->getOverlayManager().connectTo(pr);
+    runOnNode(*from, [from, to]()
+              {
+                  PeerRecord pr{"127.0.0.1", to->getConfig().PEER_PORT,
+                                from->getClock().now(), 0, 10};
+                  from->getOverlayManager().connectTo(pr);
+              });
 }
 
 void
 Simulation::startAllNodes()
 {
+    if (mMode == OVER_TCP_THREADED)
+    {
+        // connections are set up while the nodes start
+        for (auto const& it : mNodes)
+        {
+            auto& node = *mNodeThreads[it.first];
+            auto app = it.second;
+            node.mThread = thread([this, app, &node]()
+                                  {
+                                      runNodeThread(app, node);
+                                  });
+        }
+        mThreadsRunning = true;
+        return;
+    }
+
     // We wait for the connections to set up (HELLO).
     while (crankAllNodes() > 0)
         ;
@@ -144,9 +186,96 @@ Simulation::startAllNodes()
     }
 }
 
+void
+Simulation::runNodeThread(Application::pointer app, NodeThread& node)
+{
+    markThreadAsMain();
+    // otherwise every node thread draws the same random sequence
+    auto const& key = app->getConfig().VALIDATION_KEY.getPublicKey().ed25519();
+    std::seed_seq seed(key.begin(), key.end());
+    gRandomEngine.seed(seed);
+
+    auto& io = node.mClock->getIOService();
+    asio::io_service::work work(io);
+    try
+    {
+        app->start();
+        while (!io.stopped())
+        {
+            node.mClock->crank(true);
+            node.mLastClosed =
+                app->getLedgerManager().getLastClosedLedgerNum();
+        }
+    }
+    catch (std::exception const& e)
+    {
+        CLOG(ERROR, "Simulation") << "Node thread stopped: " << e.what();
+        node.mError = e.what();
+    }
+    node.mExited = true;
+}
+
+void
+Simulation::stopNodeThreads()
+{
+    if (!mThreadsRunning)
+    {
+        return;
+    }
+    for (auto const& it : mNodes)
+    {
+        auto app = it.second;
+        app->getClock().getIOService().post([app]()
+                                            {
+                                                app->gracefulStop();
+                                            });
+    }
+    for (auto& it : mNodeThreads)
+    {
+        if (it.second->mThread.joinable())
+        {
+            it.second->mThread.join();
+        }
+    }
+    mThreadsRunning = false;
+}
+
+void
+Simulation::runOnNode(Application& app, function<void()> f)
+{
+    if (!mThreadsRunning)
+    {
+        f();
+        return;
+    }
+    auto& node = *mNodeThreads[app.getConfig().VALIDATION_KEY.getPublicKey()];
+    // the task may outlive this call if the thread stops first
+    auto task = make_shared<packaged_task<void()>>(f);
+    auto done = task->get_future();
+    app.getClock().getIOService().post([task]()
+                                       {
+                                           (*task)();
+                                       });
+    while (done.wait_for(chrono::milliseconds(100)) != future_status::ready)
+    {
+        if (node.mExited)
+        {
+            throw runtime_error("node thread stopped: " + node.mError);
+        }
+    }
+    // rethrows what `f` threw
+    done.get();
+}
+
 void
 Simulation::stopAllNodes()
 {
+    if (mMode == OVER_TCP_THREADED)
+    {
+        stopNodeThreads();
+        return;
+    }
+
     for (auto& n : mNodes)
     {
         n.second->gracefulStop();
@@ -171,13 +300,24 @@ Simulation::crankAllNodes(int nbTicks)
     return count;
 }
 
+uint32_t
+Simulation::getLastClosedLedgerNum(NodeID const& nodeID)
+{
+    if (mThreadsRunning)
+    {
+        // the ledger manager belongs to the node's thread
+        return mNodeThreads[nodeID]->mLastClosed.load();
+    }
+    return mNodes[nodeID]->getLedgerManager().getLastClosedLedgerNum();
+}
+
 bool
 Simulation::haveAllExternalized(SequenceNumber num)
 {
     uint32_t min = UINT_MAX;
     for (auto it = mNodes.begin(); it != mNodes.end(); ++it)
     {
-        auto n = it->second->getLedgerManager().getLastClosedLedgerNum();
+        auto n = getLastClosedLedgerNum(it->first);
         LOG(DEBUG) << "Ledger#: " << n;
 
         if (n < min)
@@ -310,7 +450,12 @@ void
 Simulation::execute(TxInfo transaction)
 {
     // Execute on the first node
-    bool res = transaction.execute(*mNodes.begin()->second);
+    bool res = false;
+    auto app = mNodes.begin()->second;
+    runOnNode(*app, [&]()
+              {
+                  res = transaction.execute(*app);
+              });
     if (!res)
     {
         CLOG(DEBUG, "Simulation") << "Failed execution in simulation";
@@ -388,8 +533,12 @@ Simulation::accountsOutOfSyncWithDb()
         {
             auto account = *accountIt;
             AccountFrame::pointer accountFrame;
-            accountFrame = AccountFrame::loadAccount(
-                account->mKey.getPublicKey(), app->getDatabase());
+            runOnNode(*app, [&]()
+                      {
+                          accountFrame = AccountFrame::loadAccount(
+                              account->mKey.getPublicKey(),
+                              app->getDatabase());
+                      });
             int64_t offset;
             if (accountFrame)
             {
@@ -423,7 +572,12 @@ Simulation::loadAccount(AccountInfo& account)
 {
     // assumes all nodes are in sync
     auto app = mNodes.begin()->second;
-    return LoadGenerator::loadAccount(*app, account);
+    bool res = false;
+    runOnNode(*app, [&]()
+              {
+                  res = LoadGenerator::loadAccount(*app, account);
+              });
+    return res;
 }
 
 class ConsoleReporterWithSum : public medida::reporting::ConsoleReporter
@@ -472,4 +626,57 @@ Simulation::metricsSummary(string domain)
     }
     return out.str();
 }
+
+Simulation::ConsensusStats
+Simulation::getConsensusStats()
+{
+    ConsensusStats stats;
+    uint32_t minClosed = UINT32_MAX;
+    vector<double> samples;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    for (auto const& it : mNodes)
+    {
+        auto app = it.second;
+        minClosed = min(minClosed, getLastClosedLedgerNum(it.first));
+
+        auto& metrics = app->getMetrics();
+        auto snapshot =
+            metrics.NewTimer({"scp", "timing", "externalized"}).GetSnapshot();
+        auto values = snapshot.getValues();
+        samples.insert(samples.end(), values.begin(), values.end());
+
+        app->getShardedMetrics().flush();
+        messages += metrics.NewMeter({"overlay", "message", "write"},
+                                     "message").count();
+        bytes +=
+            metrics.NewMeter({"overlay", "byte", "write"}, "byte").count();
+    }
+
+    // every node starts from the genesis ledger
+    stats.mLedgers = (mNodes.empty() || minClosed <= 1) ? 0 : minClosed - 1;
+    stats.mSamples = samples.size();
+    sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double q) -> double
+    {
+        if (samples.empty())
+        {
+            return 0.0;
+        }
+        return samples[min(samples.size() - 1,
+                           static_cast<size_t>(q * samples.size()))];
+    };
+    stats.mMedian = percentile(0.5);
+    stats.m90thPercentile = percentile(0.9);
+    stats.m99thPercentile = percentile(0.99);
+    stats.mMax = samples.empty() ? 0.0 : samples.back();
+    auto perLedger = [&stats](uint64_t n)
+    {
+        return stats.mLedgers == 0 ? 0.0 : static_cast<double>(n) /
+                                               stats.mLedgers;
+    };
+    stats.mMessagesPerLedger = perLedger(messages);
+    stats.mBytesPerLedger = perLedger(bytes);
+    return stats;
+}
 }
@@ -16,6 +16,10 @@
 #include "xdr/Stellar-types.h"
 #include "simulation/LoadGenerator.h"
 
+#include <atomic>
+#include <functional>
+#include <thread>
+
 #define SIMULATION_CREATE_NODE(N)                                              \
     const Hash v##N##VSeed = sha256("SEED_VALIDATION_SEED_" #N);               \
     const SecretKey v##N##SecretKey = SecretKey::fromSeed(v##N##VSeed);        \
@@ -32,7 +36,25 @@ class Simulation : public LoadGenerator
     enum Mode
     {
         OVER_TCP,
-        OVER_LOOPBACK
+        OVER_LOOPBACK,
+        // every node cranks a real-time clock of its own on a thread of its
+        // own, talking to the others over localhost TCP
+        OVER_TCP_THREADED
+    };
+
+    // time from proposing a value to externalizing it, over all nodes, and
+    // what the overlay sent (over TCP) for each ledger the nodes closed
+    struct ConsensusStats
+    {
+        uint32_t mLedgers;
+        size_t mSamples;
+        // in milliseconds
+        double mMedian;
+        double m90thPercentile;
+        double m99thPercentile;
+        double mMax;
+        double mMessagesPerLedger;
+        double mBytesPerLedger;
     };
 
     typedef std::shared_ptr<Simulation> pointer;
@@ -42,6 +64,8 @@ class Simulation : public LoadGenerator
 
     VirtualClock& getClock();
 
+    // OVER_TCP_THREADED gives every node a clock of its own and ignores
+    // `clock`
     NodeID addNode(SecretKey nodeKey, SCPQuorumSet qSet, VirtualClock& clock,
                    Config::pointer cfg = std::shared_ptr<Config>());
     Application::pointer getNode(NodeID nodeID);
@@ -79,13 +103,35 @@ class Simulation : public LoadGenerator
     accountsOutOfSyncWithDb(); // returns the accounts that don't match
     bool loadAccount(AccountInfo& account);
     std::string metricsSummary(std::string domain = "");
+    ConsensusStats getConsensusStats();
+
+    // runs `f` against `app`: on the node's thread while it runs one,
+    // right away otherwise; throws if the node's thread has stopped
+    void runOnNode(Application& app, std::function<void()> f);
 
   private:
+    struct NodeThread
+    {
+        std::unique_ptr<VirtualClock> mClock;
+        std::thread mThread;
+        std::atomic<uint32_t> mLastClosed{0};
+        // set when the thread stops cranking; mError says why, if it failed
+        std::atomic<bool> mExited{false};
+        std::string mError;
+    };
+
+    void runNodeThread(Application::pointer app, NodeThread& node);
+    void stopNodeThreads();
+    uint32_t getLastClosedLedgerNum(NodeID const& nodeID);
+
     VirtualClock mClock;
     Mode mMode;
     int mConfigCount;
     Application::pointer mIdleApp;
     std::map<NodeID, Config::pointer> mConfigs;
+    // outlives mNodes: the applications refer to the clocks
+    std::map<NodeID, std::unique_ptr<NodeThread>> mNodeThreads;
+    bool mThreadsRunning;
     std::map<NodeID, Application::pointer> mNodes;
     std::vector<std::shared_ptr<LoopbackPeerConnection>> mConnections;
 };
@@ -30,10 +30,9 @@ Topologies::pair(Simulation::Mode mode)
 }
 
 Simulation::pointer
-Topologies::cycle4()
+Topologies::cycle4(Simulation::Mode mode)
 {
-    Simulation::pointer simulation =
-        make_shared<Simulation>(Simulation::OVER_LOOPBACK);
+    Simulation::pointer simulation = make_shared<Simulation>(mode);
 
     SIMULATION_CREATE_NODE(0);
     SIMULATION_CREATE_NODE(1);
@@ -62,19 +61,13 @@ Topologies::cycle4()
     auto n2 = simulation->addNode(v2SecretKey, qSet2, simulation->getClock());
     auto n3 = simulation->addNode(v3SecretKey, qSet3, simulation->getClock());
 
-    std::shared_ptr<LoopbackPeerConnection> n0n1 =
-        simulation->addLoopbackConnection(n0, n1);
-    std::shared_ptr<LoopbackPeerConnection> n1n2 =
-        simulation->addLoopbackConnection(n1, n2);
-    std::shared_ptr<LoopbackPeerConnection> n2n3 =
-        simulation->addLoopbackConnection(n2, n3);
-    std::shared_ptr<LoopbackPeerConnection> n3n0 =
-        simulation->addLoopbackConnection(n3, n0);
-
-    std::shared_ptr<LoopbackPeerConnection> n0n2 =
-        simulation->addLoopbackConnection(n0, n2);
-    std::shared_ptr<LoopbackPeerConnection> n1n3 =
-        simulation->addLoopbackConnection(n1, n3);
+    simulation->addConnection(n0, n1);
+    simulation->addConnection(n1, n2);
+    simulation->addConnection(n2, n3);
+    simulation->addConnection(n3, n0);
+
+    simulation->addConnection(n0, n2);
+    simulation->addConnection(n1, n3);
 
     return simulation;
 }
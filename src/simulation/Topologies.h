@@ -13,7 +13,8 @@ class Topologies
 {
   public:
     static Simulation::pointer pair(Simulation::Mode mode);
-    static Simulation::pointer cycle4();
+    static Simulation::pointer
+    cycle4(Simulation::Mode mode = Simulation::OVER_LOOPBACK);
     static Simulation::pointer core(int nNodes, float quorumThresoldFraction, Simulation::Mode mode);
     static Simulation::pointer hierarchicalQuorum(int nBranches, Simulation::Mode mode);
 };
@@ -13,6 +13,7 @@
 #include "util/Logging.h"
 #include "TxTests.h"
 #include "transactions/InflationOpFrame.h"
+#include "database/Database.h"
 #include <functional>
 
 using namespace stellar;
@@ -287,6 +288,9 @@ doInflation(Application& app, int nbAccounts,
     }
     REQUIRE(actualChanges == expectedWinnerCount);
     REQUIRE(expectedWinnerCount == payouts.size());
+
+    // the vote totals followed the payouts
+    AccountFrame::checkInflationVotes(app.getDatabase());
 }
 
 TEST_CASE("inflation", "[tx][inflation]")
@@ -487,3 +491,138 @@ TEST_CASE("inflation", "[tx][inflation]")
         }
     }
 }
+
+// the vote totals, by destination StrKey
+static std::map<std::string, int64>
+loadInflationVotes(Database& db)
+{
+    std::map<std::string, int64> res;
+    AccountFrame::processForInflation(
+        [&res](AccountFrame::InflationVotes const& votes)
+        {
+            res[PubKeyUtils::toStrKey(votes.mInflationDest)] = votes.mVotes;
+            return true;
+        },
+        maxWinners, db);
+    return res;
+}
+
+TEST_CASE("inflation votes follow their voter", "[tx][inflation]")
+{
+    VirtualClock clock;
+    Application::pointer appPtr = Application::create(clock, getTestConfig());
+    Application& app = *appPtr;
+    app.start();
+    auto& db = app.getDatabase();
+
+    SecretKey root = getRoot();
+    SecretKey voter = getAccount("voter");
+    SecretKey dest = getAccount("dest");
+    SecretKey other = getAccount("other");
+    int64 const balance = 2000000000;
+
+    SequenceNumber rootSeq = getAccountSeqNum(root, app) + 1;
+    applyCreateAccountTx(app, root, voter, rootSeq++, balance);
+    applyCreateAccountTx(app, root, dest, rootSeq++, balance / 4);
+    applyCreateAccountTx(app, root, other, rootSeq++, balance / 4);
+
+    SequenceNumber voterSeq = getAccountSeqNum(voter, app) + 1;
+    AccountID destID = dest.getPublicKey();
+    applySetOptions(app, voter, voterSeq++, &destID, nullptr, nullptr,
+                    nullptr, nullptr);
+
+    auto votes = loadInflationVotes(db);
+    REQUIRE(votes.size() == 1);
+    REQUIRE(votes[dest.getStrKeyPublic()] ==
+            loadAccount(voter, app)->getBalance());
+
+    // the sole voter for `dest` leaves it, taking its total to 0
+    SECTION("voter changes its destination")
+    {
+        AccountID otherID = other.getPublicKey();
+        applySetOptions(app, voter, voterSeq++, &otherID, nullptr, nullptr,
+                        nullptr, nullptr);
+        votes = loadInflationVotes(db);
+        REQUIRE(votes.size() == 1);
+        REQUIRE(votes.count(dest.getStrKeyPublic()) == 0);
+        REQUIRE(votes[other.getStrKeyPublic()] ==
+                loadAccount(voter, app)->getBalance());
+    }
+    SECTION("voter drops below the minimum balance")
+    {
+        applyPaymentTx(app, voter, root, voterSeq++, balance * 3 / 4);
+        REQUIRE(loadInflationVotes(db).empty());
+    }
+    SECTION("voter merges")
+    {
+        applyAccountMerge(app, voter, root, voterSeq++);
+        REQUIRE(loadInflationVotes(db).empty());
+    }
+    SECTION("a total that would go negative is out of sync")
+    {
+        // rolled back, with the account change that couldn't be counted
+        soci::transaction sqlTx(db.getSession());
+        db.getSession() << "UPDATE inflationvotes SET votes = 1";
+        auto act = loadAccount(voter, app);
+        act->getAccount().inflationDest.activate() = other.getPublicKey();
+        LedgerDelta delta(app.getLedgerManager().getCurrentLedgerHeader());
+        REQUIRE_THROWS_AS(act->storeChange(delta, db), std::runtime_error);
+    }
+    AccountFrame::checkInflationVotes(db);
+}
+
+TEST_CASE("inflation vote lookup benchmark", "[tx][inflation][bench][hide]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer appPtr = Application::create(clock, cfg);
+    Application& app = *appPtr;
+    app.start();
+
+    int const nbAccounts = 1000000;
+    int const nbDestinations = 1000;
+    auto& db = app.getDatabase();
+
+    LOG(INFO) << "Creating " << nbAccounts << " voting accounts";
+    {
+        LedgerDelta delta(app.getLedgerManager().getCurrentLedgerHeader());
+        soci::transaction sqlTx(db.getSession());
+        for (int i = 0; i < nbAccounts; i++)
+        {
+            AccountFrame act(getTestAccount(i).getPublicKey());
+            act.getAccount().balance = 1000000000LL + i;
+            act.getAccount().inflationDest.activate() =
+                getTestAccount(i % nbDestinations).getPublicKey();
+            act.storeAdd(delta, db);
+        }
+        sqlTx.commit();
+    }
+
+    int const nbLookups = 100;
+    LOG(INFO) << "Looking up the winners " << nbLookups << " times";
+    {
+        TIMED_SCOPE(timerBlkObj, "processForInflation");
+        for (int i = 0; i < nbLookups; i++)
+        {
+            int n = 0;
+            AccountFrame::processForInflation(
+                [&](AccountFrame::InflationVotes const&)
+                {
+                    return ++n < maxWinners;
+                },
+                maxWinners, db);
+            REQUIRE(n == maxWinners);
+        }
+    }
+
+    // what every lookup used to cost
+    LOG(INFO) << "Aggregating the accounts table";
+    {
+        TIMED_SCOPE(timerBlkObj, "rebuildInflationVotes");
+        soci::transaction sqlTx(db.getSession());
+        AccountFrame::rebuildInflationVotes(db);
+        sqlTx.commit();
+    }
+    AccountFrame::checkInflationVotes(db);
+}
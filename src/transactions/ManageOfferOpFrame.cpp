@@ -8,6 +8,7 @@
 #include "util/types.h"
 #include "database/Database.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerState.h"
 #include "OfferExchange.h"
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
@@ -203,7 +204,7 @@ ManageOfferOpFrame::doApply(medida::MetricsRegistry& metrics,
     innerResult().code(MANAGE_OFFER_SUCCESS);
 
     {
-        soci::transaction sqlTx(db.getSession());
+        LedgerStateScope stateScope(db);
         LedgerDelta tempDelta(delta);
 
         int64_t sheepSent, wheatReceived;
@@ -337,7 +338,7 @@ ManageOfferOpFrame::doApply(medida::MetricsRegistry& metrics,
             }
         }
 
-        sqlTx.commit();
+        stateScope.commit();
         tempDelta.commit();
     }
     metrics.NewMeter({"op-create-offer", "success", "apply"}, "operation")
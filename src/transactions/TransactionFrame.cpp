@@ -10,15 +10,15 @@
 #include "util/Logging.h"
 #include "util/XDRStream.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerState.h"
 #include "crypto/SHA.h"
 #include "crypto/SecretKey.h"
 #include "database/Database.h"
 #include "herder/TxSetFrame.h"
 #include "crypto/Hex.h"
 #include "util/basen.h"
+#include "util/ShardedMetrics.h"
 
-#include "medida/meter.h"
-#include "medida/metrics_registry.h"
 
 namespace stellar
 {
@@ -30,6 +30,10 @@ TransactionFramePtr
 TransactionFrame::makeTransactionFromWire(TransactionEnvelope const& msg)
 {
     TransactionFramePtr res = make_shared<TransactionFrame>(msg);
+    // the envelope won't change: hash it now rather than whenever the frame
+    // is first sorted, looked up or stored
+    res->cacheEnvelope();
+    res->getContentsHash();
     return res;
 }
 
@@ -38,16 +42,30 @@ TransactionFrame::TransactionFrame(TransactionEnvelope const& envelope)
 {
 }
 
-Hash const&
-TransactionFrame::getFullHash() const
+void
+TransactionFrame::cacheEnvelope() const
 {
     if (isZero(mFullHash))
     {
-        mFullHash = sha256(xdr::xdr_to_opaque(mEnvelope));
+        mEnvelopeBytes = xdr::xdr_to_opaque(mEnvelope);
+        mFullHash = sha256(mEnvelopeBytes);
     }
+}
+
+Hash const&
+TransactionFrame::getFullHash() const
+{
+    cacheEnvelope();
     return (mFullHash);
 }
 
+xdr::opaque_vec<> const&
+TransactionFrame::getEnvelopeBytes() const
+{
+    cacheEnvelope();
+    return mEnvelopeBytes;
+}
+
 Hash const&
 TransactionFrame::getContentsHash() const
 {
@@ -65,6 +83,7 @@ TransactionFrame::clearCached()
     Hash zero;
     mContentsHash = zero;
     mFullHash = zero;
+    mEnvelopeBytes.clear();
 }
 
 TransactionResultPair
@@ -163,6 +182,30 @@ TransactionFrame::checkSignature(AccountFrame& account, int32_t neededWeight)
     return false;
 }
 
+void
+TransactionFrame::preverifySignatures(AccountFrame const& account) const
+{
+    Hash const& contentsHash = getContentsHash();
+    auto const& signers = account.getAccount().signers;
+    for (auto const& sig : getEnvelope().signatures)
+    {
+        if (account.getAccount().thresholds[0] &&
+            PubKeyUtils::hasHint(account.getID(), sig.hint))
+        {
+            PubKeyUtils::verifySig(account.getID(), sig.signature,
+                                   contentsHash);
+        }
+        for (auto const& signer : signers)
+        {
+            if (PubKeyUtils::hasHint(signer.pubKey, sig.hint))
+            {
+                PubKeyUtils::verifySig(signer.pubKey, sig.signature,
+                                       contentsHash);
+            }
+        }
+    }
+}
+
 AccountFrame::pointer
 TransactionFrame::loadAccount(Application& app, AccountID const& accountID)
 {
@@ -186,10 +229,52 @@ TransactionFrame::loadAccount(Application& app)
     return !!mSigningAccount;
 }
 
+namespace
+{
+// reasons transactions are rejected for, looked up once per application as
+// checkValid runs for every transaction received and applied
+struct InvalidTxMeters
+{
+    ShardedMeter& mMissingOperation;
+    ShardedMeter& mTooEarly;
+    ShardedMeter& mTooLate;
+    ShardedMeter& mInsufficientFee;
+    ShardedMeter& mNoAccount;
+    ShardedMeter& mBadSeq;
+    ShardedMeter& mBadAuth;
+    ShardedMeter& mInsufficientBalance;
+    ShardedMeter& mInvalidOp;
+    ShardedMeter& mBadAuthExtra;
+
+    static ShardedMeter&
+    meter(ShardedMetrics& metrics, std::string const& reason)
+    {
+        return metrics.NewMeter({"transaction", "invalid", reason},
+                                "transaction");
+    }
+
+    explicit InvalidTxMeters(ShardedMetrics& metrics)
+        : mMissingOperation(meter(metrics, "missing-operation"))
+        , mTooEarly(meter(metrics, "too-early"))
+        , mTooLate(meter(metrics, "too-late"))
+        , mInsufficientFee(meter(metrics, "insufficient-fee"))
+        , mNoAccount(meter(metrics, "no-account"))
+        , mBadSeq(meter(metrics, "bad-seq"))
+        , mBadAuth(meter(metrics, "bad-auth"))
+        , mInsufficientBalance(meter(metrics, "insufficient-balance"))
+        , mInvalidOp(meter(metrics, "invalid-op"))
+        , mBadAuthExtra(meter(metrics, "bad-auth-extra"))
+    {
+    }
+};
+}
+
 bool
 TransactionFrame::checkValid(Application& app, bool applying,
                              SequenceNumber current)
 {
+    auto& invalid = app.getShardedMetrics().getHandles<InvalidTxMeters>();
+
     // pre-allocates the results for all operations
     getResult().result.code(txSUCCESS);
     getResult().result.results().resize(
@@ -212,10 +297,7 @@ TransactionFrame::checkValid(Application& app, bool applying,
 
     if (mOperations.size() == 0)
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "missing-operation"},
-                      "transaction")
-            .Mark();
+        invalid.mMissingOperation.Mark();
         getResult().result.code(txMISSING_OPERATION);
         return false;
     }
@@ -226,19 +308,14 @@ TransactionFrame::checkValid(Application& app, bool applying,
             app.getLedgerManager().getCurrentLedgerHeader().scpValue.closeTime;
         if (mEnvelope.tx.timeBounds->minTime > closeTime)
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "too-early"},
-                          "transaction")
-                .Mark();
+            invalid.mTooEarly.Mark();
             getResult().result.code(txTOO_EARLY);
             return false;
         }
         if (mEnvelope.tx.timeBounds->maxTime &&
             (mEnvelope.tx.timeBounds->maxTime < closeTime))
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "too-late"}, "transaction")
-                .Mark();
+            invalid.mTooLate.Mark();
             getResult().result.code(txTOO_LATE);
             return false;
         }
@@ -246,19 +323,14 @@ TransactionFrame::checkValid(Application& app, bool applying,
 
     if (mEnvelope.tx.fee < getMinFee(app))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "insufficient-fee"},
-                      "transaction")
-            .Mark();
+        invalid.mInsufficientFee.Mark();
         getResult().result.code(txINSUFFICIENT_FEE);
         return false;
     }
 
     if (!loadAccount(app))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "no-account"}, "transaction")
-            .Mark();
+        invalid.mNoAccount.Mark();
         getResult().result.code(txNO_ACCOUNT);
         return false;
     }
@@ -270,18 +342,14 @@ TransactionFrame::checkValid(Application& app, bool applying,
 
     if (current + 1 != mEnvelope.tx.seqNum)
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "bad-seq"}, "transaction")
-            .Mark();
+        invalid.mBadSeq.Mark();
         getResult().result.code(txBAD_SEQ);
         return false;
     }
 
     if (!checkSignature(*mSigningAccount, mSigningAccount->getLowThreshold()))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "bad-auth"}, "transaction")
-            .Mark();
+        invalid.mBadAuth.Mark();
         getResult().result.code(txBAD_AUTH);
         return false;
     }
@@ -294,10 +362,7 @@ TransactionFrame::checkValid(Application& app, bool applying,
     if (mSigningAccount->getAccount().balance - mEnvelope.tx.fee <
         mSigningAccount->getMinimumBalance(app.getLedgerManager()))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "insufficient-balance"},
-                      "transaction")
-            .Mark();
+        invalid.mInsufficientBalance.Mark();
         getResult().result.code(txINSUFFICIENT_BALANCE);
         return false;
     }
@@ -311,10 +376,7 @@ TransactionFrame::checkValid(Application& app, bool applying,
                 // it's OK to just fast fail here and not try to call
                 // checkValid on all operations as the resulting object
                 // is only used by applications
-                app.getMetrics()
-                    .NewMeter({"transaction", "invalid", "invalid-op"},
-                              "transaction")
-                    .Mark();
+                invalid.mInvalidOp.Mark();
                 markResultFailed();
                 return false;
             }
@@ -322,10 +384,7 @@ TransactionFrame::checkValid(Application& app, bool applying,
         auto b = checkAllSignaturesUsed();
         if (!b)
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "bad-auth-extra"},
-                          "transaction")
-                .Mark();
+            invalid.mBadAuthExtra.Mark();
         }
         return b;
     }
@@ -439,8 +498,8 @@ TransactionFrame::apply(LedgerDelta& delta, TransactionMeta& tm,
 
     {
         // shield outer scope of any side effects by using
-        // a sql transaction for ledger state and LedgerDelta
-        soci::transaction sqlTx(app.getDatabase().getSession());
+        // a nested scope for ledger state and LedgerDelta
+        LedgerStateScope stateScope(app.getDatabase());
         LedgerDelta thisTxDelta(delta);
 
         for (auto& op : mOperations)
@@ -465,7 +524,7 @@ TransactionFrame::apply(LedgerDelta& delta, TransactionMeta& tm,
                 return false;
             }
 
-            sqlTx.commit();
+            stateScope.commit();
             thisTxDelta.commit();
         }
     }
@@ -495,25 +554,23 @@ TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
                                    TransactionMeta& tm, int txindex,
                                    TransactionResultSet& resultSet) const
 {
-    auto txBytes(xdr::xdr_to_opaque(mEnvelope));
+    auto const& txBytes = getEnvelopeBytes();
 
     resultSet.results.emplace_back(getResultPair());
     auto txResultBytes(xdr::xdr_to_opaque(resultSet.results.back()));
 
-    std::string txBody;
-    txBody = bn::encode_b64(txBytes);
-
-    std::string txResult;
-    txResult = bn::encode_b64(txResultBytes);
-
     xdr::opaque_vec<> txMeta(xdr::xdr_to_opaque(tm));
 
-    std::string meta;
-    meta = bn::encode_b64(txMeta);
-
     string txIDString(binToHex(getContentsHash()));
 
     auto& db = ledgerManager.getDatabase();
+    BinaryColumn txBody(db, db.getSession());
+    BinaryColumn txResult(db, db.getSession());
+    BinaryColumn meta(db, db.getSession());
+    txBody.set(txBytes);
+    txResult.set(txResultBytes);
+    meta.set(txMeta);
+
     auto prep = db.getPreparedStatement(
         "INSERT INTO txhistory "
         "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
@@ -523,9 +580,9 @@ TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
     st.exchange(soci::use(txIDString));
     st.exchange(soci::use(ledgerManager.getCurrentLedgerHeader().ledgerSeq));
     st.exchange(soci::use(txindex));
-    st.exchange(soci::use(txBody));
-    st.exchange(soci::use(txResult));
-    st.exchange(soci::use(meta));
+    txBody.bindUse(st);
+    txResult.bindUse(st);
+    meta.bindUse(st);
     st.define_and_bind();
     {
         auto timer = db.getInsertTimer("txhistory");
@@ -539,14 +596,14 @@ TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
 }
 
 static void
-saveTransactionHelper(Database& db, soci::session& sess, uint32 ledgerSeq,
+saveTransactionHelper(StatementCache& stmts, uint32 ledgerSeq,
                       TxSetFrame& txSet, TransactionHistoryResultEntry& results,
                       XDROutputFileStream& txOut,
                       XDROutputFileStream& txResultOut)
 {
     // prepare the txset for saving
     LedgerHeaderFrame::pointer lh =
-        LedgerHeaderFrame::loadBySequence(ledgerSeq, db, sess);
+        LedgerHeaderFrame::loadBySequence(ledgerSeq, stmts);
     if (!lh)
     {
         throw std::runtime_error("Could not find ledger");
@@ -562,27 +619,36 @@ saveTransactionHelper(Database& db, soci::session& sess, uint32 ledgerSeq,
 }
 
 size_t
-TransactionFrame::copyTransactionsToStream(Database& db, soci::session& sess,
+TransactionFrame::copyTransactionsToStream(Database& db,
+                                           StatementCache& stmts,
                                            uint32_t ledgerSeq,
                                            uint32_t ledgerCount,
                                            XDROutputFileStream& txOut,
                                            XDROutputFileStream& txResultOut)
 {
     auto timer = db.getSelectTimer("txhistory");
-    std::string txBody, txResult, txMeta;
+    auto& sess = stmts.getSession();
+    BinaryColumn txBody(db, sess), txResult(db, sess);
+    // decode buffers, reused across rows
+    std::vector<uint8_t> body, result;
     uint32_t begin = ledgerSeq, end = ledgerSeq + ledgerCount;
     size_t n = 0;
 
     TransactionEnvelope tx;
-    uint32_t curLedgerSeq;
+    uint32_t curLedgerSeq = 0;
 
     assert(begin <= end);
-    soci::statement st =
-        (sess.prepare << "SELECT ledgerseq, txbody, txresult FROM txhistory "
-                         "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
-                         "BY ledgerseq ASC, txindex ASC",
-         soci::into(curLedgerSeq), soci::into(txBody), soci::into(txResult),
-         soci::use(begin), soci::use(end));
+    soci::statement st(sess);
+    st.exchange(soci::into(curLedgerSeq));
+    txBody.bindInto(st);
+    txResult.bindInto(st);
+    st.exchange(soci::use(begin));
+    st.exchange(soci::use(end));
+    st.alloc();
+    st.prepare("SELECT ledgerseq, txbody, txresult FROM txhistory "
+               "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
+               "BY ledgerseq ASC, txindex ASC");
+    st.define_and_bind();
 
     Hash h;
     TxSetFrame txSet(h); // we're setting the hash later
@@ -597,7 +663,7 @@ TransactionFrame::copyTransactionsToStream(Database& db, soci::session& sess,
     {
         if (curLedgerSeq != lastLedgerSeq)
         {
-            saveTransactionHelper(db, sess, lastLedgerSeq, txSet, results,
+            saveTransactionHelper(stmts, lastLedgerSeq, txSet, results,
                                   txOut, txResultOut);
             // reset state
             txSet.mTransactions.clear();
@@ -606,23 +672,18 @@ TransactionFrame::copyTransactionsToStream(Database& db, soci::session& sess,
             lastLedgerSeq = curLedgerSeq;
         }
 
-        std::vector<uint8_t> body;
-        bn::decode_b64(txBody, body);
-
-        std::vector<uint8_t> result;
-        bn::decode_b64(txResult, result);
+        txBody.get(body);
+        txResult.get(result);
 
-        xdr::xdr_get g1(&body.front(), &body.back() + 1);
-        xdr_argpack_archive(g1, tx);
+        xdr::xdr_from_opaque(body, tx);
 
         TransactionFramePtr txFrame = make_shared<TransactionFrame>(tx);
         txSet.add(txFrame);
 
-        xdr::xdr_get g2(&result.front(), &result.back() + 1);
         results.txResultSet.results.emplace_back();
 
         TransactionResultPair& p = results.txResultSet.results.back();
-        xdr_argpack_archive(g2, p);
+        xdr::xdr_from_opaque(result, p);
 
         if (p.transactionHash != txFrame->getContentsHash())
         {
@@ -634,26 +695,92 @@ TransactionFrame::copyTransactionsToStream(Database& db, soci::session& sess,
     }
     if (n != 0)
     {
-        saveTransactionHelper(db, sess, lastLedgerSeq, txSet, results, txOut,
+        saveTransactionHelper(stmts, lastLedgerSeq, txSet, results, txOut,
                               txResultOut);
     }
     return n;
 }
 
-void
-TransactionFrame::dropAll(Database& db)
+static void
+createTxHistoryTable(Database& db, std::string const& name)
 {
-    db.getSession() << "DROP TABLE IF EXISTS txhistory";
-
-    db.getSession() << "CREATE TABLE txhistory ("
+    std::string bin = db.getBinaryColumnType();
+    db.getSession() << "CREATE TABLE " + name + " ("
                        "txid          CHARACTER(64) NOT NULL,"
                        "ledgerseq     INT NOT NULL CHECK (ledgerseq >= 0),"
                        "txindex         INT NOT NULL,"
-                       "txbody        TEXT NOT NULL,"
-                       "txresult      TEXT NOT NULL,"
-                       "txmeta        TEXT NOT NULL,"
+                       "txbody        " + bin + " NOT NULL,"
+                       "txresult      " + bin + " NOT NULL,"
+                       "txmeta        " + bin + " NOT NULL,"
                        "PRIMARY KEY (txid, ledgerseq),"
                        "UNIQUE      (ledgerseq, txindex)"
                        ")";
 }
+
+void
+TransactionFrame::convertTxHistoryToBinary(Database& db)
+{
+    auto& sess = db.getSession();
+
+    // build the binary table on the side and swap it in at the end, so that
+    // constraint names of the old table don't collide with the new ones.
+    sess << "DROP TABLE IF EXISTS txhistorybin";
+    createTxHistoryTable(db, "txhistorybin");
+
+    std::string txID, txBody, txResult, txMeta;
+    uint32_t ledgerSeq = 0;
+    int txIndex = 0;
+    std::vector<uint8_t> body, result, meta;
+    BinaryColumn binBody(db, sess), binResult(db, sess), binMeta(db, sess);
+
+    soci::statement ins(sess);
+    ins.exchange(soci::use(txID));
+    ins.exchange(soci::use(ledgerSeq));
+    ins.exchange(soci::use(txIndex));
+    binBody.bindUse(ins);
+    binResult.bindUse(ins);
+    binMeta.bindUse(ins);
+    ins.alloc();
+    ins.prepare("INSERT INTO txhistorybin "
+                "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
+                "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
+    ins.define_and_bind();
+
+    soci::statement sel =
+        (sess.prepare << "SELECT txid, ledgerseq, txindex, txbody, txresult, "
+                         "txmeta FROM txhistory",
+         soci::into(txID), soci::into(ledgerSeq), soci::into(txIndex),
+         soci::into(txBody), soci::into(txResult), soci::into(txMeta));
+
+    size_t n = 0;
+    sel.execute(true);
+    while (sel.got_data())
+    {
+        bn::decode_b64(txBody, body);
+        bn::decode_b64(txResult, result);
+        bn::decode_b64(txMeta, meta);
+        binBody.set(body);
+        binResult.set(result);
+        binMeta.set(meta);
+        ins.execute(true);
+        if (ins.get_affected_rows() != 1)
+        {
+            throw std::runtime_error("Could not update data in SQL");
+        }
+        ++n;
+        sel.fetch();
+    }
+
+    sess << "DROP TABLE txhistory";
+    sess << "ALTER TABLE txhistorybin RENAME TO txhistory";
+    CLOG(INFO, "Database") << "Converted " << n
+                           << " txhistory rows to binary storage";
+}
+
+void
+TransactionFrame::dropAll(Database& db)
+{
+    db.getSession() << "DROP TABLE IF EXISTS txhistory";
+    createTxHistoryTable(db, "txhistory");
+}
 }
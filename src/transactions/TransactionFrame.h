@@ -25,6 +25,7 @@ class Application;
 class OperationFrame;
 class LedgerDelta;
 class SecretKey;
+class StatementCache;
 class XDROutputFileStream;
 class SHA256;
 
@@ -40,7 +41,11 @@ class TransactionFrame
     AccountFrame::pointer mSigningAccount;
     std::vector<bool> mUsedSignatures;
 
+    // the envelope as XDR and its hashes, computed on first use or, for
+    // transactions received from the wire, when the frame is made
     void clearCached();
+    void cacheEnvelope() const;
+    mutable xdr::opaque_vec<> mEnvelopeBytes;
     mutable Hash mContentsHash; // the hash of the contents
     mutable Hash mFullHash;     // the hash of the contents and the sig.
 
@@ -66,6 +71,8 @@ class TransactionFrame
 
     Hash const& getFullHash() const;
     Hash const& getContentsHash() const;
+    // the XDR encoding of the envelope, as hashed by getFullHash
+    xdr::opaque_vec<> const& getEnvelopeBytes() const;
 
     AccountFrame::pointer
     getSourceAccountPtr() const
@@ -101,6 +108,7 @@ class TransactionFrame
 
     TransactionResultPair getResultPair() const;
     TransactionEnvelope const& getEnvelope() const;
+    // the cached encoding and hashes are only refreshed by addSignature
     TransactionEnvelope& getEnvelope();
 
     SequenceNumber
@@ -132,6 +140,11 @@ class TransactionFrame
 
     bool checkSignature(AccountFrame& account, int32_t neededWeight);
 
+    // verifies the signatures `account` may have made, so that checkSignature
+    // finds them in the signature cache; safe to call from another thread
+    // once the contents hash is known
+    void preverifySignatures(AccountFrame const& account) const;
+
     bool checkValid(Application& app, SequenceNumber current);
 
     // apply this transaction to the current ledger
@@ -155,11 +168,15 @@ class TransactionFrame
     txOut: stream of TransactionHistoryEntry
     txResultOut: stream of TransactionHistoryResultEntry
     */
-    static size_t copyTransactionsToStream(Database& db, soci::session& sess,
+    static size_t copyTransactionsToStream(Database& db,
+                                           StatementCache& stmts,
                                            uint32_t ledgerSeq,
                                            uint32_t ledgerCount,
                                            XDROutputFileStream& txOut,
                                            XDROutputFileStream& txResultOut);
     static void dropAll(Database& db);
+
+    // schema upgrade: rewrite txhistory from base64 text columns to binary
+    static void convertTxHistoryToBinary(Database& db);
 };
 }
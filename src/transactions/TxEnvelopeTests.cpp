@@ -16,6 +16,10 @@
 #include "transactions/CreateAccountOpFrame.h"
 #include "transactions/ManageOfferOpFrame.h"
 #include "transactions/TxTests.h"
+#include "transactions/TransactionFrame.h"
+#include "database/Database.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
 
 using namespace stellar;
 using namespace stellar::txtest;
@@ -485,3 +489,72 @@ TEST_CASE("txenvelope", "[tx][envelope]")
         }
     }
 }
+
+TEST_CASE("txhistory store and stream benchmark",
+          "[tx][txhistory][bench][hide]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer appPtr = Application::create(clock, cfg);
+    Application& app = *appPtr;
+    app.start();
+
+    size_t const nLedgers = 64;
+    size_t const nTxPerLedger = 500;
+
+    SecretKey root = getRoot();
+    SecretKey a1 = getAccount("A");
+    SequenceNumber rootSeq = getAccountSeqNum(root, app) + 1;
+    auto& lm = app.getLedgerManager();
+
+    // a meta of typical size: the source account updated by the fee and by
+    // the operation
+    TransactionMeta tm;
+    LedgerEntryChange change(LEDGER_ENTRY_UPDATED);
+    change.updated() = loadAccount(root, app)->mEntry;
+    tm.v0().changes.push_back(change);
+    tm.v0().operations.emplace_back();
+    tm.v0().operations.back().changes.push_back(change);
+
+    std::vector<TransactionFramePtr> txs;
+    for (size_t i = 0; i < nTxPerLedger; i++)
+    {
+        txs.emplace_back(createPaymentTx(root, a1, rootSeq++, 1000));
+    }
+
+    uint32_t first = lm.getLedgerNum();
+    LOG(INFO) << "Storing " << nLedgers << " ledgers of " << nTxPerLedger
+              << " transactions";
+    for (size_t l = 0; l < nLedgers; l++)
+    {
+        LedgerDelta delta(lm.getCurrentLedgerHeader());
+        TransactionResultSet resultSet;
+        {
+            TIMED_SCOPE(timerBlkObj, "storeTransaction");
+            soci::transaction sqlTx(app.getDatabase().getSession());
+            int index = 0;
+            for (auto const& tx : txs)
+            {
+                tx->storeTransaction(lm, delta, tm, ++index, resultSet);
+            }
+            sqlTx.commit();
+        }
+        // an empty close stores the header the rows above refer to
+        closeLedgerOn(app, lm.getLedgerNum(), 1, 1, 2015);
+    }
+
+    TmpDir dir(app.getTmpDirManager().tmpDir("txhistorybench"));
+    XDROutputFileStream txOut, txResultOut;
+    txOut.open(dir.getName() + "/tx.xdr");
+    txResultOut.open(dir.getName() + "/txresult.xdr");
+    size_t n = 0;
+    LOG(INFO) << "Streaming " << nLedgers * nTxPerLedger << " transactions";
+    {
+        TIMED_SCOPE(timerBlkObj, "copyTransactionsToStream");
+        n = TransactionFrame::copyTransactionsToStream(
+            app.getDatabase(), app.getDatabase().getStatementCache(), first,
+            static_cast<uint32_t>(nLedgers), txOut, txResultOut);
+    }
+    REQUIRE(n == nLedgers * nTxPerLedger);
+}
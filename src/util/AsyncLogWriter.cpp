@@ -0,0 +1,220 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/AsyncLogWriter.h"
+
+#include <chrono>
+#include <iostream>
+
+namespace stellar
+{
+
+// lines queued beyond which callers wait for the writer
+static uint64_t const MAX_PENDING_LINES = 1 << 16;
+
+// how long an idle writer sleeps when it misses a wake-up
+static std::chrono::milliseconds const IDLE_WAIT{20};
+
+AsyncLogWriter::AsyncLogWriter() : mHead(&mStub), mTail(&mStub)
+{
+    mThread = std::thread([this]()
+                          {
+                              run();
+                          });
+}
+
+AsyncLogWriter::~AsyncLogWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+        mStopping = true;
+    }
+    mWake.notify_one();
+    mThread.join();
+}
+
+void
+AsyncLogWriter::push(Item* item)
+{
+    item->mNext.store(nullptr, std::memory_order_relaxed);
+    Item* prev = mHead.exchange(item, std::memory_order_acq_rel);
+    // until this store the writer sees the queue end at `prev`
+    prev->mNext.store(item, std::memory_order_release);
+}
+
+AsyncLogWriter::Item*
+AsyncLogWriter::pop()
+{
+    Item* tail = mTail;
+    Item* next = tail->mNext.load(std::memory_order_acquire);
+    if (tail == &mStub)
+    {
+        if (!next)
+        {
+            return nullptr;
+        }
+        mTail = next;
+        tail = next;
+        next = next->mNext.load(std::memory_order_acquire);
+    }
+    if (next)
+    {
+        mTail = next;
+        return tail;
+    }
+    if (tail != mHead.load(std::memory_order_acquire))
+    {
+        // a producer is between its exchange and its store
+        return nullptr;
+    }
+    // `tail` is the last item: put the stub behind it so it can be handed out
+    push(&mStub);
+    next = tail->mNext.load(std::memory_order_acquire);
+    if (next)
+    {
+        mTail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void
+AsyncLogWriter::wake()
+{
+    if (mIdle.load())
+    {
+        mWake.notify_one();
+    }
+}
+
+void
+AsyncLogWriter::write(std::string line, bool toStdout, bool toFile)
+{
+    while (pending() > MAX_PENDING_LINES)
+    {
+        wake();
+        std::this_thread::yield();
+    }
+    auto item = new Item();
+    item->mText = std::move(line);
+    item->mToStdout = toStdout;
+    item->mToFile = toFile;
+    mQueued++;
+    push(item);
+    wake();
+}
+
+void
+AsyncLogWriter::setFile(std::string const& filename)
+{
+    auto item = new Item();
+    item->mKind = Item::SET_FILE;
+    item->mText = filename;
+    push(item);
+    wake();
+}
+
+void
+AsyncLogWriter::flush()
+{
+    std::promise<void> flushed;
+    auto item = new Item();
+    item->mKind = Item::FLUSH;
+    item->mFlushed = &flushed;
+    push(item);
+    {
+        // can't miss the writer going to sleep, unlike wake()
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+        mWake.notify_one();
+    }
+    flushed.get_future().wait();
+}
+
+void
+AsyncLogWriter::writeItem(Item& item)
+{
+    switch (item.mKind)
+    {
+    case Item::LINE:
+        if (item.mToStdout)
+        {
+            std::cout.write(item.mText.data(), item.mText.size());
+        }
+        if (item.mToFile && mFile.is_open())
+        {
+            mFile.write(item.mText.data(), item.mText.size());
+        }
+        mWritten++;
+        break;
+    case Item::SET_FILE:
+        if (mFile.is_open())
+        {
+            mFile.close();
+        }
+        if (!item.mText.empty())
+        {
+            mFile.open(item.mText, std::ios::out | std::ios::app);
+            if (!mFile)
+            {
+                std::cerr << "Unable to open log file " << item.mText
+                          << std::endl;
+            }
+        }
+        break;
+    case Item::FLUSH:
+        std::cout.flush();
+        if (mFile.is_open())
+        {
+            mFile.flush();
+        }
+        item.mFlushed->set_value();
+        break;
+    }
+}
+
+void
+AsyncLogWriter::run()
+{
+    for (;;)
+    {
+        bool wrote = false;
+        while (Item* item = pop())
+        {
+            writeItem(*item);
+            delete item;
+            wrote = true;
+        }
+        if (wrote)
+        {
+            // hand what was written to the OS before going idle
+            std::cout.flush();
+            if (mFile.is_open())
+            {
+                mFile.flush();
+            }
+            continue;
+        }
+        if (mStopping && mHead.load() == mTail)
+        {
+            break;
+        }
+
+        mIdle = true;
+        {
+            std::unique_lock<std::mutex> lock(mWakeMutex);
+            mWake.wait_for(lock, IDLE_WAIT, [this]()
+                           {
+                               return mStopping.load() ||
+                                      mTail->mNext.load() != nullptr ||
+                                      mHead.load() != mTail;
+                           });
+        }
+        mIdle = false;
+    }
+    if (mFile.is_open())
+    {
+        mFile.close();
+    }
+}
+}
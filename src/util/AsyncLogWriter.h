@@ -0,0 +1,96 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace stellar
+{
+
+/**
+ * Writes log lines to stdout and a log file on a thread of its own.
+ *
+ * Threads logging hand their formatted lines over through a lock-free queue
+ * (an intrusive multi-producer, single-consumer list) and go on; the writer
+ * thread drains it, writing lines in the order they were queued, and flushes
+ * the streams whenever it runs out of lines. Should the writer fall far
+ * behind, callers wait for it rather than queueing without bound.
+ *
+ * Changing the log file goes through the queue too, so lines end up in the
+ * file that was current when they were logged.
+ */
+class AsyncLogWriter : NonMovableOrCopyable
+{
+    struct Item
+    {
+        enum Kind
+        {
+            LINE,
+            SET_FILE,
+            // everything queued before it is written out
+            FLUSH
+        };
+
+        std::atomic<Item*> mNext{nullptr};
+        Kind mKind{LINE};
+        std::string mText;
+        bool mToStdout{false};
+        bool mToFile{false};
+        // set once a FLUSH is reached
+        std::promise<void>* mFlushed{nullptr};
+    };
+
+    // producers append at mHead; only the writer thread touches mTail
+    std::atomic<Item*> mHead;
+    Item* mTail;
+    Item mStub;
+
+    std::atomic<uint64_t> mQueued{0};
+    std::atomic<uint64_t> mWritten{0};
+
+    std::atomic<bool> mIdle{false};
+    std::atomic<bool> mStopping{false};
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+
+    std::ofstream mFile;
+    std::thread mThread;
+
+    void push(Item* item);
+    Item* pop();
+    void wake();
+    void writeItem(Item& item);
+    void run();
+
+  public:
+    AsyncLogWriter();
+    // writes out what is queued before returning
+    ~AsyncLogWriter();
+
+    void write(std::string line, bool toStdout, bool toFile);
+
+    // lines queued after this go to `filename`, or to no file if it is empty
+    void setFile(std::string const& filename);
+
+    // waits until every line queued so far is written out
+    void flush();
+
+    // lines queued and not yet written
+    uint64_t
+    pending() const
+    {
+        return mQueued.load() - mWritten.load();
+    }
+};
+}
@@ -0,0 +1,189 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/CuckooFilter.h"
+#include "util/Math.h"
+
+namespace stellar
+{
+
+// mixes the bits of `x`, so that the fingerprint doesn't depend on the bits
+// picking the bucket
+static uint64_t
+mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+CuckooFilter::CuckooFilter(size_t capacity)
+    : mCount(0), mHasVictim(false), mVictim(0), mVictimBucket(0)
+{
+    // keep the filter at most ~85% full
+    size_t buckets = 1;
+    while (buckets * SLOTS_PER_BUCKET * 85 < capacity * 100 + 1)
+    {
+        buckets <<= 1;
+    }
+    mSlots.assign(buckets * SLOTS_PER_BUCKET, 0);
+    mBucketMask = buckets - 1;
+}
+
+uint16_t
+CuckooFilter::fingerprint(uint64_t hash) const
+{
+    auto fp = static_cast<uint16_t>(mix(hash) >> 48);
+    return fp == 0 ? 1 : fp;
+}
+
+size_t
+CuckooFilter::altBucket(size_t bucket, uint16_t fp) const
+{
+    return (bucket ^ static_cast<size_t>(mix(fp))) & mBucketMask;
+}
+
+bool
+CuckooFilter::bucketContains(size_t bucket, uint16_t fp) const
+{
+    auto slots = &mSlots[bucket * SLOTS_PER_BUCKET];
+    for (size_t i = 0; i < SLOTS_PER_BUCKET; i++)
+    {
+        if (slots[i] == fp)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+CuckooFilter::bucketInsert(size_t bucket, uint16_t fp)
+{
+    auto slots = &mSlots[bucket * SLOTS_PER_BUCKET];
+    for (size_t i = 0; i < SLOTS_PER_BUCKET; i++)
+    {
+        if (slots[i] == 0)
+        {
+            slots[i] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+CuckooFilter::bucketErase(size_t bucket, uint16_t fp)
+{
+    auto slots = &mSlots[bucket * SLOTS_PER_BUCKET];
+    for (size_t i = 0; i < SLOTS_PER_BUCKET; i++)
+    {
+        if (slots[i] == fp)
+        {
+            slots[i] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+CuckooFilter::insert(uint64_t hash)
+{
+    if (mHasVictim)
+    {
+        return false;
+    }
+    ++mCount;
+
+    uint16_t fp = fingerprint(hash);
+    size_t b1 = static_cast<size_t>(hash) & mBucketMask;
+    size_t b2 = altBucket(b1, fp);
+    if (bucketInsert(b1, fp) || bucketInsert(b2, fp))
+    {
+        return true;
+    }
+
+    // relocate existing fingerprints to their other bucket until one slot
+    // frees up
+    size_t b = rand_flip() ? b1 : b2;
+    for (int kick = 0; kick < MAX_KICKS; kick++)
+    {
+        auto& slot = mSlots[b * SLOTS_PER_BUCKET +
+                            rand_uniform<size_t>(0, SLOTS_PER_BUCKET - 1)];
+        std::swap(fp, slot);
+        b = altBucket(b, fp);
+        if (bucketInsert(b, fp))
+        {
+            return true;
+        }
+    }
+
+    // keep the homeless fingerprint so that no item is lost
+    mHasVictim = true;
+    mVictim = fp;
+    mVictimBucket = b;
+    return false;
+}
+
+bool
+CuckooFilter::contains(uint64_t hash) const
+{
+    uint16_t fp = fingerprint(hash);
+    size_t b1 = static_cast<size_t>(hash) & mBucketMask;
+    size_t b2 = altBucket(b1, fp);
+    if (mHasVictim && mVictim == fp &&
+        (mVictimBucket == b1 || mVictimBucket == b2))
+    {
+        return true;
+    }
+    return bucketContains(b1, fp) || bucketContains(b2, fp);
+}
+
+bool
+CuckooFilter::erase(uint64_t hash)
+{
+    uint16_t fp = fingerprint(hash);
+    size_t b1 = static_cast<size_t>(hash) & mBucketMask;
+    size_t b2 = altBucket(b1, fp);
+    bool found;
+    if (mHasVictim && mVictim == fp &&
+        (mVictimBucket == b1 || mVictimBucket == b2))
+    {
+        mHasVictim = false;
+        found = true;
+    }
+    else
+    {
+        found = bucketErase(b1, fp) || bucketErase(b2, fp);
+    }
+    if (!found)
+    {
+        return false;
+    }
+    --mCount;
+
+    // try to place the victim in the room that was made
+    if (mHasVictim)
+    {
+        if (bucketInsert(mVictimBucket, mVictim) ||
+            bucketInsert(altBucket(mVictimBucket, mVictim), mVictim))
+        {
+            mHasVictim = false;
+        }
+    }
+    return true;
+}
+
+void
+CuckooFilter::clear()
+{
+    std::fill(mSlots.begin(), mSlots.end(), 0);
+    mCount = 0;
+    mHasVictim = false;
+}
+}
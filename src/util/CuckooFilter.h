@@ -0,0 +1,80 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include <cstdint>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Approximate set of 64-bit hashes supporting deletion (Fan et al., "Cuckoo
+ * Filter: Practically Better Than Bloom").
+ *
+ * Each item is reduced to a 16-bit fingerprint stored in one of two buckets
+ * of 4 slots: the bucket picked by the low bits of its hash, or that bucket
+ * xor the hash of the fingerprint. contains() never returns false for an
+ * item that was inserted and not erased since; with 16-bit fingerprints it
+ * returns true for about 1 in 8000 other items. Erasing an item that was
+ * never inserted may erase another one, so callers must not do it.
+ *
+ * The filter doesn't grow: insert() returns false once it is too full to
+ * place the item, and the filter must then be rebuilt larger.
+ */
+class CuckooFilter
+{
+  public:
+    // Sized to hold `capacity` items with room to spare.
+    explicit CuckooFilter(size_t capacity = 0);
+
+    // Returns false if the filter is full. The item that fills it is still
+    // recorded, aside from the table, but further items aren't.
+    bool insert(uint64_t hash);
+    bool contains(uint64_t hash) const;
+    // Returns false if no matching fingerprint was found.
+    bool erase(uint64_t hash);
+
+    void clear();
+
+    size_t
+    size() const
+    {
+        return mCount;
+    }
+
+    size_t
+    capacity() const
+    {
+        return mSlots.size();
+    }
+
+    size_t
+    memoryUsage() const
+    {
+        return mSlots.size() * sizeof(uint16_t);
+    }
+
+  private:
+    static const size_t SLOTS_PER_BUCKET = 4;
+    static const int MAX_KICKS = 500;
+
+    // 0 marks an empty slot
+    std::vector<uint16_t> mSlots;
+    size_t mBucketMask;
+    size_t mCount;
+
+    // a fingerprint evicted by the last insert that could not be placed
+    bool mHasVictim;
+    uint16_t mVictim;
+    size_t mVictimBucket;
+
+    uint16_t fingerprint(uint64_t hash) const;
+    size_t altBucket(size_t bucket, uint16_t fp) const;
+    bool bucketContains(size_t bucket, uint16_t fp) const;
+    bool bucketInsert(size_t bucket, uint16_t fp);
+    bool bucketErase(size_t bucket, uint16_t fp);
+};
+}
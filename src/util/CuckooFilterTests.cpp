@@ -0,0 +1,100 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/CuckooFilter.h"
+#include "lib/catch.hpp"
+#include "util/Math.h"
+
+#include <vector>
+
+using namespace stellar;
+
+static std::vector<uint64_t>
+randomHashes(size_t n)
+{
+    std::vector<uint64_t> res;
+    for (size_t i = 0; i < n; i++)
+    {
+        res.push_back(rand_uniform<uint64_t>(0, UINT64_MAX));
+    }
+    return res;
+}
+
+TEST_CASE("cuckoo filter has no false negatives", "[cuckoo]")
+{
+    CuckooFilter filter(10000);
+    auto in = randomHashes(10000);
+    for (auto h : in)
+    {
+        REQUIRE(filter.insert(h));
+    }
+    REQUIRE(filter.size() == in.size());
+    for (auto h : in)
+    {
+        REQUIRE(filter.contains(h));
+    }
+
+    // about 4 * 2 / 65536 of the items not inserted are reported anyway
+    size_t falsePositives = 0;
+    for (auto h : randomHashes(100000))
+    {
+        if (filter.contains(h))
+        {
+            ++falsePositives;
+        }
+    }
+    CHECK(falsePositives < 100000 / 1000);
+}
+
+TEST_CASE("cuckoo filter erase", "[cuckoo]")
+{
+    CuckooFilter filter(1000);
+    auto in = randomHashes(1000);
+    for (auto h : in)
+    {
+        filter.insert(h);
+    }
+    for (size_t i = 0; i < in.size(); i += 2)
+    {
+        REQUIRE(filter.erase(in[i]));
+    }
+    REQUIRE(filter.size() == in.size() / 2);
+    for (size_t i = 1; i < in.size(); i += 2)
+    {
+        REQUIRE(filter.contains(in[i]));
+    }
+
+    // an item inserted twice stays until erased twice
+    filter.insert(in[0]);
+    filter.insert(in[0]);
+    REQUIRE(filter.erase(in[0]));
+    REQUIRE(filter.contains(in[0]));
+    REQUIRE(filter.erase(in[0]));
+
+    filter.clear();
+    REQUIRE(filter.size() == 0);
+    REQUIRE(!filter.contains(in[1]));
+}
+
+TEST_CASE("cuckoo filter reports when full", "[cuckoo]")
+{
+    CuckooFilter filter(100);
+    std::vector<uint64_t> in;
+    bool full = false;
+    while (!full)
+    {
+        in.push_back(rand_uniform<uint64_t>(0, UINT64_MAX));
+        full = !filter.insert(in.back());
+    }
+    REQUIRE(in.size() > 100);
+    // the last item is kept aside
+    REQUIRE(in.size() <= filter.capacity() + 1);
+
+    // everything, including the item that didn't fit, is still found
+    for (auto h : in)
+    {
+        REQUIRE(filter.contains(h));
+    }
+    REQUIRE(!filter.insert(rand_uniform<uint64_t>(0, UINT64_MAX)));
+}
@@ -13,10 +13,16 @@
 namespace stellar
 {
 static std::thread::id mainThread = std::this_thread::get_id();
+static thread_local bool markedAsMain = false;
 
 void assertThreadIsMain()
 {
-    dbgAssert(mainThread == std::this_thread::get_id());
+    dbgAssert(markedAsMain || mainThread == std::this_thread::get_id());
+}
+
+void markThreadAsMain()
+{
+    markedAsMain = true;
 }
 
 void dbgAbort()
@@ -8,6 +8,10 @@ namespace stellar
 {
 void assertThreadIsMain();
 
+// lets the calling thread pass assertThreadIsMain; for threads that crank an
+// application's clock of their own, as in a threaded Simulation
+void markThreadAsMain();
+
 void dbgAbort();
 
 #ifdef NDEBUG
@@ -4,8 +4,12 @@
 
 #include "util/Logging.h"
 #include "main/Application.h"
+#include "util/AsyncLogWriter.h"
 #include "util/types.h"
 
+#include <algorithm>
+#include <cstdlib>
+
 /*
 Levels:
     TRACE
@@ -19,6 +23,81 @@ Levels:
 namespace stellar
 {
 el::Configurations Logging::gDefaultConf;
+std::atomic<int> Logging::gMinEnabledLevel{STELLAR_LOG_LEVEL_TRACE};
+
+namespace
+{
+char const* const kPartitions[] = {"Fs",      "SCP",     "Bucket",  "Database",
+                                   "History", "Process", "Ledger",  "Overlay",
+                                   "Herder",  "Tx",      "LoadGen", "default"};
+
+std::string gLogFile;
+
+// Set while logging is asynchronous. Never deleted while it is: the process
+// may exit with threads still logging, so the writer is only flushed at exit.
+AsyncLogWriter* gAsyncWriter = nullptr;
+
+char const* const kAsyncDispatchID = "StellarAsyncLogDispatch";
+char const* const kDefaultDispatchID = "DefaultLogDispatchCallback";
+
+// Formats lines on the calling thread, under easylogging's lock like the
+// default dispatcher does, and leaves the writing to gAsyncWriter.
+class AsyncLogDispatch : public el::LogDispatchCallback
+{
+  protected:
+    void
+    handle(el::LogDispatchData const* data) override
+    {
+        if (data->dispatchAction() != el::base::DispatchAction::NormalLog)
+        {
+            return;
+        }
+        auto msg = data->logMessage();
+        auto logger = msg->logger();
+        auto level = msg->level();
+        bool toStdout = logger->typedConfigurations()->toStandardOutput(level);
+        bool toFile = logger->typedConfigurations()->toFile(level);
+        if (!toStdout && !toFile)
+        {
+            return;
+        }
+        gAsyncWriter->write(logger->logBuilder()->build(msg, true), toStdout,
+                            toFile);
+        if (level == el::Level::Error || level == el::Level::Fatal)
+        {
+            gAsyncWriter->flush();
+        }
+    }
+};
+
+void
+flushAtExit()
+{
+    Logging::flush();
+}
+
+int
+toStellarLevel(el::Level level)
+{
+    switch (level)
+    {
+    case el::Level::Trace:
+        return STELLAR_LOG_LEVEL_TRACE;
+    case el::Level::Debug:
+        return STELLAR_LOG_LEVEL_DEBUG;
+    case el::Level::Info:
+        return STELLAR_LOG_LEVEL_INFO;
+    case el::Level::Warning:
+        return STELLAR_LOG_LEVEL_WARNING;
+    case el::Level::Error:
+        return STELLAR_LOG_LEVEL_ERROR;
+    case el::Level::Fatal:
+        return STELLAR_LOG_LEVEL_FATAL;
+    default:
+        return STELLAR_LOG_LEVEL_FATAL + 1;
+    }
+}
+}
 
 void
 Logging::setFmt(std::string const& peerID, bool timestamps)
@@ -36,6 +115,7 @@ Logging::setFmt(std::string const& peerID, bool timestamps)
     gDefaultConf.set(el::Level::Trace, el::ConfigurationType::Format, longFmt);
     gDefaultConf.set(el::Level::Fatal, el::ConfigurationType::Format, longFmt);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    updateMinEnabledLevel();
 }
 
 void
@@ -44,17 +124,10 @@ Logging::init()
     // el::Loggers::addFlag(el::LoggingFlag::HierarchicalLogging);
     el::Loggers::addFlag(el::LoggingFlag::DisableApplicationAbortOnFatalLog);
 
-    el::Loggers::getLogger("Fs");
-    el::Loggers::getLogger("SCP");
-    el::Loggers::getLogger("Bucket");
-    el::Loggers::getLogger("Database");
-    el::Loggers::getLogger("History");
-    el::Loggers::getLogger("Process");
-    el::Loggers::getLogger("Ledger");
-    el::Loggers::getLogger("Overlay");
-    el::Loggers::getLogger("Herder");
-    el::Loggers::getLogger("Tx");
-    el::Loggers::getLogger("LoadGen");
+    for (auto partition : kPartitions)
+    {
+        el::Loggers::getLogger(partition);
+    }
 
     gDefaultConf.setToDefault();
     gDefaultConf.setGlobally(el::ConfigurationType::ToStandardOutput, "true");
@@ -68,6 +141,81 @@ Logging::setLoggingToFile(std::string const& filename)
     gDefaultConf.setGlobally(el::ConfigurationType::ToFile, "true");
     gDefaultConf.setGlobally(el::ConfigurationType::Filename, filename);
     el::Loggers::reconfigureAllLoggers(gDefaultConf);
+    updateMinEnabledLevel();
+    gLogFile = filename;
+    if (gAsyncWriter)
+    {
+        gAsyncWriter->setFile(gLogFile);
+    }
+}
+
+std::string
+Logging::getLoggingFile()
+{
+    return gLogFile;
+}
+
+void
+Logging::setAsync(bool async)
+{
+    if (async == isAsync())
+    {
+        return;
+    }
+    if (async)
+    {
+        gAsyncWriter = new AsyncLogWriter();
+        gAsyncWriter->setFile(gLogFile);
+        static bool atExitRegistered = false;
+        if (!atExitRegistered)
+        {
+            std::atexit(flushAtExit);
+            atExitRegistered = true;
+        }
+        el::base::threading::ScopedLock lock(ELPP->lock());
+        el::Helpers::uninstallLogDispatchCallback<
+            el::base::DefaultLogDispatchCallback>(kDefaultDispatchID);
+        el::Helpers::installLogDispatchCallback<AsyncLogDispatch>(
+            kAsyncDispatchID);
+    }
+    else
+    {
+        {
+            el::base::threading::ScopedLock lock(ELPP->lock());
+            el::Helpers::uninstallLogDispatchCallback<AsyncLogDispatch>(
+                kAsyncDispatchID);
+            el::Helpers::installLogDispatchCallback<
+                el::base::DefaultLogDispatchCallback>(kDefaultDispatchID);
+        }
+        delete gAsyncWriter;
+        gAsyncWriter = nullptr;
+    }
+}
+
+bool
+Logging::isAsync()
+{
+    return gAsyncWriter != nullptr;
+}
+
+void
+Logging::flush()
+{
+    if (gAsyncWriter)
+    {
+        gAsyncWriter->flush();
+    }
+}
+
+void
+Logging::updateMinEnabledLevel()
+{
+    int minLevel = STELLAR_LOG_LEVEL_FATAL + 1;
+    for (auto partition : kPartitions)
+    {
+        minLevel = std::min(minLevel, toStellarLevel(getLogLevel(partition)));
+    }
+    gMinEnabledLevel = minLevel;
 }
 
 el::Level
@@ -134,6 +282,7 @@ Logging::setLogLevel(el::Level level, const char* partition)
         el::Loggers::reconfigureLogger(partition, config);
     else
         el::Loggers::reconfigureAllLoggers(config);
+    updateMinEnabledLevel();
 }
 
 
@@ -12,19 +12,70 @@
 //  include this file instead
 #include "lib/util/easylogging++.h"
 
+#include <atomic>
+
+// Levels of CLOG statements, lowest first.
+#define STELLAR_LOG_LEVEL_TRACE 0
+#define STELLAR_LOG_LEVEL_DEBUG 1
+#define STELLAR_LOG_LEVEL_INFO 2
+#define STELLAR_LOG_LEVEL_WARNING 3
+#define STELLAR_LOG_LEVEL_ERROR 4
+#define STELLAR_LOG_LEVEL_FATAL 5
+
+// CLOG statements below this level are compiled out, along with the
+// expressions they would print: build with -DSTELLAR_MIN_LOG_LEVEL=2 to keep
+// only INFO and above.
+#ifndef STELLAR_MIN_LOG_LEVEL
+#define STELLAR_MIN_LOG_LEVEL STELLAR_LOG_LEVEL_TRACE
+#endif
+
+// Statements of a level no partition has enabled are skipped without
+// evaluating what they print, rather than formatted and then dropped by
+// easylogging.
+#undef CLOG
+#define CLOG(LEVEL, ...)                                                       \
+    if (STELLAR_LOG_LEVEL_##LEVEL < STELLAR_MIN_LOG_LEVEL ||                   \
+        STELLAR_LOG_LEVEL_##LEVEL < ::stellar::Logging::minEnabledLevel())     \
+    {                                                                          \
+    }                                                                          \
+    else                                                                       \
+        C##LEVEL(el::base::Writer, el::base::DispatchAction::NormalLog,        \
+                 __VA_ARGS__)
+
 namespace stellar
 {
 class Logging
 {
     static el::Configurations gDefaultConf;
+    static std::atomic<int> gMinEnabledLevel;
+
+    static void updateMinEnabledLevel();
 
   public:
     static void init();
     static void setFmt(std::string const& peerID, bool timestamps=true);
     static void setLoggingToFile(std::string const& filename);
+    // the file given to setLoggingToFile, empty until it is called
+    static std::string getLoggingFile();
     static void setLogLevel(el::Level level, const char* partition);
     static el::Level getLLfromString(std::string const& levelName);
     static el::Level getLogLevel(std::string const& partition);
     static std::string getStringFromLL(el::Level);
+
+    // Hands log lines over to a writer thread instead of writing them on the
+    // thread logging them. Lines are still formatted by the caller, in
+    // order; ERROR and FATAL lines are written out before the call returns.
+    static void setAsync(bool async);
+    static bool isAsync();
+
+    // Waits until every line logged so far is written out.
+    static void flush();
+
+    // lowest STELLAR_LOG_LEVEL_* enabled in any partition
+    static int
+    minEnabledLevel()
+    {
+        return gMinEnabledLevel.load(std::memory_order_relaxed);
+    }
 };
 }
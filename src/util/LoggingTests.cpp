@@ -0,0 +1,171 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Logging.h"
+#include "lib/catch.hpp"
+#include "util/AsyncLogWriter.h"
+#include "util/TmpDir.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+TEST_CASE("async log writer keeps each thread's lines in order", "[logging]")
+{
+    TmpDirManager tdm("logtmp");
+    TmpDir dir(tdm.tmpDir("async"));
+    std::string first = dir.getName() + "/first.log";
+    std::string second = dir.getName() + "/second.log";
+
+    size_t const nThreads = 4;
+    size_t const nLines = 2000;
+    {
+        AsyncLogWriter writer;
+        writer.setFile(first);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < nThreads; ++t)
+        {
+            threads.emplace_back([&writer, t]()
+                                 {
+                                     for (size_t i = 0; i < nLines; ++i)
+                                     {
+                                         std::ostringstream oss;
+                                         oss << t << " " << i << "\n";
+                                         writer.write(oss.str(), false, true);
+                                     }
+                                 });
+        }
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+        writer.flush();
+        REQUIRE(writer.pending() == 0);
+
+        // lines queued after the switch go to the new file, the rest is
+        // written out when the writer goes away
+        writer.setFile(second);
+        writer.write("last\n", false, true);
+    }
+
+    std::ifstream in(first);
+    std::vector<size_t> next(nThreads, 0);
+    size_t t, i;
+    while (in >> t >> i)
+    {
+        REQUIRE(t < nThreads);
+        REQUIRE(i == next[t]);
+        next[t]++;
+    }
+    for (auto n : next)
+    {
+        REQUIRE(n == nLines);
+    }
+
+    std::ifstream in2(second);
+    std::string line;
+    REQUIRE(std::getline(in2, line));
+    REQUIRE(line == "last");
+}
+
+static int gEvaluated = 0;
+
+static int
+evaluate()
+{
+    return ++gEvaluated;
+}
+
+TEST_CASE("disabled log statements are not evaluated", "[logging]")
+{
+    auto saved = Logging::getLogLevel("Tx");
+    Logging::setLogLevel(el::Level::Info, nullptr);
+    REQUIRE(Logging::minEnabledLevel() == STELLAR_LOG_LEVEL_INFO);
+
+    gEvaluated = 0;
+    CLOG(DEBUG, "Tx") << "not evaluated " << evaluate();
+    CLOG(TRACE, "Tx") << "not evaluated " << evaluate();
+    REQUIRE(gEvaluated == 0);
+    CLOG(INFO, "Tx") << "evaluated " << evaluate();
+    REQUIRE(gEvaluated == 1);
+
+    // one partition at DEBUG is enough to evaluate DEBUG statements
+    Logging::setLogLevel(el::Level::Debug, "Overlay");
+    REQUIRE(Logging::minEnabledLevel() == STELLAR_LOG_LEVEL_DEBUG);
+    CLOG(DEBUG, "Tx") << "evaluated " << evaluate();
+    REQUIRE(gEvaluated == 2);
+
+    Logging::setLogLevel(saved, nullptr);
+}
+
+namespace
+{
+// puts logging back as it was, before anything it logged to is deleted
+class LoggingRestorer
+{
+    std::string mFile;
+    bool mAsync;
+    el::Level mLevel;
+
+  public:
+    LoggingRestorer()
+        : mFile(Logging::getLoggingFile())
+        , mAsync(Logging::isAsync())
+        , mLevel(Logging::getLogLevel("Tx"))
+    {
+    }
+
+    ~LoggingRestorer()
+    {
+        Logging::setAsync(mAsync);
+        if (!mFile.empty())
+        {
+            Logging::setLoggingToFile(mFile);
+        }
+        Logging::setLogLevel(mLevel, nullptr);
+    }
+};
+}
+
+TEST_CASE("logging cost on the calling thread", "[logging][bench][hide]")
+{
+    size_t const nLines = 20000;
+
+    TmpDirManager tdm("logtmp");
+    TmpDir dir(tdm.tmpDir("bench"));
+    LoggingRestorer restorer;
+    Logging::setLogLevel(el::Level::Info, nullptr);
+    Logging::setLoggingToFile(dir.getName() + "/bench.log");
+
+    for (bool async : {false, true})
+    {
+        Logging::setAsync(async);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nLines; ++i)
+        {
+            CLOG(INFO, "Tx") << "benchmark line " << i;
+        }
+        std::chrono::duration<double> logging =
+            std::chrono::steady_clock::now() - start;
+        for (size_t i = 0; i < nLines; ++i)
+        {
+            CLOG(DEBUG, "Tx") << "skipped line " << i;
+        }
+        std::chrono::duration<double> skipped =
+            std::chrono::steady_clock::now() - start - logging;
+        Logging::flush();
+        std::chrono::duration<double> total =
+            std::chrono::steady_clock::now() - start;
+
+        LOG(INFO) << (async ? "async" : "sync") << ": " << nLines
+                  << " INFO lines in " << logging.count() << "s ("
+                  << logging.count() * 1e6 / nLines << "us each), " << nLines
+                  << " DEBUG lines skipped in " << skipped.count()
+                  << "s, written out after " << total.count() << "s";
+    }
+}
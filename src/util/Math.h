@@ -16,7 +16,9 @@ size_t rand_pareto(float alpha, size_t max);
 
 bool rand_flip();
 
-extern std::default_random_engine gRandomEngine;
+// one engine per thread, each starting from the default seed unless the
+// thread reseeds it (as the node threads of a Simulation do)
+extern thread_local std::default_random_engine gRandomEngine;
 
 template<typename T> T
 rand_uniform(T lo, T hi)
@@ -0,0 +1,303 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShardedMetrics.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace stellar
+{
+
+// Lock of a cache only ever used from one thread.
+struct NoCacheLock
+{
+    void
+    lock()
+    {
+    }
+    void
+    unlock()
+    {
+    }
+};
+
+// Weighs every entry as 1, making the capacity a number of entries.
+struct UnitCacheWeight
+{
+    template <typename K, typename V>
+    size_t
+    operator()(K const&, V const&) const
+    {
+        return 1;
+    }
+};
+
+/**
+ * A map of bounded total weight, evicting with a segmented LRU policy.
+ *
+ * Entries come in on a probation segment and move to a protected segment
+ * the first time they are looked up again. Eviction takes the least recently
+ * used entries of the probation segment first, so a scan over many keys used
+ * once pushes out other keys used once rather than the working set. The
+ * protected segment holds at most 4/5 of the capacity; entries it overflows
+ * with go back on probation instead of out of the cache.
+ *
+ * `Weight` gives the weight of an entry from its key and value, which lets
+ * the capacity be a number of bytes. `Lock` is NoCacheLock for caches used
+ * from one thread, std::mutex for caches shared between threads.
+ */
+template <typename K, typename V, typename Weight = UnitCacheWeight,
+          typename Lock = NoCacheLock, typename Hash = std::hash<K>>
+class SegmentedCache
+{
+    enum Segment
+    {
+        PROBATION,
+        PROTECTED
+    };
+
+    struct Entry
+    {
+        K mKey;
+        V mValue;
+        size_t mWeight;
+        Segment mSegment;
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef typename EntryList::iterator EntryIt;
+
+    mutable Lock mLock;
+    Weight mWeigh;
+    size_t mCapacity;
+    size_t mProtectedCapacity;
+
+    // most recently used first
+    EntryList mProbation;
+    EntryList mProtected;
+    size_t mProbationWeight;
+    size_t mProtectedWeight;
+    std::unordered_map<K, EntryIt, Hash> mIndex;
+
+    uint64_t mHits;
+    uint64_t mMisses;
+    ShardedMeter* mHitMeter;
+    ShardedMeter* mMissMeter;
+
+    EntryList&
+    entries(Segment segment)
+    {
+        return segment == PROTECTED ? mProtected : mProbation;
+    }
+
+    size_t&
+    segmentWeight(Segment segment)
+    {
+        return segment == PROTECTED ? mProtectedWeight : mProbationWeight;
+    }
+
+    // moves `it` to the front of `segment`
+    void
+    moveTo(EntryIt it, Segment segment)
+    {
+        segmentWeight(it->mSegment) -= it->mWeight;
+        segmentWeight(segment) += it->mWeight;
+        entries(segment).splice(entries(segment).begin(),
+                                entries(it->mSegment), it);
+        it->mSegment = segment;
+    }
+
+    void
+    promote(EntryIt it)
+    {
+        moveTo(it, PROTECTED);
+        while (mProtectedWeight > mProtectedCapacity &&
+               std::prev(mProtected.end()) != it)
+        {
+            moveTo(std::prev(mProtected.end()), PROBATION);
+        }
+    }
+
+    void
+    remove(EntryIt it)
+    {
+        segmentWeight(it->mSegment) -= it->mWeight;
+        mIndex.erase(it->mKey);
+        entries(it->mSegment).erase(it);
+    }
+
+    // evicts until `weight` more fits
+    void
+    makeRoom(size_t weight)
+    {
+        while (!mIndex.empty() &&
+               mProbationWeight + mProtectedWeight + weight > mCapacity)
+        {
+            auto& victims = mProbation.empty() ? mProtected : mProbation;
+            remove(std::prev(victims.end()));
+        }
+    }
+
+  public:
+    explicit SegmentedCache(size_t capacity, Weight weigh = Weight())
+        : mWeigh(weigh)
+        , mCapacity(capacity)
+        , mProtectedCapacity(capacity - capacity / 5)
+        , mProbationWeight(0)
+        , mProtectedWeight(0)
+        , mHits(0)
+        , mMisses(0)
+        , mHitMeter(nullptr)
+        , mMissMeter(nullptr)
+    {
+    }
+
+    // marks the meters {domain, type, "hit"} and {domain, type, "miss"} on
+    // every lookup through maybeGet; sharded, as caches sit on hot paths
+    void
+    trackMetrics(ShardedMetrics& metrics, std::string const& domain,
+                 std::string const& type)
+    {
+        std::lock_guard<Lock> guard(mLock);
+        mHitMeter = &metrics.NewMeter({domain, type, "hit"}, "lookup");
+        mMissMeter = &metrics.NewMeter({domain, type, "miss"}, "lookup");
+    }
+
+    // Copies the value cached for `key` into `value`, returning false if
+    // there is none. Counts as a use of `key`.
+    bool
+    maybeGet(K const& key, V& value)
+    {
+        std::lock_guard<Lock> guard(mLock);
+        auto found = mIndex.find(key);
+        if (found == mIndex.end())
+        {
+            mMisses++;
+            if (mMissMeter)
+            {
+                mMissMeter->Mark();
+            }
+            return false;
+        }
+        mHits++;
+        if (mHitMeter)
+        {
+            mHitMeter->Mark();
+        }
+        promote(found->second);
+        value = found->second->mValue;
+        return true;
+    }
+
+    // Does not count as a use of `key`.
+    bool
+    exists(K const& key) const
+    {
+        std::lock_guard<Lock> guard(mLock);
+        return mIndex.find(key) != mIndex.end();
+    }
+
+    // Replacing the value of a cached key counts as a use of it. Entries
+    // heavier than the whole capacity are not cached.
+    void
+    put(K const& key, V const& value)
+    {
+        std::lock_guard<Lock> guard(mLock);
+        bool wasCached = false;
+        auto found = mIndex.find(key);
+        if (found != mIndex.end())
+        {
+            remove(found->second);
+            wasCached = true;
+        }
+        size_t weight = mWeigh(key, value);
+        if (weight > mCapacity)
+        {
+            return;
+        }
+        makeRoom(weight);
+        mProbation.push_front(Entry{key, value, weight, PROBATION});
+        mProbationWeight += weight;
+        mIndex.emplace(key, mProbation.begin());
+        if (wasCached)
+        {
+            promote(mProbation.begin());
+        }
+    }
+
+    void
+    erase(K const& key)
+    {
+        std::lock_guard<Lock> guard(mLock);
+        auto found = mIndex.find(key);
+        if (found != mIndex.end())
+        {
+            remove(found->second);
+        }
+    }
+
+    void
+    clear()
+    {
+        std::lock_guard<Lock> guard(mLock);
+        mIndex.clear();
+        mProbation.clear();
+        mProtected.clear();
+        mProbationWeight = 0;
+        mProtectedWeight = 0;
+    }
+
+    // evicts what no longer fits; 0 leaves nothing cached
+    void
+    setCapacity(size_t capacity)
+    {
+        std::lock_guard<Lock> guard(mLock);
+        mCapacity = capacity;
+        mProtectedCapacity = capacity - capacity / 5;
+        while (mProtectedWeight > mProtectedCapacity)
+        {
+            moveTo(std::prev(mProtected.end()), PROBATION);
+        }
+        makeRoom(0);
+    }
+
+    size_t
+    size() const
+    {
+        std::lock_guard<Lock> guard(mLock);
+        return mIndex.size();
+    }
+
+    size_t
+    weight() const
+    {
+        std::lock_guard<Lock> guard(mLock);
+        return mProbationWeight + mProtectedWeight;
+    }
+
+    // lookups through maybeGet that found a value, and those that did not
+    uint64_t
+    hits() const
+    {
+        std::lock_guard<Lock> guard(mLock);
+        return mHits;
+    }
+
+    uint64_t
+    misses() const
+    {
+        std::lock_guard<Lock> guard(mLock);
+        return mMisses;
+    }
+};
+}
@@ -0,0 +1,257 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/SegmentedCache.h"
+#include "lib/catch.hpp"
+#include "lib/util/lrucache.hpp"
+#include "util/Logging.h"
+#include "util/Math.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+namespace
+{
+struct StringWeight
+{
+    size_t
+    operator()(int, std::string const& value) const
+    {
+        return value.size();
+    }
+};
+}
+
+TEST_CASE("segmented cache basics", "[cache]")
+{
+    SegmentedCache<int, int> cache(3);
+    int v = 0;
+    REQUIRE(!cache.maybeGet(1, v));
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(3, 30);
+    REQUIRE(cache.size() == 3);
+    REQUIRE(cache.maybeGet(1, v));
+    REQUIRE(v == 10);
+
+    // 2 is the least recently used entry on probation
+    cache.put(4, 40);
+    REQUIRE(cache.size() == 3);
+    REQUIRE(!cache.exists(2));
+    REQUIRE(cache.exists(1));
+    REQUIRE(cache.exists(3));
+
+    cache.put(1, 11);
+    REQUIRE(cache.maybeGet(1, v));
+    REQUIRE(v == 11);
+
+    cache.erase(1);
+    REQUIRE(!cache.exists(1));
+    REQUIRE(cache.hits() == 2);
+    REQUIRE(cache.misses() == 1);
+
+    cache.clear();
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.weight() == 0);
+}
+
+TEST_CASE("segmented cache keeps its working set through scans", "[cache]")
+{
+    size_t const capacity = 100;
+    SegmentedCache<int, int> cache(capacity);
+    cache::lru_cache<int, int> lru(capacity);
+
+    int const nHot = 50;
+    for (int i = 0; i < nHot; ++i)
+    {
+        int v;
+        cache.put(i, i);
+        REQUIRE(cache.maybeGet(i, v));
+        lru.put(i, i);
+        lru.get(i);
+    }
+
+    for (int i = nHot; i < 100 * nHot; ++i)
+    {
+        cache.put(i, i);
+        lru.put(i, i);
+    }
+
+    for (int i = 0; i < nHot; ++i)
+    {
+        REQUIRE(cache.exists(i));
+        REQUIRE(!lru.exists(i));
+    }
+    REQUIRE(cache.size() == capacity);
+}
+
+TEST_CASE("segmented cache capacity in bytes", "[cache]")
+{
+    SegmentedCache<int, std::string, StringWeight> cache(10);
+    cache.put(1, "aaaa");
+    cache.put(2, "bbbb");
+    REQUIRE(cache.weight() == 8);
+
+    cache.put(3, "cccc");
+    REQUIRE(cache.weight() == 8);
+    REQUIRE(!cache.exists(1));
+
+    // too heavy to cache at all
+    cache.put(4, "dddddddddddd");
+    REQUIRE(!cache.exists(4));
+    REQUIRE(cache.weight() == 8);
+
+    cache.setCapacity(5);
+    REQUIRE(cache.size() == 1);
+    cache.setCapacity(0);
+    REQUIRE(cache.size() == 0);
+    cache.put(5, "e");
+    REQUIRE(!cache.exists(5));
+}
+
+TEST_CASE("segmented cache metrics", "[cache]")
+{
+    medida::MetricsRegistry registry;
+    ShardedMetrics sharded(registry);
+    SegmentedCache<int, int> cache(10);
+    cache.trackMetrics(sharded, "test", "cache");
+
+    int v;
+    cache.put(1, 1);
+    cache.maybeGet(1, v);
+    cache.maybeGet(2, v);
+    cache.maybeGet(3, v);
+    sharded.flush();
+    REQUIRE(registry.NewMeter({"test", "cache", "hit"}, "lookup").count() ==
+            1);
+    REQUIRE(registry.NewMeter({"test", "cache", "miss"}, "lookup").count() ==
+            2);
+}
+
+TEST_CASE("segmented cache shared between threads", "[cache]")
+{
+    SegmentedCache<int, int, UnitCacheWeight, std::mutex> cache(64);
+    std::atomic<size_t> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&cache, &wrong, t]()
+                             {
+                                 for (int i = 0; i < 20000; ++i)
+                                 {
+                                     int key = (i * 7 + t) % 200;
+                                     int v;
+                                     if (cache.maybeGet(key, v))
+                                     {
+                                         if (v != key * 2)
+                                         {
+                                             wrong++;
+                                         }
+                                     }
+                                     else
+                                     {
+                                         cache.put(key, key * 2);
+                                     }
+                                 }
+                             });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(cache.size() <= 64);
+    REQUIRE(cache.hits() + cache.misses() == 4 * 20000);
+}
+
+namespace
+{
+// Keys looked up the way ledger entries are: a skewed working set of
+// accounts, optionally interrupted by scans over keys seen once (as when
+// replaying history or applying buckets).
+std::vector<int>
+makeTrace(size_t nLookups, size_t nKeys, size_t scanEvery, size_t scanLength)
+{
+    std::vector<int> trace;
+    trace.reserve(nLookups);
+    int nextScanKey = static_cast<int>(nKeys);
+    while (trace.size() < nLookups)
+    {
+        if (scanEvery != 0 && trace.size() % scanEvery == 0 &&
+            !trace.empty())
+        {
+            for (size_t i = 0; i < scanLength; ++i)
+            {
+                trace.push_back(nextScanKey++);
+            }
+        }
+        trace.push_back(static_cast<int>(rand_pareto(0.5f, nKeys)));
+    }
+    return trace;
+}
+
+template <typename Lookup>
+void
+replay(std::string const& name, std::vector<int> const& trace, Lookup lookup)
+{
+    size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto key : trace)
+    {
+        if (lookup(key))
+        {
+            hits++;
+        }
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    LOG(INFO) << name << ": hit rate " << (100.0 * hits / trace.size())
+              << "%, " << (trace.size() / elapsed.count()) << " lookups/s";
+}
+}
+
+TEST_CASE("segmented cache against lru cache", "[cache][bench][hide]")
+{
+    size_t const capacity = 4096;
+    size_t const nLookups = 2000000;
+    size_t const nKeys = 50000;
+
+    for (size_t scanEvery : {0, 10000, 1000})
+    {
+        auto trace = makeTrace(nLookups, nKeys, scanEvery, 2000);
+        LOG(INFO) << trace.size() << " lookups, scans of 2000 keys every "
+                  << scanEvery << " lookups";
+
+        cache::lru_cache<int, int> lru(capacity);
+        replay("lru", trace, [&lru](int key)
+               {
+                   if (lru.exists(key))
+                   {
+                       lru.get(key);
+                       return true;
+                   }
+                   lru.put(key, key);
+                   return false;
+               });
+
+        SegmentedCache<int, int> segmented(capacity);
+        replay("segmented", trace, [&segmented](int key)
+               {
+                   int v;
+                   if (segmented.maybeGet(key, v))
+                   {
+                       return true;
+                   }
+                   segmented.put(key, key);
+                   return false;
+               });
+    }
+}
@@ -0,0 +1,220 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShardedMetrics.h"
+
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+namespace stellar
+{
+
+// samples a shard of a timer or histogram holds before flushing itself
+static size_t const MAX_BUFFERED_SAMPLES = 256;
+
+static std::atomic<uint64_t> gNextRegistryID{1};
+
+namespace sharded
+{
+size_t
+thisShard()
+{
+    static std::atomic<size_t> nextShard{0};
+    static thread_local size_t const shard = nextShard++ % SHARDS;
+    return shard;
+}
+}
+
+ShardedMeter::ShardedMeter(medida::Meter& meter) : mMeter(meter)
+{
+}
+
+void
+ShardedMeter::flush()
+{
+    uint64_t total = 0;
+    for (auto& shard : mShards)
+    {
+        total += shard.mCount.exchange(0, std::memory_order_relaxed);
+    }
+    if (total != 0)
+    {
+        mMeter.Mark(total);
+    }
+}
+
+ShardedHistogram::ShardedHistogram(medida::Histogram& histogram)
+    : mHistogram(histogram)
+{
+}
+
+void
+ShardedHistogram::Update(int64_t value)
+{
+    auto& shard = mShards[sharded::thisShard()];
+    std::unique_lock<std::mutex> guard(shard.mMutex);
+    shard.mSamples.push_back(value);
+    if (shard.mSamples.size() >= MAX_BUFFERED_SAMPLES)
+    {
+        guard.unlock();
+        flush(shard);
+    }
+}
+
+void
+ShardedHistogram::flush(Shard& shard)
+{
+    std::vector<int64_t> samples;
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        samples.swap(shard.mSamples);
+        shard.mSamples.reserve(samples.size());
+    }
+    for (auto s : samples)
+    {
+        mHistogram.Update(s);
+    }
+}
+
+void
+ShardedHistogram::flush()
+{
+    for (auto& shard : mShards)
+    {
+        flush(shard);
+    }
+}
+
+ShardedTimer::Context::Context(ShardedTimer& timer)
+    : mTimer(&timer), mStart(std::chrono::steady_clock::now())
+{
+}
+
+ShardedTimer::Context::Context(Context&& other)
+    : mTimer(other.mTimer), mStart(other.mStart)
+{
+    other.mTimer = nullptr;
+}
+
+ShardedTimer::Context::~Context()
+{
+    Stop();
+}
+
+std::chrono::nanoseconds
+ShardedTimer::Context::Stop()
+{
+    std::chrono::nanoseconds elapsed(0);
+    if (mTimer)
+    {
+        elapsed = std::chrono::steady_clock::now() - mStart;
+        mTimer->Update(elapsed);
+        mTimer = nullptr;
+    }
+    return elapsed;
+}
+
+ShardedTimer::ShardedTimer(medida::Timer& timer) : mTimer(timer)
+{
+}
+
+void
+ShardedTimer::Update(std::chrono::nanoseconds duration)
+{
+    auto& shard = mShards[sharded::thisShard()];
+    std::unique_lock<std::mutex> guard(shard.mMutex);
+    shard.mSamples.push_back(duration);
+    if (shard.mSamples.size() >= MAX_BUFFERED_SAMPLES)
+    {
+        guard.unlock();
+        flush(shard);
+    }
+}
+
+void
+ShardedTimer::flush(Shard& shard)
+{
+    std::vector<std::chrono::nanoseconds> samples;
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        samples.swap(shard.mSamples);
+        shard.mSamples.reserve(samples.size());
+    }
+    for (auto s : samples)
+    {
+        mTimer.Update(s);
+    }
+}
+
+void
+ShardedTimer::flush()
+{
+    for (auto& shard : mShards)
+    {
+        flush(shard);
+    }
+}
+
+ShardedMetrics::ShardedMetrics(medida::MetricsRegistry& registry)
+    : mRegistry(registry), mID(gNextRegistryID++)
+{
+}
+
+ShardedMeter&
+ShardedMetrics::NewMeter(medida::MetricName const& name,
+                         std::string const& eventType)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    auto& m = mMeters[name];
+    if (!m)
+    {
+        m.reset(new ShardedMeter(mRegistry.NewMeter(name, eventType)));
+    }
+    return *m;
+}
+
+ShardedHistogram&
+ShardedMetrics::NewHistogram(medida::MetricName const& name)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    auto& h = mHistograms[name];
+    if (!h)
+    {
+        h.reset(new ShardedHistogram(mRegistry.NewHistogram(name)));
+    }
+    return *h;
+}
+
+ShardedTimer&
+ShardedMetrics::NewTimer(medida::MetricName const& name)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    auto& t = mTimers[name];
+    if (!t)
+    {
+        t.reset(new ShardedTimer(mRegistry.NewTimer(name)));
+    }
+    return *t;
+}
+
+void
+ShardedMetrics::flush()
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    for (auto& kv : mMeters)
+    {
+        kv.second->flush();
+    }
+    for (auto& kv : mHistograms)
+    {
+        kv.second->flush();
+    }
+    for (auto& kv : mTimers)
+    {
+        kv.second->flush();
+    }
+}
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "medida/metric_name.h"
+#include "util/NonCopyable.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <vector>
+
+namespace medida
+{
+class Histogram;
+class Meter;
+class MetricsRegistry;
+class Timer;
+}
+
+/*
+Metrics for hot paths, recorded without going through medida's locks.
+
+Each wrapper sits in front of a regular medida metric of the same name and
+records into one of a few shards, picked per thread, so that threads updating
+the same metric don't share a cache line or a lock. ShardedMetrics::flush folds
+what was recorded into the medida metrics; Application::syncAllMetrics runs it,
+so the `metrics` command reports everything recorded so far. Meter rates only
+move at flushes, and a shard of a timer or histogram flushes itself once it
+holds a few hundred samples.
+
+Looking a metric up by name takes a lock: hot paths keep the returned
+reference, or a struct of them obtained through ShardedMetrics::getHandles.
+*/
+
+namespace stellar
+{
+
+namespace sharded
+{
+size_t const SHARDS = 16;
+
+// shard of the calling thread
+size_t thisShard();
+}
+
+class ShardedMeter : NonMovableOrCopyable
+{
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> mCount{0};
+    };
+
+    medida::Meter& mMeter;
+    std::array<Shard, sharded::SHARDS> mShards;
+
+  public:
+    explicit ShardedMeter(medida::Meter& meter);
+
+    void
+    Mark(uint64_t n = 1)
+    {
+        mShards[sharded::thisShard()].mCount.fetch_add(
+            n, std::memory_order_relaxed);
+    }
+
+    void flush();
+};
+
+class ShardedHistogram : NonMovableOrCopyable
+{
+    struct alignas(64) Shard
+    {
+        std::mutex mMutex;
+        std::vector<int64_t> mSamples;
+    };
+
+    medida::Histogram& mHistogram;
+    std::array<Shard, sharded::SHARDS> mShards;
+
+    void flush(Shard& shard);
+
+  public:
+    explicit ShardedHistogram(medida::Histogram& histogram);
+
+    void Update(int64_t value);
+
+    void flush();
+};
+
+class ShardedTimer : NonMovableOrCopyable
+{
+    struct alignas(64) Shard
+    {
+        std::mutex mMutex;
+        std::vector<std::chrono::nanoseconds> mSamples;
+    };
+
+    medida::Timer& mTimer;
+    std::array<Shard, sharded::SHARDS> mShards;
+
+    void flush(Shard& shard);
+
+  public:
+    // Records the time it is alive for, or until Stop.
+    class Context : NonCopyable
+    {
+        ShardedTimer* mTimer;
+        std::chrono::steady_clock::time_point mStart;
+
+      public:
+        explicit Context(ShardedTimer& timer);
+        Context(Context&& other);
+        ~Context();
+        std::chrono::nanoseconds Stop();
+    };
+
+    explicit ShardedTimer(medida::Timer& timer);
+
+    void Update(std::chrono::nanoseconds duration);
+
+    Context
+    TimeScope()
+    {
+        return Context(*this);
+    }
+
+    void flush();
+};
+
+class ShardedMetrics : NonMovableOrCopyable
+{
+    medida::MetricsRegistry& mRegistry;
+    // tells apart registries of successive applications in the per-thread
+    // caches of getHandles
+    uint64_t const mID;
+
+    std::mutex mMutex;
+    std::map<medida::MetricName, std::unique_ptr<ShardedMeter>> mMeters;
+    std::map<medida::MetricName, std::unique_ptr<ShardedHistogram>>
+        mHistograms;
+    std::map<medida::MetricName, std::unique_ptr<ShardedTimer>> mTimers;
+
+    // held while constructing handles, which takes mMutex
+    std::mutex mHandlesMutex;
+    std::map<std::type_index, std::shared_ptr<void>> mHandles;
+
+    template <typename T>
+    T&
+    lookupHandles()
+    {
+        std::lock_guard<std::mutex> guard(mHandlesMutex);
+        auto& handles = mHandles[std::type_index(typeid(T))];
+        if (!handles)
+        {
+            handles = std::make_shared<T>(*this);
+        }
+        return *static_cast<T*>(handles.get());
+    }
+
+  public:
+    explicit ShardedMetrics(medida::MetricsRegistry& registry);
+
+    ShardedMeter& NewMeter(medida::MetricName const& name,
+                           std::string const& eventType);
+    ShardedHistogram& NewHistogram(medida::MetricName const& name);
+    ShardedTimer& NewTimer(medida::MetricName const& name);
+
+    // The single instance of T for this registry, constructed from it on
+    // first use: a struct holding the metrics of some hot path. The lookup
+    // is lock free after the first one from a given thread.
+    template <typename T>
+    T&
+    getHandles()
+    {
+        static thread_local uint64_t cachedID = 0;
+        static thread_local T* cached = nullptr;
+        if (cachedID != mID)
+        {
+            cached = &lookupHandles<T>();
+            cachedID = mID;
+        }
+        return *cached;
+    }
+
+    // Folds everything recorded so far into the medida metrics.
+    void flush();
+};
+}
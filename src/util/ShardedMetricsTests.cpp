@@ -0,0 +1,149 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/ShardedMetrics.h"
+#include "lib/catch.hpp"
+#include "util/Logging.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+namespace
+{
+struct TestHandles
+{
+    ShardedMeter& mMeter;
+    explicit TestHandles(ShardedMetrics& metrics)
+        : mMeter(metrics.NewMeter({"test", "handles", "meter"}, "event"))
+    {
+    }
+};
+
+template <typename F>
+void
+runThreads(size_t nThreads, F f)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        threads.emplace_back(f);
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+}
+
+TEST_CASE("sharded metrics add up after flush", "[metrics]")
+{
+    medida::MetricsRegistry registry;
+    ShardedMetrics metrics(registry);
+
+    size_t const nThreads = 8;
+    size_t const nEvents = 10000;
+
+    auto& meter = metrics.NewMeter({"test", "sharded", "meter"}, "event");
+    auto& histogram = metrics.NewHistogram({"test", "sharded", "histogram"});
+    auto& timer = metrics.NewTimer({"test", "sharded", "timer"});
+    REQUIRE(&meter == &metrics.NewMeter({"test", "sharded", "meter"}, "event"));
+
+    runThreads(nThreads, [&]()
+               {
+                   for (size_t i = 0; i < nEvents; ++i)
+                   {
+                       meter.Mark();
+                       histogram.Update(i);
+                       timer.Update(std::chrono::microseconds(1));
+                       metrics.getHandles<TestHandles>().mMeter.Mark(2);
+                   }
+               });
+
+    auto& rawMeter = registry.NewMeter({"test", "sharded", "meter"}, "event");
+    auto& rawTimer = registry.NewTimer({"test", "sharded", "timer"});
+    auto& rawHistogram =
+        registry.NewHistogram({"test", "sharded", "histogram"});
+    auto& rawHandles = registry.NewMeter({"test", "handles", "meter"}, "event");
+
+    // histograms and timers flush by themselves once a shard fills up
+    REQUIRE(rawMeter.count() == 0);
+    REQUIRE(rawTimer.count() < nThreads * nEvents);
+
+    metrics.flush();
+    REQUIRE(rawMeter.count() == nThreads * nEvents);
+    REQUIRE(rawHistogram.count() == nThreads * nEvents);
+    REQUIRE(rawTimer.count() == nThreads * nEvents);
+    REQUIRE(rawHandles.count() == 2 * nThreads * nEvents);
+
+    // nothing is counted twice
+    metrics.flush();
+    REQUIRE(rawMeter.count() == nThreads * nEvents);
+    REQUIRE(rawTimer.count() == nThreads * nEvents);
+
+    {
+        auto ctx = timer.TimeScope();
+    }
+    metrics.flush();
+    REQUIRE(rawTimer.count() == nThreads * nEvents + 1);
+}
+
+TEST_CASE("sharded metrics handles follow the registry", "[metrics]")
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        medida::MetricsRegistry registry;
+        ShardedMetrics metrics(registry);
+        metrics.getHandles<TestHandles>().mMeter.Mark();
+        metrics.flush();
+        REQUIRE(registry.NewMeter({"test", "handles", "meter"}, "event")
+                    .count() == 1);
+    }
+}
+
+TEST_CASE("sharded meter contention", "[metrics][bench][hide]")
+{
+    size_t const nEvents = 1000000;
+
+    for (size_t nThreads : {1, 2, 4, 8})
+    {
+        medida::MetricsRegistry registry;
+        ShardedMetrics metrics(registry);
+        auto& raw = registry.NewMeter({"bench", "raw", "meter"}, "event");
+        auto& sharded =
+            metrics.NewMeter({"bench", "sharded", "meter"}, "event");
+
+        auto start = std::chrono::steady_clock::now();
+        runThreads(nThreads, [&]()
+                   {
+                       for (size_t i = 0; i < nEvents; ++i)
+                       {
+                           raw.Mark();
+                       }
+                   });
+        std::chrono::duration<double> rawElapsed =
+            std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        runThreads(nThreads, [&]()
+                   {
+                       for (size_t i = 0; i < nEvents; ++i)
+                       {
+                           sharded.Mark();
+                       }
+                   });
+        metrics.flush();
+        std::chrono::duration<double> shardedElapsed =
+            std::chrono::steady_clock::now() - start;
+
+        LOG(INFO) << nThreads << " threads, " << nThreads * nEvents
+                  << " marks: medida " << rawElapsed.count() << "s, sharded "
+                  << shardedElapsed.count() << "s";
+    }
+}
@@ -8,17 +8,22 @@
 #include "util/Logging.h"
 #include <thread>
 #include "util/GlobalChecks.h"
+#include "util/TimerWheel.h"
+#include "util/make_unique.h"
 
 namespace stellar
 {
 
 using namespace std;
 
+const size_t VirtualClock::MAX_POOLED_EVENTS = 1024;
+
 VirtualClock::VirtualClock(Mode mode) : mRealTimer(mIOService), mMode(mode)
 {
     if (mMode == REAL_TIME)
     {
         mNow = std::chrono::system_clock::now();
+        mWheel = make_unique<TimerWheel>(mNow);
     }
 }
 
@@ -62,6 +67,10 @@ VirtualClock::time_point
 VirtualClock::next()
 {
     assertThreadIsMain();
+    if (mWheel)
+    {
+        return mWheel->nextWakeup();
+    }
     VirtualClock::time_point least = time_point::max();
     if (!mEvents.empty())
     {
@@ -145,15 +154,52 @@ VirtualClock::enqueue(shared_ptr<VirtualClockEvent> ve)
         return;
     }
     // LOG(DEBUG) << "VirtualClock::enqueue";
-    mEvents.emplace(ve);
+    if (mWheel)
+    {
+        mWheel->insert(ve);
+    }
+    else
+    {
+        mEvents.emplace(ve);
+    }
     assertThreadIsMain();
 }
 
+shared_ptr<VirtualClockEvent>
+VirtualClock::newEvent(time_point when,
+                       std::function<void(asio::error_code)> callback)
+{
+    if (mEventPool.empty())
+    {
+        return make_shared<VirtualClockEvent>(when, callback);
+    }
+    auto ve = mEventPool.back();
+    mEventPool.pop_back();
+    ve->reset(when, callback);
+    return ve;
+}
+
+void
+VirtualClock::releaseEvent(shared_ptr<VirtualClockEvent> ve)
+{
+    if (ve->mInWheel)
+    {
+        mWheel->remove(*ve);
+    }
+    // Events still sitting in the heap, or held elsewhere, are left alone.
+    if (ve.use_count() == 1 && ve->getTriggered() &&
+        mEventPool.size() < MAX_POOLED_EVENTS)
+    {
+        mEventPool.emplace_back(std::move(ve));
+    }
+}
+
 void
 VirtualClock::flushCancelledEvents()
 {
-    if (mDestructing)
+    if (mDestructing || mWheel)
     {
+        // The wheel removes cancelled events eagerly.
         return;
     }
     if (mFlushesIgnored <= mEvents.size())
@@ -190,6 +236,17 @@ VirtualClock::cancelAllEvents()
 {
     assertThreadIsMain();
 
+    if (mWheel)
+    {
+        vector<shared_ptr<VirtualClockEvent>> pending;
+        mWheel->clear(pending);
+        for (auto const& ev : pending)
+        {
+            ev->cancel();
+        }
+        return !pending.empty();
+    }
+
     bool wasEmpty = mEvents.empty();
     while (!mEvents.empty())
     {
@@ -280,6 +337,10 @@ VirtualClock::advanceTo(time_point n)
     //            << n.time_since_epoch().count() << ")";
     mNow = n;
     vector<shared_ptr<VirtualClockEvent>> toDispatch;
+    if (mWheel)
+    {
+        mWheel->advance(mNow, toDispatch);
+    }
     while (!mEvents.empty())
     {
         if (mEvents.top()->mWhen > mNow)
@@ -290,10 +351,14 @@ VirtualClock::advanceTo(time_point n)
     // Keep the dispatch loop separate from the pop()-ing loop
     // so the triggered events can't mutate the priority queue
     // from underneat us while we are looping.
-    for (auto ev : toDispatch)
+    for (auto const& ev : toDispatch)
     {
         ev->trigger();
     }
+    for (auto& ev : toDispatch)
+    {
+        releaseEvent(std::move(ev));
+    }
     // LOG(DEBUG) << "VirtualClock::advanceTo done";
     maybeSetRealtimer();
     return toDispatch.size();
@@ -318,8 +383,24 @@ VirtualClock::advanceToNext()
 VirtualClockEvent::VirtualClockEvent(
     VirtualClock::time_point when,
     std::function<void(asio::error_code)> callback)
-    : mCallback(callback), mTriggered(false), mWhen(when)
+    : mCallback(callback)
+    , mTriggered(false)
+    , mInWheel(false)
+    , mWheelLevel(0)
+    , mWheelSlot(0)
+    , mWheelIndex(0)
+    , mWhen(when)
+{
+}
+
+void
+VirtualClockEvent::reset(VirtualClock::time_point when,
+                         std::function<void(asio::error_code)> callback)
 {
+    assert(!mInWheel);
+    mCallback = callback;
+    mTriggered = false;
+    mWhen = when;
 }
 
 bool
@@ -381,9 +462,13 @@ VirtualTimer::cancel()
     if (!mCancelled)
     {
         mCancelled = true;
-        for (auto ev : mEvents)
+        // Swap the events out first: a cancel callback may re-arm this timer.
+        vector<shared_ptr<VirtualClockEvent>> events;
+        events.swap(mEvents);
+        for (auto& ev : events)
         {
             ev->cancel();
+            mClock.releaseEvent(std::move(ev));
         }
         mClock.flushCancelledEvents();
     }
@@ -411,7 +496,7 @@ VirtualTimer::async_wait(function<void(asio::error_code)> const& fn)
     if (!mCancelled)
     {
         assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(mExpiryTime, fn);
+        auto ve = mClock.newEvent(mExpiryTime, fn);
         mClock.enqueue(ve);
         mEvents.push_back(ve);
     }
@@ -424,7 +509,7 @@ VirtualTimer::async_wait(std::function<void()> const& onSuccess,
     if (!mCancelled)
     {
         assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(
+        auto ve = mClock.newEvent(
             mExpiryTime, [onSuccess, onFailure](asio::error_code error)
             {
                 if (error)
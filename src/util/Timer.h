@@ -48,6 +48,7 @@ namespace stellar
 class VirtualTimer;
 class Application;
 class VirtualClockEvent;
+class TimerWheel;
 class VirtualClockEventCompare
 {
   public:
@@ -116,6 +117,15 @@ class VirtualClock
     PrQueue mEvents;
     size_t mFlushesIgnored = 0;
 
+    // In REAL_TIME mode pending events live in a timer wheel instead of
+    // mEvents, which makes scheduling and cancelling O(1). Virtual time keeps
+    // the heap: it dispatches in exact deadline order, which tests rely on.
+    std::unique_ptr<TimerWheel> mWheel;
+
+    // Events no longer referenced by anyone, kept for reuse by newEvent().
+    static const size_t MAX_POOLED_EVENTS;
+    std::vector<std::shared_ptr<VirtualClockEvent>> mEventPool;
+
     bool mDestructing{false};
 
     time_point next();
@@ -142,6 +152,15 @@ class VirtualClock
 
     void enqueue(std::shared_ptr<VirtualClockEvent> ve);
     void flushCancelledEvents();
+
+    // Allocate an event, reusing a pooled one if possible.
+    std::shared_ptr<VirtualClockEvent>
+    newEvent(time_point when, std::function<void(asio::error_code)> callback);
+
+    // Called by the owner of a cancelled or triggered event when dropping its
+    // reference: removes the event from the wheel and, if nothing else refers
+    // to it, returns it to the pool.
+    void releaseEvent(std::shared_ptr<VirtualClockEvent> ve);
     bool cancelAllEvents();
 
     // only valid with VIRTUAL_TIME: sets the current value
@@ -154,6 +173,18 @@ class VirtualClockEvent : public NonMovableOrCopyable
     std::function<void(asio::error_code)> mCallback;
     bool mTriggered;
 
+    // Position in the owning clock's TimerWheel, if any.
+    bool mInWheel;
+    size_t mWheelLevel;
+    size_t mWheelSlot;
+    size_t mWheelIndex;
+
+    void reset(VirtualClock::time_point when,
+               std::function<void(asio::error_code)> callback);
+
+    friend class VirtualClock;
+    friend class TimerWheel;
+
   public:
     VirtualClock::time_point mWhen;
     VirtualClockEvent(VirtualClock::time_point when,
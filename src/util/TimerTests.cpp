@@ -10,6 +10,11 @@
 #include "lib/catch.hpp"
 #include "util/Logging.h"
 #include "util/make_unique.h"
+#include "util/TimerWheel.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
 
 using namespace stellar;
 
@@ -228,3 +233,132 @@ TEST_CASE("timer cancels", "[timer]")
 
 
 }
+
+TEST_CASE("timer wheel fires each event once, never early", "[timer]")
+{
+    using std::chrono::milliseconds;
+    using std::chrono::nanoseconds;
+
+    std::default_random_engine gen;
+    VirtualClock::time_point now(std::chrono::hours(24 * 365 * 45));
+    TimerWheel wheel(now);
+
+    // Mostly near deadlines, plus some beyond the wheel's range.
+    std::vector<std::shared_ptr<VirtualClockEvent>> events;
+    for (int i = 0; i < 10000; ++i)
+    {
+        int64_t maxNs = (i % 10 == 0) ? int64_t(2) * 1000000 * 1000000 * 1000
+                                      : int64_t(5) * 1000000 * 1000;
+        auto offset = nanoseconds(
+            std::uniform_int_distribution<int64_t>(0, maxNs)(gen));
+        events.push_back(std::make_shared<VirtualClockEvent>(
+            now + std::chrono::duration_cast<VirtualClock::duration>(offset),
+            [](asio::error_code const&)
+            {
+            }));
+        wheel.insert(events.back());
+    }
+    std::set<VirtualClockEvent*> removed;
+    for (size_t i = 0; i < events.size(); i += 7)
+    {
+        wheel.remove(*events[i]);
+        removed.insert(events[i].get());
+    }
+    REQUIRE(wheel.size() == events.size() - removed.size());
+
+    std::set<VirtualClockEvent*> fired;
+    while (wheel.size() != 0)
+    {
+        auto next = now + milliseconds(
+                              std::uniform_int_distribution<int>(0, 50)(gen));
+        if (gen() % 3 == 0)
+        {
+            next = std::max(now, wheel.nextWakeup());
+        }
+        else if (gen() % 100 == 0)
+        {
+            next = now + std::chrono::hours(24 * 30);
+        }
+
+        std::vector<std::shared_ptr<VirtualClockEvent>> due;
+        wheel.advance(next, due);
+        for (auto const& ev : due)
+        {
+            REQUIRE(removed.find(ev.get()) == removed.end());
+            REQUIRE(fired.insert(ev.get()).second);
+            REQUIRE(ev->mWhen <= next);
+            // Anything due by the previous advance, rounded up to the next
+            // tick, must have fired then.
+            REQUIRE(ev->mWhen + milliseconds(1) >= now);
+        }
+        now = next;
+    }
+    REQUIRE(fired.size() == events.size() - removed.size());
+}
+
+TEST_CASE("real-time timers dispatch in deadline order", "[timer]")
+{
+    VirtualClock clock(VirtualClock::REAL_TIME);
+
+    std::vector<int> fired;
+    int cancelled = 0;
+    std::vector<std::unique_ptr<VirtualTimer>> timers;
+    for (int i = 20; i > 0; --i)
+    {
+        timers.push_back(make_unique<VirtualTimer>(clock));
+        timers.back()->expires_from_now(std::chrono::milliseconds(3 * i));
+        timers.back()->async_wait(
+            [&fired, &cancelled, i](asio::error_code const& ec)
+            {
+                if (ec)
+                    ++cancelled;
+                else
+                    fired.push_back(i);
+            });
+    }
+    timers[0]->cancel();
+
+    while (fired.size() < timers.size() - 1)
+    {
+        clock.crank(true);
+    }
+    REQUIRE(cancelled == 1);
+    REQUIRE(std::is_sorted(fired.begin(), fired.end()));
+    REQUIRE(fired.back() == 19);
+}
+
+TEST_CASE("timer schedule and cancel throughput", "[timer][bench][hide]")
+{
+    size_t const nTimers = 10000;
+    size_t const nRounds = 50;
+
+    for (auto mode : {VirtualClock::REAL_TIME, VirtualClock::VIRTUAL_TIME})
+    {
+        VirtualClock clock(mode);
+        std::vector<std::unique_ptr<VirtualTimer>> timers;
+        for (size_t i = 0; i < nTimers; ++i)
+        {
+            timers.push_back(make_unique<VirtualTimer>(clock));
+        }
+
+        // Re-arming a timer cancels its pending event, as the overlay and
+        // herder timers do all the time.
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < nRounds; ++r)
+        {
+            for (size_t i = 0; i < nTimers; ++i)
+            {
+                timers[i]->expires_from_now(
+                    std::chrono::seconds(1 + (i * 7919 + r) % 600));
+                timers[i]->async_wait(VirtualTimer::onFailureNoop);
+            }
+        }
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        LOG(INFO) << (mode == VirtualClock::REAL_TIME ? "real" : "virtual")
+                  << " time: " << nTimers * nRounds << " schedule/cancel in "
+                  << elapsed.count() << "s ("
+                  << (nTimers * nRounds) / elapsed.count() << " per second)";
+    }
+}
@@ -0,0 +1,238 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/TimerWheel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace stellar
+{
+
+using namespace std;
+using std::chrono::milliseconds;
+
+TimerWheel::TimerWheel(VirtualClock::time_point now)
+    : mCurrentTick(floorTick(now)), mCount(0), mLevel0Count(0)
+{
+}
+
+uint64_t
+TimerWheel::floorTick(VirtualClock::time_point t)
+{
+    auto since = t.time_since_epoch();
+    if (since.count() <= 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<milliseconds>(since).count());
+}
+
+uint64_t
+TimerWheel::ceilTick(VirtualClock::time_point t)
+{
+    uint64_t tick = floorTick(t);
+    if (tickTime(tick) < t)
+    {
+        ++tick;
+    }
+    return tick;
+}
+
+VirtualClock::time_point
+TimerWheel::tickTime(uint64_t tick)
+{
+    return VirtualClock::time_point(milliseconds(tick));
+}
+
+vector<TimerWheel::EventPtr>&
+TimerWheel::slot(size_t level, size_t index)
+{
+    return level == LEVELS ? mOverflow : mSlots[level][index];
+}
+
+void
+TimerWheel::insert(EventPtr const& ev)
+{
+    assert(!ev->mInWheel);
+    place(ev);
+}
+
+void
+TimerWheel::place(EventPtr const& ev)
+{
+    uint64_t tick = std::max(ceilTick(ev->mWhen), mCurrentTick);
+
+    // The lowest level at which the event's tick and the current tick agree
+    // on all higher-order slot digits.
+    uint64_t diff = tick ^ mCurrentTick;
+    size_t level = 0;
+    while (level < LEVELS && (diff >> (SLOT_BITS * (level + 1))) != 0)
+    {
+        ++level;
+    }
+    size_t index =
+        level == LEVELS ? 0 : (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+
+    auto& events = slot(level, index);
+    ev->mInWheel = true;
+    ev->mWheelLevel = level;
+    ev->mWheelSlot = index;
+    ev->mWheelIndex = events.size();
+    events.push_back(ev);
+
+    ++mCount;
+    if (level == 0)
+    {
+        ++mLevel0Count;
+    }
+}
+
+void
+TimerWheel::remove(VirtualClockEvent& ev)
+{
+    assert(ev.mInWheel);
+    auto& events = slot(ev.mWheelLevel, ev.mWheelSlot);
+    assert(events[ev.mWheelIndex].get() == &ev);
+
+    size_t level = ev.mWheelLevel;
+    size_t index = ev.mWheelIndex;
+    ev.mInWheel = false;
+    if (index + 1 != events.size())
+    {
+        events[index] = std::move(events.back());
+        events[index]->mWheelIndex = index;
+    }
+    events.pop_back();
+
+    --mCount;
+    if (level == 0)
+    {
+        --mLevel0Count;
+    }
+}
+
+void
+TimerWheel::reinsert(vector<EventPtr>& events)
+{
+    vector<EventPtr> moving;
+    moving.swap(events);
+    for (auto const& ev : moving)
+    {
+        --mCount;
+        if (ev->mWheelLevel == 0)
+        {
+            --mLevel0Count;
+        }
+        ev->mInWheel = false;
+        place(ev);
+    }
+}
+
+// Called when mCurrentTick enters a new level-0 block: pull down the events of
+// every block that starts here, from the highest level to the lowest.
+void
+TimerWheel::cascade()
+{
+    size_t top = 1;
+    while (top < LEVELS && ((mCurrentTick >> (SLOT_BITS * top)) & SLOT_MASK) == 0)
+    {
+        ++top;
+    }
+    if (top == LEVELS)
+    {
+        reinsert(mOverflow);
+        --top;
+    }
+    for (size_t level = top; level > 0; --level)
+    {
+        size_t index = (mCurrentTick >> (SLOT_BITS * level)) & SLOT_MASK;
+        if (!mSlots[level][index].empty())
+        {
+            reinsert(mSlots[level][index]);
+        }
+    }
+}
+
+void
+TimerWheel::advance(VirtualClock::time_point now, vector<EventPtr>& due)
+{
+    uint64_t target = floorTick(now);
+    while (mCurrentTick <= target)
+    {
+        if (mCount == 0)
+        {
+            mCurrentTick = target + 1;
+            break;
+        }
+        if ((mCurrentTick & SLOT_MASK) == 0)
+        {
+            cascade();
+        }
+
+        auto& events = mSlots[0][mCurrentTick & SLOT_MASK];
+        for (auto& ev : events)
+        {
+            ev->mInWheel = false;
+            due.push_back(std::move(ev));
+        }
+        mCount -= events.size();
+        mLevel0Count -= events.size();
+        events.clear();
+
+        ++mCurrentTick;
+        if (mLevel0Count == 0 && (mCurrentTick & SLOT_MASK) != 0)
+        {
+            // Nothing else in this block; skip ahead to the next cascade.
+            mCurrentTick = std::min((mCurrentTick | SLOT_MASK) + 1, target + 1);
+        }
+    }
+}
+
+VirtualClock::time_point
+TimerWheel::nextWakeup() const
+{
+    if (mCount == 0)
+    {
+        return VirtualClock::time_point::max();
+    }
+    if ((mCurrentTick & SLOT_MASK) == 0)
+    {
+        // A cascade is pending.
+        return tickTime(mCurrentTick);
+    }
+    if (mLevel0Count != 0)
+    {
+        for (uint64_t t = mCurrentTick; (t & SLOT_MASK) != 0; ++t)
+        {
+            if (!mSlots[0][t & SLOT_MASK].empty())
+            {
+                return tickTime(t);
+            }
+        }
+    }
+    return tickTime((mCurrentTick | SLOT_MASK) + 1);
+}
+
+void
+TimerWheel::clear(vector<EventPtr>& out)
+{
+    for (size_t level = 0; level <= LEVELS; ++level)
+    {
+        for (size_t index = 0; index < (level == LEVELS ? 1 : SLOTS); ++index)
+        {
+            auto& events = slot(level, index);
+            for (auto& ev : events)
+            {
+                ev->mInWheel = false;
+                out.push_back(std::move(ev));
+            }
+            events.clear();
+        }
+    }
+    mCount = 0;
+    mLevel0Count = 0;
+}
+}
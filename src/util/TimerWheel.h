@@ -0,0 +1,82 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Timer.h"
+
+#include <memory>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Hierarchical timer wheel holding the pending events of a REAL_TIME
+ * VirtualClock.
+ *
+ * Time is divided into 1ms ticks. Level 0 has one slot per tick for the
+ * current 64-tick block; each further level has 64 slots each covering a
+ * whole block of the level below. An event lives in the lowest level whose
+ * block it shares with the current tick, and is moved ("cascaded") one or
+ * more levels down when the current tick enters its block. Events more than
+ * 2^30 ticks (about 12 days) out wait in an overflow list.
+ *
+ * Inserting and removing are O(1): each event records its slot and position,
+ * and removal swaps the last event of the slot into its place. Events fire up
+ * to one tick late and, within a tick, in no particular order; the virtual
+ * time mode, where exact ordering matters for tests, keeps using a heap.
+ */
+class TimerWheel : NonMovableOrCopyable
+{
+  public:
+    typedef std::shared_ptr<VirtualClockEvent> EventPtr;
+
+    TimerWheel(VirtualClock::time_point now);
+
+    void insert(EventPtr const& ev);
+
+    // Remove an event that is still pending in the wheel.
+    void remove(VirtualClockEvent& ev);
+
+    // Move every event due at or before `now` to `due`.
+    void advance(VirtualClock::time_point now, std::vector<EventPtr>& due);
+
+    // The time by which advance() next needs to be called: either the
+    // earliest deadline, or the next time events must be cascaded.
+    VirtualClock::time_point nextWakeup() const;
+
+    // Move all pending events to `out`.
+    void clear(std::vector<EventPtr>& out);
+
+    size_t
+    size() const
+    {
+        return mCount;
+    }
+
+  private:
+    static const unsigned SLOT_BITS = 6;
+    static const size_t SLOTS = size_t(1) << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+    static const size_t LEVELS = 5;
+
+    std::vector<EventPtr> mSlots[LEVELS][SLOTS];
+    std::vector<EventPtr> mOverflow;
+
+    // Every tick before this one has been processed.
+    uint64_t mCurrentTick;
+    size_t mCount;
+    size_t mLevel0Count;
+
+    static uint64_t ceilTick(VirtualClock::time_point t);
+    static uint64_t floorTick(VirtualClock::time_point t);
+    static VirtualClock::time_point tickTime(uint64_t tick);
+
+    std::vector<EventPtr>& slot(size_t level, size_t index);
+    void place(EventPtr const& ev);
+    void reinsert(std::vector<EventPtr>& events);
+    void cascade();
+};
+}
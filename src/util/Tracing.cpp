@@ -0,0 +1,110 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Tracing.h"
+#include "lib/json/json.h"
+
+namespace stellar
+{
+
+const size_t Tracer::DEFAULT_LEDGERS_RETAINED = 32;
+
+Tracer::Tracer(size_t ledgersRetained)
+    : mLedgersRetained(ledgersRetained), mEpoch(clock::now())
+{
+}
+
+void
+Tracer::beginLedger(uint32_t ledgerSeq)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mLedgers.empty() && mLedgers.back().mLedgerSeq == ledgerSeq)
+    {
+        return;
+    }
+    mLedgers.push_back(LedgerTrace{ledgerSeq, {}});
+    while (mLedgers.size() > mLedgersRetained)
+    {
+        mLedgers.pop_front();
+    }
+}
+
+void
+Tracer::record(char const* name, char const* category,
+               clock::time_point start, clock::time_point end)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mLedgers.empty())
+    {
+        // Spans recorded before the first ledger close, e.g. at startup.
+        mLedgers.push_back(LedgerTrace{0, {}});
+    }
+    auto tid = mThreadIds.emplace(std::this_thread::get_id(),
+                                  static_cast<uint32_t>(mThreadIds.size()))
+                   .first->second;
+    mLedgers.back().mEvents.push_back(
+        Event{name, category, tid, start, end - start});
+}
+
+void
+Tracer::dumpChromeTrace(Json::Value& ret, size_t nLedgers)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    size_t skip = 0;
+    if (nLedgers != 0 && nLedgers < mLedgers.size())
+    {
+        skip = mLedgers.size() - nLedgers;
+    }
+
+    Json::Value& events = ret["traceEvents"];
+    events = Json::Value(Json::arrayValue);
+    for (size_t i = skip; i < mLedgers.size(); ++i)
+    {
+        auto const& lt = mLedgers[i];
+        for (auto const& e : lt.mEvents)
+        {
+            Json::Value ev;
+            ev["name"] = e.mName;
+            ev["cat"] = e.mCategory;
+            ev["ph"] = "X";
+            ev["pid"] = 0;
+            ev["tid"] = e.mThread;
+            ev["ts"] = static_cast<Json::UInt64>(
+                duration_cast<microseconds>(e.mStart - mEpoch).count());
+            ev["dur"] = static_cast<Json::UInt64>(
+                duration_cast<microseconds>(e.mDuration).count());
+            ev["args"]["ledger"] = lt.mLedgerSeq;
+            events.append(ev);
+        }
+    }
+    ret["displayTimeUnit"] = "ms";
+}
+
+TraceSpan::TraceSpan(Tracer& tracer, char const* name, char const* category)
+    : mTracer(tracer)
+    , mName(name)
+    , mCategory(category)
+    , mStart(Tracer::clock::now())
+    , mEnded(false)
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+    end();
+}
+
+void
+TraceSpan::end()
+{
+    if (!mEnded)
+    {
+        mEnded = true;
+        mTracer.record(mName, mCategory, mStart, Tracer::clock::now());
+    }
+}
+}
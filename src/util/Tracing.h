@@ -0,0 +1,94 @@
+#pragma once
+
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "lib/json/json-forwards.h"
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Lightweight span tracing, for finding out where the time in a single slow
+ * ledger close went; the medida timers only say how slow closes are on
+ * average.
+ *
+ * Code of interest opens a TraceSpan on the Application's Tracer; when the
+ * span ends its name, thread and wall-clock start/duration are appended to
+ * the trace of the ledger currently being closed. The Tracer keeps the traces
+ * of the most recent ledgers in a ring buffer and can render them as Chrome
+ * trace-event JSON (load it in chrome://tracing), see the `trace` command.
+ *
+ * Spans may be recorded from any thread. Names and categories must be string
+ * literals (or otherwise outlive the Tracer); they are stored by pointer.
+ */
+class Tracer : NonMovableOrCopyable
+{
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    static const size_t DEFAULT_LEDGERS_RETAINED;
+
+    explicit Tracer(size_t ledgersRetained = DEFAULT_LEDGERS_RETAINED);
+
+    // Start attributing spans to `ledgerSeq`, evicting the oldest ledger if
+    // the buffer is full. A no-op if `ledgerSeq` is already current.
+    void beginLedger(uint32_t ledgerSeq);
+
+    void record(char const* name, char const* category,
+                clock::time_point start, clock::time_point end);
+
+    // Fill `ret` with a Chrome trace-event document covering the most recent
+    // `nLedgers` ledgers (all retained ones if 0).
+    void dumpChromeTrace(Json::Value& ret, size_t nLedgers = 0);
+
+  private:
+    struct Event
+    {
+        char const* mName;
+        char const* mCategory;
+        uint32_t mThread;
+        clock::time_point mStart;
+        clock::duration mDuration;
+    };
+
+    struct LedgerTrace
+    {
+        uint32_t mLedgerSeq;
+        std::vector<Event> mEvents;
+    };
+
+    size_t const mLedgersRetained;
+    clock::time_point const mEpoch;
+
+    std::mutex mMutex;
+    std::deque<LedgerTrace> mLedgers;
+    std::map<std::thread::id, uint32_t> mThreadIds;
+};
+
+// Records the time between its construction and end() (or destruction) as a
+// span on a Tracer.
+class TraceSpan : NonMovableOrCopyable
+{
+    Tracer& mTracer;
+    char const* mName;
+    char const* mCategory;
+    Tracer::clock::time_point mStart;
+    bool mEnded;
+
+  public:
+    TraceSpan(Tracer& tracer, char const* name, char const* category);
+    ~TraceSpan();
+    void end();
+};
+}
@@ -0,0 +1,74 @@
+// Copyright 2015 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/Tracing.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/test.h"
+#include "transactions/TxTests.h"
+#include "util/Timer.h"
+
+#include <set>
+#include <string>
+
+using namespace stellar;
+
+TEST_CASE("tracer keeps the most recent ledgers", "[tracing]")
+{
+    Tracer tracer(2);
+    for (uint32_t seq = 1; seq <= 3; ++seq)
+    {
+        tracer.beginLedger(seq);
+        TraceSpan outer(tracer, "outer", "test");
+        {
+            TraceSpan inner(tracer, "inner", "test");
+        }
+    }
+
+    Json::Value all;
+    tracer.dumpChromeTrace(all);
+    auto const& events = all["traceEvents"];
+    REQUIRE(events.size() == 4);
+    REQUIRE(events[0u]["args"]["ledger"].asUInt() == 2);
+    REQUIRE(events[3u]["args"]["ledger"].asUInt() == 3);
+    for (auto const& ev : events)
+    {
+        REQUIRE(ev["ph"].asString() == "X");
+    }
+    // Spans are recorded as they end, so the inner one comes first and lies
+    // within the outer one.
+    REQUIRE(events[0u]["name"].asString() == "inner");
+    REQUIRE(events[1u]["name"].asString() == "outer");
+    REQUIRE(events[0u]["ts"].asUInt64() >= events[1u]["ts"].asUInt64());
+
+    Json::Value last;
+    tracer.dumpChromeTrace(last, 1);
+    REQUIRE(last["traceEvents"].size() == 2);
+    REQUIRE(last["traceEvents"][0u]["args"]["ledger"].asUInt() == 3);
+}
+
+TEST_CASE("ledger close is traced", "[tracing][ledger]")
+{
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, getTestConfig());
+    app->start();
+
+    txtest::closeLedgerOn(*app, 2, 1, 1, 2015);
+
+    Json::Value root;
+    app->getTracer().dumpChromeTrace(root, 1);
+    std::set<std::string> names;
+    for (auto const& ev : root["traceEvents"])
+    {
+        REQUIRE(ev["args"]["ledger"].asUInt() == 2);
+        names.insert(ev["name"].asString());
+    }
+    for (auto name : {"closeLedger", "applyTransactions", "closeLedgerHelper",
+                      "addBatch", "snapshotLedger", "storeInsert", "setState",
+                      "commit"})
+    {
+        REQUIRE(names.find(name) != names.end());
+    }
+}